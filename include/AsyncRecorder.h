@@ -0,0 +1,146 @@
+//
+// CS 5330 - Project 4
+// Nathaniel Haddad and Stephen Dorris
+//
+
+#ifndef PROJECT_4_ASYNCRECORDER_H
+#define PROJECT_4_ASYNCRECORDER_H
+
+#include <condition_variable>
+#include <fstream>
+#include <future>
+#include <mutex>
+#include <string>
+
+// OpenCV Libraries
+#include <opencv2/core.hpp>
+#include <opencv2/videoio.hpp>
+
+// Local Includes
+#include "PoseStream.h"
+
+/**
+ * Records composited frames without encoding on the caller's thread. submit copies a frame into one of a fixed
+ * pool of buffers and queues it; a dedicated encoder thread writes the queued frames with cv::VideoWriter and a
+ * sidecar CSV (<output>.frames.csv) with the frame id, capture timestamp and the pose of every board (one line per
+ * board) of every written frame.
+ * When the encoder falls behind and every buffer is queued, the back-pressure policy either drops the new frame
+ * (the live loop never waits) or blocks until a buffer is free.
+ */
+class AsyncRecorder {
+
+public:
+
+    enum Policy {
+        DROP,
+        BLOCK
+    };
+
+private:
+
+    struct Slot {
+        cv::Mat frame;
+        uint64_t frameId;
+        uint64_t timestampNs;
+        std::vector<PoseRecord> poses; // one per board
+    };
+
+    std::string m_outputPath;
+
+    double m_fps = 30;
+
+    Policy m_policy = DROP;
+
+    std::vector<Slot> m_slots; // buffer pool, allocated with the first frame
+
+    std::vector<size_t> m_queue; // ring of queued slot indices
+
+    size_t m_queueHead = 0, m_queueSize = 0;
+
+    std::vector<size_t> m_free; // slots neither queued nor being encoded
+
+    uint64_t m_dropped = 0;
+
+    bool m_stopping = false;
+
+    std::mutex m_mutex;
+
+    std::condition_variable m_queued, m_released;
+
+    std::future<void> m_encoder; // encode, on the blocking lane of the scheduler
+
+    cv::VideoWriter m_video;
+
+    std::ofstream m_sidecar;
+
+    /**
+     * encode
+     * @does body of the encoder thread, writes queued frames until close
+     */
+    void encode();
+
+public:
+
+    AsyncRecorder() = default;
+
+    AsyncRecorder(const AsyncRecorder &) = delete;
+
+    AsyncRecorder &operator=(const AsyncRecorder &) = delete;
+
+    ~AsyncRecorder();
+
+    /**
+     * parsePolicy
+     * @param name (const std::string &) "drop" or "block"
+     * @param policy (Policy &) receives the policy
+     * @return (bool) whether the name is known
+     */
+    static bool parsePolicy(const std::string &name, Policy &policy);
+
+    /**
+     * open
+     * @param outputPath (const std::string &) output video (.mp4, .avi or .mkv)
+     * @param fps (double) frame rate written into the video
+     * @param policy (Policy) what submit does when every buffer is in use
+     * @param bufferCount (int) frames that can wait for the encoder
+     * @return (bool) whether the sidecar file could be created; the video is opened with the first frame
+     */
+    bool open(const std::string &outputPath, double fps, Policy policy, int bufferCount);
+
+    /**
+     * isOpen
+     * @return (bool) whether frames are being recorded
+     */
+    bool isOpen() const;
+
+    /**
+     * submit
+     * @param frame (const cv::Mat &) the composited BGR frame, copied
+     * @param frameId (uint64_t) the frame counter
+     * @param timestampNs (uint64_t) capture time of the frame
+     * @param poses (const std::vector<PoseRecord> &) pose of every board, cornerCount 0 for a board not found
+     * @return (bool) false if the frame was dropped
+     */
+    bool submit(const cv::Mat &frame, uint64_t frameId, uint64_t timestampNs, const std::vector<PoseRecord> &poses);
+
+    /**
+     * queueDepth
+     * @return (size_t) frames waiting for the encoder
+     */
+    size_t queueDepth();
+
+    /**
+     * droppedCount
+     * @return (uint64_t) frames dropped since open
+     */
+    uint64_t droppedCount();
+
+    /**
+     * close
+     * @does writes the frames still queued, then closes the video and the sidecar file
+     */
+    void close();
+
+};
+
+#endif //PROJECT_4_ASYNCRECORDER_H
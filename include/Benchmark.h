@@ -0,0 +1,116 @@
+//
+// CS 5330 - Project 4
+// Nathaniel Haddad and Stephen Dorris
+//
+
+#ifndef PROJECT_4_BENCHMARK_H
+#define PROJECT_4_BENCHMARK_H
+
+// OpenCV Libraries
+#include <opencv2/core.hpp>
+
+// Local Includes
+#include "Options.h"
+
+/**
+ * Measurements that run without a camera, selected with --benchmark <name>
+ */
+class Benchmark {
+
+    /**
+     * detector
+     * @param options (const Options &) command line options
+     * @param patternSize (cv::Size) inner corners of the chessboard
+     * @return (int) process exit code
+     * @does compares the chessboard detectors on synthetic frames at 720p, 1080p and 4K (or on the frames of
+     *       --input): detection rate, corner error after cornerSubPix and time per frame
+     */
+    static int detector(const Options &options, cv::Size patternSize);
+
+    /**
+     * refiner
+     * @param options (const Options &) command line options (--frames, --seed and the synthetic scene flags)
+     * @param patternSize (cv::Size) inner corners of the chessboard
+     * @return (int) process exit code
+     * @does refines the same unrefined corners of synthetic frames with cv::cornerSubPix and with SubPixelRefiner,
+     *       and prints the corner error against the ground truth and the time per board of both
+     */
+    static int refiner(const Options &options, cv::Size patternSize);
+
+    /**
+     * pipeline
+     * @param options (const Options &) command line options
+     * @param patternSize (cv::Size) inner corners of the chessboard
+     * @return (int) process exit code
+     * @does runs detection and solvePnP with every detector on synthetic frames with known poses (rendered on the
+     *       fly, or a sequence written by --generate given with --input): detection rate, throughput, corner
+     *       error and rotation/translation error
+     */
+    static int pipeline(const Options &options, cv::Size patternSize);
+
+    /**
+     * instancing
+     * @param options (const Options &) command line options (--model, --instance-layout, --resolution, --frames)
+     * @param patternSize (cv::Size) inner corners of the chessboard
+     * @return (int) process exit code
+     * @does doubles the number of copies of a model until projecting and drawing them no longer fits a 60 fps
+     *       frame budget, and prints time per frame and instances per second for every count
+     */
+    static int instancing(const Options &options, cv::Size patternSize);
+
+    /**
+     * rasterizer
+     * @param options (const Options &) command line options (--resolution, --frames, --antialias, --seed)
+     * @return (int) process exit code
+     * @does draws dense sets of random short lines with cv::line and with LineRasterizer, and prints the time per
+     *       frame of both, the speedup and the number of pixels where the two frames differ
+     */
+    static int rasterizer(const Options &options);
+
+    /**
+     * perf
+     * @param options (const Options &) command line options (--baseline, --report, --tolerance, --update-baseline,
+     *        --frames, --detector and the synthetic scene flags)
+     * @param patternSize (cv::Size) inner corners of the chessboard
+     * @return (int) 0 if no metric regressed beyond its tolerance, 1 if one did or has no reference, -1 on errors
+     * @does runs detection, pose, projection and drawing of the video mode on the same synthetic frames with the
+     *       bunny, monkey and octahedron models (read from obj/ next to the baseline), compares fps, p99 latency
+     *       and the memory each model adds with the committed baseline and writes a JSON report; a model missing
+     *       from the baseline fails; with --update-baseline the results become the new baseline
+     */
+    static int perf(const Options &options, cv::Size patternSize);
+
+    /**
+     * planar
+     * @param options (const Options &) command line options (--frames and the synthetic scene flags)
+     * @param patternSize (cv::Size) inner corners of the chessboard
+     * @return (int) process exit code
+     * @does maps the planar content (corner markers, star triangles, the overlay quad and a flat grid) with
+     *       solvePnP and cv::projectPoints and with a homography fitted to the corners, and prints the time per frame
+     *       of both, the saving and how far the two results lie from each other and from the ground truth
+     */
+    static int planar(const Options &options, cv::Size patternSize);
+
+    /**
+     * arena
+     * @param options (const Options &) command line options (--frames and the synthetic scene flags)
+     * @param patternSize (cv::Size) inner corners of the chessboard
+     * @return (int) 0 if the scratch arena kept its size after warm-up in every mode, 1 if it grew, -1 on errors
+     * @does runs the chessboard video mode with both detectors and the Harris corner mode on the same synthetic
+     *       frames and counts how often the scratch arena of each had to grow after the warm-up frames
+     */
+    static int arena(const Options &options, cv::Size patternSize);
+
+public:
+
+    /**
+     * run
+     * @param options (const Options &) command line options, options.benchmark names the benchmark
+     * @param patternSize (cv::Size) inner corners of the chessboard
+     * @return (int) process exit code
+     */
+    static int run(const Options &options, cv::Size patternSize);
+
+};
+
+#endif //PROJECT_4_BENCHMARK_H
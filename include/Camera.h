@@ -6,11 +6,26 @@
 #ifndef PROJECT_4_CAMERA_H
 #define PROJECT_4_CAMERA_H
 
+#include <chrono>
+#include <future>
+
 // OpenCV Libraries
 #include <opencv2/core.hpp>
+#include <opencv2/videoio.hpp>
 
 // Local Includes
+#include "AsyncRecorder.h"
+#include "ChunkedMesh.h"
+#include "FrameStream.h"
+#include "FrameWorkspace.h"
+#include "ModelInstances.h"
+#include "MultiBoardTracker.h"
 #include "ObjectModel.h"
+#include "Options.h"
+#include "PlanarOverlay.h"
+#include "PoseStream.h"
+#include "SessionRecording.h"
+#include "UndistortMap.h"
 
 /**
  * Represents our camera used to represent virtual objects in scene
@@ -25,33 +40,173 @@ class Camera {
 
     std::unique_ptr<cv::VideoCapture> capdev; // video capture device
 
+    std::future<std::unique_ptr<cv::VideoCapture>> m_pendingDevice; // device being opened, moved to capdev when needed
+
+    double m_deviceOpenMs = 0; // how long opening the device took
+
+    std::chrono::steady_clock::time_point m_startTime = std::chrono::steady_clock::now(); // for time to first overlay
+
     std::vector<std::vector<cv::Mat>> m_rotationVectors, m_translationVectors;
 
     int m_rows, m_cols; // size of checkerboard
 
+    std::vector<cv::Vec3f> m_boardWorld; // chessboard corners in world frame, built once per board size
+
+    std::vector<cv::Point2f> m_boardPlane; // the same corners on the board plane (z dropped), for homographies
+
+    FrameWorkspace m_workspace; // buffers reused by the live modes from frame to frame
+
+    ChessboardDetector::Method m_detectorMethod = ChessboardDetector::OPENCV; // set with --detector
+
     int m_minCalibrationCount; // number of calibrations saved images necessary for calibration process to start.
 
+    Options m_options; // command line options
+
+    bool m_verbose = true; // print per-frame progress (disabled when frames are processed on worker threads)
+
+    std::unique_ptr<PosePublisher> m_posePublisher; // binary pose stream, set with --pose-shm
+
+    uint64_t m_frameId = 0; // frames captured by the live modes
+
+    std::unique_ptr<SharedFrameSink> m_frameSink; // composited frames for other processes, set with --frame-shm
+
+    std::unique_ptr<MultiBoardTracker> m_boardTracker; // several boards with their own models, set with --boards
+
+    std::unique_ptr<AsyncRecorder> m_recorder; // records the video mode off the loop, set with --record
+
+    AsyncRecorder::Policy m_recordPolicy = AsyncRecorder::DROP;
+
+    std::unique_ptr<SessionRecorder> m_sessionRecorder; // raw frames, detections and timings, set with --session
+
+    std::unique_ptr<SessionReader> m_replay; // recorded session read instead of the camera, set with --replay
+
+    static const uint32_t FRAME_TILE_SIZE = 32; // tiles of the frame stream between whole frames (--frame-keyframe)
+
+    int m_framesSinceBase = 0; // frames published as tiles since the last whole frame (--frame-keyframe)
+
+    UndistortMap m_undistortMap; // prepared once the frame size is known, set with --undistort
+
+    std::unique_ptr<ModelInstances> m_instances; // copies of an obj model drawn instead of one, set with --instances
+
+    std::unique_ptr<ChunkedMesh> m_chunkedMesh; // obj model streamed in chunks, set with --mesh-budget
+
+    std::unique_ptr<PlanarOverlay> m_overlay; // image or clip laid on the board, set with --overlay
+
+    bool m_poseNeeded = true; // something reads the pose every frame; if not, planar content skips solvePnP
+
+    /**
+     * Intrinsic parameters solved from the calibration images
+     */
+    struct Calibration {
+        cv::Mat cameraMatrix, distortionCoeffs;
+        std::vector<cv::Mat> rotationVectors, translationVectors;
+        double rms = 0; // re-projection error
+    };
+
+    std::future<Calibration> m_pendingCalibration; // solve running as a background task of the scheduler
+
+    /**
+     * presentFrame
+     * @param window (const std::string &) the window to show the frame in (skipped with --headless)
+     * @param frame (const cv::Mat &) the composited frame
+     * @param frameId (uint64_t) the frame counter
+     * @param timestampNs (uint64_t) capture time of the frame
+     * @does hands a composited frame to every enabled sink; with --frame-keyframe the frame stream only receives
+     *       the tiles that changed since the last whole frame in between
+     */
+    void presentFrame(const std::string &window, const cv::Mat &frame, uint64_t frameId, uint64_t timestampNs);
+
+    /**
+     * waitKey
+     * @param delay (int) milliseconds to wait for a key
+     * @return (int) the pressed key or -1; in headless mode 'q' once SIGINT/SIGTERM was received
+     */
+    int waitKey(int delay);
+
+    /**
+     * openDevice
+     * @does starts opening the default video device in the background
+     */
+    void openDevice();
+
+    /**
+     * waitForDevice
+     * @does waits until the device started by openDevice is open (capdev), exits if it is not available
+     */
+    void waitForDevice();
+
+    /**
+     * buildInstances
+     * @param objModel (const ObjectModel &) the loaded model
+     * @does lays out --instances copies of an obj model (m_instances); other models are drawn once
+     */
+    void buildInstances(const ObjectModel &objModel);
+
+    /**
+     * openOverlay
+     * @does reads the --overlay image or clip (m_overlay), fitted onto the whole board
+     */
+    void openOverlay();
+
+    /**
+     * undistortFrame
+     * @param frame (cv::Mat &) a captured frame, swapped with its undistorted version
+     * @param workspace (FrameWorkspace &) its frame cache keeps the second frame buffer and takes the undistorted
+     *        frame as its current one
+     * @does removes lens distortion with the prepared maps (--undistort); the frame must then be processed with
+     *       m_undistortMap.getCameraMatrix() and no distortion
+     */
+    void undistortFrame(cv::Mat &frame, FrameWorkspace &workspace);
+
+    /**
+     * buildBoardGeometry
+     * @does computes the 3D coordinates for the chessboard in world frame with top left corner of chessboard
+     *       as origin (m_boardWorld)
+     */
+    void buildBoardGeometry();
+
     /**
      * getChessboardCorners
-     * @param src (cv::Mat) the input image
-     * @param dst (cv::Mat)
-     * @return (std::vector<cv::Point2f>) a vector of two dimensional corners
-     * @does identifies a chessboard in an image and returns the pixel coordinates of the corners in the
+     * @param src (const cv::Mat &) the input image; workspace.images must have been reset with it, so the gray
+     *        frame is shared with the other stages
+     * @param workspace (FrameWorkspace &) receives the corners (workspace.corners, empty if not found)
+     * @return (bool) whether the chessboard was found
+     * @does identifies a chessboard in an image and finds the pixel coordinates of the corners in the
      *       chessboard
      */
-    std::vector<cv::Point2f> getChessboardCorners(cv::Mat src, cv::Mat dst);
+    bool getChessboardCorners(const cv::Mat &src, FrameWorkspace &workspace);
 
     /**
-     * getChessboardCornersWorld
-     * @return (std::vector<cv::Vec3f>) the 3D coordinates in world frame.
-     * @does gets the 3D coordinates for the chessboard in world frame with top left corner of chessboard as
-     *       origin.
+     * trackBoards
+     * @param src (cv::Mat &) the current frame, the models of the boards are drawn into it
+     * @param workspace (FrameWorkspace &) stage timings and overlay of this stream
+     * @param cameraMatrix (const cv::Mat &) intrinsic camera matrix
+     * @param distortionCoefficients (const cv::Mat &) intrinsic distortion coefficients
+     * @does finds every board of --boards, solves their poses and draws their models
+     */
+    void trackBoards(cv::Mat &src, FrameWorkspace &workspace, const cv::Mat &cameraMatrix,
+                     const cv::Mat &distortionCoefficients);
+
+    /**
+     * solvePose
+     * @param workspace (FrameWorkspace &) holds the detected corners; receives the pose of the board
+     * @param cameraMatrix (const cv::Mat &) intrinsic camera matrix
+     * @param distortionCoefficients (const cv::Mat &) intrinsic distortion coefficients
+     */
+    void solvePose(FrameWorkspace &workspace, const cv::Mat &cameraMatrix, const cv::Mat &distortionCoefficients);
+
+    /**
+     * fitHomography
+     * @param workspace (FrameWorkspace &) holds the detected corners; receives the board plane to image homography
+     * @return (bool) whether the homography could be fitted, workspace.homographyFitted is set the same
+     * @does least squares fit over every corner, exact for a pinhole camera (lens distortion aside)
      */
-    std::vector<cv::Vec3f> getChessboardCornersWorld();
+    bool fitHomography(FrameWorkspace &workspace);
 
     /**
      * addChessBoardCalibrationImage
-     * @param src (cv::Mat) an image from which the chessboard corners will be found.
+     * @param src (cv::Mat) an image from which the chessboard corners will be found, m_workspace.images must have
+     *        been reset with it
      * @return bool true if calibration process worked and camera euclid/world coords were added properly.
      */
     bool addChessBoardCalibrationImage(cv::Mat src);
@@ -65,6 +220,21 @@ class Camera {
      */
     bool calibrate(cv::Mat src);
 
+    /**
+     * startCalibration
+     * @param imageSize (cv::Size) size of the calibration images
+     * @return (bool) whether enough images were saved and no solve is running
+     * @does solves the intrinsic parameters as a low priority task, frames keep being processed meanwhile
+     */
+    bool startCalibration(cv::Size imageSize);
+
+    /**
+     * finishCalibration
+     * @return (bool) whether a solve was started
+     * @does waits for the solve, prints the intrinsic parameters and provides option to save them to a file
+     */
+    bool finishCalibration();
+
     /**
      * setup
      * @does is used to perform calibration, display corners, etc. (non AR stuff)
@@ -83,9 +253,18 @@ class Camera {
      */
     void startImage();
 
+    /**
+     * startOffline
+     * @does renders a recorded video or image directory to an output video and a per-frame pose file
+     *       (<output>.poses.csv). Frames are augmented out of order on all cores and reassembled in order
+     *       before encoding.
+     */
+    void startOffline();
+
     /**
      * startVideo
-     * @does is used to start the video-based augmented reality
+     * @does is used to start the video-based augmented reality; with --replay the frames of a recorded session are
+     *       processed instead of the camera's
      */
     void startVideo();
 
@@ -95,17 +274,67 @@ class Camera {
      */
     void startVideoWithHarrisCorners();
 
+    /**
+     * spinModel
+     * @param workspace (FrameWorkspace &) stage timings of the stream
+     * @param objModel (ObjectModel &) the model drawn on the board
+     * @does turns a custom or streamed model by 0.1 rad about the board normal, once per drawn frame of the live loop
+     */
+    void spinModel(FrameWorkspace &workspace, ObjectModel &objModel);
+
     /**
      * projectPoints
      * @param src (cv::Mat) image to project points to
-     * @param corners (std::vector<cv::Point2f>) the corners of the detected pattern
-     * @param cameraMatrix (cv::Mat) intrinsic camera matrix
-     * @param distortionCoefficients (cv::Mat) intrinsic distortion coefficients
-     * @param objModel (ObjectModel) an object model
+     * @param workspace (FrameWorkspace &) holds the detected corners; receives the pose and projected points
+     * @param cameraMatrix (const cv::Mat &) intrinsic camera matrix
+     * @param distortionCoefficients (const cv::Mat &) intrinsic distortion coefficients
+     * @param objModel (const ObjectModel &) an object model, not modified
+     * @param reusePose (bool) keep the pose already in the workspace instead of solving it from the corners
+     * @param turn (const cv::Matx33f *) rotation applied to the vertices before they are projected, null for none
      * @return (bool) success of fail
+     * @does a model on the board plane (and the overlay) is mapped with the homography of the corners, solvePnP
+     *       then only runs if m_poseNeeded; 3D models, streamed meshes and instances are projected from the pose
+     */
+    bool projectPoints(cv::Mat &src, FrameWorkspace &workspace, const cv::Mat &cameraMatrix,
+                       const cv::Mat &distortionCoefficients, const ObjectModel &objModel, bool reusePose = false,
+                       const cv::Matx33f *turn = nullptr);
+
+    /**
+     * addPose
+     * @param workspace (FrameWorkspace &) receives the record in workspace.poses and the corners in
+     *        workspace.poseCorners
+     * @param world (const std::vector<cv::Vec3f> &) corners of the board in board coordinates
+     * @param corners (const std::vector<cv::Point2f> &) detected corners, empty if the board was not found
+     * @param rotationVector (const cv::Mat &) pose of the board
+     * @param translationVector (const cv::Mat &) pose of the board
+     * @param cameraMatrix (const cv::Mat &) intrinsic camera matrix
+     * @param distortionCoefficients (const cv::Mat &) intrinsic distortion coefficients
+     * @does appends the pose and reprojection error of one board (zero when it was not found)
+     */
+    static void addPose(FrameWorkspace &workspace, const std::vector<cv::Vec3f> &world,
+                        const std::vector<cv::Point2f> &corners, const cv::Mat &rotationVector,
+                        const cv::Mat &translationVector, const cv::Mat &cameraMatrix,
+                        const cv::Mat &distortionCoefficients);
+
+    /**
+     * collectPoses
+     * @param frameId (uint64_t) the frame the poses belong to
+     * @param timestampNs (uint64_t) capture time of the frame
+     * @param workspace (FrameWorkspace &) the detected corners and pose of the single board mode; receives a
+     *        PoseRecord per board (one per tracked board with --boards) and their corners
+     * @param cameraMatrix (const cv::Mat &) intrinsic camera matrix
+     * @param distortionCoefficients (const cv::Mat &) intrinsic distortion coefficients
+     * @does fills the records the pose stream, the recorders and the replay report read
      */
-    bool projectPoints(cv::Mat &src, std::vector<cv::Point2f> corners, cv::Mat cameraMatrix,
-                               cv::Mat distortionCoefficients, ObjectModel &objModel);
+    void collectPoses(uint64_t frameId, uint64_t timestampNs, FrameWorkspace &workspace,
+                      const cv::Mat &cameraMatrix, const cv::Mat &distortionCoefficients);
+
+    /**
+     * publishPose
+     * @param workspace (const FrameWorkspace &) the records filled by collectPoses
+     * @does appends the record of every board to the pose stream (no-op unless --pose-shm is set)
+     */
+    void publishPose(const FrameWorkspace &workspace);
 
     /**
      * animateTriangle
@@ -116,9 +345,11 @@ class Camera {
     /**
      * harrisCorners
      * @param (cv::Mat &) an input image
+     * @param workspace (FrameWorkspace &) provides the gray frame (workspace.images, reset with src) and scratch
+     *        images
      * @does Showcases Harris Corner Detection
      */
-    void harrisCorners(cv::Mat &src);
+    void harrisCorners(cv::Mat &src, FrameWorkspace &workspace);
 
 public:
 
@@ -134,6 +365,62 @@ public:
      */
     Camera(cv::Size chessBoardCalibrationSize, int minCalibrationCount);
 
+    /**
+     * Constructor used to create camera objects
+     * @param chessBoardCalibrationSize (cv::Size) the size of the chessboard in rows and columns
+     * @param minCalibrationCount (int) the minimum number of images needed to calibrate
+     * @param options (const Options &) command line options; the video device is only opened for the
+     *        interactive menu
+     */
+    Camera(cv::Size chessBoardCalibrationSize, int minCalibrationCount, const Options &options);
+
+    /**
+     * Destructor
+     * @does waits for the background tasks that still refer to the camera
+     */
+    ~Camera();
+
+    /**
+     * getChessboardCornersWorld
+     * @return (const std::vector<cv::Vec3f> &) the 3D coordinates in world frame.
+     * @does gets the 3D coordinates for the chessboard in world frame with top left corner of chessboard as
+     *       origin.
+     */
+    const std::vector<cv::Vec3f> &getChessboardCornersWorld() const;
+
+    /**
+     * estimatePose
+     * @param src (const cv::Mat &) the input image
+     * @param workspace (FrameWorkspace &) receives the corners (empty if not found) and the pose of the board
+     * @param cameraMatrix (const cv::Mat &) intrinsic camera matrix
+     * @param distortionCoefficients (const cv::Mat &) intrinsic distortion coefficients
+     * @return (bool) whether the chessboard was found
+     * @does runs the detection and pose stages of the video modes on a single frame
+     */
+    bool estimatePose(const cv::Mat &src, FrameWorkspace &workspace, const cv::Mat &cameraMatrix,
+                      const cv::Mat &distortionCoefficients);
+
+    /**
+     * processFrame
+     * @param frame (cv::Mat &) a captured frame, the overlay is drawn into it
+     * @param workspace (FrameWorkspace &) buffers and stage timings of the stream
+     * @param cameraMatrix (const cv::Mat &) intrinsic camera matrix
+     * @param distortionCoefficients (const cv::Mat &) intrinsic distortion coefficients
+     * @param objModel (ObjectModel &) the model drawn on the board
+     * @return (bool) whether the chessboard was found
+     * @does runs the detection, pose, projection and draw stages of the video mode on one frame
+     */
+    bool processFrame(cv::Mat &frame, FrameWorkspace &workspace, const cv::Mat &cameraMatrix,
+                      const cv::Mat &distortionCoefficients, ObjectModel &objModel);
+
+    /**
+     * processHarrisFrame
+     * @param frame (cv::Mat &) a captured frame, the corners are drawn into it
+     * @param workspace (FrameWorkspace &) buffers, scratch arena and stage timings of the stream
+     * @does runs the detection stage of the Harris corner mode on one frame
+     */
+    void processHarrisFrame(cv::Mat &frame, FrameWorkspace &workspace);
+
     /**
      * Starts the camera-based application
      */
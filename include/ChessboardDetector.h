@@ -0,0 +1,233 @@
+//
+// CS 5330 - Project 4
+// Nathaniel Haddad and Stephen Dorris
+//
+
+#ifndef PROJECT_4_CHESSBOARDDETECTOR_H
+#define PROJECT_4_CHESSBOARDDETECTOR_H
+
+#include <string>
+
+// OpenCV Libraries
+#include <opencv2/core.hpp>
+
+// Local Includes
+#include "FrameCache.h"
+#include "SubPixelRefiner.h"
+
+/**
+ * Finds the inner corners of a chessboard of known size. Two methods are available:
+ *  - OPENCV: cv::findChessboardCorners, the general quad-grouping detector.
+ *  - SADDLE: scores every pixel of a downscaled copy of the frame as an X-corner (saddle point of the intensity
+ *    surface) in parallel over image tiles, clusters the local maxima and grows a lattice from them until it
+ *    matches the known board topology.
+ * Both refine the result with SubPixelRefiner (the estimator of cv::cornerSubPix) and return the corners in the
+ * order of cv::findChessboardCorners.
+ * The detector keeps its scratch buffers between frames, so every stream needs its own instance.
+ */
+class ChessboardDetector {
+
+public:
+
+    enum Method {
+        OPENCV,
+        SADDLE
+    };
+
+private:
+
+    struct Candidate {
+        cv::Point2f point; // position in the detection image
+        float response;
+    };
+
+    Method m_method;
+
+    int m_maxDetectionWidth; // frames wider than this are pyrDown'ed before the saddle response is computed
+
+    double m_detectionScale = 1.0; // the board is searched for in a copy of the frame resized by this factor
+
+    SubPixelRefiner m_refiner; // refines the corners of both methods
+
+    cv::Mat m_scaled; // resized gray frame when the detection scale is below 1
+
+    cv::Mat m_levels[2]; // pyramid levels, used alternately
+
+    cv::Mat m_blurred; // smoothed detection image (CV_32F)
+
+    cv::Mat m_response; // saddle response (CV_32F), zero where the surface is not a saddle
+
+    std::vector<float> m_tileMax; // largest response of every tile
+
+    std::vector<std::vector<Candidate>> m_tileCandidates; // local maxima of every tile
+
+    std::vector<Candidate> m_candidates; // clustered local maxima, strongest first
+
+    int m_bucketSize = 16; // side of a bucket of the spatial index in detection pixels
+
+    int m_bucketCols = 0, m_bucketRows = 0;
+
+    std::vector<int> m_bucketStart, m_bucketItems; // candidates sorted by bucket
+
+    std::vector<char> m_used; // candidates already placed on the lattice
+
+    std::vector<int> m_cells; // candidate per lattice cell, -1 if empty
+
+    std::vector<cv::Point2f> m_cellSteps; // local lattice vectors per cell (2 per cell)
+
+    std::vector<int> m_queue; // cells still to be grown from
+
+    /**
+     * computeResponse
+     * @param firstRow (int) first row of the tile
+     * @param lastRow (int) one past the last row of the tile
+     * @return (float) the largest response in the tile
+     * @does fills the tile of m_response with the saddle response of m_blurred
+     */
+    float computeResponse(int firstRow, int lastRow);
+
+    /**
+     * findMaxima
+     * @param firstRow (int) first row of the tile
+     * @param lastRow (int) one past the last row of the tile
+     * @param threshold (float) minimum response of a candidate
+     * @param candidates (std::vector<Candidate> &) receives the local maxima of the tile
+     */
+    void findMaxima(int firstRow, int lastRow, float threshold, std::vector<Candidate> &candidates) const;
+
+    /**
+     * clusterCandidates
+     * @param radius (float) candidates closer than this to a stronger one are merged into it
+     * @does sorts m_candidates by response and merges neighbouring maxima
+     */
+    void clusterCandidates(float radius);
+
+    /**
+     * buildBuckets
+     * @does indexes m_candidates by position so neighbours can be found without a full scan
+     */
+    void buildBuckets();
+
+    /**
+     * nearestCandidate
+     * @param point (cv::Point2f) where to look
+     * @param radius (float) search radius
+     * @param minResponse (float) weaker candidates are ignored
+     * @return (int) the closest unused candidate within radius, -1 if there is none
+     */
+    int nearestCandidate(cv::Point2f point, float radius, float minResponse = 0) const;
+
+    /**
+     * fitGrid
+     * @param seed (int) candidate the lattice is grown from
+     * @param patternSize (cv::Size) inner corners per row and per column
+     * @param corners (std::vector<cv::Point2f> &) receives the corners in detection image coordinates
+     * @return (bool) whether a complete board was found around the seed
+     */
+    bool fitGrid(int seed, cv::Size patternSize, std::vector<cv::Point2f> &corners);
+
+    /**
+     * detect
+     * @param image (const cv::Mat &) grayscale detection image
+     * @param factor (float) frame pixels per detection image pixel
+     * @param offset (cv::Point2f) position of the detection image in the frame
+     * @param patternSize (cv::Size) inner corners per row and per column
+     * @param corners (std::vector<cv::Point2f> &) receives the unrefined corners in frame coordinates
+     * @return (bool) whether the whole board was found
+     */
+    bool detect(const cv::Mat &image, float factor, cv::Point2f offset, cv::Size patternSize,
+                std::vector<cv::Point2f> &corners);
+
+    /**
+     * sample
+     * @param point (cv::Point2f) position in the detection image
+     * @return (float) smoothed intensity at the closest pixel
+     */
+    float sample(cv::Point2f point) const;
+
+public:
+
+    /**
+     * Constructor
+     * @param method (Method) the detector to use
+     * @param maxDetectionWidth (int) widest image the saddle response is computed on
+     */
+    explicit ChessboardDetector(Method method = OPENCV, int maxDetectionWidth = 1280);
+
+    /**
+     * parseMethod
+     * @param name (const std::string &) "opencv" or "saddle"
+     * @param method (Method &) receives the method
+     * @return (bool) whether the name is known
+     */
+    static bool parseMethod(const std::string &name, Method &method);
+
+    /**
+     * methodName
+     * @param method (Method) a method
+     * @return (const char *) its name as accepted by parseMethod
+     */
+    static const char *methodName(Method method);
+
+    /**
+     * setMethod
+     * @param method (Method) the detector to use from now on
+     */
+    void setMethod(Method method);
+
+    /**
+     * getMethod
+     * @return (Method) the detector in use
+     */
+    Method getMethod() const;
+
+    /**
+     * setDetectionScale
+     * @param scale (double) the board is searched for in a copy of the frame resized by this factor (at most 1);
+     *        the corners are still refined at full resolution
+     */
+    void setDetectionScale(double scale);
+
+    /**
+     * setRefinement
+     * @param window (int) largest half size of the refinement window (11 by default)
+     * @param iterations (int) maximum refinement iterations per corner (30 by default)
+     * @param epsilon (double) a corner stops once it moves less than this (0.0001 by default)
+     */
+    void setRefinement(int window, int iterations, double epsilon);
+
+    /**
+     * find
+     * @param src (const cv::Mat &) BGR or grayscale image
+     * @param gray (cv::Mat &) receives the grayscale image
+     * @param patternSize (cv::Size) inner corners per row and per column
+     * @param corners (std::vector<cv::Point2f> &) receives the refined corners, empty if not found
+     * @return (bool) whether the whole board was found
+     */
+    bool find(const cv::Mat &src, cv::Mat &gray, cv::Size patternSize, std::vector<cv::Point2f> &corners);
+
+    /**
+     * find
+     * @param images (FrameCache &) the current frame and its derived images
+     * @param region (const cv::Rect &) where to look, empty for the whole frame
+     * @param patternSize (cv::Size) inner corners per row and per column
+     * @param corners (std::vector<cv::Point2f> &) receives the refined corners in frame coordinates, empty if not found
+     * @return (bool) whether the whole board was found
+     * @does like the other find, but takes the gray frame, the resized frame of the detection scale and the pyramid
+     *       level of the saddle detector from the cache; corners are refined on the whole gray frame, so a board near
+     *       the edge of the region is refined like anywhere else
+     */
+    bool find(FrameCache &images, const cv::Rect &region, cv::Size patternSize, std::vector<cv::Point2f> &corners);
+
+    /**
+     * detectSaddles
+     * @param gray (const cv::Mat &) grayscale image (CV_8UC1)
+     * @param patternSize (cv::Size) inner corners per row and per column
+     * @param corners (std::vector<cv::Point2f> &) receives the unrefined corners, empty if not found
+     * @return (bool) whether the whole board was found
+     */
+    bool detectSaddles(const cv::Mat &gray, cv::Size patternSize, std::vector<cv::Point2f> &corners);
+
+};
+
+#endif //PROJECT_4_CHESSBOARDDETECTOR_H
@@ -0,0 +1,184 @@
+//
+// CS 5330 - Project 4
+// Nathaniel Haddad and Stephen Dorris
+//
+
+#ifndef PROJECT_4_CHUNKEDMESH_H
+#define PROJECT_4_CHUNKEDMESH_H
+
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+
+// OpenCV Libraries
+#include <opencv2/core.hpp>
+
+// Local Includes
+#include "LineRasterizer.h"
+#include "TaskScheduler.h"
+
+/**
+ * An obj model displayed while it is still being read, for meshes too large to parse up front or to keep in memory.
+ * The model is split once into a grid of spatial chunks with bounding boxes and written to <obj>.chunks, with a
+ * coarse (vertex clustered) and a fine version of every chunk. Low priority tasks of the scheduler read every coarse
+ * version first, then the fine versions of the chunks that cover the most of the screen; a task returns once nothing
+ * is left to read and draw starts the next one when the model moved. Draw shows whatever has arrived. Fine chunks
+ * are kept within a memory budget: when a chunk needs room, the fine versions of chunks that are off-screen or too
+ * small on screen are evicted and those chunks fall back to their coarse version.
+ */
+class ChunkedMesh {
+
+public:
+
+    /**
+     * Vertices and faces of one version of a chunk; faces index the chunk's own vertices, 1-based like an obj file
+     */
+    struct ChunkData {
+        std::vector<cv::Vec3f> vertices;
+        std::vector<cv::Vec3f> indices;
+    };
+
+private:
+
+    /**
+     * A chunk as listed in the table of the chunk file
+     */
+    struct ChunkEntry {
+        cv::Vec3f low, high; // bounding box in obj coordinates
+        int64_t coarseOffset, coarseVertexCount, coarseIndexCount;
+        int64_t fineOffset, fineVertexCount, fineIndexCount;
+    };
+
+    struct Chunk {
+        ChunkEntry entry;
+        std::shared_ptr<const ChunkData> coarse, fine; // empty until read, fine also when evicted
+        float screenSize = 0; // longest side of the projected bounding box in pixels, 0 when off-screen
+        bool unreadable = false; // the fine version could not be read and is not asked for again
+    };
+
+    std::string m_path; // the chunk file
+
+    FILE *m_file = nullptr; // read by the loader task only
+
+    std::vector<Chunk> m_chunks; // guarded by m_mutex once the loader runs
+
+    size_t m_budget = 0; // bytes of fine chunks kept in memory
+
+    size_t m_fineBytes = 0; // bytes of fine chunks in memory
+
+    float m_minScreenSize = 48; // chunks smaller than this on screen are drawn coarse
+
+    cv::Matx33f m_transform = cv::Matx33f::eye(); // applied to every vertex before the pose
+
+    bool m_stopping = false;
+
+    bool m_loading = false; // a loader task is queued or running, at most one is
+
+    std::mutex m_mutex;
+
+    TaskScheduler::TaskGroup m_loader{TaskScheduler::BLOCKING}; // the loader waits on file reads
+
+    std::vector<std::shared_ptr<const ChunkData>> m_drawn; // scratch of draw
+
+    std::vector<cv::Vec3f> m_transformed; // scratch of draw
+
+    std::vector<cv::Point2f> m_projected; // scratch of draw
+
+    /**
+     * loadCoarse
+     * @does reads every coarse chunk, run by the first loader task
+     */
+    void loadCoarse();
+
+    /**
+     * loadFine
+     * @does body of a loader task: reads the fine chunks of the largest chunks on screen within the budget, making
+     *       room if needed, until nothing is left to read for the current screen sizes
+     */
+    void loadFine();
+
+    /**
+     * readChunk
+     * @param offset (int64_t) where the chunk data starts in the chunk file
+     * @param vertexCount (int64_t) vertices of the chunk data
+     * @param indexCount (int64_t) faces of the chunk data
+     * @return (std::shared_ptr<const ChunkData>) the chunk data, empty if it could not be read
+     */
+    std::shared_ptr<const ChunkData> readChunk(int64_t offset, int64_t vertexCount, int64_t indexCount);
+
+    /**
+     * byteSize
+     * @param vertexCount (int64_t) vertices of a chunk version
+     * @param indexCount (int64_t) faces of a chunk version
+     * @return (size_t) memory the version takes once read
+     */
+    static size_t byteSize(int64_t vertexCount, int64_t indexCount);
+
+public:
+
+    ChunkedMesh() = default;
+
+    ChunkedMesh(const ChunkedMesh &) = delete;
+
+    ChunkedMesh &operator=(const ChunkedMesh &) = delete;
+
+    ~ChunkedMesh();
+
+    /**
+     * build
+     * @param objPath (const std::string &) the obj file
+     * @param chunkPath (const std::string &) the chunk file to write
+     * @return (bool) whether the chunk file was written
+     * @does splits the obj file into chunks without holding the mesh in memory: the vertices are spilled to a
+     *       scratch file, the faces are bucketed per chunk into scratch files and every chunk is then assembled on
+     *       its own; only two bytes per vertex (its chunk) and one chunk at a time are kept in memory
+     */
+    static bool build(const std::string &objPath, const std::string &chunkPath);
+
+    /**
+     * open
+     * @param objPath (const std::string &) the obj file, split into <obj>.chunks first if that is missing or older
+     * @param budgetMb (int) megabytes of fine chunks kept in memory
+     * @return (bool) whether the chunks could be listed; the first loader task is queued and the model is placed on
+     *         the chessboard like ObjectModel::loadModel does
+     */
+    bool open(const std::string &objPath, int budgetMb);
+
+    /**
+     * isOpen
+     * @return (bool) whether a chunk file is being displayed
+     */
+    bool isOpen() const;
+
+    /**
+     * applyTransform
+     * @param transform (const cv::Matx33f &) the 3x3 matrix multiplied onto the model
+     * @does the vertices are only transformed when drawn, so this is the same for any model size
+     */
+    void applyTransform(const cv::Matx33f &transform);
+
+    /**
+     * draw
+     * @param rasterizer (LineRasterizer &) collects the lines, drawn when it is rendered
+     * @param rotationVector (const cv::Mat &) pose of the chessboard
+     * @param translationVector (const cv::Mat &) pose of the chessboard
+     * @param cameraMatrix (const cv::Mat &) intrinsic camera matrix
+     * @param distortionCoefficients (const cv::Mat &) intrinsic distortion coefficients
+     * @param frameSize (cv::Size) size of the frame
+     * @return (int) chunks drawn with their fine version
+     * @does projects the bounding box of every chunk, skips the chunks off-screen and draws the wireframe of the
+     *       others from the chunks read so far; the screen sizes steer what the loader reads and evicts next
+     */
+    int draw(LineRasterizer &rasterizer, const cv::Mat &rotationVector, const cv::Mat &translationVector,
+             const cv::Mat &cameraMatrix, const cv::Mat &distortionCoefficients, cv::Size frameSize);
+
+    /**
+     * close
+     * @does waits for the loader task to stop and releases every chunk
+     */
+    void close();
+
+};
+
+#endif //PROJECT_4_CHUNKEDMESH_H
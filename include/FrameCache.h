@@ -0,0 +1,121 @@
+//
+// CS 5330 - Project 4
+// Nathaniel Haddad and Stephen Dorris
+//
+
+#ifndef PROJECT_4_FRAMECACHE_H
+#define PROJECT_4_FRAMECACHE_H
+
+// OpenCV Libraries
+#include <opencv2/core.hpp>
+
+// Local Includes
+#include "UndistortMap.h"
+
+/**
+ * Images derived from the current frame, computed the first time a stage asks for them and shared by every later
+ * stage of the same frame: the undistorted frame (--undistort), the grayscale frame, its pyramid, its gradients, a
+ * resized copy for downscaled detection and a small thumbnail for the motion gate. Derived images are computed from
+ * the cheapest source available (the thumbnail is shrunk from the gray frame when that exists, from the color frame
+ * otherwise). The buffers are kept from frame to frame and only reallocated when the frame size changes. A frame
+ * that is already grayscale is used as the gray image without conversion. The frame itself is not copied; every new
+ * frame has to be passed to reset or undistort, the cache cannot tell two frames in the same buffer (or in a buffer
+ * reallocated at the same address) apart.
+ * Derived images are created lazily, so a cache must not be shared between threads that may create them.
+ */
+class FrameCache {
+
+    cv::Mat m_frame; // header of the current frame
+
+    cv::Mat m_undistortBuffer; // destination of the next remap, swapped with the captured frame
+
+    cv::Mat m_grayBuffer; // converted gray frame
+
+    cv::Mat m_gray; // gray view of the current frame, empty until computed
+
+    static const int MAX_LEVEL = 8;
+
+    cv::Mat m_levels[MAX_LEVEL]; // pyramid levels 1 to MAX_LEVEL (level 0 is m_gray), never moved
+
+    int m_levelCount = 0; // pyramid levels computed for the current frame, level 0 included
+
+    cv::Mat m_gradientX, m_gradientY; // 3x3 Sobel derivatives of the gray frame
+
+    bool m_gradients = false; // whether the gradients belong to the current frame
+
+    cv::Mat m_scaled; // gray frame resized for detection
+
+    double m_scale = 0; // factor of m_scaled, 0 when it is not computed for the current frame
+
+    cv::Mat m_thumbnail, m_colorThumbnail; // gray thumbnail and its color source
+
+    int m_thumbnailFactor = 0; // frame pixels per thumbnail pixel, 0 when it is not computed for the current frame
+
+public:
+
+    /**
+     * reset
+     * @param frame (const cv::Mat &) the new BGR or grayscale frame, not copied
+     * @does forgets every derived image of the previous frame; the buffers are kept for reuse
+     */
+    void reset(const cv::Mat &frame);
+
+    /**
+     * undistort
+     * @param frame (cv::Mat &) the captured BGR or grayscale frame, swapped with its undistorted version
+     * @param map (const UndistortMap &) maps prepared for the frame size
+     * @does removes lens distortion and makes the undistorted frame the current one, every derived image is then
+     *       computed from it; the captured buffer becomes the destination of the next remap, nothing is copied
+     */
+    void undistort(cv::Mat &frame, const UndistortMap &map);
+
+    /**
+     * frame
+     * @return (const cv::Mat &) the current frame
+     */
+    const cv::Mat &frame() const;
+
+    /**
+     * gray
+     * @return (const cv::Mat &) the grayscale frame (CV_8UC1), converted once per frame
+     */
+    const cv::Mat &gray();
+
+    /**
+     * level
+     * @param level (int) pyramid level, 0 is the gray frame and every level halves the previous one with cv::pyrDown
+     * @return (const cv::Mat &) the pyramid level (at most level 8), the levels below it are built on the way
+     */
+    const cv::Mat &level(int level);
+
+    /**
+     * gradientX
+     * @return (const cv::Mat &) derivative of the gray frame along x (CV_32FC1, 3x3 Sobel), computed once per frame
+     *         together with gradientY
+     */
+    const cv::Mat &gradientX();
+
+    /**
+     * gradientY
+     * @return (const cv::Mat &) derivative of the gray frame along y (CV_32FC1, 3x3 Sobel), computed once per frame
+     *         together with gradientX
+     */
+    const cv::Mat &gradientY();
+
+    /**
+     * scaled
+     * @param scale (double) resize factor, at most 1
+     * @return (const cv::Mat &) the gray frame resized by scale (area averaged); one scale is kept per frame
+     */
+    const cv::Mat &scaled(double scale);
+
+    /**
+     * thumbnail
+     * @param factor (int) frame pixels per thumbnail pixel along each axis
+     * @return (const cv::Mat &) the gray frame shrunk by factor (area averaged); one factor is kept per frame
+     */
+    const cv::Mat &thumbnail(int factor);
+
+};
+
+#endif //PROJECT_4_FRAMECACHE_H
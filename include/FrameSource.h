@@ -0,0 +1,50 @@
+//
+// CS 5330 - Project 4
+// Nathaniel Haddad and Stephen Dorris
+//
+
+#ifndef PROJECT_4_FRAMESOURCE_H
+#define PROJECT_4_FRAMESOURCE_H
+
+// OpenCV Libraries
+#include <opencv2/core.hpp>
+#include <opencv2/videoio.hpp>
+
+/**
+ * A source of recorded frames, either a video file or a directory of images (read in name order)
+ */
+class FrameSource {
+
+    std::unique_ptr<cv::VideoCapture> m_video; // set when reading from a video file
+
+    std::vector<std::string> m_imagePaths; // set when reading from an image directory
+
+    size_t m_nextImage = 0;
+
+    double m_fps = 30.0;
+
+public:
+
+    /**
+     * open
+     * @param path (const std::string &) a video file or a directory of images
+     * @return (bool) whether the source could be opened
+     */
+    bool open(const std::string &path);
+
+    /**
+     * read
+     * @param frame (cv::Mat &) receives the next frame
+     * @return (bool) false once the source is exhausted
+     */
+    bool read(cv::Mat &frame);
+
+    /**
+     * getFps
+     * @return (double) the frame rate of the source (30 for image directories)
+     */
+    double getFps() const;
+
+};
+
+#endif //PROJECT_4_FRAMESOURCE_H
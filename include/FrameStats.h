@@ -0,0 +1,187 @@
+//
+// CS 5330 - Project 4
+// Nathaniel Haddad and Stephen Dorris
+//
+
+#ifndef PROJECT_4_FRAMESTATS_H
+#define PROJECT_4_FRAMESTATS_H
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * Per-stream frame instrumentation: time spent per pipeline stage and heap allocations per frame, printed every
+ * reportInterval frames. Allocations are counted by the global operator new replacement in FrameStats.cpp, per
+ * thread and only between beginFrame and endFrame: the count of a frame is what the thread of the loop allocated,
+ * other streams and background threads do not add to it.
+ */
+class FrameStats {
+
+public:
+
+    enum Stage {
+        CAPTURE,
+        UNDISTORT,
+        DETECT,
+        POSE,
+        PROJECT,
+        DRAW,
+        PRESENT,
+        STAGE_COUNT
+    };
+
+private:
+
+    typedef std::chrono::steady_clock Clock;
+
+    int m_reportInterval; // frames between reports, 0 disables reporting
+
+    Clock::time_point m_intervalStart;
+
+    Clock::time_point m_stageStart[STAGE_COUNT];
+
+    double m_stageSeconds[STAGE_COUNT] = {};
+
+    Clock::time_point m_frameStart;
+
+    double m_frameStageSeconds[STAGE_COUNT] = {}; // stage times of the current frame
+
+    double m_lastFrameSeconds = 0; // duration of the last finished frame
+
+    double m_lastStageSeconds[STAGE_COUNT] = {}; // stage times of the last finished frame
+
+    int m_quality[4] = {-1, -1, -1, -1}; // detection and render quality level and their maximum, -1 if not adapted
+
+    uint64_t m_frames = 0; // frames in the current interval
+
+    uint64_t m_allocationsAtFrameStart = 0;
+
+    uint64_t m_allocations = 0; // allocations in the current interval
+
+    uint64_t m_maxAllocations = 0; // most allocations seen in a single frame of the current interval
+
+    uint64_t m_reusedDetections = 0; // frames of the current interval that reused the previous board detection
+
+    uint64_t m_recordedFrames = 0; // frames of the current interval handed to the recorder (--record)
+
+    uint64_t m_recorderDepthSum = 0, m_recorderMaxDepth = 0, m_recorderDrops = 0;
+
+    size_t m_arenaBytes = 0; // capacity of the scratch arena of the stream
+
+    uint64_t m_arenaGrowths = 0; // times the arena grew since the stream started
+
+    /**
+     * report
+     * @does prints the averages of the current interval and starts a new one
+     */
+    void report();
+
+public:
+
+    /**
+     * Constructor
+     * @param reportInterval (int) frames between reports, 0 disables reporting
+     */
+    explicit FrameStats(int reportInterval = 0);
+
+    /**
+     * setReportInterval
+     * @param reportInterval (int) frames between reports, 0 disables reporting
+     */
+    void setReportInterval(int reportInterval);
+
+    /**
+     * beginFrame
+     * @does marks the start of a frame (call before capturing it) and starts counting the allocations of the
+     *       calling thread
+     */
+    void beginFrame();
+
+    /**
+     * endFrame
+     * @return (bool) whether a report was printed, the caller may print its own reports next to it
+     * @does marks the end of a frame, stops counting allocations and prints a report every reportInterval frames
+     */
+    bool endFrame();
+
+    /**
+     * beginStage
+     * @param stage (Stage) the stage that starts now
+     */
+    void beginStage(Stage stage) {
+        m_stageStart[stage] = Clock::now();
+    }
+
+    /**
+     * endStage
+     * @param stage (Stage) the stage that ends now
+     */
+    void endStage(Stage stage) {
+        double seconds = std::chrono::duration<double>(Clock::now() - m_stageStart[stage]).count();
+        m_stageSeconds[stage] += seconds;
+        m_frameStageSeconds[stage] += seconds;
+    }
+
+    /**
+     * lastFrameSeconds
+     * @return (double) time between beginFrame and endFrame of the last finished frame
+     */
+    double lastFrameSeconds() const {
+        return m_lastFrameSeconds;
+    }
+
+    /**
+     * lastStageSeconds
+     * @param stage (Stage) a stage
+     * @return (double) time the last finished frame spent in the stage
+     */
+    double lastStageSeconds(Stage stage) const {
+        return m_lastStageSeconds[stage];
+    }
+
+    /**
+     * setQuality
+     * @param detectLevel (int) current detection quality level
+     * @param detectMax (int) highest detection quality level
+     * @param renderLevel (int) current render quality level
+     * @param renderMax (int) highest render quality level
+     * @does the levels are shown in the report (--target-fps)
+     */
+    void setQuality(int detectLevel, int detectMax, int renderLevel, int renderMax);
+
+    /**
+     * reuseDetection
+     * @does counts a frame that skipped detection and reused the previous corners and pose
+     */
+    void reuseDetection() {
+        m_reusedDetections++;
+    }
+
+    /**
+     * countRecorder
+     * @param queueDepth (size_t) frames waiting for the encoder after this frame was submitted
+     * @param dropped (bool) whether the recorder dropped this frame
+     */
+    void countRecorder(size_t queueDepth, bool dropped);
+
+    /**
+     * setArena
+     * @param bytes (size_t) capacity of the scratch arena of the stream
+     * @param growths (uint64_t) times the arena grew since the stream started
+     * @does both are shown in the report, growth after the first frames means a frame needed more scratch
+     */
+    void setArena(size_t bytes, uint64_t growths) {
+        m_arenaBytes = bytes;
+        m_arenaGrowths = growths;
+    }
+
+    /**
+     * allocationCount
+     * @return (uint64_t) heap allocations made through operator new by the calling thread inside frames so far
+     */
+    static uint64_t allocationCount();
+
+};
+
+#endif //PROJECT_4_FRAMESTATS_H
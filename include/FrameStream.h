@@ -0,0 +1,258 @@
+//
+// CS 5330 - Project 4
+// Nathaniel Haddad and Stephen Dorris
+//
+
+#ifndef PROJECT_4_FRAMESTREAM_H
+#define PROJECT_4_FRAMESTREAM_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * Pixel layouts a frame slot can hold
+ */
+enum class PixelFormat : uint32_t {
+    BGR8 = 1,
+    GRAY8 = 2,
+    BGRA8 = 3
+};
+
+/**
+ * A rectangle of a frame, in pixels
+ */
+struct FrameRegion {
+
+    uint32_t x = 0;
+
+    uint32_t y = 0;
+
+    uint32_t width = 0;
+
+    uint32_t height = 0;
+
+};
+
+/**
+ * Per-slot header, followed by the pixel data. sequence is odd while the producer writes the slot. A slot holds
+ * either a whole frame (a base frame) or the tiles that changed since the last base frame (a tile frame): the
+ * tile indices (row major, tileCount uint32_t, padded to 64 bytes), then the pixels of every tile in the same order,
+ * each packed row by row and clipped at the frame edges. The pixels outside the tiles are those of the base frame.
+ */
+struct FrameSlotHeader {
+
+    std::atomic<uint64_t> sequence; // 2 * index + 1 while writing frame index, 2 * index + 2 once complete
+
+    uint32_t width; // size of the whole frame
+
+    uint32_t height;
+
+    uint32_t stride; // bytes per row of a base frame
+
+    uint32_t tileSize; // edge of a tile in pixels, 0 for base frames
+
+    uint32_t tileCount; // tiles carried by a tile frame
+
+    uint64_t baseFrameId; // frameId of the last base frame, equal to frameId for base frames
+
+    PixelFormat pixelFormat;
+
+    uint64_t frameId;
+
+    uint64_t timestampNs; // CLOCK_MONOTONIC nanoseconds
+
+};
+
+/**
+ * Layout of the shared memory segment: a header followed by slotCount slots of slotSize bytes each
+ */
+struct FrameRingHeader {
+
+    static constexpr uint32_t MAGIC = 0x46524d45; // "FRME"
+
+    static constexpr uint32_t VERSION = 3;
+
+    uint32_t magic;
+
+    uint32_t version;
+
+    uint32_t slotCount;
+
+    uint32_t headerSize; // offset of the pixel data inside a slot
+
+    uint64_t slotSize; // bytes per slot including its header
+
+    std::atomic<uint64_t> writeIndex; // number of frames published so far
+
+};
+
+/**
+ * A frame inside the shared memory ring. data points straight into the mapping (no copy); the view is only
+ * valid if SharedFrameReader::release returns true afterwards.
+ */
+struct FrameView {
+
+    const uint8_t *data = nullptr; // first pixel of the base frame, or of the first tile
+
+    size_t dataBytes = 0; // bytes of the slot from data on, what a torn read may read at most
+
+    uint32_t width = 0;
+
+    uint32_t height = 0;
+
+    uint32_t stride = 0; // bytes per row of a base frame
+
+    uint32_t tileSize = 0; // edge of a tile in pixels, 0 for base frames
+
+    uint32_t tileCount = 0;
+
+    const uint32_t *tiles = nullptr; // indices of the tiles, see SharedFrameReader::tileRegion
+
+    PixelFormat pixelFormat = PixelFormat::BGR8;
+
+    uint64_t frameId = 0;
+
+    uint64_t baseFrameId = 0; // frameId of the base frame the tiles apply on top of
+
+    uint64_t timestampNs = 0;
+
+    uint64_t sequence = 0; // sequence number observed by acquire
+
+    uint64_t index = 0; // ring index of the frame
+
+};
+
+/**
+ * Writes composited frames into a POSIX shared memory ring of fixed-size slots (single producer). The producer
+ * never waits for readers, slow readers simply see their frame overwritten.
+ */
+class SharedFrameSink {
+
+    std::string m_name;
+
+    uint32_t m_slotCount;
+
+    FrameRingHeader *m_header = nullptr;
+
+    uint8_t *m_slots = nullptr;
+
+    size_t m_mappedSize = 0;
+
+    bool m_warnedSize = false;
+
+    uint64_t m_baseFrameId = 0;
+
+    uint32_t m_baseWidth = 0, m_baseHeight = 0; // size of the last base frame, 0 before the first one
+
+    PixelFormat m_basePixelFormat = PixelFormat::BGR8;
+
+    uint32_t m_tileSize; // 0 publishes base frames only
+
+    std::vector<uint8_t> m_published; // the frame readers compose from the last base frame and its tiles
+
+    std::vector<uint8_t> m_changed; // one flag per tile, set once the tile changed since the last base frame
+
+    std::vector<uint32_t> m_changedTiles; // scratch, indices of the flagged tiles
+
+    /**
+     * create
+     * @param maxFrameBytes (size_t) the largest frame a slot must hold
+     * @param maxTiles (size_t) the most tiles such a frame has
+     * @return (bool) whether the segment was created and mapped
+     */
+    bool create(size_t maxFrameBytes, size_t maxTiles);
+
+public:
+
+    /**
+     * Constructor, the segment itself is created lazily from the size of the first frame
+     * @param name (const std::string &) shared memory name, e.g. "/cvninjas_frames"
+     * @param slotCount (uint32_t) number of frames kept in the ring
+     * @param tileSize (uint32_t) edge of the tiles compared and sent between base frames, 0 only sends base frames
+     */
+    SharedFrameSink(const std::string &name, uint32_t slotCount, uint32_t tileSize = 0);
+
+    SharedFrameSink(const SharedFrameSink &) = delete;
+
+    SharedFrameSink &operator=(const SharedFrameSink &) = delete;
+
+    ~SharedFrameSink();
+
+    /**
+     * publish
+     * @param data (const uint8_t *) first pixel of the frame
+     * @param width (uint32_t) width in pixels
+     * @param height (uint32_t) height in pixels
+     * @param stride (size_t) bytes per row of the source
+     * @param pixelFormat (PixelFormat) pixel layout
+     * @param frameId (uint64_t) frame counter of the producer
+     * @param timestampNs (uint64_t) capture time
+     * @param base (bool) publish the whole frame; otherwise the frame is compared tile by tile with what readers
+     *        already have, and every tile that changed since the last base frame is sent (the first frame, a
+     *        change of size or format, or a sink without tiles always publishes a base frame)
+     * @return (bool) false if the frame does not fit in a slot or the segment could not be created
+     */
+    bool publish(const uint8_t *data, uint32_t width, uint32_t height, size_t stride, PixelFormat pixelFormat,
+                 uint64_t frameId, uint64_t timestampNs, bool base = true);
+
+};
+
+/**
+ * Zero-copy reader for a ring created by SharedFrameSink
+ */
+class SharedFrameReader {
+
+    const FrameRingHeader *m_header = nullptr;
+
+    const uint8_t *m_slots = nullptr;
+
+    size_t m_mappedSize = 0;
+
+    uint64_t m_readIndex = 0;
+
+public:
+
+    SharedFrameReader() = default;
+
+    SharedFrameReader(const SharedFrameReader &) = delete;
+
+    SharedFrameReader &operator=(const SharedFrameReader &) = delete;
+
+    ~SharedFrameReader();
+
+    /**
+     * open
+     * @param name (const std::string &) shared memory name used by the sink
+     * @return (bool) whether the segment exists and has a compatible version
+     */
+    bool open(const std::string &name);
+
+    /**
+     * acquireLatest
+     * @param view (FrameView &) receives a view of the newest complete frame
+     * @return (bool) false if no frame newer than the last acquired one is available
+     */
+    bool acquireLatest(FrameView &view);
+
+    /**
+     * tileRegion
+     * @param view (const FrameView &) a tile frame
+     * @param tile (uint32_t) index of a tile
+     * @return (FrameRegion) the pixels of the frame the tile covers, its pixels are packed with width * bytes per
+     *         pixel per row
+     */
+    static FrameRegion tileRegion(const FrameView &view, uint32_t tile);
+
+    /**
+     * release
+     * @param view (const FrameView &) a view returned by acquireLatest
+     * @return (bool) whether the frame stayed intact while it was being read (false: discard what was read)
+     */
+    bool release(const FrameView &view) const;
+
+};
+
+#endif //PROJECT_4_FRAMESTREAM_H
@@ -0,0 +1,142 @@
+//
+// CS 5330 - Project 4
+// Nathaniel Haddad and Stephen Dorris
+//
+
+#ifndef PROJECT_4_FRAMEWORKSPACE_H
+#define PROJECT_4_FRAMEWORKSPACE_H
+
+// OpenCV Libraries
+#include <opencv2/core.hpp>
+
+// Local Includes
+#include "ChessboardDetector.h"
+#include "FrameCache.h"
+#include "FrameStats.h"
+#include "LineRasterizer.h"
+#include "ModelInstances.h"
+#include "MotionGate.h"
+#include "PlanarOverlay.h"
+#include "PoseStream.h"
+#include "QualityController.h"
+
+/**
+ * Bump allocator for transient per-frame scratch. Requests that do not fit during warm-up get their own block;
+ * the next reset replaces everything with one block large enough for the whole frame, so the steady state does
+ * not touch the heap.
+ */
+class ScratchArena {
+
+    std::unique_ptr<unsigned char[]> m_block;
+
+    size_t m_capacity = 0;
+
+    size_t m_used = 0;
+
+    std::vector<std::unique_ptr<unsigned char[]>> m_overflow; // blocks handed out since the last reset
+
+    size_t m_overflowBytes = 0;
+
+    uint64_t m_growths = 0; // resets that had to replace the block with a larger one
+
+public:
+
+    /**
+     * allocate
+     * @param bytes (size_t) number of bytes needed
+     * @return (void *) 64 byte aligned memory, valid until the next reset
+     */
+    void *allocate(size_t bytes);
+
+    /**
+     * mat
+     * @param rows (int) number of rows
+     * @param cols (int) number of columns
+     * @param type (int) OpenCV type, e.g. CV_32FC1
+     * @return (cv::Mat) a matrix backed by arena memory, valid until the next reset
+     */
+    cv::Mat mat(int rows, int cols, int type);
+
+    /**
+     * reset
+     * @does releases everything handed out this frame; grows the block if the frame needed more
+     */
+    void reset();
+
+    /**
+     * capacity
+     * @return (size_t) bytes a frame can take from the arena without touching the heap
+     */
+    size_t capacity() const {
+        return m_capacity;
+    }
+
+    /**
+     * growthCount
+     * @return (uint64_t) how often a reset had to grow the block, once or twice during warm-up in the steady state
+     */
+    uint64_t growthCount() const {
+        return m_growths;
+    }
+
+};
+
+/**
+ * Buffers reused from frame to frame by one video stream. Nothing in here is shared between streams, so each
+ * worker thread owns its own workspace.
+ */
+struct FrameWorkspace {
+
+    FrameCache images; // the current frame and the undistorted, gray, pyramid, gradient and thumbnail images of it
+
+    std::vector<cv::Point2f> corners; // detected chessboard corners, empty if the board was not found
+
+    cv::Mat rotationVector, translationVector; // pose of the board, written by solvePnP
+
+    bool poseIsGuess = false; // the pose above is a starting point for the next solvePnP (--resume), used once
+
+    cv::Rect searchHint; // where the next detection looks before searching the whole frame (--resume), used once
+
+    std::vector<cv::Point2f> projectedPoints; // model vertices projected into the frame
+
+    std::vector<cv::Vec3f> turnedVertices; // model vertices turned for the current frame (offline rendering)
+
+    std::vector<cv::Point2f> reprojectedCorners; // board corners projected with the estimated pose
+
+    std::vector<PoseRecord> poses; // pose of every board in the current frame, collected while something reads it
+
+    std::vector<cv::Point2f> poseCorners; // corners of the found boards in poses order, cornerCount per record
+
+    cv::Matx33d homography; // board plane (z = 0) to image, fitted to the corners (--overlay, planar models)
+
+    bool homographyFitted = false; // the homography above belongs to the current corners
+
+    PlanarOverlay::Buffers overlay; // overlay content of the current frame and its cached warp (--overlay)
+
+    ChessboardDetector detector; // board detector of this stream, keeps its own scratch buffers
+
+    MotionGate motionGate; // skips detection while the scene does not move (--motion-gate)
+
+    QualityController quality; // adapts detection and render settings to a frame rate (--target-fps)
+
+    ModelInstances::Buffers instanceBuffers; // projected copies of the model (--instances)
+
+    LineRasterizer rasterizer; // overlay primitives of the current frame, rendered at the end of the draw stage
+
+    cv::Rect dirty; // bounding box of everything the overlay drew into the current frame
+
+    ScratchArena arena; // transient per-frame scratch, reset at the start of every frame
+
+    FrameStats stats; // stage timings and allocation counts of this stream
+
+    /**
+     * reserve
+     * @param cornerCount (size_t) number of chessboard corners
+     * @param vertexCount (size_t) number of model vertices
+     * @does sizes the point buffers up front so they never grow while frames are processed
+     */
+    void reserve(size_t cornerCount, size_t vertexCount);
+
+};
+
+#endif //PROJECT_4_FRAMEWORKSPACE_H
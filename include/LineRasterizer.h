@@ -0,0 +1,126 @@
+//
+// CS 5330 - Project 4
+// Nathaniel Haddad and Stephen Dorris
+//
+
+#ifndef PROJECT_4_LINERASTERIZER_H
+#define PROJECT_4_LINERASTERIZER_H
+
+// OpenCV Libraries
+#include <opencv2/core.hpp>
+
+/**
+ * Batched wireframe drawing into BGR frames. Lines, edge buffers and discs are collected for a frame, binned by
+ * horizontal band of the frame when rendered, and the bands are rasterized in parallel straight into the frame
+ * memory, filling spans 16 pixels at a time. 1 px lines without anti-aliasing set the same pixels as cv::line
+ * (8-connected) for end points inside the frame; wider lines (up to 4 px) are drawn with round caps, optionally
+ * anti-aliased. Every stream needs its own instance.
+ */
+class LineRasterizer {
+
+    struct Item {
+        const cv::Point2f *points; // vertices of an edge buffer, nullptr for lines kept in m_points
+        const cv::Vec2i *edges; // nullptr for lines kept in m_edges
+        size_t edgeStart, edgeCount;
+        cv::Point2f center; // disc center (edgeCount == 0)
+        float radius; // half the line width, or the disc radius
+        float top, bottom; // rows covered
+
+        float left, right; // columns covered
+        uchar color[3];
+        bool thin; // 1 px without anti-aliasing, drawn like cv::line
+    };
+
+    bool m_antialias = false;
+
+    std::vector<Item> m_items; // in drawing order
+
+    std::vector<cv::Point2f> m_points; // end points of single lines
+
+    std::vector<cv::Vec2i> m_edges; // single lines as pairs of m_points
+
+    std::vector<std::vector<int>> m_bands; // items touching every band, in drawing order
+
+    cv::Rect m_bounds; // pixels the last render may have changed
+
+    /**
+     * addItem
+     * @does sets the style of an item and appends it, or extends the previous item with its single lines
+     */
+    void addItem(Item &item, const cv::Scalar &color, int thickness);
+
+    /**
+     * drawBand
+     * @param frame (cv::Mat &) the frame
+     * @param top (int) first row of the band
+     * @param bottom (int) one past the last row of the band
+     * @param items (const std::vector<int> &) items touching the band
+     */
+    void drawBand(cv::Mat &frame, int top, int bottom, const std::vector<int> &items) const;
+
+public:
+
+    /**
+     * setAntialiasing
+     * @param antialias (bool) blend the edges of lines and discs with the frame
+     */
+    void setAntialiasing(bool antialias);
+
+    /**
+     * clear
+     * @does forgets every primitive, keeps the buffers
+     */
+    void clear();
+
+    /**
+     * size
+     * @return (size_t) number of lines and discs to draw
+     */
+    size_t size() const;
+
+    /**
+     * addLine
+     * @param a (cv::Point2f) first end point
+     * @param b (cv::Point2f) second end point
+     * @param color (const cv::Scalar &) BGR color
+     * @param thickness (int) width in pixels, 1 to 4
+     */
+    void addLine(cv::Point2f a, cv::Point2f b, const cv::Scalar &color, int thickness = 1);
+
+    /**
+     * addEdges
+     * @param points (const cv::Point2f *) projected vertices; must stay valid until render, NaN vertices are
+     *        skipped with their edges
+     * @param edges (const std::vector<cv::Vec2i> &) pairs of vertex indices; must stay valid until render
+     * @param color (const cv::Scalar &) BGR color
+     * @param thickness (int) width in pixels, 1 to 4
+     * @param bounds (cv::Rect) rows and columns covered by the vertices if known, computed otherwise
+     */
+    void addEdges(const cv::Point2f *points, const std::vector<cv::Vec2i> &edges, const cv::Scalar &color,
+                  int thickness = 1, cv::Rect bounds = cv::Rect());
+
+    /**
+     * addDisc
+     * @param center (cv::Point2f) center of the disc
+     * @param radius (float) radius in pixels
+     * @param color (const cv::Scalar &) BGR color
+     */
+    void addDisc(cv::Point2f center, float radius, const cv::Scalar &color);
+
+    /**
+     * render
+     * @param frame (cv::Mat &) BGR frame (CV_8UC3) to draw into
+     * @does draws everything added since the last clear, in order
+     */
+    void render(cv::Mat &frame);
+
+    /**
+     * getBounds
+     * @return (cv::Rect) bounding box of the pixels the last render may have changed, empty if nothing was drawn
+     *         since the last clear
+     */
+    cv::Rect getBounds() const;
+
+};
+
+#endif //PROJECT_4_LINERASTERIZER_H
@@ -0,0 +1,123 @@
+//
+// CS 5330 - Project 4
+// Nathaniel Haddad and Stephen Dorris
+//
+
+#ifndef PROJECT_4_MODELINSTANCES_H
+#define PROJECT_4_MODELINSTANCES_H
+
+#include <string>
+
+// OpenCV Libraries
+#include <opencv2/core.hpp>
+
+// Local Includes
+#include "LineRasterizer.h"
+
+/**
+ * Many copies of one wireframe mesh. The mesh is shared: its unique edges are extracted once from the faces and
+ * the vertices are passed in per frame, so a copy only costs one row of a structure-of-arrays transform table
+ * (position on the board, rotation about the board normal, uniform scale). Instances are culled against the view
+ * frustum by their bounding sphere, projected in parallel chunks and handed to a LineRasterizer as edge buffers.
+ * The table is only read while drawing, one instance can serve several threads.
+ */
+class ModelInstances {
+
+public:
+
+    /**
+     * Per-stream scratch of project and draw, kept in FrameWorkspace
+     */
+    struct Buffers {
+        std::vector<int> visible; // instances that survived culling
+        std::vector<cv::Point2f> points; // projected vertices of the visible instances, one mesh after another
+        std::vector<cv::Rect> bounds; // bounding box of every visible instance in the frame
+    };
+
+private:
+
+    std::vector<cv::Vec2i> m_edges; // unique edges of the mesh (0-based vertex indices)
+
+    // transform table, one entry per instance: p = (x, y, z) + scale * Rz(angle) * v
+    std::vector<float> m_x, m_y, m_z;
+
+    std::vector<float> m_cos, m_sin; // scale * cos(angle), scale * sin(angle)
+
+    std::vector<float> m_scale;
+
+public:
+
+    /**
+     * Constructor
+     * @param indices (const std::vector<cv::Vec3f> &) the faces of the mesh (1-based, as ObjectModel::getIndices)
+     */
+    explicit ModelInstances(const std::vector<cv::Vec3f> &indices);
+
+    /**
+     * clear
+     * @does removes every instance
+     */
+    void clear();
+
+    /**
+     * addInstance
+     * @param position (cv::Vec3f) where the model origin is placed, in board units
+     * @param angle (float) rotation about the board normal in radians
+     * @param scale (float) uniform scale
+     */
+    void addInstance(cv::Vec3f position, float angle, float scale);
+
+    /**
+     * size
+     * @return (size_t) number of instances
+     */
+    size_t size() const;
+
+    /**
+     * getEdgeCount
+     * @return (size_t) unique edges of the shared mesh
+     */
+    size_t getEdgeCount() const;
+
+    /**
+     * layout
+     * @param name (const std::string &) "grid" (a field of copies on the board) or "swarm" (copies floating above
+     *        it at random positions)
+     * @param vertices (const std::vector<cv::Vec3f> &) the shared mesh, sets the scale of the copies
+     * @param count (int) number of instances
+     * @param rows (int) inner corners per board column
+     * @param cols (int) inner corners per board row
+     * @param rng (cv::RNG &) random orientations and swarm positions
+     * @return (bool) whether the layout name is known
+     * @does replaces the instances; copies are scaled so that neighbours do not overlap
+     */
+    bool layout(const std::string &name, const std::vector<cv::Vec3f> &vertices, int count, int rows, int cols,
+                cv::RNG &rng);
+
+    /**
+     * project
+     * @param vertices (const std::vector<cv::Vec3f> &) the shared mesh in model frame
+     * @param rotationVector (const cv::Mat &) pose of the board
+     * @param translationVector (const cv::Mat &) pose of the board
+     * @param cameraMatrix (const cv::Mat &) intrinsic camera matrix
+     * @param distortionCoefficients (const cv::Mat &) intrinsic distortion coefficients (may be empty)
+     * @param imageSize (cv::Size) size of the frame, for culling
+     * @param buffers (Buffers &) receives the visible instances and their projected vertices
+     * @return (int) number of visible instances
+     */
+    int project(const std::vector<cv::Vec3f> &vertices, const cv::Mat &rotationVector,
+                const cv::Mat &translationVector, const cv::Mat &cameraMatrix,
+                const cv::Mat &distortionCoefficients, cv::Size imageSize, Buffers &buffers) const;
+
+    /**
+     * draw
+     * @param rasterizer (LineRasterizer &) collects the wireframes, drawn when it is rendered
+     * @param vertexCount (size_t) vertices of the shared mesh
+     * @param buffers (const Buffers &) the output of project, must stay unchanged until the rasterizer is rendered
+     * @param color (const cv::Scalar &) color of the wireframe
+     */
+    void draw(LineRasterizer &rasterizer, size_t vertexCount, const Buffers &buffers, const cv::Scalar &color) const;
+
+};
+
+#endif //PROJECT_4_MODELINSTANCES_H
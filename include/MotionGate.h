@@ -0,0 +1,72 @@
+//
+// CS 5330 - Project 4
+// Nathaniel Haddad and Stephen Dorris
+//
+
+#ifndef PROJECT_4_MOTIONGATE_H
+#define PROJECT_4_MOTIONGATE_H
+
+// OpenCV Libraries
+#include <opencv2/core.hpp>
+
+// Local Includes
+#include "FrameCache.h"
+
+/**
+ * Decides whether a frame can reuse the chessboard corners and pose of an earlier one. Every frame is reduced to a
+ * small grayscale thumbnail (1/8 of the size, area averaged) and compared with the thumbnail of the last frame where
+ * the board was detected; the scene counts as static while almost no thumbnail pixel changed by more than the
+ * threshold. Comparing against the last detection instead of the previous frame lets slow drift add up until it
+ * is noticed. A full detection is forced after maxStaticFrames reused frames. Every stream needs its own instance.
+ */
+class MotionGate {
+
+    int m_threshold = 0; // gray levels a thumbnail pixel must change by to count as motion, 0 disables the gate
+
+    int m_maxStaticFrames = 30;
+
+    int m_staticFrames = 0; // frames that reused the last detection
+
+    cv::Mat m_reference; // thumbnail of the last frame where the board was detected, empty if there is none
+
+    cv::Mat m_gray, m_difference; // thumbnail of the current frame (owned by the frame cache) and scratch
+
+public:
+
+    /**
+     * configure
+     * @param threshold (int) gray levels a thumbnail pixel must change by to count as motion, 0 disables the gate
+     * @param maxStaticFrames (int) frames after which a full detection is forced even if nothing moved
+     */
+    void configure(int threshold, int maxStaticFrames);
+
+    /**
+     * enabled
+     * @return (bool) whether the gate may skip detections
+     */
+    bool enabled() const;
+
+    /**
+     * isStatic
+     * @param images (FrameCache &) the current frame, its thumbnail is taken from the cache
+     * @return (bool) whether the frame looks like the last detected one and the previous result may be reused;
+     *         the thumbnail of the frame is kept for accept
+     */
+    bool isStatic(FrameCache &images);
+
+    /**
+     * accept
+     * @does the board was detected in the frame last passed to isStatic, later frames are compared with it (call
+     *       isStatic on every frame, also on those that are detected in full)
+     */
+    void accept();
+
+    /**
+     * reset
+     * @does forgets the reference frame, the next frame is detected in full
+     */
+    void reset();
+
+};
+
+#endif //PROJECT_4_MOTIONGATE_H
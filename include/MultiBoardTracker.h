@@ -0,0 +1,126 @@
+//
+// CS 5330 - Project 4
+// Nathaniel Haddad and Stephen Dorris
+//
+
+#ifndef PROJECT_4_MULTIBOARDTRACKER_H
+#define PROJECT_4_MULTIBOARDTRACKER_H
+
+#include <string>
+
+// OpenCV Libraries
+#include <opencv2/core.hpp>
+
+// Local Includes
+#include "ChessboardDetector.h"
+#include "FrameCache.h"
+#include "ObjectModel.h"
+
+/**
+ * Finds several chessboards in the same frame, each one an independent anchor with its own size, pose, tracking
+ * state and model. A board that was found in the previous frame is only searched for in a window around its last
+ * position; these searches are small and run in parallel, one detector per board. When two windows found the same
+ * board, only one of them keeps it. The boards that are still missing are then searched for one after another in
+ * the whole frame, with every board already found painted over, so two boards of the same size are told apart.
+ * Full-frame searches only run while a board is lost.
+ */
+class MultiBoardTracker {
+
+public:
+
+    struct Board {
+        cv::Size patternSize; // inner corners per row and per column
+        std::vector<cv::Vec3f> world; // corners in board coordinates (x to the right, y up, one unit per square)
+        ObjectModel model; // drawn on this board
+        ChessboardDetector detector;
+        cv::Mat gray; // gray image the corners were refined on, a view of the frame
+        std::vector<cv::Point2f> corners; // in frame coordinates, empty if the board was not found
+        cv::Mat rotationVector, translationVector; // pose of the board, valid while corners is not empty
+        std::vector<cv::Point2f> projectedPoints; // model vertices projected into the frame
+        cv::Rect window; // where to look in the next frame, empty when the board is lost
+        int lostFrames = 0; // frames since the board was last found
+    };
+
+private:
+
+    std::vector<Board> m_boards;
+
+    cv::Mat m_masked; // copy of the gray frame with the boards found so far painted over
+
+    /**
+     * paintOver
+     * @param image (cv::Mat &) the image to paint into
+     * @param board (const Board &) a found board
+     * @does covers the board and the border of squares around its inner corners with a flat gray
+     */
+    static void paintOver(cv::Mat &image, const Board &board);
+
+    /**
+     * overlaps
+     * @param a (const Board &) a found board
+     * @param b (const Board &) another found board
+     * @return (bool) whether the corners of both cover mostly the same area, i.e. they are the same physical board
+     */
+    static bool overlaps(const Board &a, const Board &b);
+
+    /**
+     * updateWindow
+     * @param board (Board &) a board that was just searched for
+     * @param frameSize (cv::Size) size of the frame
+     * @does sets the search window for the next frame from the corners, or marks the board as lost
+     */
+    static void updateWindow(Board &board, cv::Size frameSize);
+
+public:
+
+    /**
+     * configure
+     * @param boards (const std::string &) comma separated board sizes, e.g. "6x9,4x5" (inner corners per row x
+     *        inner corners per column); a size may repeat for several identical boards
+     * @param models (const std::string &) comma separated models per board ("corners", "axes" or an obj path); the
+     *        last one is used for the remaining boards
+     * @param method (ChessboardDetector::Method) detector used for every board
+     * @return (bool) whether every board size and model could be parsed and loaded
+     */
+    bool configure(const std::string &boards, const std::string &models, ChessboardDetector::Method method);
+
+    /**
+     * size
+     * @return (size_t) number of boards
+     */
+    size_t size() const;
+
+    /**
+     * getBoards
+     * @return (std::vector<Board> &) the boards and their latest state
+     */
+    std::vector<Board> &getBoards();
+
+    /**
+     * detect
+     * @param images (FrameCache &) the current frame, every board is searched for in its gray frame
+     * @return (int) number of boards found
+     * @does tracks the boards found in the previous frame in parallel, then searches the whole frame for the rest
+     */
+    int detect(FrameCache &images);
+
+    /**
+     * estimatePoses
+     * @param cameraMatrix (const cv::Mat &) intrinsic camera matrix
+     * @param distortionCoefficients (const cv::Mat &) intrinsic distortion coefficients
+     * @does solves the pose of every found board in parallel
+     */
+    void estimatePoses(const cv::Mat &cameraMatrix, const cv::Mat &distortionCoefficients);
+
+    /**
+     * draw
+     * @param rasterizer (LineRasterizer &) collects the overlays
+     * @param cameraMatrix (const cv::Mat &) intrinsic camera matrix
+     * @param distortionCoefficients (const cv::Mat &) intrinsic distortion coefficients
+     * @does projects the model of every found board with its pose and queues it for drawing
+     */
+    void draw(LineRasterizer &rasterizer, const cv::Mat &cameraMatrix, const cv::Mat &distortionCoefficients);
+
+};
+
+#endif //PROJECT_4_MULTIBOARDTRACKER_H
@@ -10,6 +10,9 @@
 #include <opencv2/core.hpp>
 #include <opencv2/imgproc/imgproc.hpp>
 
+// Local Includes
+#include "LineRasterizer.h"
+
 /**
  * A class that represents an object model. Used from AR applications
  */
@@ -23,6 +26,34 @@ class ObjectModel {
 
     std::vector<cv::Vec3f> m_indices;
 
+    std::vector<std::vector<cv::Vec3f>> m_coarseIndices; // faces of the coarser levels of detail, coarsest last
+
+    bool m_planar = false; // every vertex lies on the board plane (z = 0)
+
+    /**
+     * updatePlanar
+     * @does checks whether every vertex lies on the board plane, after the vertices were loaded or transformed
+     */
+    void updatePlanar();
+
+    /**
+     * loadMeshCache
+     * @param PATH (const std::string) the path to the obj file
+     * @return (bool) whether <obj>.mesh.bin exists and was written from this version of the obj file
+     * @does appends the cached vertices and indices, skipping the text parser
+     */
+    bool loadMeshCache(const std::string PATH);
+
+    /**
+     * saveMeshCache
+     * @param PATH (const std::string) the path to the obj file
+     * @param firstVertex (size_t) first vertex parsed from the file
+     * @param firstIndex (size_t) first face parsed from the file
+     * @does writes the parsed vertices and indices to <obj>.mesh.bin, tagged with the size and time of the obj file,
+     *       through a temporary file that is renamed into place once it is complete
+     */
+    void saveMeshCache(const std::string PATH, size_t firstVertex, size_t firstIndex) const;
+
 public:
 
     /**
@@ -38,24 +69,56 @@ public:
 
     /**
      * getVertices
-     * @return (std::vector<cv::Vec3f>) gets the vertices for this object model
+     * @return (const std::vector<cv::Vec3f> &) gets the vertices for this object model
+     */
+    const std::vector<cv::Vec3f> &getVertices() const;
+
+    /**
+     * getIndices
+     * @return (const std::vector<cv::Vec3f> &) gets the indices for this object model
      */
-    std::vector<cv::Vec3f> getVertices();
+    const std::vector<cv::Vec3f> &getIndices() const;
 
     /**
      * getIndices
-     * @return (std::vector<cv::Vec3f>) gets the indices for this object model
+     * @param level (int) level of detail, 0 is the full mesh
+     * @return (const std::vector<cv::Vec3f> &) the faces of that level, over the same vertices as the full mesh
      */
-    std::vector<cv::Vec3f> getIndices();
+    const std::vector<cv::Vec3f> &getIndices(int level) const;
+
+    /**
+     * isPlanar
+     * @return (bool) whether the model lies on the board plane (z = 0), so one homography maps it into the image
+     */
+    bool isPlanar() const;
+
+    /**
+     * buildLevelsOfDetail
+     * @param levels (int) number of levels including the full mesh
+     * @does simplifies the faces by vertex clustering: every vertex is snapped to the first vertex of its cell in a
+     *       grid of 64, 32, ... cells along the longest side of the model, faces that collapse are dropped
+     */
+    void buildLevelsOfDetail(int levels);
 
     /**
      * loadObj
      * @param PATH (const std::string) the path to the obj file
      * @return (bool) whether or not the obj was loaded successfully
-     * @does parses an obj file and saves its vertices and indices
+     * @does parses an obj file and saves its vertices and indices; the parsed mesh is cached next to the file
+     *       (<obj>.mesh.bin) and read from there while the obj file is unchanged
      */
     bool loadObj(const std::string PATH);
 
+    /**
+     * loadModel
+     * @param model (const std::string &) "corners", "axes" or a path to an obj file
+     * @param rows (int) the number of rows used to calculate corners
+     * @param cols (int) the number of columns used to calculate corners
+     * @return (bool) whether or not the model was loaded successfully
+     * @does loads a model without prompting; obj files are oriented and scaled onto the chessboard
+     */
+    bool loadModel(const std::string &model, const int rows = 6, const int cols = 9);
+
     /**
      * loadCorners
      * @param rows (int) the number of rows used to calculate corners
@@ -72,28 +135,29 @@ public:
 
     /**
      * draw
-     * @param src (cv::Mat &) a reference to a image to draw to
-     * @param points (std::vector<cv::Point2f>) 2D points in an image
-     * @param indices (std::vector<cv::Vec3f>) the indices for the vertices (taken from obj file)
+     * @param rasterizer (LineRasterizer &) collects the lines, drawn when it is rendered
+     * @param points (const std::vector<cv::Point2f> &) 2D points in an image
+     * @param indices (const std::vector<cv::Vec3f> &) the indices for the vertices (taken from obj file)
      * @does draws a wireframe image
      */
-    static void draw(cv::Mat &src, std::vector<cv::Point2f> points, std::vector<cv::Vec3f> indices);
+    static void draw(LineRasterizer &rasterizer, const std::vector<cv::Point2f> &points,
+                     const std::vector<cv::Vec3f> &indices);
 
     /**
      * drawAxes
-     * @param src (cv::Mat &) a reference to a image to draw to
-     * @param points (std::vector<cv::Point2f>) 2D points in an image
+     * @param rasterizer (LineRasterizer &) collects the lines, drawn when it is rendered
+     * @param points (const std::vector<cv::Point2f> &) 2D points in an image
      * @does draws 3D axes in RGB colors
      */
-    static void drawAxes(cv::Mat &src, std::vector<cv::Point2f> points);
+    static void drawAxes(LineRasterizer &rasterizer, const std::vector<cv::Point2f> &points);
 
     /**
      * drawCircles
-     * @param src (cv::Mat &) a reference to a image to draw to
-     * @param points (std::vector<cv::Point2f>) 2D points in an image
+     * @param rasterizer (LineRasterizer &) collects the circles, drawn when it is rendered
+     * @param points (const std::vector<cv::Point2f> &) 2D points in an image
      * @does draws circles in the four corners of the chessboard
      */
-    static void drawCircles(cv::Mat &src, std::vector<cv::Point2f> points);
+    static void drawCircles(LineRasterizer &rasterizer, const std::vector<cv::Point2f> &points);
 
     /**
      * setObjectModel
@@ -104,9 +168,15 @@ public:
 
     /**
      * getObjectType
-     * @return (std::string) an object string
+     * @return (const std::string &) an object string
+     */
+    const std::string &getObjectType() const;
+
+    /**
+     * getPath
+     * @return (const std::string &) the obj file of a custom model
      */
-    std::string getObjectType();
+    const std::string &getPath() const;
 
     /**
      * applyTransform
@@ -115,6 +185,13 @@ public:
      */
     void applyTransform(cv::Mat transform, bool homogeneous = false);
 
+    /**
+     * applyTransform
+     * @param transform (const cv::Matx33f &) the 3x3 matrix used to multiply each point
+     * @does same as the cv::Mat version without allocating, used every frame
+     */
+    void applyTransform(const cv::Matx33f &transform);
+
     /**
      * eqTriangleVerticesAndCentroid
      * @param sideLength (double) side length of equalateral triangle
@@ -0,0 +1,133 @@
+//
+// CS 5330 - Project 4
+// Nathaniel Haddad and Stephen Dorris
+//
+
+#ifndef PROJECT_4_OPTIONS_H
+#define PROJECT_4_OPTIONS_H
+
+#include <string>
+
+/**
+ * Command line options. When no mode is given the application falls back to the interactive menu.
+ */
+class Options {
+
+public:
+
+    std::string mode; // "" (interactive menu), "offline", "replay", "benchmark" or "generate"
+
+    std::string inputPath; // video file or image directory (offline mode)
+
+    std::string intrinsicsPath; // yml file written by Utils::saveIntrinsicParameters
+
+    std::string model; // "corners", "axes" or a path to an obj file
+
+    int instances = 0; // copies of an obj model to draw, 0 draws the model once
+
+    std::string instanceLayout = "grid"; // arrangement of the copies, "grid" or "swarm"
+
+    std::string outputPath; // output video (offline mode), video or image directory (generate mode)
+
+    int threads = 0; // worker threads of the task scheduler, 0 uses every core
+
+    std::string poseShm; // shared memory name for the binary pose stream, e.g. "/cvninjas_poses" (off when empty)
+
+    int poseSlots = 256; // records kept in the pose ring
+
+    int cameraId = 0; // identifies this producer in published records
+
+    std::string frameShm; // shared memory name for composited frames, e.g. "/cvninjas_frames" (off when empty)
+
+    int frameSlots = 4; // frames kept in the frame ring
+
+    int frameKeyframe = 0; // publish a whole frame every n frames and only the changed tiles in between, 0 is off
+
+    std::string recordPath; // video of the composited frames of the video mode, recorded off the loop (off when empty)
+
+    std::string recordPolicy = "drop"; // what recording does when the encoder falls behind, "drop" or "block"
+
+    int recordBuffers = 8; // frames that can wait for the encoder
+
+    std::string sessionPath; // directory the raw frames, detections and timings of the video mode are recorded to
+
+    std::string sessionCodec = "png"; // how recorded session frames are stored, "raw", "png" or "jpg"
+
+    int sessionChunk = 300; // frames per chunk file of a recorded session
+
+    std::string replayPath; // recorded session fed through the video mode instead of the camera (replay mode)
+
+    int replayStart = 0; // first frame of the session to replay
+
+    bool headless = false; // no windows; the video modes run until SIGINT/SIGTERM
+
+    bool quiet = false; // no per-frame console output
+
+    bool undistort = false; // undistort frames with cached maps, then detect and project with a pinhole model
+
+    bool antialias = false; // blend the edges of overlay lines and circles with the frame
+
+    std::string statePath = "session.yml"; // session state the video mode saves on exit (see SessionState)
+
+    bool resume = false; // start the video mode from the saved session state instead of prompting
+
+    int statsInterval = 0; // print stage timings and allocations every n frames, 0 disables
+
+    std::string detector = "opencv"; // chessboard detector, "opencv" or "saddle"
+
+    std::string boards; // comma separated sizes of several boards tracked at once, e.g. "6x9,4x5" (off when empty)
+
+    std::string boardModels = "axes"; // comma separated model of every board, the last one repeats
+
+    int motionGate = 0; // gray levels of change that count as motion, 0 detects the board in every frame
+
+    int motionInterval = 30; // frames after which the board is detected again even if nothing moved
+
+    double targetFps = 0; // frame rate the video mode adapts its quality to, 0 always uses the best settings
+
+    int meshBudget = 0; // megabytes of fine chunks of an obj model kept in memory, the model is then streamed in chunks
+
+    std::string overlay; // image or video clip laid flat on the board, drawn under the model
+
+    std::string benchmark; // benchmark to run instead of the application ("detector", "pipeline", "perf", ...)
+
+    int frames = 50; // frames per configuration in benchmark mode, frames to write in generate mode
+
+    std::string baselinePath = "../data/perf_baseline.yml"; // committed results the perf benchmark is compared with
+
+    std::string reportPath = "perf_report.json"; // machine readable results of the perf benchmark
+
+    double tolerance = -1; // allowed relative regression of every perf metric, negative uses those of the baseline
+
+    bool updateBaseline = false; // the perf benchmark writes its results as the new baseline instead of comparing
+
+    int width = 1280, height = 720; // synthetic frame size, set with --resolution <width>x<height>
+
+    double blur = 0.8; // optical blur of synthetic frames in pixels
+
+    double noise = 2.0; // sensor noise of synthetic frames in gray levels
+
+    bool lighting = true; // random exposure and light gradient on synthetic frames
+
+    double occlusion = 0; // probability that an object covers part of a synthetic board
+
+    int seed = 5330; // synthetic sequences are reproducible for a given seed
+
+    /**
+     * parse
+     * @param argc (int) argument count
+     * @param argv (char *[]) argument values
+     * @return (Options) the parsed options
+     * @does parses "--flag value" pairs; exits with a usage message on unknown flags
+     */
+    static Options parse(int argc, char *argv[]);
+
+    /**
+     * usage
+     * @does prints the supported command line flags
+     */
+    static void usage();
+
+};
+
+#endif //PROJECT_4_OPTIONS_H
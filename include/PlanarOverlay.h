@@ -0,0 +1,133 @@
+//
+// CS 5330 - Project 4
+// Nathaniel Haddad and Stephen Dorris
+//
+
+#ifndef PROJECT_4_PLANAROVERLAY_H
+#define PROJECT_4_PLANAROVERLAY_H
+
+#include <memory>
+#include <string>
+
+// OpenCV Libraries
+#include <opencv2/core.hpp>
+#include <opencv2/videoio.hpp>
+
+/**
+ * An image or a video clip laid flat on the board. The content is fitted into a rectangle of the board plane (z = 0)
+ * and mapped into the frame with the board to image homography: only the pixels inside the destination quad are
+ * visited, in parallel bands of rows, each mapped back into the content and sampled bilinearly in fixed point from
+ * the mip level that matches its size on screen, then alpha blended into the frame. The mip levels are built once per
+ * image or clip frame (premultiplied by alpha, so minified and transparent content does not fringe). The warp is
+ * cached per stream and only blended again while the homography and the content do not change. The content is only
+ * read while drawing, one overlay can serve several threads.
+ */
+class PlanarOverlay {
+
+public:
+
+    /**
+     * One image or clip frame with its mip levels
+     */
+    struct Texture {
+        std::vector<cv::Mat> levels; // premultiplied BGRA (CV_8UC4), level 0 full size, every level halves the last
+        uint64_t serial = 0; // different for every image or clip frame
+    };
+
+    /**
+     * Per-stream content and cached warp, kept in FrameWorkspace
+     */
+    struct Buffers {
+        std::shared_ptr<const Texture> texture; // content of the current frame, set by the loop, empty draws nothing
+        cv::Matx33d homography; // homography of the cached warp
+        uint64_t serial = 0; // texture of the cached warp, 0 when nothing is cached
+        cv::Rect rect; // where the cached warp lies in the frame
+        cv::Mat warped; // the cached warp over rect, premultiplied BGRA
+    };
+
+private:
+
+    static const int BAND_ROWS = 16; // rows of the destination quad warped by one parallel task
+
+    static const int MAX_LEVELS = 12;
+
+    cv::Rect2f m_area; // rectangle of the board plane the content is fitted into, in board units
+
+    std::unique_ptr<cv::VideoCapture> m_clip; // null for a still image
+
+    cv::Mat m_clipFrame; // scratch of advance
+
+    std::shared_ptr<Texture> m_texture; // content of the current frame, only changed by advance
+
+    std::shared_ptr<Texture> m_spare; // the previous texture, refilled by advance once no stream holds it
+
+    uint64_t m_serial = 0;
+
+    /**
+     * buildTexture
+     * @param image (const cv::Mat &) a BGR, BGRA or grayscale image
+     * @param texture (Texture &) filled with the premultiplied levels of image, its buffers are reused
+     */
+    static void buildTexture(const cv::Mat &image, Texture &texture);
+
+    /**
+     * warpRows
+     * @param texture (const Texture &) the content
+     * @param toTexture (const cv::Matx33d &) homography from frame pixels to level 0 texels
+     * @param warped (cv::Mat &) premultiplied BGRA over rect, rows top to bottom of it are written
+     * @param rect (cv::Rect) where warped lies in the frame
+     * @param top (int) first row of warped
+     * @param bottom (int) row after the last row of warped
+     * @does samples the mip level that matches the size of a texel in the middle of the rows; pixels that map outside
+     *       the content are transparent
+     */
+    static void warpRows(const Texture &texture, const cv::Matx33d &toTexture, cv::Mat &warped, cv::Rect rect,
+                         int top, int bottom);
+
+    /**
+     * blendRows
+     * @param frame (cv::Mat &) BGR frame
+     * @param warped (const cv::Mat &) premultiplied BGRA over rect
+     * @param rect (cv::Rect) where warped lies in the frame
+     * @param top (int) first row of warped
+     * @param bottom (int) row after the last row of warped
+     */
+    static void blendRows(cv::Mat &frame, const cv::Mat &warped, cv::Rect rect, int top, int bottom);
+
+public:
+
+    /**
+     * open
+     * @param path (const std::string &) an image, or a video clip that is played in a loop
+     * @param area (cv::Rect2f) rectangle of the board plane in board units (x right, y up), the content is fitted
+     *        into it keeping its aspect ratio
+     * @return (bool) whether the content could be read
+     */
+    bool open(const std::string &path, cv::Rect2f area);
+
+    /**
+     * advance
+     * @does moves a clip to its next frame and rebuilds the mip levels, from the start once it ends; nothing for an
+     *       image
+     */
+    void advance();
+
+    /**
+     * texture
+     * @return (std::shared_ptr<const Texture>) the content of the current frame, held by a stream while it draws
+     */
+    std::shared_ptr<const Texture> texture() const;
+
+    /**
+     * draw
+     * @param frame (cv::Mat &) BGR frame
+     * @param homography (const cv::Matx33d &) board plane to image homography
+     * @param buffers (Buffers &) content and cached warp of the stream
+     * @return (cv::Rect) region of the frame drawn into, empty if the overlay is not in view
+     * @does warps the content into its quad unless the cached warp is still valid, then blends it into the frame
+     */
+    cv::Rect draw(cv::Mat &frame, const cv::Matx33d &homography, Buffers &buffers) const;
+
+};
+
+#endif //PROJECT_4_PLANAROVERLAY_H
@@ -0,0 +1,168 @@
+//
+// CS 5330 - Project 4
+// Nathaniel Haddad and Stephen Dorris
+//
+
+#ifndef PROJECT_4_POSESTREAM_H
+#define PROJECT_4_POSESTREAM_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/**
+ * One pose per board and processed frame (boardCount records per frame with --boards, one otherwise). Plain old
+ * data so it can live in shared memory; readers must check version.
+ */
+struct PoseRecord {
+
+    static constexpr uint32_t VERSION = 2;
+
+    uint32_t version; // PoseRecord::VERSION of the producer
+
+    uint32_t cameraId; // --camera-id of the producer
+
+    uint64_t frameId; // frame counter of the producer, starting at 0
+
+    uint64_t timestampNs; // capture time, CLOCK_MONOTONIC nanoseconds (media time in offline mode)
+
+    double rotation[3]; // Rodrigues rotation vector of the board in camera frame
+
+    double translation[3]; // translation of the board in camera frame (units of chessboard squares)
+
+    float reprojectionError; // RMS reprojection error of the board corners in pixels
+
+    uint32_t cornerCount; // detected corners, 0 when the board was not found (pose is zero)
+
+    uint32_t board; // index of the board in --boards order, 0 in the single board mode
+
+    uint32_t boardCount; // boards tracked by the producer, i.e. records per frame
+
+};
+
+static_assert(sizeof(PoseRecord) == 88, "PoseRecord layout is part of the wire format");
+
+/**
+ * Layout of the shared memory segment: a header followed by capacity slots. Each slot is guarded by a sequence
+ * number (odd while being written) so the producer never waits for readers.
+ */
+struct PoseRingHeader {
+
+    static constexpr uint32_t MAGIC = 0x504f5345; // "POSE"
+
+    uint32_t magic;
+
+    uint32_t version;
+
+    uint32_t capacity; // number of slots
+
+    uint32_t recordSize; // sizeof(PoseRecord) of the producer
+
+    std::atomic<uint64_t> writeIndex; // number of records published so far
+
+};
+
+struct PoseSlot {
+
+    std::atomic<uint64_t> sequence; // 2 * index + 1 while writing record index, 2 * index + 2 once complete
+
+    PoseRecord record;
+
+};
+
+/**
+ * Publishes pose records into a POSIX shared memory ring (single producer, any number of readers)
+ */
+class PosePublisher {
+
+    std::string m_name;
+
+    PoseRingHeader *m_header = nullptr;
+
+    PoseSlot *m_slots = nullptr;
+
+    size_t m_mappedSize = 0;
+
+public:
+
+    PosePublisher() = default;
+
+    PosePublisher(const PosePublisher &) = delete;
+
+    PosePublisher &operator=(const PosePublisher &) = delete;
+
+    ~PosePublisher();
+
+    /**
+     * open
+     * @param name (const std::string &) shared memory name, e.g. "/cvninjas_poses"
+     * @param capacity (uint32_t) number of records kept in the ring
+     * @return (bool) whether the segment was created and mapped
+     */
+    bool open(const std::string &name, uint32_t capacity);
+
+    /**
+     * publish
+     * @param record (const PoseRecord &) the record to append; overwrites the oldest slot, never blocks
+     */
+    void publish(const PoseRecord &record);
+
+    /**
+     * nowNanoseconds
+     * @return (uint64_t) the CLOCK_MONOTONIC time used for PoseRecord::timestampNs
+     */
+    static uint64_t nowNanoseconds();
+
+};
+
+/**
+ * Reads pose records from a ring created by PosePublisher. Each subscriber keeps its own read position.
+ */
+class PoseSubscriber {
+
+    const PoseRingHeader *m_header = nullptr;
+
+    const PoseSlot *m_slots = nullptr;
+
+    size_t m_mappedSize = 0;
+
+    uint64_t m_readIndex = 0;
+
+    uint64_t m_lost = 0;
+
+public:
+
+    PoseSubscriber() = default;
+
+    PoseSubscriber(const PoseSubscriber &) = delete;
+
+    PoseSubscriber &operator=(const PoseSubscriber &) = delete;
+
+    ~PoseSubscriber();
+
+    /**
+     * open
+     * @param name (const std::string &) shared memory name used by the publisher
+     * @param fromStart (bool) start with the oldest record still in the ring instead of the next new one
+     * @return (bool) whether the segment exists and has a compatible version
+     */
+    bool open(const std::string &name, bool fromStart = false);
+
+    /**
+     * next
+     * @param record (PoseRecord &) receives the next record
+     * @return (bool) false when no new record is available yet
+     * @does skips ahead (and counts the skipped records as lost) when the producer lapped this reader
+     */
+    bool next(PoseRecord &record);
+
+    /**
+     * getLost
+     * @return (uint64_t) the number of records overwritten before this reader got to them
+     */
+    uint64_t getLost() const;
+
+};
+
+#endif //PROJECT_4_POSESTREAM_H
@@ -0,0 +1,123 @@
+//
+// CS 5330 - Project 4
+// Nathaniel Haddad and Stephen Dorris
+//
+
+#ifndef PROJECT_4_QUALITYCONTROLLER_H
+#define PROJECT_4_QUALITYCONTROLLER_H
+
+// Local Includes
+#include "ChessboardDetector.h"
+#include "FrameStats.h"
+#include "LineRasterizer.h"
+
+/**
+ * Holds the video mode at a target frame rate by trading quality for time. Two ladders of settings are adjusted
+ * independently: detection (detection scale, detection interval and the cornerSubPix window, iterations and
+ * epsilon) and rendering (mesh level of detail and anti-aliasing). After every frame the processing time (the frame
+ * without the time spent waiting for the camera) and the detection and rendering stage times are averaged. When the
+ * average stays over the budget, the ladder of the more expensive side is lowered by one step; when it stays well
+ * under the budget for longer, the cheaper side is raised again. The gap between both thresholds, a hold time after
+ * every change and a growing wait after a raise that did not fit keep the levels from oscillating.
+ */
+class QualityController {
+
+public:
+
+    struct DetectSettings {
+        double scale; // see ChessboardDetector::setDetectionScale
+        int interval; // the board is detected every n frames, the frames between reuse the last pose
+        int subPixWindow, subPixIterations; // see ChessboardDetector::setRefinement
+        double subPixEpsilon;
+    };
+
+    struct RenderSettings {
+        int meshLevel; // see ObjectModel::getIndices
+        bool antialias;
+    };
+
+    static const int MESH_LEVELS = 3; // levels of detail an obj model needs (ObjectModel::buildLevelsOfDetail)
+
+private:
+
+    double m_budgetSeconds = 0; // processing time per frame to stay under, 0 disables the controller
+
+    int m_detectLevel = 0, m_renderLevel = 0, m_renderMax = 0;
+
+    double m_frameSeconds = 0, m_detectSeconds = 0, m_renderSeconds = 0; // running averages
+
+    uint64_t m_frames = 0;
+
+    int m_framesSinceChange = 0;
+
+    int m_overFrames = 0, m_underFrames = 0; // consecutive frames over the budget and well under it
+
+    int m_raiseAfter; // frames well under the budget before a level is raised
+
+    uint64_t m_lastRaise = 0; // frame of the last raise
+
+    int m_framesSinceDetection = 0;
+
+    /**
+     * change
+     * @param lower (bool) lower a level instead of raising one
+     * @return (bool) whether a level was changed
+     * @does picks the ladder, changes it by one step and logs the change
+     */
+    bool change(bool lower);
+
+public:
+
+    QualityController();
+
+    /**
+     * configure
+     * @param targetFps (double) frame rate to hold, 0 disables the controller (the best settings are used)
+     * @param antialias (bool) whether the best render level blends line edges
+     */
+    void configure(double targetFps, bool antialias);
+
+    /**
+     * enabled
+     * @return (bool) whether the settings are adapted
+     */
+    bool enabled() const;
+
+    /**
+     * detectSettings
+     * @return (const DetectSettings &) settings of the current detection level
+     */
+    const DetectSettings &detectSettings() const;
+
+    /**
+     * renderSettings
+     * @return (const RenderSettings &) settings of the current render level
+     */
+    const RenderSettings &renderSettings() const;
+
+    /**
+     * update
+     * @param stats (const FrameStats &) timings of the frame that just ended
+     * @return (bool) whether a level changed, the new settings must then be applied
+     */
+    bool update(const FrameStats &stats);
+
+    /**
+     * apply
+     * @param detector (ChessboardDetector &) receives the detection settings
+     * @param rasterizer (LineRasterizer &) receives the anti-aliasing setting
+     * @param stats (FrameStats &) shows the current levels in its reports
+     * @does no-op while the controller is disabled
+     */
+    void apply(ChessboardDetector &detector, LineRasterizer &rasterizer, FrameStats &stats) const;
+
+    /**
+     * skipDetection
+     * @return (bool) whether this frame may reuse the last detection under the current detection interval
+     *         (call once per frame)
+     */
+    bool skipDetection();
+
+};
+
+#endif //PROJECT_4_QUALITYCONTROLLER_H
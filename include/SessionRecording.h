@@ -0,0 +1,287 @@
+//
+// CS 5330 - Project 4
+// Nathaniel Haddad and Stephen Dorris
+//
+
+#ifndef PROJECT_4_SESSIONRECORDING_H
+#define PROJECT_4_SESSIONRECORDING_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <fstream>
+#include <future>
+#include <mutex>
+#include <string>
+
+// OpenCV Libraries
+#include <opencv2/core.hpp>
+
+// Local Includes
+#include "FrameStats.h"
+#include "PoseStream.h"
+
+/**
+ * On-disk layout of a session directory:
+ *  - session.yml: codec, frames per chunk, the intrinsics and the model the session ran with
+ *  - chunk_00000.bin, chunk_00001.bin, ...: frame records, chunkFrames per file; a record is a SessionFrameHeader,
+ *    the encoded input frame, a PoseRecord per board (boardCount) and the corners of the found boards in board
+ *    order (cornerCount pairs of floats, the cornerCount of every PoseRecord added up)
+ *  - index.bin: "SESSIDX2", then a SessionIndexEntry per record in frame order, so any frame can be seeked to
+ */
+struct SessionFrameHeader {
+    char magic[4]; // "SFR2"
+    uint32_t cornerCount; // of all boards
+    uint64_t frameId;
+    uint64_t timestampNs; // capture time
+    int32_t width, height, type; // of the decoded frame
+    uint32_t imageBytes; // encoded frame that follows the header
+    uint32_t boardCount; // pose records that follow the encoded frame
+    float frameMs; // duration of the frame
+    float stageMs[FrameStats::STAGE_COUNT]; // time spent in every stage of the frame
+};
+
+struct SessionIndexEntry {
+    uint64_t frameId;
+    uint64_t timestampNs;
+    uint32_t chunk; // number of the chunk file
+    uint32_t recordBytes; // size of the whole record
+    uint64_t offset; // of the record in the chunk file
+};
+
+/**
+ * A recorded frame as returned by SessionReader::read
+ */
+struct SessionFrame {
+    uint64_t frameId;
+    uint64_t timestampNs;
+    std::vector<PoseRecord> poses; // pose of every board found live, cornerCount 0 for a board not found
+    std::vector<cv::Point2f> corners; // corners of the found boards as detected live, in poses order
+    float frameMs;
+    float stageMs[FrameStats::STAGE_COUNT];
+};
+
+/**
+ * Records a live session for later replay: raw input frames, capture timestamps, detected corners, poses and stage
+ * timings. The live loop only copies the captured frame into one of a fixed pool of buffers (acquire) and fills in
+ * the results once the frame is done (commit); encoding and writing the chunks and the index happen on a background
+ * thread. When every buffer is in use the frame is dropped from the recording, the live loop never waits.
+ */
+class SessionRecorder {
+
+    struct Slot {
+        cv::Mat frame;
+        SessionFrameHeader header;
+        std::vector<PoseRecord> poses;
+        std::vector<cv::Point2f> corners;
+    };
+
+    std::string m_directory;
+
+    std::string m_codec; // "raw", "png" or "jpg"
+
+    int m_chunkFrames = 300;
+
+    std::vector<Slot> m_slots;
+
+    std::vector<size_t> m_queue; // ring of committed slot indices
+
+    size_t m_queueHead = 0, m_queueSize = 0;
+
+    std::vector<size_t> m_free; // slots neither acquired, queued nor being written
+
+    uint64_t m_dropped = 0, m_written = 0;
+
+    bool m_stopping = false;
+
+    std::mutex m_mutex;
+
+    std::condition_variable m_queued;
+
+    std::future<void> m_writer; // write, on the blocking lane of the scheduler
+
+    std::ofstream m_chunk, m_index;
+
+    std::vector<unsigned char> m_encoded; // writer scratch
+
+    /**
+     * write
+     * @does body of the writer thread, encodes and writes committed frames until close
+     */
+    void write();
+
+public:
+
+    SessionRecorder() = default;
+
+    SessionRecorder(const SessionRecorder &) = delete;
+
+    SessionRecorder &operator=(const SessionRecorder &) = delete;
+
+    ~SessionRecorder();
+
+    /**
+     * open
+     * @param directory (const std::string &) session directory, created if needed
+     * @param codec (const std::string &) "raw" (uncompressed), "png" (lossless) or "jpg" (lossy, quality 95)
+     * @param chunkFrames (int) frames per chunk file
+     * @param bufferCount (int) frames that can wait for the writer
+     * @param cameraMatrix (const cv::Mat &) intrinsics the session runs with
+     * @param distortionCoefficients (const cv::Mat &) intrinsics the session runs with
+     * @param model (const std::string &) "corners", "axes" or the obj file the session runs with
+     * @return (bool) whether the codec is known and the directory could be written
+     */
+    bool open(const std::string &directory, const std::string &codec, int chunkFrames, int bufferCount,
+              const cv::Mat &cameraMatrix, const cv::Mat &distortionCoefficients, const std::string &model);
+
+    /**
+     * acquire
+     * @param frame (const cv::Mat &) the raw captured frame, copied
+     * @param frameId (uint64_t) the frame counter
+     * @param timestampNs (uint64_t) capture time of the frame
+     * @return (int) the slot to commit the results to, -1 if the frame was dropped
+     */
+    int acquire(const cv::Mat &frame, uint64_t frameId, uint64_t timestampNs);
+
+    /**
+     * commit
+     * @param slot (int) returned by acquire, nothing happens for -1
+     * @param poses (const std::vector<PoseRecord> &) pose of every board, cornerCount 0 for a board not found
+     * @param corners (const std::vector<cv::Point2f> &) corners of the found boards, in poses order
+     * @param stats (const FrameStats &) holds the stage timings of the frame (call after endFrame)
+     */
+    void commit(int slot, const std::vector<PoseRecord> &poses, const std::vector<cv::Point2f> &corners,
+                const FrameStats &stats);
+
+    /**
+     * droppedCount
+     * @return (uint64_t) frames dropped since open
+     */
+    uint64_t droppedCount();
+
+    /**
+     * close
+     * @does writes the frames still queued, then closes the chunk and the index
+     */
+    void close();
+
+};
+
+/**
+ * Reads a session directory written by SessionRecorder, in order or from any frame
+ */
+class SessionReader {
+
+    std::string m_directory;
+
+    std::string m_codec;
+
+    std::vector<SessionIndexEntry> m_index;
+
+    size_t m_next = 0; // index of the next frame to read
+
+    std::ifstream m_chunk;
+
+    int m_openChunk = -1;
+
+    cv::Mat m_cameraMatrix, m_distortionCoefficients;
+
+    std::string m_model;
+
+    cv::Size m_frameSize;
+
+    std::vector<unsigned char> m_encoded; // scratch
+
+public:
+
+    /**
+     * open
+     * @param directory (const std::string &) a session directory
+     * @return (bool) whether the session could be read
+     */
+    bool open(const std::string &directory);
+
+    /**
+     * frameCount
+     * @return (size_t) frames in the session
+     */
+    size_t frameCount() const;
+
+    /**
+     * seek
+     * @param index (size_t) the next read returns this frame (counted from the first recorded frame)
+     * @return (bool) whether the session has that many frames
+     */
+    bool seek(size_t index);
+
+    /**
+     * read
+     * @param frame (cv::Mat &) receives the raw frame
+     * @param record (SessionFrame &) receives what was recorded with it
+     * @return (bool) false at the end of the session or if the chunk cannot be read
+     */
+    bool read(cv::Mat &frame, SessionFrame &record);
+
+    /**
+     * getCameraMatrix
+     * @return (const cv::Mat &) intrinsic camera matrix of the session
+     */
+    const cv::Mat &getCameraMatrix() const;
+
+    /**
+     * getDistortionCoefficients
+     * @return (const cv::Mat &) intrinsic distortion coefficients of the session
+     */
+    const cv::Mat &getDistortionCoefficients() const;
+
+    /**
+     * getModel
+     * @return (const std::string &) the model the session ran with
+     */
+    const std::string &getModel() const;
+
+    /**
+     * getFrameSize
+     * @return (cv::Size) size of the recorded frames
+     */
+    cv::Size getFrameSize() const;
+
+    /**
+     * getFps
+     * @return (double) the frame rate the session was captured at
+     */
+    double getFps() const;
+
+};
+
+/**
+ * Compares a replay with the recorded session: detections that differ, how far the poses moved and the processing
+ * time of both runs
+ */
+struct ReplayReport {
+
+    uint64_t frames = 0;
+
+    uint64_t foundDiffers = 0; // frames where a board was found in one run only
+
+    double maxTranslationDifference = 0; // largest distance between a recorded and the replayed board position
+
+    double recordedMs = 0, replayedMs = 0; // summed processing time without capture
+
+    /**
+     * add
+     * @param recorded (const SessionFrame &) what was recorded with the frame
+     * @param poses (const std::vector<PoseRecord> &) pose of every board found in the replay
+     * @param stats (const FrameStats &) timings of the replayed frame (call after endFrame)
+     * @does boards are compared by index, a different number of boards counts as a differing detection
+     */
+    void add(const SessionFrame &recorded, const std::vector<PoseRecord> &poses, const FrameStats &stats);
+
+    /**
+     * print
+     * @param seconds (double) wall time of the replay
+     */
+    void print(double seconds) const;
+
+};
+
+#endif //PROJECT_4_SESSIONRECORDING_H
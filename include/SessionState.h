@@ -0,0 +1,45 @@
+//
+// CS 5330 - Project 4
+// Nathaniel Haddad and Stephen Dorris
+//
+
+#ifndef PROJECT_4_SESSIONSTATE_H
+#define PROJECT_4_SESSIONSTATE_H
+
+#include <string>
+
+// OpenCV Libraries
+#include <opencv2/core.hpp>
+
+/**
+ * What the video mode remembers between runs: the intrinsics file and model that were chosen, and where the board
+ * was and how it was posed when the last session ended. With --resume the next session skips both prompts, looks
+ * for the board around the saved region first and starts solvePnP from the saved pose.
+ */
+struct SessionState {
+
+    std::string intrinsicsPath; // yml file written by Utils::saveIntrinsicParameters
+
+    std::string model; // "corners", "axes" or a path to an obj file
+
+    cv::Rect boardRegion; // bounding box of the corners in the last frame the board was found, empty if never found
+
+    cv::Mat rotationVector, translationVector; // pose of the board in that frame
+
+    /**
+     * load
+     * @param path (const std::string &) a file written by save
+     * @return (bool) whether the file exists and names an intrinsics file and a model
+     */
+    bool load(const std::string &path);
+
+    /**
+     * save
+     * @param path (const std::string &) the file to write
+     * @return (bool) whether the file could be written
+     */
+    bool save(const std::string &path) const;
+
+};
+
+#endif //PROJECT_4_SESSIONSTATE_H
@@ -0,0 +1,81 @@
+//
+// CS 5330 - Project 4
+// Nathaniel Haddad and Stephen Dorris
+//
+
+#ifndef PROJECT_4_SUBPIXELREFINER_H
+#define PROJECT_4_SUBPIXELREFINER_H
+
+// OpenCV Libraries
+#include <opencv2/core.hpp>
+
+/**
+ * Refines chessboard corners to sub-pixel accuracy with the same estimator as cv::cornerSubPix: every corner moves
+ * to the point where the Gaussian weighted image gradients in a window around it are orthogonal to the vectors
+ * towards it, iterated until it moves less than epsilon. Corners are refined in parallel and stop iterating
+ * independently of each other. The gradient sums are accumulated in fixed width lanes, so the compiler keeps them
+ * in SIMD registers. The window of every corner follows the local square size (the distance to its neighbours in
+ * the board), bounded by the configured window, so small boards do not pull in the neighbouring corners and large
+ * ones keep the full window.
+ */
+class SubPixelRefiner {
+
+public:
+
+    static const int MAX_WINDOW = 24; // largest half window size that can be configured
+
+private:
+
+    int m_window = 11; // largest half window size
+
+    int m_iterations = 30;
+
+    double m_epsilon = 0.0001;
+
+    std::vector<std::vector<float>> m_masks; // Gaussian weights of the (2w+1)x(2w+1) window of every half size w
+
+    std::vector<int> m_windows; // half window size of every corner being refined
+
+    /**
+     * windowFor
+     * @param corners (const std::vector<cv::Point2f> &) the corners of a board
+     * @param patternSize (cv::Size) inner corners per row and per column
+     * @param index (int) a corner
+     * @return (int) half window size for the corner, about 0.4 of the distance to its closest neighbour
+     */
+    int windowFor(const std::vector<cv::Point2f> &corners, cv::Size patternSize, int index) const;
+
+    /**
+     * refineCorner
+     * @param gray (const cv::Mat &) grayscale image (CV_8UC1)
+     * @param corner (cv::Point2f &) the corner, moved to its refined position
+     * @param window (int) half window size
+     * @param patch (float *) scratch for (2 * window + 3)^2 values
+     */
+    void refineCorner(const cv::Mat &gray, cv::Point2f &corner, int window, float *patch) const;
+
+public:
+
+    SubPixelRefiner();
+
+    /**
+     * configure
+     * @param window (int) largest half window size (11 by default, as cv::Size(11, 11) for cv::cornerSubPix)
+     * @param iterations (int) maximum iterations per corner (30 by default)
+     * @param epsilon (double) a corner stops once it moves less than this (0.0001 by default)
+     */
+    void configure(int window, int iterations, double epsilon);
+
+    /**
+     * refine
+     * @param gray (const cv::Mat &) grayscale image (CV_8UC1) the corners were detected in
+     * @param corners (std::vector<cv::Point2f> &) the corners of a board in cv::findChessboardCorners order,
+     *        refined in place
+     * @param patternSize (cv::Size) inner corners per row and per column; if it does not match the number of
+     *        corners every corner uses the largest window
+     */
+    void refine(const cv::Mat &gray, std::vector<cv::Point2f> &corners, cv::Size patternSize);
+
+};
+
+#endif //PROJECT_4_SUBPIXELREFINER_H
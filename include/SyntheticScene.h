@@ -0,0 +1,146 @@
+//
+// CS 5330 - Project 4
+// Nathaniel Haddad and Stephen Dorris
+//
+
+#ifndef PROJECT_4_SYNTHETICSCENE_H
+#define PROJECT_4_SYNTHETICSCENE_H
+
+#include <string>
+
+// OpenCV Libraries
+#include <opencv2/core.hpp>
+
+// Local Includes
+#include "Options.h"
+
+/**
+ * A rendered frame and its ground truth
+ */
+struct SyntheticFrame {
+
+    cv::Mat image; // BGR frame
+
+    cv::Mat rotationVector, translationVector; // board to camera (CV_64F), as solvePnP would return them
+
+    std::vector<cv::Point2f> corners; // inner corners in the image, in cv::findChessboardCorners order
+
+    bool visible = false; // every corner inside the image and nothing in front of the board
+
+};
+
+/**
+ * Renders a chessboard of known size under known intrinsics, distortion and pose, so detection and pose
+ * estimation can be measured without a camera or a printed board. The board uses the world frame of Camera
+ * (corner (x, -y, 0), one unit per square).
+ */
+class SyntheticScene {
+
+public:
+
+    struct Settings {
+
+        cv::Size imageSize = cv::Size(1280, 720);
+
+        cv::Size patternSize = cv::Size(6, 9); // inner corners per row and per column
+
+        cv::Mat cameraMatrix; // defaults to a focal length of one image width and a centered principal point
+
+        cv::Mat distortionCoefficients; // defaults to mild barrel distortion
+
+        double blurSigma = 0.8; // optical blur in pixels, 0 disables
+
+        double noiseSigma = 2.0; // sensor noise in gray levels, 0 disables
+
+        bool lighting = true; // random exposure and a light gradient across every frame
+
+        double occlusion = 0; // probability that an object covers part of the board
+
+        uint64_t seed = 5330; // the same seed renders the same sequence
+
+    };
+
+private:
+
+    Settings m_settings;
+
+    cv::RNG m_rng;
+
+    std::vector<cv::Vec3f> m_boardWorld; // inner corners in world frame
+
+    cv::Mat m_board; // board texture including a white margin of one square
+
+    cv::Mat m_rays; // undistorted normalized image coordinates of every pixel (CV_32FC2)
+
+    cv::Mat m_mapX, m_mapY; // texture coordinates of every pixel for the current pose
+
+    /**
+     * randomPose
+     * @param rotationVector (cv::Mat &) receives the rotation of the board
+     * @param translationVector (cv::Mat &) receives the translation of the board
+     * @does picks a pose that keeps the board roughly in view, tilted by up to 35 degrees
+     */
+    void randomPose(cv::Mat &rotationVector, cv::Mat &translationVector);
+
+    /**
+     * renderBackground
+     * @param image (cv::Mat &) receives a background with some clutter
+     */
+    void renderBackground(cv::Mat &image);
+
+public:
+
+    /**
+     * Constructor
+     * @param settings (const Settings &) image size, board, intrinsics and degradations
+     */
+    explicit SyntheticScene(const Settings &settings);
+
+    /**
+     * settingsFromOptions
+     * @param options (const Options &) --resolution, --blur, --noise, --occlusion and --seed
+     * @param patternSize (cv::Size) inner corners of the chessboard
+     * @return (Settings) the settings of the scene
+     */
+    static Settings settingsFromOptions(const Options &options, cv::Size patternSize);
+
+    /**
+     * getCameraMatrix
+     * @return (const cv::Mat &) the intrinsic camera matrix used for rendering
+     */
+    const cv::Mat &getCameraMatrix() const;
+
+    /**
+     * getDistortionCoefficients
+     * @return (const cv::Mat &) the distortion coefficients used for rendering
+     */
+    const cv::Mat &getDistortionCoefficients() const;
+
+    /**
+     * render
+     * @param rotationVector (const cv::Mat &) rotation of the board
+     * @param translationVector (const cv::Mat &) translation of the board
+     * @param frame (SyntheticFrame &) receives the frame and its ground truth
+     */
+    void render(const cv::Mat &rotationVector, const cv::Mat &translationVector, SyntheticFrame &frame);
+
+    /**
+     * next
+     * @param frame (SyntheticFrame &) receives a frame with a random pose and its ground truth
+     */
+    void next(SyntheticFrame &frame);
+
+    /**
+     * generate
+     * @param options (const Options &) --frames and the scene settings; options.outputPath is a video file
+     *        (.mp4/.avi) or a directory for png frames
+     * @param patternSize (cv::Size) inner corners of the chessboard
+     * @return (int) process exit code
+     * @does writes a synthetic sequence, its ground truth (<output>.truth.csv) and its intrinsics
+     *       (<output>.intrinsics.yml, readable by Utils::loadIntrinsicParameters)
+     */
+    static int generate(const Options &options, cv::Size patternSize);
+
+};
+
+#endif //PROJECT_4_SYNTHETICSCENE_H
@@ -0,0 +1,332 @@
+//
+// CS 5330 - Project 4
+// Nathaniel Haddad and Stephen Dorris
+//
+
+#ifndef PROJECT_4_TASKSCHEDULER_H
+#define PROJECT_4_TASKSCHEDULER_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// OpenCV Libraries
+#include <opencv2/core.hpp>
+
+/**
+ * The one thread pool of the process, shared by every parallel stage so they do not each start their own threads
+ * and oversubscribe the cores. Every worker has a deque per priority: it pushes and pops its own tasks at the back
+ * and, once they run out, takes tasks from the front of the queue of tasks submitted by other threads and then from
+ * the front of the other workers' deques (a steal). HIGH tasks (the frames) are always taken before LOW tasks
+ * (calibration solves), on every queue of the pool; a running task is not interrupted. A thread waiting for tasks
+ * (parallelFor, TaskGroup::wait) only runs its own tasks that are still queued, never unrelated ones, so a frame is
+ * not held up by background work picked up while it waits. BLOCKING tasks (device opening, file parsing, mesh
+ * loading, the encoders) wait on I/O most of the time; they never run on the workers but on the blocking lane,
+ * threads of the pool that are started when no lane thread is idle and kept for the next blocking task.
+ */
+class TaskScheduler {
+
+public:
+
+    enum Priority {
+        HIGH,
+        LOW,
+        BLOCKING // not a queue of the workers, runs on the blocking lane
+    };
+
+    /**
+     * Tasks that are waited for together
+     */
+    class TaskGroup {
+
+        friend class TaskScheduler;
+
+        Priority m_priority;
+
+        int m_pending = 0; // tasks submitted and not finished, guarded by m_mutex
+
+        std::mutex m_mutex;
+
+        std::condition_variable m_done;
+
+        /**
+         * finish
+         * @does counts a finished task of the group
+         */
+        void finish();
+
+    public:
+
+        /**
+         * Constructor
+         * @param priority (Priority) priority of the tasks of the group
+         */
+        explicit TaskGroup(Priority priority = HIGH);
+
+        TaskGroup(const TaskGroup &) = delete;
+
+        TaskGroup &operator=(const TaskGroup &) = delete;
+
+        ~TaskGroup();
+
+        /**
+         * run
+         * @param task (std::function<void()>) work to run on the pool
+         */
+        void run(std::function<void()> task);
+
+        /**
+         * wait
+         * @does returns once every task of the group has finished, running the tasks of the group that are still
+         *       queued meanwhile
+         */
+        void wait();
+
+    };
+
+private:
+
+    typedef void (*TaskFunction)(void *data);
+
+    typedef void (*RangeFunction)(const void *body, const cv::Range &range);
+
+    /**
+     * A queued task, no allocation is needed to queue one
+     */
+    struct Task {
+        TaskFunction function;
+        void *data;
+        TaskGroup *group; // finished once the task ran, may be null
+    };
+
+    /**
+     * A fixed ring of tasks, the owner uses the back and the other threads the front
+     */
+    struct TaskQueue {
+        static const size_t CAPACITY = 1024;
+        static const int COUNT = 2; // HIGH and LOW tasks are queued, BLOCKING tasks go to the lane
+        std::mutex mutex;
+        Task tasks[CAPACITY];
+        size_t head = 0, tail = 0; // tasks live in [head, tail), both only grow
+
+        bool push(const Task &task);
+
+        bool popBack(Task &task);
+
+        bool popFront(Task &task);
+
+        bool remove(const TaskGroup *group, const void *data, Task &task); // the oldest task that matches, see takeOwn
+    };
+
+    /**
+     * A worker thread, its deques and its counters; aligned so the counters of two workers do not share a line
+     */
+    struct alignas(64) Worker {
+        TaskQueue queues[TaskQueue::COUNT];
+        std::thread thread;
+        std::atomic<uint64_t> busyNanos{0}, tasks{0}, steals{0};
+        uint64_t reportedBusyNanos = 0, reportedTasks = 0, reportedSteals = 0; // values at the last report
+    };
+
+    /**
+     * A parallelFor in progress, lives on the stack of the calling thread
+     */
+    struct RangeJob {
+        RangeFunction function;
+        const void *body;
+        cv::Range range;
+        int grain, chunkCount;
+        std::atomic<int> next{0}; // next chunk to claim
+        std::atomic<int> helpers{0}; // helper tasks not finished, the job must outlive them
+    };
+
+    static int s_threadCount; // workers of the instance, set with configure
+
+    std::vector<std::unique_ptr<Worker>> m_workers;
+
+    TaskQueue m_submitted[TaskQueue::COUNT]; // tasks submitted by threads that are not workers
+
+    std::atomic<int> m_queued{0}; // tasks in every queue
+
+    std::atomic<int> m_sleeping{0}; // workers waiting on m_wake
+
+    std::atomic<unsigned int> m_nextVictim{0}; // first deque searched by threads that are not workers
+
+    std::atomic<uint64_t> m_helpedTasks{0}; // tasks run by waiting threads that are not workers
+
+    std::mutex m_sleepMutex;
+
+    std::condition_variable m_wake;
+
+    bool m_stopping = false; // guarded by m_sleepMutex
+
+    std::mutex m_reportMutex;
+
+    std::chrono::steady_clock::time_point m_reportStart = std::chrono::steady_clock::now();
+
+    uint64_t m_reportedHelpedTasks = 0;
+
+    std::mutex m_laneMutex;
+
+    std::condition_variable m_laneWake;
+
+    std::deque<Task> m_laneTasks; // BLOCKING tasks no lane thread took yet, guarded by m_laneMutex
+
+    std::vector<std::thread> m_laneThreads; // guarded by m_laneMutex
+
+    int m_laneIdle = 0; // lane threads waiting for a task, guarded by m_laneMutex
+
+    bool m_laneStopping = false; // guarded by m_laneMutex
+
+    std::atomic<uint64_t> m_laneTaskCount{0}; // BLOCKING tasks run
+
+    uint64_t m_reportedLaneTaskCount = 0;
+
+    /**
+     * Constructor
+     * @param workerCount (int) worker threads to start
+     */
+    explicit TaskScheduler(int workerCount);
+
+    /**
+     * work
+     * @param index (int) index of the worker
+     * @does body of a worker thread: runs tasks, highest priority first, and sleeps while every queue is empty
+     */
+    void work(int index);
+
+    /**
+     * lane
+     * @does body of a lane thread: runs BLOCKING tasks and waits for the next one while there is none
+     */
+    void lane();
+
+    /**
+     * submit
+     * @param priority (Priority) priority of the task
+     * @param task (const Task &) the task, run on the calling thread if its queue is full; BLOCKING tasks are
+     *        handed to an idle lane thread or a new one
+     */
+    void submit(Priority priority, const Task &task);
+
+    /**
+     * take
+     * @param lowest (Priority) lowest priority taken
+     * @param task (Task &) the task taken
+     * @param stolen (bool &) whether the task came from the deque of another worker
+     * @return (bool) whether a task was taken
+     */
+    bool take(Priority lowest, Task &task, bool &stolen);
+
+    /**
+     * takeOwn
+     * @param priority (Priority) priority the task was submitted with
+     * @param group (const TaskGroup *) group of the task, null to match by data instead
+     * @param data (const void *) data of the task when group is null
+     * @param task (Task &) the task taken
+     * @return (bool) whether a task of the caller was still queued and was taken off its queue; BLOCKING tasks are
+     *         left to the lane
+     */
+    bool takeOwn(Priority priority, const TaskGroup *group, const void *data, Task &task);
+
+    /**
+     * execute
+     * @param task (const Task &) a task taken from a queue
+     * @param stolen (bool) whether it was stolen, counted for the worker that runs it
+     */
+    void execute(const Task &task, bool stolen);
+
+    /**
+     * runChunks
+     * @param job (RangeJob &) the parallelFor in progress
+     * @does runs chunks of the job until every chunk is claimed
+     */
+    static void runChunks(RangeJob &job);
+
+    /**
+     * parallelFor
+     * @does type erased parallelFor, the body is called through function
+     */
+    void parallelFor(const cv::Range &range, int grain, RangeFunction function, const void *body,
+                     Priority priority);
+
+public:
+
+    TaskScheduler(const TaskScheduler &) = delete;
+
+    TaskScheduler &operator=(const TaskScheduler &) = delete;
+
+    ~TaskScheduler();
+
+    /**
+     * configure
+     * @param threads (int) worker threads of the pool (--threads), 0 uses every core
+     * @does only has an effect before the first call to instance
+     */
+    static void configure(int threads);
+
+    /**
+     * instance
+     * @return (TaskScheduler &) the pool of the process, started on the first call; starting it turns off the
+     *         thread pool of OpenCV (cv::setNumThreads(1)) so OpenCV functions run on the task that calls them
+     */
+    static TaskScheduler &instance();
+
+    /**
+     * workerCount
+     * @return (int) worker threads of the pool
+     */
+    int workerCount() const;
+
+    /**
+     * parallelFor
+     * @param range (const cv::Range &) the iterations
+     * @param grain (int) iterations per chunk, 0 picks about four chunks per thread
+     * @param body (const Body &) called with the chunks of range, like a cv::ParallelLoopBody
+     * @param priority (Priority) priority of the chunks, BLOCKING chunks run as LOW ones
+     * @does runs the chunks on the pool and on the calling thread, returns once every chunk is done; the body is
+     *       not copied and nothing is allocated
+     */
+    template<typename Body>
+    void parallelFor(const cv::Range &range, int grain, const Body &body, Priority priority = HIGH) {
+        parallelFor(range, grain, [](const void *erased, const cv::Range &chunk) {
+            (*static_cast<const Body *>(erased))(chunk);
+        }, &body, priority);
+    }
+
+    /**
+     * async
+     * @param priority (Priority) priority of the task
+     * @param function (Function) work to run on the pool, BLOCKING for work that waits on devices or files
+     * @return (std::future) the result of function; unlike std::async the future does not wait in its destructor
+     */
+    template<typename Function>
+    auto async(Priority priority, Function function) -> std::future<decltype(function())> {
+        typedef std::packaged_task<decltype(function())()> Packaged;
+        Packaged *packaged = new Packaged(std::move(function));
+        std::future<decltype(function())> future = packaged->get_future();
+        submit(priority, {[](void *data) {
+            std::unique_ptr<Packaged> owned(static_cast<Packaged *>(data));
+            (*owned)();
+        }, packaged, nullptr});
+        return future;
+    }
+
+    /**
+     * report
+     * @does prints the share of time every worker spent running tasks, the tasks it ran and how many of them it
+     *       stole since the last report, and the tasks run on the blocking lane
+     */
+    void report();
+
+};
+
+#endif //PROJECT_4_TASKSCHEDULER_H
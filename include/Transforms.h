@@ -83,6 +83,17 @@ public:
      */
     static void rotateZ(cv::Mat src, cv::Mat dst, double theta, bool aboutOrigin, cv::Vec3f translationToOrigin);
 
+    /**
+     * projectPlanar
+     * @param homography (const cv::Matx33d &) board plane to image homography
+     * @param points (const std::vector<cv::Vec3f> &) points on the board plane, z is ignored
+     * @param projected (std::vector<cv::Point2f> &) receives the points in the image
+     * @does maps every point with the homography in one loop without branches, which the compiler vectorizes; what
+     *       cv::projectPoints computes for z = 0 with a pinhole camera, without solving a pose first
+     */
+    static void projectPlanar(const cv::Matx33d &homography, const std::vector<cv::Vec3f> &points,
+                              std::vector<cv::Point2f> &projected);
+
 };
 
 #endif //PROJECT_4_TRANSFORMS_H
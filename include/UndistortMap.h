@@ -0,0 +1,85 @@
+//
+// CS 5330 - Project 4
+// Nathaniel Haddad and Stephen Dorris
+//
+
+#ifndef PROJECT_4_UNDISTORTMAP_H
+#define PROJECT_4_UNDISTORTMAP_H
+
+#include <string>
+
+// OpenCV Libraries
+#include <opencv2/core.hpp>
+
+/**
+ * Removes lens distortion from whole frames with a precomputed remap, so detection, solvePnP and projection can
+ * use a pure pinhole model and the cost of projecting a mesh no longer depends on the distortion model. The maps
+ * are in fixed-point format and are stored next to the intrinsics file (<intrinsics>.undistort_<w>x<h>.bin), so
+ * they are computed once per intrinsics file and frame size. After prepare() the maps are only read, one instance
+ * can serve several threads.
+ */
+class UndistortMap {
+
+    cv::Mat m_map1, m_map2; // fixed-point maps for cv::remap (CV_16SC2 and CV_16UC1)
+
+    cv::Mat m_cameraMatrix; // intrinsic camera matrix of the distorted and the undistorted frames
+
+    cv::Mat m_distortionCoefficients; // distortion the maps were built for
+
+    cv::Size m_imageSize;
+
+    /**
+     * load
+     * @param path (const std::string &) a file written by save
+     * @return (bool) whether the file exists and matches the intrinsics and frame size
+     */
+    bool load(const std::string &path);
+
+    /**
+     * save
+     * @param path (const std::string &) where to store the maps
+     */
+    void save(const std::string &path) const;
+
+public:
+
+    /**
+     * prepare
+     * @param intrinsicsPath (const std::string &) the intrinsics file, empty to skip the map file
+     * @param cameraMatrix (const cv::Mat &) intrinsic camera matrix
+     * @param distortionCoefficients (const cv::Mat &) intrinsic distortion coefficients
+     * @param imageSize (cv::Size) size of the frames to undistort
+     * @does loads the maps stored next to the intrinsics file, or computes and stores them; nothing happens if
+     *       the maps already match
+     */
+    void prepare(const std::string &intrinsicsPath, const cv::Mat &cameraMatrix,
+                 const cv::Mat &distortionCoefficients, cv::Size imageSize);
+
+    /**
+     * apply
+     * @param src (const cv::Mat &) a distorted frame of the prepared size
+     * @param dst (cv::Mat &) receives the undistorted frame (must not share data with src)
+     */
+    void apply(const cv::Mat &src, cv::Mat &dst) const;
+
+    /**
+     * getImageSize
+     * @return (cv::Size) the frame size the maps were prepared for, empty before prepare
+     */
+    cv::Size getImageSize() const;
+
+    /**
+     * getCameraMatrix
+     * @return (const cv::Mat &) camera matrix of the undistorted frames
+     */
+    const cv::Mat &getCameraMatrix() const;
+
+    /**
+     * getDistortionCoefficients
+     * @return (cv::Mat) distortion of the undistorted frames, i.e. none
+     */
+    static cv::Mat getDistortionCoefficients();
+
+};
+
+#endif //PROJECT_4_UNDISTORTMAP_H
@@ -0,0 +1,154 @@
+//
+// CS 5330 - Project 4
+// Nathaniel Haddad and Stephen Dorris
+//
+
+#include <algorithm>
+#include <iostream>
+
+// Local Includes
+#include "AsyncRecorder.h"
+#include "TaskScheduler.h"
+
+AsyncRecorder::~AsyncRecorder() {
+    close();
+}
+
+bool AsyncRecorder::parsePolicy(const std::string &name, Policy &policy) {
+    if (name == "drop") {
+        policy = DROP;
+        return true;
+    }
+    if (name == "block") {
+        policy = BLOCK;
+        return true;
+    }
+    return false;
+}
+
+bool AsyncRecorder::open(const std::string &outputPath, double fps, Policy policy, int bufferCount) {
+    close();
+    std::string sidecarPath = outputPath + ".frames.csv";
+    m_sidecar.open(sidecarPath);
+    if (!m_sidecar) {
+        std::cerr << "ERROR: could not open " << sidecarPath << " for writing" << std::endl;
+        return false;
+    }
+    m_sidecar << "frame,timestamp_ns,board,found,rx,ry,rz,tx,ty,tz\n";
+    m_outputPath = outputPath;
+    m_fps = fps > 0 ? fps : 30;
+    m_policy = policy;
+    m_slots.assign(std::max(bufferCount, 1), Slot());
+    m_queue.assign(m_slots.size(), 0);
+    m_queueHead = m_queueSize = 0;
+    m_free.clear();
+    for (size_t i = 0; i < m_slots.size(); i++) {
+        m_free.push_back(i);
+    }
+    m_dropped = 0;
+    m_stopping = false;
+    m_encoder = TaskScheduler::instance().async(TaskScheduler::BLOCKING, [this]() { encode(); });
+    std::cout << "Recording to " << m_outputPath << " and " << sidecarPath << " (" << m_slots.size() << " buffers, "
+              << (m_policy == DROP ? "dropping" : "blocking") << " when full)" << std::endl;
+    return true;
+}
+
+bool AsyncRecorder::isOpen() const {
+    return m_encoder.valid();
+}
+
+bool AsyncRecorder::submit(const cv::Mat &frame, uint64_t frameId, uint64_t timestampNs,
+                           const std::vector<PoseRecord> &poses) {
+    size_t index;
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        if (m_free.empty()) {
+            if (m_policy == DROP) {
+                m_dropped++;
+                return false;
+            }
+            m_released.wait(lock, [&]() { return !m_free.empty(); });
+        }
+        index = m_free.back();
+        m_free.pop_back();
+    }
+    // the copy happens outside the lock, the slot belongs to this thread until it is queued
+    Slot &slot = m_slots[index];
+    frame.copyTo(slot.frame);
+    slot.frameId = frameId;
+    slot.timestampNs = timestampNs;
+    // the slot keeps its capacity, so the same number of boards does not allocate again
+    slot.poses.assign(poses.begin(), poses.end());
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_queue[(m_queueHead + m_queueSize) % m_queue.size()] = index;
+        m_queueSize++;
+    }
+    m_queued.notify_one();
+    return true;
+}
+
+void AsyncRecorder::encode() {
+    for (;;) {
+        size_t index;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_queued.wait(lock, [&]() { return m_queueSize > 0 || m_stopping; });
+            if (m_queueSize == 0) {
+                return;
+            }
+            index = m_queue[m_queueHead];
+            m_queueHead = (m_queueHead + 1) % m_queue.size();
+            m_queueSize--;
+        }
+        const Slot &slot = m_slots[index];
+        if (!m_video.isOpened()) {
+            m_video.open(m_outputPath, cv::VideoWriter::fourcc('m', 'p', '4', 'v'), m_fps, slot.frame.size());
+            if (!m_video.isOpened()) {
+                std::cerr << "ERROR: could not open " << m_outputPath << " for writing" << std::endl;
+            }
+        }
+        if (m_video.isOpened()) {
+            m_video.write(slot.frame);
+        }
+        for (const PoseRecord &pose : slot.poses) {
+            m_sidecar << slot.frameId << "," << slot.timestampNs << "," << pose.board << "," << (pose.cornerCount > 0);
+            for (const double *vector : {pose.rotation, pose.translation}) {
+                for (int i = 0; i < 3; i++) {
+                    m_sidecar << "," << vector[i];
+                }
+            }
+            m_sidecar << "\n";
+        }
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_free.push_back(index);
+        }
+        m_released.notify_one();
+    }
+}
+
+size_t AsyncRecorder::queueDepth() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_queueSize;
+}
+
+uint64_t AsyncRecorder::droppedCount() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_dropped;
+}
+
+void AsyncRecorder::close() {
+    if (!m_encoder.valid()) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+    }
+    m_queued.notify_all();
+    m_encoder.get();
+    m_video.release();
+    m_sidecar.close();
+    std::cout << "Recorded " << m_outputPath << " (" << m_dropped << " frames dropped)" << std::endl;
+}
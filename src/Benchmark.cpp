@@ -0,0 +1,976 @@
+//
+// CS 5330 - Project 4
+// Nathaniel Haddad and Stephen Dorris
+//
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <ctime>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#ifdef __APPLE__
+#include <mach/mach.h>
+#else
+#include <unistd.h>
+#endif
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+// OpenCV Libraries
+#include <opencv2/calib3d.hpp>
+#include <opencv2/imgproc.hpp>
+
+// Local Includes
+#include "Benchmark.h"
+#include "Camera.h"
+#include "ChessboardDetector.h"
+#include "FrameSource.h"
+#include "LineRasterizer.h"
+#include "ModelInstances.h"
+#include "ObjectModel.h"
+#include "SubPixelRefiner.h"
+#include "SyntheticScene.h"
+#include "Transforms.h"
+#include "Utils.h"
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+const ChessboardDetector::Method METHODS[] = {ChessboardDetector::OPENCV, ChessboardDetector::SADDLE};
+
+const int METHOD_COUNT = 2;
+
+struct DetectorResult {
+    int frames = 0;
+    int detected = 0;
+    double seconds = 0;
+    double errorSum = 0; // distance of every detected corner to the reference corner of the same index
+    double errorMax = 0;
+    size_t errorCount = 0;
+};
+
+/**
+ * timedFind
+ * @return (bool) whether the board was found; the time taken is added to result
+ */
+bool timedFind(ChessboardDetector &detector, const cv::Mat &frame, cv::Mat &gray, cv::Size patternSize,
+               std::vector<cv::Point2f> &corners, DetectorResult &result) {
+    Clock::time_point start = Clock::now();
+    bool found = detector.find(frame, gray, patternSize, corners);
+    result.seconds += std::chrono::duration<double>(Clock::now() - start).count();
+    result.frames++;
+    if (found) {
+        result.detected++;
+    }
+    return found;
+}
+
+/**
+ * addErrors
+ * @does compares every corner with the reference corner of the same index, so a detection that orders the corners
+ *       differently (starts at another end or runs the other way round) counts with its full error
+ */
+void addErrors(const std::vector<cv::Point2f> &corners, const std::vector<cv::Point2f> &reference,
+               DetectorResult &result) {
+    size_t count = std::min(corners.size(), reference.size());
+    for (size_t k = 0; k < count; k++) {
+        double error = cv::norm(corners[k] - reference[k]);
+        result.errorSum += error;
+        result.errorMax = std::max(result.errorMax, error);
+        result.errorCount++;
+    }
+}
+
+void printResult(const std::string &label, ChessboardDetector::Method method, const DetectorResult &result) {
+    printf("%-12s %-8s %5d/%-5d %12.3f %12.3f %10.2f\n", label.c_str(), ChessboardDetector::methodName(method),
+           result.detected, result.frames, result.errorCount > 0 ? result.errorSum / result.errorCount : 0.0,
+           result.errorMax, result.frames > 0 ? 1000.0 * result.seconds / result.frames : 0.0);
+}
+
+struct PipelineResult {
+    int frames = 0;
+    int visible = 0; // frames with the whole board in view
+    int detected = 0; // detections on those frames
+    int hiddenDetected = 0; // detections while the board was partly hidden or out of view
+    int flipped = 0; // detections that start at the opposite end of the board
+    double seconds = 0;
+    double cornerSquaredSum = 0;
+    size_t cornerCount = 0;
+    double rotationSum = 0, rotationMax = 0; // degrees
+    double translationSum = 0, translationMax = 0; // percent of the distance to the board
+};
+
+/**
+ * readTruth
+ * @return (bool) whether the ground truth written by SyntheticScene::generate could be read
+ */
+bool readTruth(const std::string &path, std::vector<SyntheticFrame> &truth) {
+    std::ifstream file(path);
+    std::string line;
+    if (!std::getline(file, line)) {
+        return false;
+    }
+    while (std::getline(file, line)) {
+        std::replace(line.begin(), line.end(), ',', ' ');
+        std::istringstream fields(line);
+        int frame, visible;
+        double pose[6];
+        if (!(fields >> frame >> visible >> pose[0] >> pose[1] >> pose[2] >> pose[3] >> pose[4] >> pose[5])) {
+            return false;
+        }
+        SyntheticFrame record;
+        record.visible = visible != 0;
+        record.rotationVector = (cv::Mat_<double>(3, 1) << pose[0], pose[1], pose[2]);
+        record.translationVector = (cv::Mat_<double>(3, 1) << pose[3], pose[4], pose[5]);
+        truth.emplace_back(record);
+    }
+    return true;
+}
+
+/**
+ * addPoseErrors
+ * @does compares a detection and its pose with the ground truth. A board turned by 180 degrees has the same
+ *       corners in reverse order, so a detector may start at either end; the truth is turned to match.
+ */
+void addPoseErrors(const FrameWorkspace &workspace, const SyntheticFrame &truth, cv::Size patternSize,
+                   PipelineResult &result) {
+    const std::vector<cv::Point2f> &corners = workspace.corners;
+    size_t count = corners.size();
+    double forward = 0, reverse = 0;
+    for (size_t k = 0; k < count; k++) {
+        cv::Point2f error = corners[k] - truth.corners[k];
+        forward += error.dot(error);
+        error = corners[k] - truth.corners[count - 1 - k];
+        reverse += error.dot(error);
+    }
+    cv::Matx33d R;
+    cv::Rodrigues(truth.rotationVector, R);
+    cv::Vec3d t(truth.translationVector.ptr<double>());
+    if (reverse < forward) {
+        result.flipped++;
+        t += R * cv::Vec3d(patternSize.height - 1, -(patternSize.width - 1), 0);
+        R = R * cv::Matx33d(-1, 0, 0, 0, -1, 0, 0, 0, 1);
+    }
+    result.cornerSquaredSum += std::min(forward, reverse);
+    result.cornerCount += count;
+
+    cv::Matx33d estimated;
+    cv::Rodrigues(workspace.rotationVector, estimated);
+    cv::Vec3d difference;
+    cv::Rodrigues(estimated * R.t(), difference);
+    double rotation = cv::norm(difference) * 180 / CV_PI;
+    double translation = 100 * cv::norm(cv::Vec3d(workspace.translationVector.ptr<double>()) - t) / cv::norm(t);
+    result.rotationSum += rotation;
+    result.rotationMax = std::max(result.rotationMax, rotation);
+    result.translationSum += translation;
+    result.translationMax = std::max(result.translationMax, translation);
+}
+
+const char *PERF_MODELS[] = {"bunny", "monkey", "octahedron"};
+
+const char *PERF_METRICS[] = {"fps", "p99Ms", "rssGrowthMb"};
+
+const int PERF_METRIC_COUNT = 3;
+
+const double RSS_NOISE_MB = 4; // memory growth within this much of the baseline passes, whatever the tolerance
+
+/**
+ * Results of one model in the perf benchmark, in the order of PERF_METRICS
+ */
+struct PerfResult {
+    double values[PERF_METRIC_COUNT] = {0, 0, 0};
+    double p50Ms = 0;
+    int detected = 0;
+};
+
+/**
+ * currentRssMb
+ * @return (double) resident set size of the process right now in megabytes
+ */
+double currentRssMb() {
+#ifdef __APPLE__
+    mach_task_basic_info_data_t info;
+    mach_msg_type_number_t count = MACH_TASK_BASIC_INFO_COUNT;
+    if (task_info(mach_task_self(), MACH_TASK_BASIC_INFO, (task_info_t) &info, &count) != KERN_SUCCESS) {
+        return 0;
+    }
+    return info.resident_size / 1048576.0;
+#else
+    FILE *file = fopen("/proc/self/statm", "r");
+    if (file == nullptr) {
+        return 0;
+    }
+    long pages = 0, resident = 0;
+    int matches = fscanf(file, "%ld %ld", &pages, &resident);
+    fclose(file);
+    return matches == 2 ? resident * (double) sysconf(_SC_PAGESIZE) / 1048576.0 : 0;
+#endif
+}
+
+/**
+ * releaseFreedMemory
+ * @does hands memory freed by the previous model back to the system, so it does not hide the growth of the next
+ */
+void releaseFreedMemory() {
+#ifdef __GLIBC__
+    malloc_trim(0);
+#endif
+}
+
+/**
+ * percentile
+ * @return (double) the value below which the given fraction of the sorted values lie
+ */
+double percentile(const std::vector<double> &sorted, double fraction) {
+    if (sorted.empty()) {
+        return 0;
+    }
+    size_t index = (size_t) std::ceil(fraction * sorted.size());
+    return sorted[std::min(std::max(index, (size_t) 1), sorted.size()) - 1];
+}
+
+}
+
+int Benchmark::run(const Options &options, cv::Size patternSize) {
+    if (options.benchmark == "detector") {
+        return detector(options, patternSize);
+    }
+    if (options.benchmark == "pipeline") {
+        return pipeline(options, patternSize);
+    }
+    if (options.benchmark == "instancing") {
+        return instancing(options, patternSize);
+    }
+    if (options.benchmark == "rasterizer") {
+        return rasterizer(options);
+    }
+    if (options.benchmark == "refiner") {
+        return refiner(options, patternSize);
+    }
+    if (options.benchmark == "perf") {
+        return perf(options, patternSize);
+    }
+    if (options.benchmark == "planar") {
+        return planar(options, patternSize);
+    }
+    if (options.benchmark == "arena") {
+        return arena(options, patternSize);
+    }
+    std::cerr << "ERROR: unknown benchmark " << options.benchmark << std::endl;
+    Options::usage();
+    return -1;
+}
+
+int Benchmark::detector(const Options &options, cv::Size patternSize) {
+    ChessboardDetector detectors[METHOD_COUNT] = {ChessboardDetector(METHODS[0]), ChessboardDetector(METHODS[1])};
+    cv::Mat gray;
+    std::vector<cv::Point2f> corners[METHOD_COUNT];
+
+    if (!options.inputPath.empty()) {
+        // recorded frames have no ground truth, errors are measured against the OpenCV corners
+        FrameSource source;
+        if (!source.open(options.inputPath)) {
+            std::cerr << "ERROR: unable to open " << options.inputPath << std::endl;
+            return -1;
+        }
+        printf("##=== DETECTOR BENCHMARK: %dx%d board, %s (errors relative to opencv) ===##\n",
+               patternSize.width, patternSize.height, options.inputPath.c_str());
+        printf("%-12s %-8s %11s %12s %12s %10s\n", "frames", "detector", "detected", "mean err px", "max err px",
+               "ms/frame");
+        DetectorResult results[METHOD_COUNT];
+        cv::Mat frame;
+        while (source.read(frame)) {
+            bool found[METHOD_COUNT];
+            for (int m = 0; m < METHOD_COUNT; m++) {
+                found[m] = timedFind(detectors[m], frame, gray, patternSize, corners[m], results[m]);
+            }
+            for (int m = 1; m < METHOD_COUNT; m++) {
+                if (found[0] && found[m]) {
+                    addErrors(corners[m], corners[0], results[m]);
+                }
+            }
+        }
+        for (int m = 0; m < METHOD_COUNT; m++) {
+            printResult(options.inputPath.substr(options.inputPath.find_last_of('/') + 1), METHODS[m], results[m]);
+        }
+        return 0;
+    }
+
+    const cv::Size RESOLUTIONS[] = {cv::Size(1280, 720), cv::Size(1920, 1080), cv::Size(3840, 2160)};
+    printf("##=== DETECTOR BENCHMARK: %dx%d board, %d synthetic frames per resolution ===##\n", patternSize.width,
+           patternSize.height, options.frames);
+    printf("%-12s %-8s %11s %12s %12s %10s\n", "resolution", "detector", "detected", "mean err px", "max err px",
+           "ms/frame");
+    for (const cv::Size &resolution : RESOLUTIONS) {
+        // same seed, so the same poses for every resolution and every run
+        SyntheticScene::Settings settings;
+        settings.imageSize = resolution;
+        settings.patternSize = patternSize;
+        settings.noiseSigma = 3;
+        SyntheticScene scene(settings);
+        SyntheticFrame frame;
+        DetectorResult results[METHOD_COUNT];
+        for (int i = 0; i < options.frames;) {
+            scene.next(frame);
+            if (!frame.visible) {
+                continue;
+            }
+            if (i == 0) {
+                // warm up buffers and the thread pool outside of the measurement
+                for (int m = 0; m < METHOD_COUNT; m++) {
+                    detectors[m].find(frame.image, gray, patternSize, corners[m]);
+                }
+            }
+            for (int m = 0; m < METHOD_COUNT; m++) {
+                if (timedFind(detectors[m], frame.image, gray, patternSize, corners[m], results[m])) {
+                    addErrors(corners[m], frame.corners, results[m]);
+                }
+            }
+            i++;
+        }
+        std::string label = std::to_string(resolution.width) + "x" + std::to_string(resolution.height);
+        for (int m = 0; m < METHOD_COUNT; m++) {
+            printResult(label, METHODS[m], results[m]);
+        }
+    }
+    return 0;
+}
+
+int Benchmark::refiner(const Options &options, cv::Size patternSize) {
+    const cv::Size RESOLUTIONS[] = {cv::Size(1280, 720), cv::Size(1920, 1080)};
+    SubPixelRefiner refiner;
+    cv::Mat gray;
+    std::vector<cv::Point2f> detected, reference, refined;
+    printf("##=== REFINER BENCHMARK: %dx%d board, %d synthetic frames per resolution ===##\n", patternSize.width,
+           patternSize.height, options.frames);
+    printf("%-12s %-14s %12s %12s %12s %10s\n", "resolution", "refinement", "mean err px", "max err px",
+           "ms/board", "speedup");
+    for (const cv::Size &resolution : RESOLUTIONS) {
+        SyntheticScene::Settings settings = SyntheticScene::settingsFromOptions(options, patternSize);
+        settings.imageSize = resolution;
+        SyntheticScene scene(settings);
+        SyntheticFrame frame;
+        DetectorResult results[2];
+        for (int i = 0; i < options.frames;) {
+            scene.next(frame);
+            cv::cvtColor(frame.image, gray, cv::COLOR_BGR2GRAY);
+            if (!frame.visible || !cv::findChessboardCorners(gray, patternSize, detected,
+                                                             cv::CALIB_CB_ADAPTIVE_THRESH)) {
+                continue;
+            }
+            if (i == 0) {
+                // warm up buffers and the thread pool outside of the measurement
+                refined = detected;
+                refiner.refine(gray, refined, patternSize);
+            }
+            reference = detected;
+            Clock::time_point start = Clock::now();
+            cv::cornerSubPix(gray, reference, cv::Size(11, 11), cv::Size(-1, -1),
+                             cv::TermCriteria(cv::TermCriteria::EPS + cv::TermCriteria::COUNT, 30, 0.0001));
+            Clock::time_point middle = Clock::now();
+            refined = detected;
+            refiner.refine(gray, refined, patternSize);
+            results[0].seconds += std::chrono::duration<double>(middle - start).count();
+            results[1].seconds += std::chrono::duration<double>(Clock::now() - middle).count();
+            addErrors(reference, frame.corners, results[0]);
+            addErrors(refined, frame.corners, results[1]);
+            results[0].frames++;
+            results[1].frames++;
+            i++;
+        }
+        std::string label = std::to_string(resolution.width) + "x" + std::to_string(resolution.height);
+        const char *NAMES[] = {"cornerSubPix", "refiner"};
+        for (int r = 0; r < 2; r++) {
+            const DetectorResult &result = results[r];
+            printf("%-12s %-14s %12.4f %12.4f %12.3f %9.1fx\n", label.c_str(), NAMES[r],
+                   result.errorCount > 0 ? result.errorSum / result.errorCount : 0.0, result.errorMax,
+                   result.frames > 0 ? 1000.0 * result.seconds / result.frames : 0.0,
+                   result.seconds > 0 ? results[0].seconds / result.seconds : 0.0);
+        }
+    }
+    return 0;
+}
+
+int Benchmark::pipeline(const Options &options, cv::Size patternSize) {
+    Options cameraOptions = options;
+    cameraOptions.quiet = true;
+    Camera camera(patternSize, 5, cameraOptions);
+    FrameWorkspace workspaces[METHOD_COUNT];
+    for (int m = 0; m < METHOD_COUNT; m++) {
+        workspaces[m].detector.setMethod(METHODS[m]);
+    }
+
+    // ground truth comes from a sequence written by --generate or from frames rendered on the fly
+    std::unique_ptr<SyntheticScene> scene;
+    FrameSource source;
+    std::vector<SyntheticFrame> truth;
+    cv::Mat cameraMatrix, distortionCoefficients;
+    std::string label;
+    if (!options.inputPath.empty()) {
+        std::string inputPath = options.inputPath;
+        while (inputPath.size() > 1 && inputPath.back() == '/') {
+            inputPath.pop_back();
+        }
+        if (!source.open(inputPath)) {
+            std::cerr << "ERROR: unable to open " << inputPath << std::endl;
+            return -1;
+        }
+        if (!readTruth(inputPath + ".truth.csv", truth)) {
+            std::cerr << "ERROR: unable to read " << inputPath << ".truth.csv" << std::endl;
+            return -1;
+        }
+        std::vector<cv::Mat> intrinsicParameters = Utils::loadIntrinsicParameters(
+                options.intrinsicsPath.empty() ? inputPath + ".intrinsics.yml" : options.intrinsicsPath);
+        cameraMatrix = intrinsicParameters[0];
+        distortionCoefficients = intrinsicParameters[1];
+        if (cameraMatrix.empty()) {
+            std::cerr << "ERROR: could not load intrinsic parameters" << std::endl;
+            return -1;
+        }
+        label = inputPath;
+    } else {
+        scene.reset(new SyntheticScene(SyntheticScene::settingsFromOptions(options, patternSize)));
+        cameraMatrix = scene->getCameraMatrix();
+        distortionCoefficients = scene->getDistortionCoefficients();
+        label = std::to_string(options.width) + "x" + std::to_string(options.height) + " synthetic";
+    }
+
+    PipelineResult results[METHOD_COUNT];
+    SyntheticFrame frame;
+    int frames = 0, visible = 0;
+    for (;; frames++) {
+        if (scene) {
+            if (frames >= options.frames) {
+                break;
+            }
+            scene->next(frame);
+        } else {
+            if (!source.read(frame.image)) {
+                break;
+            }
+            if (frames >= (int) truth.size()) {
+                std::cerr << "ERROR: the ground truth ends after " << truth.size() << " frames" << std::endl;
+                break;
+            }
+            frame.rotationVector = truth[frames].rotationVector;
+            frame.translationVector = truth[frames].translationVector;
+            frame.visible = truth[frames].visible;
+            cv::projectPoints(camera.getChessboardCornersWorld(), frame.rotationVector, frame.translationVector,
+                              cameraMatrix, distortionCoefficients, frame.corners);
+        }
+        if (frames == 0) {
+            // warm up buffers and the thread pool outside of the measurement
+            for (int m = 0; m < METHOD_COUNT; m++) {
+                camera.estimatePose(frame.image, workspaces[m], cameraMatrix, distortionCoefficients);
+            }
+        }
+        visible += frame.visible;
+        for (int m = 0; m < METHOD_COUNT; m++) {
+            PipelineResult &result = results[m];
+            Clock::time_point start = Clock::now();
+            bool found = camera.estimatePose(frame.image, workspaces[m], cameraMatrix, distortionCoefficients);
+            result.seconds += std::chrono::duration<double>(Clock::now() - start).count();
+            result.frames++;
+            if (found && frame.visible) {
+                result.detected++;
+                addPoseErrors(workspaces[m], frame, patternSize, result);
+            } else if (found) {
+                result.hiddenDetected++;
+            }
+        }
+    }
+
+    printf("##=== PIPELINE BENCHMARK: %dx%d board, %s, %d frames (%d with the whole board visible) ===##\n",
+           patternSize.width, patternSize.height, label.c_str(), frames, visible);
+    printf("%-8s %11s %7s %8s %8s %9s %9s %9s %9s %9s\n", "detector", "detected", "hidden", "flipped", "fps",
+           "rms px", "rot deg", "rot max", "trans %", "trans max");
+    for (int m = 0; m < METHOD_COUNT; m++) {
+        const PipelineResult &result = results[m];
+        int posed = std::max(result.detected, 1);
+        printf("%-8s %5d/%-5d %7d %8d %8.1f %9.3f %9.3f %9.3f %9.3f %9.3f\n",
+               ChessboardDetector::methodName(METHODS[m]), result.detected, visible, result.hiddenDetected,
+               result.flipped,
+               result.seconds > 0 ? result.frames / result.seconds : 0.0,
+               result.cornerCount > 0 ? std::sqrt(result.cornerSquaredSum / result.cornerCount) : 0.0,
+               result.rotationSum / posed, result.rotationMax, result.translationSum / posed, result.translationMax);
+    }
+    return 0;
+}
+
+int Benchmark::instancing(const Options &options, cv::Size patternSize) {
+    const double FRAME_BUDGET = 1.0 / 60;
+    const int MAX_INSTANCES = 1 << 20;
+    ObjectModel model;
+    std::string modelPath = options.model.empty() ? "../data/obj/bunny.obj" : options.model;
+    if (!model.loadModel(modelPath, patternSize.width, patternSize.height) || model.getObjectType() != "custom") {
+        std::cerr << "ERROR: --benchmark instancing needs an obj model" << std::endl;
+        return -1;
+    }
+    ModelInstances instances(model.getIndices());
+
+    // the camera of the synthetic scenes, looking at the board from 35 degrees off its normal
+    cv::Size imageSize(options.width, options.height);
+    SyntheticScene::Settings settings;
+    settings.imageSize = imageSize;
+    settings.patternSize = patternSize;
+    cv::Mat cameraMatrix = SyntheticScene(settings).getCameraMatrix();
+    cv::Mat rotationVector = (cv::Mat_<double>(3, 1) << 0.6, 0, 0);
+    cv::Matx33d R;
+    cv::Rodrigues(rotationVector, R);
+    double distance = cameraMatrix.at<double>(0, 0) * patternSize.height / (0.8 * imageSize.width);
+    cv::Vec3d center((patternSize.height - 1) / 2.0, -(patternSize.width - 1) / 2.0, 0);
+    cv::Vec3d t = cv::Vec3d(0, 0, distance) - R * center;
+    cv::Mat translationVector = (cv::Mat_<double>(3, 1) << t[0], t[1], t[2]);
+
+    printf("##=== INSTANCING BENCHMARK: %s (%zu edges), %s layout, %dx%d, budget %.1f ms ===##\n", modelPath.c_str(),
+           instances.getEdgeCount(), options.instanceLayout.c_str(), imageSize.width, imageSize.height,
+           1000 * FRAME_BUDGET);
+    printf("%10s %10s %12s %12s %16s\n", "instances", "visible", "project ms", "draw ms", "instances/s");
+    cv::Mat frame(imageSize, CV_8UC3);
+    ModelInstances::Buffers buffers;
+    LineRasterizer rasterizer;
+    rasterizer.setAntialiasing(options.antialias);
+    int withinBudget = 0;
+    for (int count = 16; count <= MAX_INSTANCES; count *= 2) {
+        cv::RNG rng(options.seed);
+        if (!instances.layout(options.instanceLayout, model.getVertices(), count, patternSize.width,
+                              patternSize.height, rng)) {
+            std::cerr << "ERROR: unknown instance layout " << options.instanceLayout << std::endl;
+            return -1;
+        }
+        double projectSeconds = 0, drawSeconds = 0;
+        int visible = 0;
+        for (int i = -1; i < options.frames; i++) {
+            frame.setTo(cv::Scalar::all(128));
+            Clock::time_point start = Clock::now();
+            visible = instances.project(model.getVertices(), rotationVector, translationVector, cameraMatrix,
+                                        cv::Mat(), imageSize, buffers);
+            Clock::time_point projected = Clock::now();
+            rasterizer.clear();
+            instances.draw(rasterizer, model.getVertices().size(), buffers, cv::Scalar(255, 0, 0));
+            rasterizer.render(frame);
+            if (i >= 0) {
+                // the first frame only warms up buffers and the thread pool
+                projectSeconds += std::chrono::duration<double>(projected - start).count();
+                drawSeconds += std::chrono::duration<double>(Clock::now() - projected).count();
+            }
+        }
+        double seconds = (projectSeconds + drawSeconds) / std::max(options.frames, 1);
+        printf("%10d %10d %12.2f %12.2f %16.0f\n", count, visible, 1000 * projectSeconds / std::max(options.frames, 1),
+               1000 * drawSeconds / std::max(options.frames, 1), seconds > 0 ? count / seconds : 0.0);
+        if (seconds > FRAME_BUDGET) {
+            break;
+        }
+        withinBudget = count;
+    }
+    printf("%d instances fit the frame budget\n", withinBudget);
+    return 0;
+}
+
+int Benchmark::rasterizer(const Options &options) {
+    const int LINE_COUNTS[] = {1000, 10000, 100000};
+    const int THICKNESSES[] = {1, 3};
+    const float MAX_LENGTH = 64; // about the edge length of a wireframe that fills a third of the frame
+    cv::Size imageSize(options.width, options.height);
+    cv::Mat reference(imageSize, CV_8UC3), frame(imageSize, CV_8UC3), difference, differing;
+    LineRasterizer rasterizer;
+    rasterizer.setAntialiasing(options.antialias);
+    int lineType = options.antialias ? cv::LINE_AA : cv::LINE_8;
+
+    printf("##=== RASTERIZER BENCHMARK: %dx%d, lines up to %.0f px, %s ===##\n", imageSize.width, imageSize.height,
+           MAX_LENGTH, options.antialias ? "anti-aliased" : "aliased");
+    printf("%10s %10s %14s %16s %10s %16s\n", "lines", "thickness", "cv::line ms", "rasterizer ms", "speedup",
+           "differing px");
+    for (int count : LINE_COUNTS) {
+        cv::RNG rng(options.seed);
+        std::vector<cv::Point2f> a(count), b(count);
+        std::vector<cv::Scalar> colors(count);
+        for (int i = 0; i < count; i++) {
+            a[i] = cv::Point2f(rng.uniform(0.f, (float) imageSize.width - 1),
+                               rng.uniform(0.f, (float) imageSize.height - 1));
+            float angle = rng.uniform(0.f, (float) (2 * CV_PI)), length = rng.uniform(1.f, MAX_LENGTH);
+            b[i] = a[i] + length * cv::Point2f(std::cos(angle), std::sin(angle));
+            b[i].x = std::min(std::max(b[i].x, 0.f), (float) imageSize.width - 1);
+            b[i].y = std::min(std::max(b[i].y, 0.f), (float) imageSize.height - 1);
+            colors[i] = cv::Scalar(rng.uniform(0, 256), rng.uniform(0, 256), rng.uniform(0, 256));
+        }
+        for (int thickness : THICKNESSES) {
+            double referenceSeconds = 0, rasterizerSeconds = 0;
+            for (int f = -1; f < options.frames; f++) {
+                reference.setTo(cv::Scalar::all(128));
+                frame.setTo(cv::Scalar::all(128));
+                Clock::time_point start = Clock::now();
+                for (int i = 0; i < count; i++) {
+                    cv::line(reference, a[i], b[i], colors[i], thickness, lineType);
+                }
+                Clock::time_point drawn = Clock::now();
+                rasterizer.clear();
+                for (int i = 0; i < count; i++) {
+                    rasterizer.addLine(a[i], b[i], colors[i], thickness);
+                }
+                rasterizer.render(frame);
+                if (f >= 0) {
+                    // the first frame only warms up buffers and the thread pool
+                    referenceSeconds += std::chrono::duration<double>(drawn - start).count();
+                    rasterizerSeconds += std::chrono::duration<double>(Clock::now() - drawn).count();
+                }
+            }
+            // wide and anti-aliased lines are shaped differently from cv::line, only 1 px lines should match
+            cv::absdiff(reference, frame, difference);
+            cv::transform(difference, differing, cv::Matx13f(1, 1, 1));
+            int frames = std::max(options.frames, 1);
+            double speedup = rasterizerSeconds > 0 ? referenceSeconds / rasterizerSeconds : 0.0;
+            printf("%10d %10d %14.2f %16.2f %9.1fx %16d\n", count, thickness, 1000 * referenceSeconds / frames,
+                   1000 * rasterizerSeconds / frames, speedup, cv::countNonZero(differing));
+        }
+    }
+    return 0;
+}
+
+int Benchmark::perf(const Options &options, cv::Size patternSize) {
+    // the models are read from obj/ next to the baseline, so the check runs from any directory (ctest)
+    const std::string MODEL_DIRECTORY = (std::filesystem::path(options.baselinePath).parent_path() / "obj").string() +
+                                        "/";
+    std::string resolution = std::to_string(options.width) + "x" + std::to_string(options.height);
+
+    // tolerances are relative: fps may drop and p99 latency and memory growth may grow by that fraction
+    double tolerances[PERF_METRIC_COUNT] = {0.25, 0.5, 0.25};
+    std::map<std::string, PerfResult> baseline;
+    cv::FileStorage baselineFile(options.baselinePath, cv::FileStorage::READ);
+    if (baselineFile.isOpened()) {
+        if (!options.updateBaseline && ((std::string) baselineFile["resolution"] != resolution ||
+                                        (int) baselineFile["frames"] != options.frames ||
+                                        (std::string) baselineFile["detector"] != options.detector)) {
+            std::cerr << "ERROR: " << options.baselinePath << " was recorded with other settings ("
+                      << (std::string) baselineFile["resolution"] << ", " << (int) baselineFile["frames"]
+                      << " frames, " << (std::string) baselineFile["detector"] << " detector)" << std::endl;
+            return -1;
+        }
+        for (int k = 0; k < PERF_METRIC_COUNT; k++) {
+            cv::FileNode tolerance = baselineFile["tolerances"][PERF_METRICS[k]];
+            if (!tolerance.empty()) {
+                tolerances[k] = (double) tolerance;
+            }
+        }
+        cv::FileNode models = baselineFile["models"];
+        for (const char *name : PERF_MODELS) {
+            cv::FileNode model = models[name];
+            if (model.isMap()) {
+                for (int k = 0; k < PERF_METRIC_COUNT; k++) {
+                    baseline[name].values[k] = (double) model[PERF_METRICS[k]];
+                }
+            }
+        }
+    } else if (!options.updateBaseline) {
+        std::cerr << "ERROR: unable to read the baseline " << options.baselinePath << std::endl;
+        return -1;
+    }
+    if (options.tolerance >= 0) {
+        std::fill(tolerances, tolerances + PERF_METRIC_COUNT, options.tolerance);
+    }
+
+    Options cameraOptions = options;
+    cameraOptions.quiet = true;
+    Camera camera(patternSize, 5, cameraOptions);
+    ChessboardDetector::Method method;
+    ChessboardDetector::parseMethod(options.detector, method); // the camera already rejected unknown names
+    SyntheticScene::Settings settings = SyntheticScene::settingsFromOptions(options, patternSize);
+    std::map<std::string, PerfResult> results;
+    std::map<std::string, std::string> statuses;
+    bool passed = true;
+    printf("##=== PERF BENCHMARK: %s, %d frames per model, %s detector, baseline %s ===##\n", resolution.c_str(),
+           options.frames, options.detector.c_str(), options.baselinePath.c_str());
+    printf("%-12s %9s %9s %9s %9s %11s  %s\n", "model", "detected", "fps", "p50 ms", "p99 ms", "RSS +MB",
+           "status");
+    for (const char *name : PERF_MODELS) {
+        // memory is measured from here, what the model, its workspace and its frames add to the process
+        releaseFreedMemory();
+        double startRssMb = currentRssMb(), highestRssMb = startRssMb;
+        ObjectModel model;
+        if (!model.loadModel(MODEL_DIRECTORY + name + ".obj", patternSize.width, patternSize.height)) {
+            return -1;
+        }
+        // every model sees the same frames, rendered outside of the measurement
+        SyntheticScene scene(settings);
+        SyntheticFrame frame;
+        FrameWorkspace workspace;
+        workspace.detector.setMethod(method);
+        workspace.reserve(camera.getChessboardCornersWorld().size(), model.getVertices().size());
+        cv::Mat image;
+        std::vector<double> latencies;
+        PerfResult &result = results[name];
+        double seconds = 0;
+        for (int i = -1; i < options.frames; i++) {
+            scene.next(frame);
+            frame.image.copyTo(image);
+            Clock::time_point start = Clock::now();
+            bool found = camera.processFrame(image, workspace, scene.getCameraMatrix(),
+                                             scene.getDistortionCoefficients(), model);
+            double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+            highestRssMb = std::max(highestRssMb, currentRssMb());
+            if (i < 0) {
+                continue; // warms up buffers and the thread pool
+            }
+            seconds += elapsed;
+            latencies.push_back(1000 * elapsed);
+            result.detected += found;
+        }
+        std::sort(latencies.begin(), latencies.end());
+        result.values[0] = seconds > 0 ? latencies.size() / seconds : 0;
+        result.values[1] = percentile(latencies, 0.99);
+        result.values[2] = highestRssMb - startRssMb;
+        result.p50Ms = percentile(latencies, 0.5);
+
+        // a model without reference numbers fails the check, it could otherwise never regress
+        std::string status = options.updateBaseline ? "recorded" : "missing";
+        std::map<std::string, PerfResult>::const_iterator reference = baseline.find(name);
+        passed &= options.updateBaseline || reference != baseline.end();
+        if (!options.updateBaseline && reference != baseline.end()) {
+            const double *expected = reference->second.values;
+            bool regressed = result.values[0] < expected[0] * (1 - tolerances[0]) ||
+                             result.values[1] > expected[1] * (1 + tolerances[1]) ||
+                             result.values[2] > std::max(expected[2] * (1 + tolerances[2]),
+                                                         expected[2] + RSS_NOISE_MB);
+            status = regressed ? "regressed" : "pass";
+            passed &= !regressed;
+        }
+        statuses[name] = status;
+        printf("%-12s %4d/%-4d %9.1f %9.2f %9.2f %11.1f  %s\n", name, result.detected, options.frames,
+               result.values[0], result.p50Ms, result.values[1], result.values[2], status.c_str());
+        if (reference != baseline.end()) {
+            printf("%-12s %9s %9.1f %9s %9.2f %11.1f\n", "  baseline", "", reference->second.values[0], "",
+                   reference->second.values[1], reference->second.values[2]);
+        }
+    }
+
+    // the report is JSON so CI can keep one per build and plot the trend
+    cv::FileStorage report(options.reportPath, cv::FileStorage::WRITE | cv::FileStorage::FORMAT_JSON);
+    if (!report.isOpened()) {
+        std::cerr << "ERROR: unable to write " << options.reportPath << std::endl;
+        return -1;
+    }
+    time_t now = time(nullptr);
+    char timestamp[32];
+    strftime(timestamp, sizeof(timestamp), "%Y-%m-%dT%H:%M:%SZ", gmtime(&now));
+    report << "benchmark" << "perf" << "timestamp" << timestamp;
+#ifdef __VERSION__
+    report << "compiler" << __VERSION__;
+#endif
+    report << "resolution" << resolution << "frames" << options.frames << "detector" << options.detector;
+    report << "baseline" << options.baselinePath;
+    report << "tolerances" << "{";
+    for (int k = 0; k < PERF_METRIC_COUNT; k++) {
+        report << PERF_METRICS[k] << tolerances[k];
+    }
+    report << "}" << "models" << "{";
+    for (const char *name : PERF_MODELS) {
+        const PerfResult &result = results[name];
+        report << name << "{" << "detected" << result.detected << "p50Ms" << result.p50Ms;
+        for (int k = 0; k < PERF_METRIC_COUNT; k++) {
+            report << PERF_METRICS[k] << result.values[k];
+        }
+        if (baseline.count(name) > 0) {
+            report << "baseline" << "{";
+            for (int k = 0; k < PERF_METRIC_COUNT; k++) {
+                report << PERF_METRICS[k] << baseline[name].values[k];
+            }
+            report << "}";
+        }
+        report << "status" << statuses[name] << "}";
+    }
+    report << "}" << "status" << (passed ? "pass" : "regressed");
+    report.release();
+    std::cout << "Report written to " << options.reportPath << std::endl;
+
+    if (options.updateBaseline) {
+        cv::FileStorage output(options.baselinePath, cv::FileStorage::WRITE);
+        if (!output.isOpened()) {
+            std::cerr << "ERROR: unable to write " << options.baselinePath << std::endl;
+            return -1;
+        }
+        output << "resolution" << resolution << "frames" << options.frames << "detector" << options.detector;
+        output << "tolerances" << "{";
+        for (int k = 0; k < PERF_METRIC_COUNT; k++) {
+            output << PERF_METRICS[k] << tolerances[k];
+        }
+        output << "}" << "models" << "{";
+        for (const char *name : PERF_MODELS) {
+            output << name << "{";
+            for (int k = 0; k < PERF_METRIC_COUNT; k++) {
+                output << PERF_METRICS[k] << results[name].values[k];
+            }
+            output << "}";
+        }
+        output << "}";
+        std::cout << "Baseline written to " << options.baselinePath << std::endl;
+        return 0;
+    }
+    if (!passed) {
+        std::cerr << "Performance regressed against " << options.baselinePath
+                  << ", or a model has no reference numbers there (record them with --update-baseline)" << std::endl;
+    }
+    return passed ? 0 : 1;
+}
+
+int Benchmark::planar(const Options &options, cv::Size patternSize) {
+    const int REPEATS = 50; // both paths run this often per frame, one run takes microseconds
+    SyntheticScene scene(SyntheticScene::settingsFromOptions(options, patternSize));
+    const cv::Mat &cameraMatrix = scene.getCameraMatrix();
+    const cv::Mat &distortionCoefficients = scene.getDistortionCoefficients();
+    int rows = patternSize.width, cols = patternSize.height;
+    // same layout as Camera::buildBoardGeometry
+    std::vector<cv::Vec3f> boardWorld;
+    std::vector<cv::Point2f> boardPlane;
+    for (int x = 0; x < cols; x++) {
+        for (int y = 0; y < rows; y++) {
+            boardWorld.emplace_back(x, -y, 0);
+            boardPlane.emplace_back(x, -y);
+        }
+    }
+
+    // the planar content of the video and animation modes, and a dense planar mesh
+    struct Content {
+        std::string name;
+        std::vector<cv::Vec3f> points;
+        double pnpSeconds = 0, homographySeconds = 0;
+        double difference = 0, pnpError = 0, homographyError = 0; // largest distances in pixels
+    };
+    std::vector<Content> contents(4);
+    ObjectModel corners;
+    corners.loadModel("corners", rows, cols);
+    contents[0].name = "corners";
+    contents[0].points = corners.getVertices();
+    std::vector<std::vector<cv::Vec3f>> star = ObjectModel::starCoordinates(2, cv::Vec3f(1, -2, 0), 30);
+    contents[1].name = "star";
+    contents[1].points = star[0];
+    contents[1].points.insert(contents[1].points.end(), star[1].begin(), star[1].end());
+    contents[2].name = "overlay quad";
+    contents[2].points = {cv::Vec3f(-1, 1, 0), cv::Vec3f(cols, 1, 0), cv::Vec3f(cols, -rows, 0),
+                          cv::Vec3f(-1, -rows, 0)};
+    contents[3].name = "flat grid";
+    for (int i = 0; i < 100; i++) {
+        for (int j = 0; j < 100; j++) {
+            contents[3].points.emplace_back((cols - 1) * i / 99.f, -(rows - 1) * j / 99.f, 0.f);
+        }
+    }
+
+    ChessboardDetector detector(ChessboardDetector::OPENCV);
+    SyntheticFrame frame;
+    cv::Mat gray, rotationVector, translationVector;
+    std::vector<cv::Point2f> detected, pnpPoints, homographyPoints, truePoints;
+    int frames = 0;
+    for (int attempts = 0; frames < options.frames && attempts < 10 * options.frames; attempts++) {
+        scene.next(frame);
+        if (!frame.visible || !detector.find(frame.image, gray, patternSize, detected) ||
+            cv::findHomography(boardPlane, detected).empty()) {
+            continue;
+        }
+        for (Content &content : contents) {
+            Clock::time_point start = Clock::now();
+            for (int r = 0; r < REPEATS; r++) {
+                cv::solvePnP(boardWorld, detected, cameraMatrix, distortionCoefficients, rotationVector,
+                             translationVector);
+                cv::projectPoints(content.points, rotationVector, translationVector, cameraMatrix,
+                                  distortionCoefficients, pnpPoints);
+            }
+            Clock::time_point middle = Clock::now();
+            for (int r = 0; r < REPEATS; r++) {
+                cv::Matx33d homography = (cv::Matx33d) cv::findHomography(boardPlane, detected);
+                Transforms::projectPlanar(homography, content.points, homographyPoints);
+            }
+            content.pnpSeconds += std::chrono::duration<double>(middle - start).count() / REPEATS;
+            content.homographySeconds += std::chrono::duration<double>(Clock::now() - middle).count() / REPEATS;
+            // against the content projected with the pose and lens the frame was rendered with
+            cv::projectPoints(content.points, frame.rotationVector, frame.translationVector, cameraMatrix,
+                              distortionCoefficients, truePoints);
+            for (size_t i = 0; i < truePoints.size(); i++) {
+                content.difference = std::max(content.difference, cv::norm(pnpPoints[i] - homographyPoints[i]));
+                content.pnpError = std::max(content.pnpError, cv::norm(pnpPoints[i] - truePoints[i]));
+                content.homographyError = std::max(content.homographyError,
+                                                   cv::norm(homographyPoints[i] - truePoints[i]));
+            }
+        }
+        frames++;
+    }
+    if (frames == 0) {
+        std::cerr << "ERROR: the board was not found in any synthetic frame" << std::endl;
+        return -1;
+    }
+
+    printf("##=== PLANAR BENCHMARK: %dx%d board, %d synthetic frames ===##\n", patternSize.width,
+           patternSize.height, frames);
+    printf("%-13s %7s %11s %11s %11s %8s %10s %10s %10s\n", "content", "points", "pnp us", "homog. us",
+           "saving us", "speedup", "diff px", "pnp err", "homog. err");
+    for (const Content &content : contents) {
+        double pnpUs = 1e6 * content.pnpSeconds / frames, homographyUs = 1e6 * content.homographySeconds / frames;
+        printf("%-13s %7zu %11.1f %11.1f %11.1f %7.1fx %10.3f %10.3f %10.3f\n", content.name.c_str(),
+               content.points.size(), pnpUs, homographyUs, pnpUs - homographyUs,
+               homographyUs > 0 ? pnpUs / homographyUs : 0.0, content.difference, content.pnpError,
+               content.homographyError);
+    }
+    printf("Times per frame for the pose and projection of the content; errors are the largest distances in pixels\n"
+           "to the content projected with the true pose and lens, the homography leaves lens distortion out.\n");
+    return 0;
+}
+
+int Benchmark::arena(const Options &options, cv::Size patternSize) {
+    // the first frame hands out overflow blocks, the reset of the second one folds them into a single block
+    const int WARMUP_FRAMES = 2;
+    const char *MODES[] = {"opencv", "saddle", "harris"};
+    Options cameraOptions = options;
+    cameraOptions.quiet = true;
+    Camera camera(patternSize, 5, cameraOptions);
+    ObjectModel model;
+    if (!model.loadModel("axes", patternSize.width, patternSize.height)) {
+        return -1;
+    }
+    SyntheticScene::Settings settings = SyntheticScene::settingsFromOptions(options, patternSize);
+    bool passed = true;
+    printf("##=== ARENA CHECK: %dx%d frames, %d frames per mode after %d warm-up frames ===##\n",
+           settings.imageSize.width, settings.imageSize.height, options.frames, WARMUP_FRAMES);
+    printf("%-8s %12s %12s %14s  %s\n", "mode", "arena KB", "warm-up", "after warm-up", "status");
+    for (const char *mode : MODES) {
+        SyntheticScene scene(settings);
+        SyntheticFrame frame;
+        FrameWorkspace workspace;
+        ChessboardDetector::Method method;
+        bool harris = !ChessboardDetector::parseMethod(mode, method);
+        if (!harris) {
+            workspace.detector.setMethod(method);
+        }
+        workspace.reserve(camera.getChessboardCornersWorld().size(), model.getVertices().size());
+        cv::Mat image;
+        uint64_t warmupGrowths = 0;
+        for (int i = 0; i < WARMUP_FRAMES + options.frames; i++) {
+            scene.next(frame);
+            frame.image.copyTo(image);
+            if (harris) {
+                camera.processHarrisFrame(image, workspace);
+            } else {
+                camera.processFrame(image, workspace, scene.getCameraMatrix(), scene.getDistortionCoefficients(),
+                                    model);
+            }
+            if (i == WARMUP_FRAMES - 1) {
+                warmupGrowths = workspace.arena.growthCount();
+            }
+        }
+        // folds what the last frame took beyond the block
+        workspace.arena.reset();
+        uint64_t growths = workspace.arena.growthCount() - warmupGrowths;
+        passed &= growths == 0;
+        printf("%-8s %12.1f %12llu %14llu  %s\n", mode, workspace.arena.capacity() / 1024.0,
+               (unsigned long long) warmupGrowths, (unsigned long long) growths, growths == 0 ? "ok" : "GREW");
+    }
+    if (!passed) {
+        std::cerr << "ERROR: the scratch arena grew after warm-up, a frame needed more scratch than the first ones"
+                  << std::endl;
+    }
+    return passed ? 0 : 1;
+}
@@ -3,46 +3,143 @@
 // Nathaniel Haddad and Stephen Dorris
 //
 
+#include <algorithm>
+#include <chrono>
+#include <csignal>
+#include <condition_variable>
+#include <fstream>
+#include <future>
 #include <iostream>
+#include <map>
+#include <mutex>
+#include <thread>
 
 // OpenCV Libraries
 #include <opencv2/core.hpp>
 #include <opencv2/calib3d.hpp>
 #include <opencv2/highgui.hpp>
 #include <opencv2/imgproc/imgproc.hpp>
+#include <opencv2/videoio.hpp>
 #include <opencv2/calib3d/calib3d_c.h>
 
 // Local Includes
 #include "Camera.h"
+#include "FrameSource.h"
+#include "SessionState.h"
 #include "Utils.h"
 #include "ObjectModel.h"
+#include "TaskScheduler.h"
 #include "Transforms.h"
 
+namespace {
+
+volatile sig_atomic_t stopRequested = 0;
+
+void requestStop(int) {
+    stopRequested = 1;
+}
+
+}
+
 Camera::Camera() {
-    // open the video device
-    std::unique_ptr <cv::VideoCapture> tempCapDev(new cv::VideoCapture(0));
-    capdev = std::move(tempCapDev);
     m_minCalibrationCount = 5;
     m_rows = 6;
     m_cols = 9;
-    if (!capdev->isOpened()) {
-        printf("Unable to open video device\n");
-        exit(-1);
-    }
-    // get some properties of the image
-    cv::Size refS((int) capdev->get(cv::CAP_PROP_FRAME_WIDTH),
-                  (int) capdev->get(cv::CAP_PROP_FRAME_HEIGHT));
-    printf("Expected size: %d %d\n", refS.width, refS.height);
-    printf("CAMERA CREATED\n");
+    buildBoardGeometry();
+    openDevice();
 }
 
 Camera::Camera(cv::Size chessBoardCalibrationSize, int minCalibrationCount) {
-    // open the video device
-    std::unique_ptr <cv::VideoCapture> tempCapDev(new cv::VideoCapture(0));
-    capdev = std::move(tempCapDev);
     m_minCalibrationCount = minCalibrationCount;
     m_rows = chessBoardCalibrationSize.width;
     m_cols = chessBoardCalibrationSize.height;
+    buildBoardGeometry();
+    openDevice();
+}
+
+Camera::Camera(cv::Size chessBoardCalibrationSize, int minCalibrationCount, const Options &options)
+        : m_options(options) {
+    m_minCalibrationCount = minCalibrationCount;
+    m_rows = chessBoardCalibrationSize.width;
+    m_cols = chessBoardCalibrationSize.height;
+    m_verbose = !m_options.quiet;
+    m_workspace.stats.setReportInterval(m_options.statsInterval);
+    if (!ChessboardDetector::parseMethod(m_options.detector, m_detectorMethod)) {
+        std::cerr << "ERROR: unknown detector " << m_options.detector << std::endl;
+        exit(-1);
+    }
+    m_workspace.detector.setMethod(m_detectorMethod);
+    m_workspace.rasterizer.setAntialiasing(m_options.antialias);
+    m_workspace.motionGate.configure(m_options.motionGate, m_options.motionInterval);
+    m_workspace.quality.configure(m_options.targetFps, m_options.antialias);
+    m_workspace.quality.apply(m_workspace.detector, m_workspace.rasterizer, m_workspace.stats);
+    if (!AsyncRecorder::parsePolicy(m_options.recordPolicy, m_recordPolicy)) {
+        std::cerr << "ERROR: unknown record policy " << m_options.recordPolicy << std::endl;
+        exit(-1);
+    }
+    if (!m_options.boards.empty()) {
+        m_boardTracker.reset(new MultiBoardTracker());
+        if (!m_boardTracker->configure(m_options.boards, m_options.boardModels, m_detectorMethod)) {
+            std::cerr << "ERROR: could not set up the boards " << m_options.boards << std::endl;
+            exit(-1);
+        }
+    }
+    buildBoardGeometry();
+    if (m_options.mode.empty()) {
+        openDevice();
+    }
+    if (m_options.mode == "replay") {
+        m_replay.reset(new SessionReader());
+        if (!m_replay->open(m_options.replayPath) || !m_replay->seek(m_options.replayStart)) {
+            std::cerr << "ERROR: could not replay " << m_options.replayPath << " from frame "
+                      << m_options.replayStart << std::endl;
+            exit(-1);
+        }
+        std::cout << "Replaying " << m_replay->frameCount() - m_options.replayStart << " frames of "
+                  << m_options.replayPath << std::endl;
+    }
+    if (!m_options.frameShm.empty()) {
+        // with --frame-keyframe the frames between whole frames only carry the tiles that changed
+        m_frameSink.reset(new SharedFrameSink(m_options.frameShm, m_options.frameSlots,
+                                              m_options.frameKeyframe > 1 ? FRAME_TILE_SIZE : 0));
+    }
+    if (m_options.headless) {
+        // without a window there is no 'q' key, stop cleanly so the shared memory segments are unlinked
+        signal(SIGINT, requestStop);
+        signal(SIGTERM, requestStop);
+    }
+    if (!m_options.poseShm.empty()) {
+        m_posePublisher.reset(new PosePublisher());
+        if (!m_posePublisher->open(m_options.poseShm, m_options.poseSlots)) {
+            exit(-1);
+        }
+    }
+}
+
+Camera::~Camera() {
+    if (m_pendingDevice.valid()) {
+        m_pendingDevice.wait();
+    }
+    if (m_pendingCalibration.valid()) {
+        m_pendingCalibration.wait();
+    }
+}
+
+void Camera::openDevice() {
+    // opening a device takes from a few hundred milliseconds to seconds, the prompts and file loading run meanwhile
+    m_pendingDevice = TaskScheduler::instance().async(TaskScheduler::BLOCKING, [this]() {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        std::unique_ptr<cv::VideoCapture> device(new cv::VideoCapture(0));
+        m_deviceOpenMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        return device;
+    });
+}
+
+void Camera::waitForDevice() {
+    if (!m_pendingDevice.valid()) {
+        return;
+    }
+    capdev = m_pendingDevice.get();
     if (!capdev->isOpened()) {
         printf("Unable to open video device\n");
         exit(-1);
@@ -56,18 +153,28 @@ Camera::Camera(cv::Size chessBoardCalibrationSize, int minCalibrationCount) {
 
 void Camera::run() {
 
+    if (m_options.mode == "offline") {
+        startOffline();
+        return;
+    }
+    if (m_options.mode == "replay") {
+        startVideo();
+        return;
+    }
+
     std::cout << "Welcome to CV-NINJAS AR Immersive 2D to 3D EXPERIENCE!\n"
                  "Please select an option below:\n"
                  "1 - setup mode (calibrate with THIS camera)\n"
                  "2 - setup mode from files (calibrate with ANY camera)\n"
                  "3 - video mode (using axes, corners, and obj file visualizations)\n"
                  "4 - video mode (with harris corners, detection only)\n"
-                 "5 - video mode (with animated stars!)" << std::endl;
+                 "5 - video mode (with animated stars!)\n"
+                 "6 - offline mode (render a recorded video or image directory)" << std::endl;
     char c;
     do {
         std::cout << "Please enter you selection: ";
         std::cin >> c;
-    } while (!std::cin.fail() && c != '1' && c != '2' && c != '3' && c != '4' && c != '5');
+    } while (!std::cin.fail() && c != '1' && c != '2' && c != '3' && c != '4' && c != '5' && c != '6');
 
     if (c == '1') {
         setup();
@@ -79,11 +186,23 @@ void Camera::run() {
         startVideoWithHarrisCorners();
     } else if (c == '5') {
         animateTriangle();
+    } else if (c == '6') {
+        std::cout << "Please type the path to the video file or image directory, then press ENTER" << std::endl;
+        std::cin >> m_options.inputPath;
+        std::cout << "Enter the file path of the intrinsic parameters, then press enter" << std::endl;
+        std::cin >> m_options.intrinsicsPath;
+        std::cout << "Enter the model to render (corners, axes or a path to an obj file), then press enter"
+                  << std::endl;
+        std::cin >> m_options.model;
+        std::cout << "Enter the path of the output video, then press enter" << std::endl;
+        std::cin >> m_options.outputPath;
+        startOffline();
     }
 }
 
 void Camera::setup() {
     std::cout << "Starting setup" << std::endl;
+    waitForDevice();
     std::cout << "Press d to detect corners\n"
                  "Press s to save image for calibration\n"
                  "Press c to calibrate\n"
@@ -98,15 +217,20 @@ void Camera::setup() {
             printf("frame is empty\n");
             break;
         }
+        m_workspace.images.reset(frame);
 
         if (displayFlag) {
-            std::vector <cv::Point2f> corners = getChessboardCorners(frame, frame);
-            if (corners.size() > 0) {
-                cv::drawChessboardCorners(frame, cv::Size(m_rows, m_cols), corners, true);
+            if (getChessboardCorners(frame, m_workspace)) {
+                cv::drawChessboardCorners(frame, cv::Size(m_rows, m_cols), m_workspace.corners, true);
             }
         }
 
         cv::imshow("Video", frame);
+        if (m_pendingCalibration.valid() &&
+            m_pendingCalibration.wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+            finishCalibration();
+            std::cout << "Camera calibration complete" << std::endl;
+        }
 
         // see if there is a waiting keystroke
         char key = cv::waitKey(1);
@@ -119,8 +243,8 @@ void Camera::setup() {
                 std::cout << "Could not use image for calibration" << std::endl;
             }
         } else if (key == 'c') {
-            if (calibrate(frame)) {
-                std::cout << "Camera calibration complete" << std::endl;
+            if (startCalibration(frame.size())) {
+                std::cout << "Calibrating, the video keeps running meanwhile" << std::endl;
             } else {
                 std::cout << "Could not complete camera calibration" << std::endl;
             }
@@ -128,6 +252,9 @@ void Camera::setup() {
             break;
         }
     }
+    if (finishCalibration()) {
+        std::cout << "Camera calibration complete" << std::endl;
+    }
     std::cout << "Ending calibration" << std::endl;
 }
 
@@ -144,6 +271,7 @@ void Camera::setupFromFiles() {
             std::cerr << "ERROR: image is empty" << std::endl;
             exit(-1);
         }
+        m_workspace.images.reset(image);
         if (addChessBoardCalibrationImage(image)) {
             std::cout << "Using image for calibration" << std::endl;
             remaining -= 1;
@@ -176,11 +304,16 @@ void Camera::startImage() {
     std::vector <cv::Mat> extrinsicParameters = Utils::loadIntrinsicParameters(filename);
     cv::Mat cameraMatrix = extrinsicParameters[0];
     cv::Mat distortionCoefficients = extrinsicParameters[1];
+    if (m_options.undistort) {
+        m_undistortMap.prepare(filename, cameraMatrix, distortionCoefficients, image.size());
+        distortionCoefficients = UndistortMap::getDistortionCoefficients();
+        undistortFrame(image, m_workspace);
+    }
+    m_workspace.images.reset(image);
 
     if (objModel.setObjectModel()) {
-        std::vector <cv::Point2f> corners = getChessboardCorners(image, image);
-        if (corners.size() > 0) {
-            projectPoints(image, corners, cameraMatrix, distortionCoefficients, objModel);
+        if (getChessboardCorners(image, m_workspace)) {
+            projectPoints(image, m_workspace, cameraMatrix, distortionCoefficients, objModel);
         }
         cv::imshow("CV-NINJAS AR", image);
         cv::waitKey();
@@ -190,51 +323,439 @@ void Camera::startImage() {
     std::cout << "Ending application" << std::endl;
 }
 
+void Camera::startOffline() {
+    FrameSource source;
+    if (!source.open(m_options.inputPath)) {
+        std::cerr << "ERROR: could not open " << m_options.inputPath << std::endl;
+        exit(-1);
+    }
+    std::vector <cv::Mat> intrinsicParameters = Utils::loadIntrinsicParameters(m_options.intrinsicsPath);
+    cv::Mat cameraMatrix = intrinsicParameters[0];
+    cv::Mat distortionCoefficients = intrinsicParameters[1];
+    if (cameraMatrix.empty()) {
+        std::cerr << "ERROR: could not load intrinsic parameters" << std::endl;
+        exit(-1);
+    }
+    // with --undistort the workers see undistorted frames and everything after detection is pinhole only
+    cv::Mat sourceDistortion = distortionCoefficients;
+    if (m_options.undistort) {
+        distortionCoefficients = UndistortMap::getDistortionCoefficients();
+    }
+    ObjectModel baseModel;
+    openOverlay();
+    // with --overlay and no model only the overlay is drawn
+    if ((!m_overlay || !m_options.model.empty()) && !baseModel.loadModel(m_options.model, m_rows, m_cols)) {
+        exit(-1);
+    }
+    buildInstances(baseModel);
+    std::string posePath = m_options.outputPath + ".poses.csv";
+    std::ofstream poseFile(posePath);
+    poseFile << "frame,found,rx,ry,rz,tx,ty,tz\n";
+
+    // the frames are tasks of the shared scheduler, one workspace per worker is enough to keep every worker busy
+    TaskScheduler &scheduler = TaskScheduler::instance();
+    size_t workerCount = scheduler.workerCount();
+    size_t maxInFlight = workerCount * 2; // bounds memory used by decoded and reordered frames
+    m_verbose = false;
+    std::cout << "Rendering " << m_options.inputPath << " with " << workerCount << " worker(s)" << std::endl;
+
+    struct RenderedFrame {
+        cv::Mat frame;
+        std::vector <cv::Point2f> corners; // empty if the board was not found
+        cv::Mat rotationVector, translationVector;
+    };
+    std::mutex mutex;
+    std::condition_variable outputReady, slotFree;
+    std::vector <FrameWorkspace> workspaces(workerCount); // nothing in a workspace is shared between frames
+    std::vector <FrameWorkspace *> freeWorkspaces;
+    for (FrameWorkspace &workspace : workspaces) {
+        workspace.detector.setMethod(m_detectorMethod);
+        workspace.rasterizer.setAntialiasing(m_options.antialias);
+        workspace.reserve(m_boardWorld.size(), baseModel.getVertices().size());
+        freeWorkspaces.push_back(&workspace);
+    }
+    std::map <size_t, RenderedFrame> finished; // augmented frames waiting for their turn to be encoded
+    size_t framesRead = 0, framesWritten = 0;
+    bool endOfInput = false;
+
+    auto render = [&](size_t index, const cv::Mat &frame, FrameWorkspace &workspace) {
+        RenderedFrame rendered;
+        rendered.frame = frame;
+        // the live loop spins custom models by 0.1 rad per frame (spinModel), derive the same angle from the frame
+        // index instead; the workers share baseModel read-only and turn its vertices while projecting
+        cv::Matx33f turn = Transforms::rotateZ3x3(0.1 * index);
+        bool turned = baseModel.getObjectType() == "custom";
+        workspace.arena.reset();
+        workspace.dirty = cv::Rect();
+        if (m_options.undistort) {
+            undistortFrame(rendered.frame, workspace);
+        }
+        workspace.images.reset(rendered.frame);
+        if (getChessboardCorners(rendered.frame, workspace)) {
+            projectPoints(rendered.frame, workspace, cameraMatrix, distortionCoefficients, baseModel, false,
+                          turned ? &turn : nullptr);
+            rendered.corners = workspace.corners;
+            rendered.rotationVector = workspace.rotationVector.clone();
+            rendered.translationVector = workspace.translationVector.clone();
+        }
+        {
+            std::lock_guard <std::mutex> lock(mutex);
+            finished.emplace(index, std::move(rendered));
+            freeWorkspaces.push_back(&workspace);
+        }
+        outputReady.notify_all();
+        slotFree.notify_one();
+    };
+
+    auto writer = [&]() {
+        cv::VideoWriter video;
+        FrameWorkspace poseWorkspace;
+        for (;;) {
+            RenderedFrame rendered;
+            {
+                std::unique_lock <std::mutex> lock(mutex);
+                outputReady.wait(lock, [&]() {
+                    return finished.count(framesWritten) > 0 || (endOfInput && framesWritten == framesRead);
+                });
+                auto it = finished.find(framesWritten);
+                if (it == finished.end()) {
+                    return;
+                }
+                rendered = std::move(it->second);
+                finished.erase(it);
+            }
+            if (!video.isOpened()) {
+                video.open(m_options.outputPath, cv::VideoWriter::fourcc('m', 'p', '4', 'v'), source.getFps(),
+                           rendered.frame.size());
+                if (!video.isOpened()) {
+                    std::cerr << "ERROR: could not open " << m_options.outputPath << " for writing" << std::endl;
+                    exit(-1);
+                }
+            }
+            video.write(rendered.frame);
+            bool found = !rendered.corners.empty();
+            poseFile << framesWritten << "," << found;
+            for (const cv::Mat &vector : {rendered.rotationVector, rendered.translationVector}) {
+                for (int i = 0; i < 3; i++) {
+                    poseFile << "," << (found ? vector.at<double>(i) : 0.0);
+                }
+            }
+            poseFile << "\n";
+            // media time keeps offline timestamps reproducible
+            poseWorkspace.corners.swap(rendered.corners);
+            poseWorkspace.rotationVector = rendered.rotationVector;
+            poseWorkspace.translationVector = rendered.translationVector;
+            if (m_posePublisher) {
+                collectPoses(framesWritten, (uint64_t) (framesWritten * 1e9 / source.getFps()), poseWorkspace,
+                             cameraMatrix, distortionCoefficients);
+                publishPose(poseWorkspace);
+            }
+            {
+                std::lock_guard <std::mutex> lock(mutex);
+                framesWritten++;
+            }
+            slotFree.notify_one();
+        }
+    };
+
+    auto start = std::chrono::steady_clock::now();
+    // the encoder blocks on file I/O, it runs on the blocking lane instead of holding a worker
+    std::future<void> writing = scheduler.async(TaskScheduler::BLOCKING, writer);
+    TaskScheduler::TaskGroup frames(TaskScheduler::HIGH);
+    for (;;) {
+        cv::Mat frame; // a fresh buffer per frame, workers still hold the previous ones
+        if (!source.read(frame)) {
+            break;
+        }
+        if (m_options.undistort && framesRead == 0) {
+            // before the first frame is handed out, the workers only read the maps
+            m_undistortMap.prepare(m_options.intrinsicsPath, cameraMatrix, sourceDistortion, frame.size());
+        }
+        std::unique_lock <std::mutex> lock(mutex);
+        slotFree.wait(lock, [&]() { return framesRead - framesWritten < maxInFlight && !freeWorkspaces.empty(); });
+        FrameWorkspace *workspace = freeWorkspaces.back();
+        freeWorkspaces.pop_back();
+        size_t index = framesRead++;
+        lock.unlock();
+        if (m_overlay) {
+            // each frame takes the clip frame of its turn along, the workers render out of order
+            m_overlay->advance();
+            workspace->overlay.texture = m_overlay->texture();
+        }
+        frames.run([&render, index, frame, workspace]() { render(index, frame, *workspace); });
+    }
+    frames.wait();
+    {
+        std::lock_guard <std::mutex> lock(mutex);
+        endOfInput = true;
+    }
+    outputReady.notify_all();
+    writing.get();
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    m_verbose = !m_options.quiet;
+    std::cout << "Rendered " << framesWritten << " frames in " << seconds << " s ("
+              << (seconds > 0 ? framesWritten / seconds : 0.0) << " fps)" << std::endl;
+    std::cout << "Wrote " << m_options.outputPath << " and " << posePath << std::endl;
+    scheduler.report();
+}
+
 void Camera::startVideo() {
-    cv::namedWindow("Video", 1); // identifies a window
+    if (!m_options.headless) {
+        cv::namedWindow("Video", 1); // identifies a window
+    }
     cv::Mat frame;
-    std::string filename;
     ObjectModel objModel;
+    SessionState session;
+    if (m_options.resume && !session.load(m_options.statePath)) {
+        std::cerr << "ERROR: no saved session in " << m_options.statePath << ", starting without it" << std::endl;
+        session = SessionState();
+    }
     // load in intrinsic parameters
-    std::cout << "Enter the file path of the intrinsic parameters, then press enter" << std::endl;
-    std::cin >> filename;
-    std::vector <cv::Mat> extrinsicParameters = Utils::loadIntrinsicParameters(filename);
+    std::string filename = !m_options.intrinsicsPath.empty() ? m_options.intrinsicsPath : session.intrinsicsPath;
+    // a replay brings the intrinsics it was recorded with, unless another file is given
+    bool replayIntrinsics = m_replay && filename.empty();
+    if (filename.empty() && !replayIntrinsics) {
+        std::cout << "Enter the file path of the intrinsic parameters, then press enter" << std::endl;
+        std::cin >> filename;
+    }
+    // the intrinsics are parsed and the device keeps opening while the model is chosen and loaded
+    double intrinsicsMs = 0;
+    std::future<std::vector<cv::Mat>> intrinsics;
+    if (!replayIntrinsics) {
+        intrinsics = TaskScheduler::instance().async(TaskScheduler::BLOCKING, [filename, &intrinsicsMs]() {
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            std::vector<cv::Mat> parameters = Utils::loadIntrinsicParameters(filename);
+            intrinsicsMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            return parameters;
+        });
+    }
+    std::chrono::steady_clock::time_point modelStart = std::chrono::steady_clock::now();
+    // with --boards every board brings its own model
+    std::string modelName = m_options.model;
+    if (modelName.empty()) {
+        modelName = m_replay ? m_replay->getModel() : session.model;
+    }
+    // with --mesh-budget an obj model is streamed in chunks and shown while it is read
+    bool streamed = m_options.meshBudget > 0 && !m_boardTracker && !modelName.empty() && modelName != "corners" &&
+                    modelName != "axes";
+    if (streamed) {
+        m_chunkedMesh.reset(new ChunkedMesh());
+    }
+    openOverlay();
+    // with --overlay and no model only the overlay is drawn
+    bool overlayOnly = m_overlay && modelName.empty();
+    bool modelLoaded = m_boardTracker || overlayOnly || (streamed ? m_chunkedMesh->open(modelName, m_options.meshBudget)
+                                                   : modelName.empty() ? objModel.setObjectModel()
+                                                                       : objModel.loadModel(modelName, m_rows, m_cols));
+    double modelMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - modelStart).count();
+    std::vector <cv::Mat> extrinsicParameters;
+    if (replayIntrinsics) {
+        extrinsicParameters = {m_replay->getCameraMatrix(), m_replay->getDistortionCoefficients()};
+    } else {
+        extrinsicParameters = intrinsics.get();
+    }
     cv::Mat cameraMatrix = extrinsicParameters[0];
     cv::Mat distortionCoefficients = extrinsicParameters[1];
-    if (objModel.setObjectModel()) {
+    std::string modelDescription = streamed ? modelName
+                                            : objModel.getObjectType() == "custom" ? objModel.getPath()
+                                                                                   : objModel.getObjectType();
+    waitForDevice();
+    // with --undistort the maps are prepared from the frames actually delivered, the device may report another size
+    cv::Mat lensDistortion = distortionCoefficients;
+    if (m_options.undistort) {
+        distortionCoefficients = UndistortMap::getDistortionCoefficients();
+    }
+    if (modelLoaded) {
+        buildInstances(objModel);
+        FrameWorkspace &workspace = m_workspace;
+        workspace.reserve(m_boardWorld.size(), objModel.getVertices().size());
+        if (workspace.quality.enabled() && objModel.getObjectType() == "custom") {
+            objModel.buildLevelsOfDetail(QualityController::MESH_LEVELS);
+        }
+        if (!m_boardTracker && !session.boardRegion.empty()) {
+            // warm start: the board is looked for where the last session left it, from the pose it had there
+            // grown like a tracking window, the detector also needs the squares around the inner corners
+            cv::Rect region = session.boardRegion;
+            int margin = std::max(region.width, region.height) / 4 + 16;
+            workspace.searchHint = cv::Rect(region.x - margin, region.y - margin, region.width + 2 * margin,
+                                            region.height + 2 * margin);
+            if (!session.rotationVector.empty()) {
+                session.rotationVector.copyTo(workspace.rotationVector);
+                session.translationVector.copyTo(workspace.translationVector);
+                workspace.poseIsGuess = true;
+            }
+        }
+        bool overlayShown = false;
+        if (!m_options.recordPath.empty()) {
+            m_recorder.reset(new AsyncRecorder());
+            if (!m_recorder->open(m_options.recordPath, m_replay ? m_replay->getFps() : capdev->get(cv::CAP_PROP_FPS),
+                                  m_recordPolicy, m_options.recordBuffers)) {
+                exit(-1);
+            }
+        }
+        if (!m_options.sessionPath.empty()) {
+            // raw frames are recorded before undistortion, with the intrinsics as loaded
+            m_sessionRecorder.reset(new SessionRecorder());
+            if (!m_sessionRecorder->open(m_options.sessionPath, m_options.sessionCodec, m_options.sessionChunk,
+                                         m_options.recordBuffers, extrinsicParameters[0], extrinsicParameters[1],
+                                         modelDescription)) {
+                exit(-1);
+            }
+        }
+        // the pose stream, the recorders and the replay report read the pose of every frame
+        m_poseNeeded = m_posePublisher || m_recorder || m_sessionRecorder || m_replay;
+        SessionFrame recorded;
+        ReplayReport replayReport;
+        std::chrono::steady_clock::time_point loopStart = std::chrono::steady_clock::now();
         for (;;) {
-            (*capdev) >> frame; // get a new frame from the camera, treat as a stream
+            workspace.stats.beginFrame();
+            workspace.arena.reset();
+            workspace.dirty = cv::Rect();
+            workspace.stats.beginStage(FrameStats::CAPTURE);
+            if (m_replay) {
+                if (!m_replay->read(frame, recorded)) {
+                    frame.release();
+                }
+            } else {
+                (*capdev) >> frame; // get a new frame from the camera, treat as a stream
+            }
+            workspace.stats.endStage(FrameStats::CAPTURE);
+            uint64_t timestampNs = m_replay ? recorded.timestampNs : PosePublisher::nowNanoseconds();
+            uint64_t frameId = m_replay ? recorded.frameId : m_frameId++;
             if (frame.empty()) {
+                if (m_replay) {
+                    break; // end of the recorded session
+                }
                 std::cerr << "ERROR: frame is empty" << std::endl;
                 exit(-1);
             }
-            std::vector <cv::Point2f> corners = getChessboardCorners(frame, frame);
-            if (corners.size() > 0) {
-                projectPoints(frame, corners, cameraMatrix, distortionCoefficients, objModel);
+            int sessionSlot = m_sessionRecorder ? m_sessionRecorder->acquire(frame, frameId, timestampNs) : -1;
+            if (m_overlay) {
+                // a clip plays one frame per camera frame
+                m_overlay->advance();
+                workspace.overlay.texture = m_overlay->texture();
+            }
+            if (m_options.undistort) {
+                if (frame.size() != m_undistortMap.getImageSize()) {
+                    m_undistortMap.prepare(filename, cameraMatrix, lensDistortion, frame.size());
+                }
+                undistortFrame(frame, workspace);
+            }
+            workspace.images.reset(frame);
+            // while nothing moves the corners and pose of the last detection are reused, only the overlay is redrawn;
+            // the quality controller may also space detections out
+            bool reused = !m_boardTracker && workspace.motionGate.isStatic(workspace.images) &&
+                          !workspace.corners.empty();
+            reused = (workspace.quality.skipDetection() && !m_boardTracker && !workspace.corners.empty()) || reused;
+            if (m_boardTracker) {
+                trackBoards(frame, workspace, cameraMatrix, distortionCoefficients);
+            } else if (reused) {
+                workspace.stats.reuseDetection();
+                spinModel(workspace, objModel);
+                projectPoints(frame, workspace, cameraMatrix, distortionCoefficients, objModel, true);
+            } else if (getChessboardCorners(frame, workspace)) {
+                workspace.motionGate.accept();
+                spinModel(workspace, objModel);
+                projectPoints(frame, workspace, cameraMatrix, distortionCoefficients, objModel);
             }
-            cv::imshow("Video", frame);
-            // see if there is a waiting keystroke
-            if (cv::waitKey(1) == 'q') {
+            if (m_poseNeeded) {
+                collectPoses(frameId, timestampNs, workspace, cameraMatrix, distortionCoefficients);
+            }
+            publishPose(workspace);
+            workspace.stats.beginStage(FrameStats::PRESENT);
+            presentFrame("Video", frame, frameId, timestampNs);
+            if (!overlayShown && !workspace.dirty.empty()) {
+                overlayShown = true;
+                double elapsedMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() -
+                                                                             m_startTime).count();
+                printf("Time to first overlay: %.0f ms (device %.0f ms, intrinsics %.0f ms, model %.0f ms, "
+                       "%llu frames)\n", elapsedMs, m_deviceOpenMs, intrinsicsMs, modelMs,
+                       (unsigned long long) frameId + 1);
+            }
+            if (m_recorder) {
+                // only a copy into a pooled buffer, the encoder thread does the rest
+                bool recorded = m_recorder->submit(frame, frameId, timestampNs, workspace.poses);
+                workspace.stats.countRecorder(m_recorder->queueDepth(), !recorded);
+            }
+            // see if there is a waiting keystroke; a headless replay runs as fast as the frames are processed
+            int key = waitKey(m_replay && m_options.headless ? 0 : 1);
+            workspace.stats.endStage(FrameStats::PRESENT);
+            workspace.stats.setArena(workspace.arena.capacity(), workspace.arena.growthCount());
+            if (workspace.stats.endFrame()) {
+                TaskScheduler::instance().report();
+            }
+            if (m_sessionRecorder) {
+                m_sessionRecorder->commit(sessionSlot, workspace.poses, workspace.poseCorners, workspace.stats);
+            }
+            if (m_replay) {
+                replayReport.add(recorded, workspace.poses, workspace.stats);
+            }
+            if (workspace.quality.update(workspace.stats)) {
+                workspace.quality.apply(workspace.detector, workspace.rasterizer, workspace.stats);
+            }
+            if (key == 'q') {
                 break;
             }
         }
+        if (m_recorder) {
+            m_recorder->close();
+        }
+        if (m_sessionRecorder) {
+            m_sessionRecorder->close();
+        }
+        if (m_chunkedMesh) {
+            m_chunkedMesh->close();
+        }
+        if (m_replay) {
+            replayReport.print(std::chrono::duration<double>(std::chrono::steady_clock::now() - loopStart).count());
+        }
+        session.intrinsicsPath = filename;
+        session.model = modelDescription;
+        if (!m_boardTracker && !workspace.corners.empty()) {
+            if (!m_poseNeeded) {
+                // planar content may have skipped the pose of the last corners
+                workspace.poseIsGuess = false;
+                solvePose(workspace, cameraMatrix, distortionCoefficients);
+            }
+            session.boardRegion = cv::boundingRect(workspace.corners);
+            session.rotationVector = workspace.rotationVector.clone();
+            session.translationVector = workspace.translationVector.clone();
+        }
+        if (!m_boardTracker && !m_replay && session.save(m_options.statePath)) {
+            std::cout << "Saved the session to " << m_options.statePath << " (continue it with --resume)" << std::endl;
+        }
     }
     std::cout << "Ending application" << std::endl;
 }
 
 void Camera::startVideoWithHarrisCorners() {
-    cv::namedWindow("Video", 1); // identifies a window
+    waitForDevice();
+    if (!m_options.headless) {
+        cv::namedWindow("Video", 1); // identifies a window
+    }
     cv::Mat frame;
     for (;;) {
+        m_workspace.stats.beginFrame();
+        m_workspace.stats.beginStage(FrameStats::CAPTURE);
         (*capdev) >> frame; // get a new frame from the camera, treat as a stream
+        m_workspace.stats.endStage(FrameStats::CAPTURE);
+        uint64_t timestampNs = PosePublisher::nowNanoseconds();
+        uint64_t frameId = m_frameId++;
         if (frame.empty()) {
             std::cerr << "ERROR: frame is empty" << std::endl;
             exit(-1);
         }
-        harrisCorners(frame);
-        cv::imshow("Video", frame);
+        processHarrisFrame(frame, m_workspace);
+        m_workspace.stats.beginStage(FrameStats::PRESENT);
+        presentFrame("Video", frame, frameId, timestampNs);
         // see if there is a waiting keystroke
-        if (cv::waitKey(1) == 'q') {
+        int key = waitKey(1);
+        m_workspace.stats.endStage(FrameStats::PRESENT);
+        m_workspace.stats.setArena(m_workspace.arena.capacity(), m_workspace.arena.growthCount());
+        if (m_workspace.stats.endFrame()) {
+            TaskScheduler::instance().report();
+        }
+        if (key == 'q') {
             std::cout << "Ending application" << std::endl;
             break;
         }
@@ -242,44 +763,90 @@ void Camera::startVideoWithHarrisCorners() {
     std::cout << "Ending application" << std::endl;
 }
 
-std::vector <cv::Point2f> Camera::getChessboardCorners(cv::Mat src, cv::Mat dst) {
-    std::vector <cv::Point2f> corners;
-    std::cout << "Finding chessboard...";
-    bool found = cv::findChessboardCorners(src, cv::Size(m_rows, m_cols), corners, cv::CALIB_CB_ADAPTIVE_THRESH);
+void Camera::buildInstances(const ObjectModel &objModel) {
+    if (m_options.instances <= 0 || objModel.getObjectType() != "custom") {
+        return;
+    }
+    m_instances.reset(new ModelInstances(objModel.getIndices()));
+    cv::RNG rng(m_options.seed);
+    if (!m_instances->layout(m_options.instanceLayout, objModel.getVertices(), m_options.instances, m_rows, m_cols,
+                             rng)) {
+        std::cerr << "ERROR: unknown instance layout " << m_options.instanceLayout << std::endl;
+        exit(-1);
+    }
+    std::cout << "Drawing " << m_instances->size() << " copies of " << m_instances->getEdgeCount() << " edges"
+              << std::endl;
+}
+
+void Camera::openOverlay() {
+    if (m_options.overlay.empty()) {
+        return;
+    }
+    if (m_boardTracker) {
+        std::cerr << "ERROR: --overlay is drawn on a single board, not with --boards" << std::endl;
+        exit(-1);
+    }
+    m_overlay.reset(new PlanarOverlay());
+    // the whole board: one square beyond the inner corners on every side
+    if (!m_overlay->open(m_options.overlay, cv::Rect2f(-1.f, (float) -m_rows, m_cols + 1.f, m_rows + 1.f))) {
+        exit(-1);
+    }
+}
+
+void Camera::undistortFrame(cv::Mat &frame, FrameWorkspace &workspace) {
+    workspace.stats.beginStage(FrameStats::UNDISTORT);
+    workspace.images.undistort(frame, m_undistortMap);
+    workspace.stats.endStage(FrameStats::UNDISTORT);
+}
+
+bool Camera::getChessboardCorners(const cv::Mat &src, FrameWorkspace &workspace) {
+    workspace.stats.beginStage(FrameStats::DETECT);
+    if (m_verbose) {
+        std::cout << "Finding chessboard...";
+    }
+    cv::Size patternSize(m_rows, m_cols);
+    cv::Rect hint = workspace.searchHint;
+    workspace.searchHint = cv::Rect();
+    bool found = !hint.empty() && workspace.detector.find(workspace.images, hint, patternSize, workspace.corners);
+    if (!found) {
+        found = workspace.detector.find(workspace.images, cv::Rect(), patternSize, workspace.corners);
+    }
     if (found) {
-        std::cout << "found" << std::endl;
-        std::cout << "numCorners: " << corners.size() << std::endl;
-        std::cout << "firstCorner: " << corners[0] << std::endl;
-        cv::Mat gray;
-        cv::cvtColor(src, gray, cv::COLOR_BGR2GRAY);
-        // size 11,11 , zero region null
-        cv::cornerSubPix(gray, corners, cv::Size(11, 11), cv::Size(-1, -1),
-                         cv::TermCriteria(cv::TermCriteria::EPS + cv::TermCriteria::COUNT, 30, 0.0001));
+        if (m_verbose) {
+            std::cout << "found" << std::endl;
+            std::cout << "numCorners: " << workspace.corners.size() << std::endl;
+            std::cout << "firstCorner: " << workspace.corners[0] << std::endl;
+        }
     } else {
-        corners.clear();
-        std::cout << "not found" << std::endl;
+        if (m_verbose) {
+            std::cout << "not found" << std::endl;
+        }
     }
-    return corners;
+    workspace.stats.endStage(FrameStats::DETECT);
+    return found;
 }
 
-std::vector <cv::Vec3f> Camera::getChessboardCornersWorld() {
-    std::vector <cv::Vec3f> points;
-    std::cout << "Getting chessboard corners world...";
+void Camera::buildBoardGeometry() {
+    m_boardWorld.clear();
+    m_boardWorld.reserve(m_rows * m_cols);
+    m_boardPlane.clear();
     for (int x = 0; x < m_cols; x++) {
         for (int y = 0; y < m_rows; y++) {
-            points.emplace_back(cv::Vec3f(x, -y, 0));
+            m_boardWorld.emplace_back(cv::Vec3f(x, -y, 0));
+            m_boardPlane.emplace_back(x, -y);
         }
     }
-    std::cout << "done" << std::endl;
-    return points;
+}
+
+const std::vector <cv::Vec3f> &Camera::getChessboardCornersWorld() const {
+    return m_boardWorld;
 }
 
 bool Camera::addChessBoardCalibrationImage(cv::Mat src) {
-    std::vector <cv::Point2f> corners = getChessboardCorners(src, src);
-    if (corners.size() > 0) {
-        std::vector <cv::Vec3f> points = getChessboardCornersWorld();
-        if (corners.size() == points.size()) {
-            m_cornerList.emplace_back(corners);
+    if (getChessboardCorners(src, m_workspace)) {
+        const std::vector <cv::Vec3f> &points = getChessboardCornersWorld();
+        if (m_workspace.corners.size() == points.size()) {
+            m_cornerList.emplace_back(m_workspace.corners);
             m_pointList.emplace_back(points);
             m_calibrationImages.emplace_back(src);
             return true;
@@ -289,76 +856,339 @@ bool Camera::addChessBoardCalibrationImage(cv::Mat src) {
 }
 
 bool Camera::calibrate(cv::Mat src) {
-    if (m_calibrationImages.size() >= m_minCalibrationCount) {
-        cv::Mat cameraMatrix = cv::Mat::eye(3, 3, CV_64F);
-        cameraMatrix.at<double>(0, 2) = src.cols / 2;
-        cameraMatrix.at<double>(1, 2) = src.rows / 2;
-        cv::Mat distortionCoeffs = cv::Mat::zeros(m_minCalibrationCount, 1, CV_64F);
-        std::vector <cv::Mat> rotationVectors, translationVectors;
+    return startCalibration(src.size()) && finishCalibration();
+}
+
+bool Camera::startCalibration(cv::Size imageSize) {
+    if (m_calibrationImages.size() < m_minCalibrationCount || m_pendingCalibration.valid()) {
+        return false;
+    }
+    // the solve works on copies, images saved meanwhile count for the next calibration
+    std::vector<std::vector<cv::Vec3f>> pointList = m_pointList;
+    std::vector<std::vector<cv::Point2f>> cornerList = m_cornerList;
+    int coefficientCount = m_minCalibrationCount;
+    m_pendingCalibration = TaskScheduler::instance().async(TaskScheduler::LOW, [=]() {
+        Calibration calibration;
+        calibration.cameraMatrix = cv::Mat::eye(3, 3, CV_64F);
+        calibration.cameraMatrix.at<double>(0, 2) = imageSize.width / 2;
+        calibration.cameraMatrix.at<double>(1, 2) = imageSize.height / 2;
+        calibration.distortionCoeffs = cv::Mat::zeros(coefficientCount, 1, CV_64F);
         cv::Mat stdDevIntrinsics, stdDevExtrinsics, perViewErrors;
-        double rms = cv::calibrateCamera(m_pointList, m_cornerList, src.size(), cameraMatrix, distortionCoeffs,
-                                         rotationVectors, translationVectors, stdDevIntrinsics, stdDevExtrinsics,
-                                         perViewErrors, CV_CALIB_FIX_ASPECT_RATIO);
-        std::cout << "##=== CAMERA MATRIX ===============##" << std::endl;
-        std::cout << cameraMatrix << std::endl;
-        std::cout << "##=== DISTORTION COEFFICIENTS =====##" << std::endl;
-        std::cout << distortionCoeffs << std::endl;
-        std::cout << "##=== FINAL RE-PROJECTION ERROR ===##" << std::endl;
-        std::cout << rms << std::endl;
-        m_rotationVectors.emplace_back(rotationVectors);
-        m_translationVectors.emplace_back(translationVectors);
-        if (Utils::prompt("Save intrinsic parameters to file [y/n]?") == 'y') {
-            Utils::saveIntrinsicParameters(cameraMatrix, distortionCoeffs);
-        }
-        return true;
+        calibration.rms = cv::calibrateCamera(pointList, cornerList, imageSize, calibration.cameraMatrix,
+                                              calibration.distortionCoeffs, calibration.rotationVectors,
+                                              calibration.translationVectors, stdDevIntrinsics, stdDevExtrinsics,
+                                              perViewErrors, CV_CALIB_FIX_ASPECT_RATIO);
+        return calibration;
+    });
+    return true;
+}
+
+bool Camera::finishCalibration() {
+    if (!m_pendingCalibration.valid()) {
+        return false;
     }
-    return false;
+    Calibration calibration = m_pendingCalibration.get();
+    std::cout << "##=== CAMERA MATRIX ===============##" << std::endl;
+    std::cout << calibration.cameraMatrix << std::endl;
+    std::cout << "##=== DISTORTION COEFFICIENTS =====##" << std::endl;
+    std::cout << calibration.distortionCoeffs << std::endl;
+    std::cout << "##=== FINAL RE-PROJECTION ERROR ===##" << std::endl;
+    std::cout << calibration.rms << std::endl;
+    m_rotationVectors.emplace_back(calibration.rotationVectors);
+    m_translationVectors.emplace_back(calibration.translationVectors);
+    if (Utils::prompt("Save intrinsic parameters to file [y/n]?") == 'y') {
+        Utils::saveIntrinsicParameters(calibration.cameraMatrix, calibration.distortionCoeffs);
+    }
+    return true;
 }
 
-bool Camera::projectPoints(cv::Mat &src, std::vector <cv::Point2f> corners, cv::Mat cameraMatrix,
-                           cv::Mat distortionCoefficients, ObjectModel &objModel) {
-    std::vector <cv::Vec3f> points = getChessboardCornersWorld();
-    cv::Mat rotationVector, translationVector;
-    cv::solvePnP(points, corners, cameraMatrix, distortionCoefficients, rotationVector, translationVector);
-    std::cout << "##====== ROTATION VECTOR ======##" << std::endl;
-    std::cout << rotationVector << std::endl;
-    std::cout << "##===== TRANSLATION VECTOR ====##" << std::endl;
-    std::cout << translationVector << std::endl;
-    std::vector <cv::Vec3f> points3D;
-    std::vector <cv::Point2f> projectedPoints;
-    if (objModel.getObjectType() == "custom") {
-        cv::Mat T_ROTZ = Transforms::rotateZ3x3(0.1);
+void Camera::spinModel(FrameWorkspace &workspace, ObjectModel &objModel) {
+    static const cv::Matx33f T_ROTZ = Transforms::rotateZ3x3(0.1);
+    workspace.stats.beginStage(FrameStats::PROJECT);
+    if (m_chunkedMesh) {
+        m_chunkedMesh->applyTransform(T_ROTZ);
+    } else if (objModel.getObjectType() == "custom") {
         objModel.applyTransform(T_ROTZ);
     }
-    points3D = objModel.getVertices();
-    cv::projectPoints(points3D, rotationVector, translationVector, cameraMatrix, distortionCoefficients,
-                      projectedPoints);
+    workspace.stats.endStage(FrameStats::PROJECT);
+}
+
+bool Camera::projectPoints(cv::Mat &src, FrameWorkspace &workspace, const cv::Mat &cameraMatrix,
+                           const cv::Mat &distortionCoefficients, const ObjectModel &objModel, bool reusePose,
+                           const cv::Matx33f *turn) {
+    bool instanced = m_instances && objModel.getObjectType() == "custom";
+    // content on the board plane is mapped with one homography, the pose is only solved when something reads it
+    bool planar = !m_chunkedMesh && !instanced &&
+                  (objModel.isPlanar() || (m_overlay && objModel.getVertices().empty()));
+    if (!reusePose) {
+        bool fitted = (planar || m_overlay) && fitHomography(workspace);
+        if (!planar || !fitted || m_poseNeeded) {
+            solvePose(workspace, cameraMatrix, distortionCoefficients);
+        } else {
+            workspace.poseIsGuess = false; // stale by the time the pose is solved again
+        }
+    }
+    // a reused detection keeps the homography of its corners, or the pose if the fit failed
+    planar = planar && workspace.homographyFitted;
+    if (m_overlay) {
+        // composited first, the wireframe stays on top of it
+        workspace.stats.beginStage(FrameStats::DRAW);
+        workspace.dirty |= m_overlay->draw(src, workspace.homography, workspace.overlay);
+        workspace.stats.endStage(FrameStats::DRAW);
+    }
+    if (m_chunkedMesh) {
+        // projected chunk by chunk while it is drawn
+        workspace.stats.beginStage(FrameStats::DRAW);
+        LineRasterizer &rasterizer = workspace.rasterizer;
+        rasterizer.clear();
+        m_chunkedMesh->draw(rasterizer, workspace.rotationVector, workspace.translationVector, cameraMatrix,
+                            distortionCoefficients, src.size());
+        rasterizer.render(src);
+        workspace.dirty |= rasterizer.getBounds();
+        workspace.stats.endStage(FrameStats::DRAW);
+        return true;
+    }
+    workspace.stats.beginStage(FrameStats::PROJECT);
+    const std::vector<cv::Vec3f> *vertices = &objModel.getVertices();
+    if (turn != nullptr) {
+        // the model stays as loaded, its turned vertices only live in the scratch of the stream
+        workspace.turnedVertices.resize(vertices->size());
+        for (size_t i = 0; i < vertices->size(); i++) {
+            workspace.turnedVertices[i] = *turn * (*vertices)[i];
+        }
+        vertices = &workspace.turnedVertices;
+    }
+    if (instanced) {
+        m_instances->project(*vertices, workspace.rotationVector, workspace.translationVector,
+                             cameraMatrix, distortionCoefficients, src.size(), workspace.instanceBuffers);
+    } else if (planar) {
+        Transforms::projectPlanar(workspace.homography, *vertices, workspace.projectedPoints);
+    } else if (!vertices->empty()) {
+        // a model without vertices when only the overlay is drawn
+        cv::projectPoints(*vertices, workspace.rotationVector, workspace.translationVector,
+                          cameraMatrix, distortionCoefficients, workspace.projectedPoints);
+    }
+    workspace.stats.endStage(FrameStats::PROJECT);
+    workspace.stats.beginStage(FrameStats::DRAW);
+    LineRasterizer &rasterizer = workspace.rasterizer;
+    rasterizer.clear();
     if (objModel.getObjectType() == "corners") {
-        ObjectModel::drawCircles(src, projectedPoints);
+        ObjectModel::drawCircles(rasterizer, workspace.projectedPoints);
     } else if (objModel.getObjectType() == "axes") {
-        ObjectModel::drawAxes(src, projectedPoints);
+        ObjectModel::drawAxes(rasterizer, workspace.projectedPoints);
+    } else if (instanced) {
+        m_instances->draw(rasterizer, objModel.getVertices().size(), workspace.instanceBuffers,
+                          cv::Scalar(255, 0, 0));
     } else if (objModel.getObjectType() == "custom") {
-        ObjectModel::draw(src, projectedPoints, objModel.getIndices());
+        ObjectModel::draw(rasterizer, workspace.projectedPoints,
+                          objModel.getIndices(workspace.quality.renderSettings().meshLevel));
+    }
+    rasterizer.render(src);
+    workspace.dirty |= rasterizer.getBounds();
+    workspace.stats.endStage(FrameStats::DRAW);
+    return true;
+}
+
+void Camera::trackBoards(cv::Mat &src, FrameWorkspace &workspace, const cv::Mat &cameraMatrix,
+                         const cv::Mat &distortionCoefficients) {
+    workspace.stats.beginStage(FrameStats::DETECT);
+    int found = m_boardTracker->detect(workspace.images);
+    workspace.stats.endStage(FrameStats::DETECT);
+    if (m_verbose) {
+        std::cout << found << " of " << m_boardTracker->size() << " boards found" << std::endl;
+    }
+    workspace.stats.beginStage(FrameStats::POSE);
+    m_boardTracker->estimatePoses(cameraMatrix, distortionCoefficients);
+    workspace.stats.endStage(FrameStats::POSE);
+    workspace.stats.beginStage(FrameStats::DRAW);
+    workspace.rasterizer.clear();
+    m_boardTracker->draw(workspace.rasterizer, cameraMatrix, distortionCoefficients);
+    workspace.rasterizer.render(src);
+    workspace.dirty |= workspace.rasterizer.getBounds();
+    workspace.stats.endStage(FrameStats::DRAW);
+}
+
+void Camera::solvePose(FrameWorkspace &workspace, const cv::Mat &cameraMatrix,
+                       const cv::Mat &distortionCoefficients) {
+    workspace.stats.beginStage(FrameStats::POSE);
+    cv::solvePnP(m_boardWorld, workspace.corners, cameraMatrix, distortionCoefficients, workspace.rotationVector,
+                 workspace.translationVector, workspace.poseIsGuess);
+    workspace.poseIsGuess = false;
+    workspace.stats.endStage(FrameStats::POSE);
+    if (m_verbose) {
+        std::cout << "##====== ROTATION VECTOR ======##" << std::endl;
+        std::cout << workspace.rotationVector << std::endl;
+        std::cout << "##===== TRANSLATION VECTOR ====##" << std::endl;
+        std::cout << workspace.translationVector << std::endl;
+    }
+}
+
+bool Camera::fitHomography(FrameWorkspace &workspace) {
+    workspace.stats.beginStage(FrameStats::POSE);
+    cv::Mat homography = cv::findHomography(m_boardPlane, workspace.corners);
+    // the overlay keeps the last homography that could be fitted
+    workspace.homographyFitted = !homography.empty();
+    if (workspace.homographyFitted) {
+        workspace.homography = homography;
+    }
+    workspace.stats.endStage(FrameStats::POSE);
+    return workspace.homographyFitted;
+}
+
+bool Camera::estimatePose(const cv::Mat &src, FrameWorkspace &workspace, const cv::Mat &cameraMatrix,
+                          const cv::Mat &distortionCoefficients) {
+    // callers may render every frame into the same buffer, so the cache cannot tell the frames apart
+    workspace.images.reset(src);
+    if (!getChessboardCorners(src, workspace)) {
+        return false;
     }
+    solvePose(workspace, cameraMatrix, distortionCoefficients);
     return true;
 }
 
-void Camera::harrisCorners(cv::Mat &src) {
-    std::cout << "Running Harris Corners...";
-    cv::Mat grayscale, dst_norm, dst_norm_scaled;
-    cv::cvtColor(src, grayscale, cv::COLOR_BGR2GRAY);
-    cv::Mat dst = cv::Mat::zeros(src.size(), CV_32FC1);
-    cv::cornerHarris(grayscale, dst, 2, 3, 0.04);
+bool Camera::processFrame(cv::Mat &frame, FrameWorkspace &workspace, const cv::Mat &cameraMatrix,
+                          const cv::Mat &distortionCoefficients, ObjectModel &objModel) {
+    workspace.arena.reset();
+    workspace.dirty = cv::Rect();
+    workspace.images.reset(frame);
+    if (!getChessboardCorners(frame, workspace)) {
+        return false;
+    }
+    spinModel(workspace, objModel);
+    return projectPoints(frame, workspace, cameraMatrix, distortionCoefficients, objModel);
+}
+
+void Camera::processHarrisFrame(cv::Mat &frame, FrameWorkspace &workspace) {
+    workspace.arena.reset();
+    workspace.dirty = cv::Rect();
+    workspace.images.reset(frame);
+    workspace.stats.beginStage(FrameStats::DETECT);
+    harrisCorners(frame, workspace);
+    workspace.stats.endStage(FrameStats::DETECT);
+}
+
+void Camera::addPose(FrameWorkspace &workspace, const std::vector<cv::Vec3f> &world,
+                     const std::vector<cv::Point2f> &corners, const cv::Mat &rotationVector,
+                     const cv::Mat &translationVector, const cv::Mat &cameraMatrix,
+                     const cv::Mat &distortionCoefficients) {
+    workspace.poses.emplace_back();
+    PoseRecord &record = workspace.poses.back();
+    if (corners.empty() || rotationVector.empty()) {
+        return;
+    }
+    for (int i = 0; i < 3; i++) {
+        record.rotation[i] = rotationVector.at<double>(i);
+        record.translation[i] = translationVector.at<double>(i);
+    }
+    cv::projectPoints(world, rotationVector, translationVector, cameraMatrix, distortionCoefficients,
+                      workspace.reprojectedCorners);
+    record.reprojectionError = (float) (cv::norm(corners, workspace.reprojectedCorners, cv::NORM_L2) /
+                                        sqrt(corners.size()));
+    record.cornerCount = corners.size();
+    workspace.poseCorners.insert(workspace.poseCorners.end(), corners.begin(), corners.end());
+}
+
+void Camera::collectPoses(uint64_t frameId, uint64_t timestampNs, FrameWorkspace &workspace,
+                          const cv::Mat &cameraMatrix, const cv::Mat &distortionCoefficients) {
+    workspace.poses.clear();
+    workspace.poseCorners.clear();
+    if (m_boardTracker) {
+        for (const MultiBoardTracker::Board &board : m_boardTracker->getBoards()) {
+            addPose(workspace, board.world, board.corners, board.rotationVector, board.translationVector,
+                    cameraMatrix, distortionCoefficients);
+        }
+    } else {
+        addPose(workspace, m_boardWorld, workspace.corners, workspace.rotationVector, workspace.translationVector,
+                cameraMatrix, distortionCoefficients);
+    }
+    for (size_t k = 0; k < workspace.poses.size(); k++) {
+        PoseRecord &record = workspace.poses[k];
+        record.version = PoseRecord::VERSION;
+        record.cameraId = m_options.cameraId;
+        record.frameId = frameId;
+        record.timestampNs = timestampNs;
+        record.board = (uint32_t) k;
+        record.boardCount = (uint32_t) workspace.poses.size();
+    }
+}
+
+void Camera::publishPose(const FrameWorkspace &workspace) {
+    if (!m_posePublisher) {
+        return;
+    }
+    for (const PoseRecord &record : workspace.poses) {
+        m_posePublisher->publish(record);
+    }
+}
+
+void Camera::presentFrame(const std::string &window, const cv::Mat &frame, uint64_t frameId,
+                          uint64_t timestampNs) {
+    if (m_frameSink && frame.type() == CV_8UC3) {
+        // between whole frames the sink compares the frame with the last one and only sends the changed tiles
+        bool base = true;
+        if (m_options.frameKeyframe > 1 && ++m_framesSinceBase < m_options.frameKeyframe) {
+            base = false;
+        } else {
+            m_framesSinceBase = 0;
+        }
+        m_frameSink->publish(frame.data, frame.cols, frame.rows, frame.step, PixelFormat::BGR8, frameId,
+                             timestampNs, base);
+    }
+    if (!m_options.headless) {
+        cv::imshow(window, frame);
+    }
+}
+
+int Camera::waitKey(int delay) {
+    if (!m_options.headless) {
+        return cv::waitKey(delay);
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(delay));
+    return stopRequested ? 'q' : -1;
+}
+
+void Camera::harrisCorners(cv::Mat &src, FrameWorkspace &workspace) {
+    if (m_verbose) {
+        std::cout << "Running Harris Corners...";
+    }
+    // cv::cornerHarris(gray, dst, 2, 3, 0.04) from the gradients of the frame cache instead of its own Sobel pass
+    const cv::Mat &dx = workspace.images.gradientX(), &dy = workspace.images.gradientY();
+    const float scale = 1.0f / (4 * 2 * 255), k = 0.04f; // the derivative scale cornerHarris uses for 8 bit images
+    // scratch images live in the arena, so the steady state does not reallocate them every frame
+    cv::Mat covariance = workspace.arena.mat(src.rows, src.cols, CV_32FC3);
+    cv::Mat dst = workspace.arena.mat(src.rows, src.cols, CV_32FC1);
+    cv::Mat dst_norm = workspace.arena.mat(src.rows, src.cols, CV_32FC1);
+    cv::Mat dst_norm_scaled = workspace.arena.mat(src.rows, src.cols, CV_8UC1);
+    for (int i = 0; i < src.rows; i++) {
+        const float *gx = dx.ptr<float>(i), *gy = dy.ptr<float>(i);
+        cv::Vec3f *products = covariance.ptr<cv::Vec3f>(i);
+        for (int j = 0; j < src.cols; j++) {
+            float x = gx[j] * scale, y = gy[j] * scale;
+            products[j] = cv::Vec3f(x * x, x * y, y * y);
+        }
+    }
+    cv::boxFilter(covariance, covariance, CV_32F, cv::Size(2, 2), cv::Point(-1, -1), false);
+    for (int i = 0; i < src.rows; i++) {
+        const cv::Vec3f *sums = covariance.ptr<cv::Vec3f>(i);
+        float *response = dst.ptr<float>(i);
+        for (int j = 0; j < src.cols; j++) {
+            float a = sums[j][0], b = sums[j][1], c = sums[j][2];
+            response[j] = a * c - b * b - k * (a + c) * (a + c);
+        }
+    }
     cv::normalize(dst, dst_norm, 0, 255, cv::NORM_MINMAX, CV_32FC1);
     cv::convertScaleAbs(dst_norm, dst_norm_scaled);
     for (int i = 0; i < dst_norm.rows; i++) {
         for (int j = 0; j < dst_norm.cols; j++) {
             if ((int) dst_norm.at<float>(i, j) > 195) {
                 cv::circle(src, cv::Point(j, i), 5, cv::Scalar(0, 0, 255), 2, 8, 0);
+                workspace.dirty |= cv::Rect(j - 6, i - 6, 13, 13);
             }
         }
     }
-    std::cout << "Done" << std::endl;
+    if (m_verbose) {
+        std::cout << "Done" << std::endl;
+    }
 }
 
 void Camera::animateTriangle() {
@@ -370,46 +1200,57 @@ void Camera::animateTriangle() {
     std::vector <cv::Mat> extrinsicParameters = Utils::loadIntrinsicParameters(filename);
     cv::Mat cameraMatrix = extrinsicParameters[0];
     cv::Mat distortionCoefficients = extrinsicParameters[1];
+    waitForDevice();
 
     double dx = 0.2;
     cv::Point3f origin = cv::Point3f(0.0, 0.0, 0.0);
     double triangleSize = 1;
-    cv::namedWindow("Animation", 1);
+    if (!m_options.headless) {
+        cv::namedWindow("Animation", 1);
+    }
     double theta = 0;
-    while (cv::waitKey(50) != 'q') {
+    while (waitKey(50) != 'q') {
         (*capdev) >> frame;
+        uint64_t timestampNs = PosePublisher::nowNanoseconds();
+        uint64_t frameId = m_frameId++;
 
-        std::vector <cv::Point2f> corners = getChessboardCorners(frame, frame);
-        if (corners.size() > 0) {
-            std::vector <cv::Vec3f> points = getChessboardCornersWorld();
-            cv::Mat rotationVector, translationVector;
-            cv::solvePnP(points, corners, cameraMatrix, distortionCoefficients, rotationVector, translationVector);
+        FrameWorkspace &workspace = m_workspace;
+        cv::Mat &rotationVector = workspace.rotationVector;
+        cv::Mat &translationVector = workspace.translationVector;
+        LineRasterizer &rasterizer = workspace.rasterizer;
+        rasterizer.clear();
+        workspace.images.reset(frame);
+        bool found = getChessboardCorners(frame, workspace);
+        // the star lies on the board plane, the homography of the corners maps it and the pose is only published
+        if (found && m_posePublisher) {
+            cv::solvePnP(m_boardWorld, workspace.corners, cameraMatrix, distortionCoefficients, rotationVector,
+                         translationVector);
+        }
+        if (found && fitHomography(workspace)) {
             theta += 5;
             std::vector <std::vector<cv::Vec3f>> starCoordinateVec = ObjectModel::starCoordinates(
                     triangleSize * 2, origin, theta);
             std::vector <cv::Vec3f> t1_points = starCoordinateVec[0];
-            std::vector <cv::Point2f> projectedPoints;
-            cv::projectPoints(t1_points, rotationVector, translationVector, cameraMatrix, distortionCoefficients,
-                              projectedPoints);
+            std::vector <cv::Point2f> &projectedPoints = workspace.projectedPoints;
+            Transforms::projectPlanar(workspace.homography, t1_points, projectedPoints);
 
             // Draw Points
-            cv::circle(frame, projectedPoints[0], 1, cv::Scalar(255, 0, 0), 10);
-            cv::circle(frame, projectedPoints[1], 1, cv::Scalar(255, 0, 0), 10);
-            cv::circle(frame, projectedPoints[2], 1, cv::Scalar(255, 0, 0), 10);
-            cv::line(frame, projectedPoints[0], projectedPoints[1], cv::Scalar(0, 255, 0), 3);
-            cv::line(frame, projectedPoints[1], projectedPoints[2], cv::Scalar(0, 255, 0), 3);
-            cv::line(frame, projectedPoints[2], projectedPoints[0], cv::Scalar(0, 255, 0), 3);
-            projectedPoints.clear();
+            // a circle of radius 1 drawn 10 px thick covers a disc of radius 6
+            rasterizer.addDisc(projectedPoints[0], 6, cv::Scalar(255, 0, 0));
+            rasterizer.addDisc(projectedPoints[1], 6, cv::Scalar(255, 0, 0));
+            rasterizer.addDisc(projectedPoints[2], 6, cv::Scalar(255, 0, 0));
+            rasterizer.addLine(projectedPoints[0], projectedPoints[1], cv::Scalar(0, 255, 0), 3);
+            rasterizer.addLine(projectedPoints[1], projectedPoints[2], cv::Scalar(0, 255, 0), 3);
+            rasterizer.addLine(projectedPoints[2], projectedPoints[0], cv::Scalar(0, 255, 0), 3);
             std::vector <cv::Vec3f> t2_points = starCoordinateVec[1];
-            cv::projectPoints(t2_points, rotationVector, translationVector, cameraMatrix, distortionCoefficients,
-                              projectedPoints);
+            Transforms::projectPlanar(workspace.homography, t2_points, projectedPoints);
             // Draw Points
-            cv::circle(frame, projectedPoints[0], 1, cv::Scalar(0, 255, 0), 10);
-            cv::circle(frame, projectedPoints[1], 1, cv::Scalar(0, 255, 0), 10);
-            cv::circle(frame, projectedPoints[2], 1, cv::Scalar(0, 255, 0), 10);
-            cv::line(frame, projectedPoints[0], projectedPoints[1], cv::Scalar(0, 0, 0), 3);
-            cv::line(frame, projectedPoints[1], projectedPoints[2], cv::Scalar(0, 0, 0), 3);
-            cv::line(frame, projectedPoints[2], projectedPoints[0], cv::Scalar(0, 0, 0), 3);
+            rasterizer.addDisc(projectedPoints[0], 6, cv::Scalar(0, 255, 0));
+            rasterizer.addDisc(projectedPoints[1], 6, cv::Scalar(0, 255, 0));
+            rasterizer.addDisc(projectedPoints[2], 6, cv::Scalar(0, 255, 0));
+            rasterizer.addLine(projectedPoints[0], projectedPoints[1], cv::Scalar(0, 0, 0), 3);
+            rasterizer.addLine(projectedPoints[1], projectedPoints[2], cv::Scalar(0, 0, 0), 3);
+            rasterizer.addLine(projectedPoints[2], projectedPoints[0], cv::Scalar(0, 0, 0), 3);
             origin.x += dx;
             if (origin.x > 5) {
                 origin.y -= 1;
@@ -418,8 +1259,13 @@ void Camera::animateTriangle() {
             if (origin.y < -7) {
                 origin = cv::Point3f(0, 0, 0);
             }
+            rasterizer.render(frame);
+        }
+        if (m_posePublisher) {
+            collectPoses(frameId, timestampNs, workspace, cameraMatrix, distortionCoefficients);
+            publishPose(workspace);
         }
-        cv::imshow("Animation", frame);
+        presentFrame("Animation", frame, frameId, timestampNs);
     }
-    exit(0);
+    std::cout << "Ending application" << std::endl;
 }
@@ -0,0 +1,543 @@
+//
+// CS 5330 - Project 4
+// Nathaniel Haddad and Stephen Dorris
+//
+
+#include <algorithm>
+#include <cmath>
+
+// OpenCV Libraries
+#include <opencv2/calib3d.hpp>
+#include <opencv2/imgproc.hpp>
+
+// Local Includes
+#include "ChessboardDetector.h"
+#include "TaskScheduler.h"
+
+namespace {
+
+const int SADDLE_RADIUS = 2; // finite difference step of the Hessian in detection pixels
+
+const int SUPPRESSION_RADIUS = 2; // a candidate is the largest response of its (2r+1)x(2r+1) neighbourhood
+
+const int TILE_ROWS = 32; // rows of the detection image handled by one parallel task
+
+const float RELATIVE_THRESHOLD = 0.05f; // weakest candidate, relative to the strongest response of the frame
+
+const float CLUSTER_RADIUS = 3.0f; // maxima closer than this (detection pixels) belong to the same corner
+
+const float MATCH_TOLERANCE = 0.3f; // how far a corner may be from its predicted lattice position, in steps
+
+const float BASIS_RESPONSE = 0.5f; // weakest candidate that may define the lattice vectors, relative to the seed
+
+const float NEIGHBOUR_RESPONSE = 0.25f; // weakest candidate the lattice may grow into, relative to the cell
+
+const int MAX_SEEDS = 16; // strongest candidates the lattice is grown from before giving up
+
+const size_t MAX_CANDIDATES = 4096;
+
+float cross(cv::Point2f a, cv::Point2f b) {
+    return a.x * b.y - a.y * b.x;
+}
+
+}
+
+ChessboardDetector::ChessboardDetector(Method method, int maxDetectionWidth) : m_method(method),
+                                                                               m_maxDetectionWidth(maxDetectionWidth) {
+}
+
+bool ChessboardDetector::parseMethod(const std::string &name, Method &method) {
+    if (name == "opencv") {
+        method = OPENCV;
+    } else if (name == "saddle") {
+        method = SADDLE;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+const char *ChessboardDetector::methodName(Method method) {
+    return method == SADDLE ? "saddle" : "opencv";
+}
+
+void ChessboardDetector::setMethod(Method method) {
+    m_method = method;
+}
+
+ChessboardDetector::Method ChessboardDetector::getMethod() const {
+    return m_method;
+}
+
+void ChessboardDetector::setDetectionScale(double scale) {
+    m_detectionScale = std::min(std::max(scale, 0.1), 1.0);
+}
+
+void ChessboardDetector::setRefinement(int window, int iterations, double epsilon) {
+    m_refiner.configure(window, iterations, epsilon);
+}
+
+bool ChessboardDetector::find(const cv::Mat &src, cv::Mat &gray, cv::Size patternSize,
+                              std::vector<cv::Point2f> &corners) {
+    // one conversion shared by detection and refinement, findChessboardCorners takes the gray image as it is
+    if (src.channels() == 1) {
+        gray = src;
+    } else {
+        cv::cvtColor(src, gray, cv::COLOR_BGR2GRAY);
+    }
+    const cv::Mat *image = &gray;
+    if (m_detectionScale < 1.0) {
+        cv::resize(gray, m_scaled, cv::Size(), m_detectionScale, m_detectionScale, cv::INTER_AREA);
+        image = &m_scaled;
+    }
+    if (!detect(*image, (float) (1.0 / m_detectionScale), cv::Point2f(0, 0), patternSize, corners)) {
+        return false;
+    }
+    m_refiner.refine(gray, corners, patternSize);
+    return true;
+}
+
+bool ChessboardDetector::find(FrameCache &images, const cv::Rect &region, cv::Size patternSize,
+                              std::vector<cv::Point2f> &corners) {
+    const cv::Mat &gray = images.gray();
+    cv::Rect frame(0, 0, gray.cols, gray.rows);
+    cv::Rect area = region.empty() ? frame : region & frame;
+    if (area.empty()) {
+        corners.clear();
+        return false;
+    }
+    const cv::Mat *image = &gray;
+    float factor = 1;
+    cv::Mat window;
+    if (area != frame) {
+        // a search window is small, it is resized on its own instead of cutting it from the resized frame
+        window = gray(area);
+        image = &window;
+        if (m_detectionScale < 1.0) {
+            cv::resize(window, m_scaled, cv::Size(), m_detectionScale, m_detectionScale, cv::INTER_AREA);
+            image = &m_scaled;
+            factor = (float) (1.0 / m_detectionScale);
+        }
+    } else if (m_detectionScale < 1.0) {
+        image = &images.scaled(m_detectionScale);
+        factor = (float) (1.0 / m_detectionScale);
+    } else if (m_method == SADDLE) {
+        // the pyramid level detectSaddles would reduce the frame to, shared with every other user of the pyramid
+        int level = 0;
+        while (images.level(level).cols > m_maxDetectionWidth && images.level(level).cols > 1) {
+            level++;
+        }
+        image = &images.level(level);
+        factor = (float) (1 << level);
+    }
+    if (!detect(*image, factor, cv::Point2f((float) area.x, (float) area.y), patternSize, corners)) {
+        return false;
+    }
+    m_refiner.refine(gray, corners, patternSize);
+    return true;
+}
+
+bool ChessboardDetector::detect(const cv::Mat &image, float factor, cv::Point2f offset, cv::Size patternSize,
+                                std::vector<cv::Point2f> &corners) {
+    bool found;
+    if (m_method == SADDLE) {
+        found = detectSaddles(image, patternSize, corners);
+    } else {
+        found = cv::findChessboardCorners(image, patternSize, corners, cv::CALIB_CB_ADAPTIVE_THRESH);
+    }
+    if (!found) {
+        corners.clear();
+        return false;
+    }
+    // back to frame pixel centers, the refinement then recovers the precision lost by resizing
+    for (cv::Point2f &corner : corners) {
+        corner = (corner + cv::Point2f(0.5f, 0.5f)) * factor - cv::Point2f(0.5f, 0.5f) + offset;
+    }
+    return true;
+}
+
+bool ChessboardDetector::detectSaddles(const cv::Mat &gray, cv::Size patternSize,
+                                       std::vector<cv::Point2f> &corners) {
+    corners.clear();
+    if (patternSize.width < 2 || patternSize.height < 2) {
+        return false;
+    }
+    // the response is computed on the first pyramid level that is narrow enough, corners are scaled back up
+    const cv::Mat *level = &gray;
+    float scale = 1;
+    for (int i = 0; level->cols > m_maxDetectionWidth; i++) {
+        cv::pyrDown(*level, m_levels[i % 2]);
+        level = &m_levels[i % 2];
+        scale *= 2;
+    }
+    level->convertTo(m_blurred, CV_32F);
+    cv::GaussianBlur(m_blurred, m_blurred, cv::Size(5, 5), 1.0);
+    m_response.create(m_blurred.size(), CV_32F);
+
+    int tileCount = (m_blurred.rows + TILE_ROWS - 1) / TILE_ROWS;
+    m_tileMax.assign(tileCount, 0.f);
+    m_tileCandidates.resize(tileCount);
+    TaskScheduler::instance().parallelFor(cv::Range(0, tileCount), 1, [&](const cv::Range &range) {
+        for (int tile = range.start; tile < range.end; tile++) {
+            m_tileMax[tile] = computeResponse(tile * TILE_ROWS, std::min((tile + 1) * TILE_ROWS, m_blurred.rows));
+        }
+    });
+    float maxResponse = *std::max_element(m_tileMax.begin(), m_tileMax.end());
+    if (maxResponse <= 0) {
+        return false;
+    }
+    float threshold = RELATIVE_THRESHOLD * maxResponse;
+    TaskScheduler::instance().parallelFor(cv::Range(0, tileCount), 1, [&](const cv::Range &range) {
+        for (int tile = range.start; tile < range.end; tile++) {
+            findMaxima(tile * TILE_ROWS, std::min((tile + 1) * TILE_ROWS, m_blurred.rows), threshold,
+                       m_tileCandidates[tile]);
+        }
+    });
+    m_candidates.clear();
+    for (const std::vector<Candidate> &tileCandidates : m_tileCandidates) {
+        m_candidates.insert(m_candidates.end(), tileCandidates.begin(), tileCandidates.end());
+    }
+    clusterCandidates(CLUSTER_RADIUS);
+    if (m_candidates.size() < (size_t) patternSize.area()) {
+        return false;
+    }
+    buildBuckets();
+
+    int seeds = std::min((int) m_candidates.size(), MAX_SEEDS);
+    for (int seed = 0; seed < seeds; seed++) {
+        if (fitGrid(seed, patternSize, corners)) {
+            // pyrDown maps pixel centers, not pixel corners
+            for (cv::Point2f &corner : corners) {
+                corner = (corner + cv::Point2f(0.5f, 0.5f)) * scale - cv::Point2f(0.5f, 0.5f);
+            }
+            return true;
+        }
+    }
+    corners.clear();
+    return false;
+}
+
+float ChessboardDetector::computeResponse(int firstRow, int lastRow) {
+    const int r = SADDLE_RADIUS;
+    int rows = m_blurred.rows, cols = m_blurred.cols;
+    for (int y = firstRow; y < lastRow; y++) {
+        float *out = m_response.ptr<float>(y);
+        if (y < r || y >= rows - r || cols <= 2 * r) {
+            std::fill(out, out + cols, 0.f);
+            continue;
+        }
+        const float *up = m_blurred.ptr<float>(y - r);
+        const float *mid = m_blurred.ptr<float>(y);
+        const float *down = m_blurred.ptr<float>(y + r);
+        std::fill(out, out + r, 0.f);
+        std::fill(out + cols - r, out + cols, 0.f);
+        // negative determinant of the Hessian: positive only where the surface curves up one way and down the
+        // other, i.e. at the X-junction of four squares. The loop is branch free so the compiler vectorizes it.
+        for (int x = r; x < cols - r; x++) {
+            float ixx = mid[x - r] + mid[x + r] - 2 * mid[x];
+            float iyy = up[x] + down[x] - 2 * mid[x];
+            float ixy = 0.25f * (up[x - r] + down[x + r] - up[x + r] - down[x - r]);
+            float saddle = ixy * ixy - ixx * iyy;
+            out[x] = saddle > 0 ? saddle : 0;
+        }
+    }
+    double maxResponse = 0;
+    cv::minMaxLoc(m_response.rowRange(firstRow, lastRow), nullptr, &maxResponse);
+    return (float) maxResponse;
+}
+
+void ChessboardDetector::findMaxima(int firstRow, int lastRow, float threshold,
+                                    std::vector<Candidate> &candidates) const {
+    candidates.clear();
+    const int r = SUPPRESSION_RADIUS;
+    const int border = SADDLE_RADIUS + r;
+    int cols = m_response.cols;
+    int endRow = std::min(lastRow, m_response.rows - border);
+    for (int y = std::max(firstRow, border); y < endRow; y++) {
+        const float *row = m_response.ptr<float>(y);
+        for (int x = border; x < cols - border; x++) {
+            float value = row[x];
+            if (value <= threshold) {
+                continue;
+            }
+            bool isMaximum = true;
+            for (int dy = -r; dy <= r && isMaximum; dy++) {
+                const float *neighbours = m_response.ptr<float>(y + dy);
+                for (int dx = -r; dx <= r; dx++) {
+                    float neighbour = neighbours[x + dx];
+                    // ties go to the first pixel in raster order, so a plateau yields a single maximum
+                    bool before = dy < 0 || (dy == 0 && dx < 0);
+                    if (neighbour > value || (before && neighbour == value)) {
+                        isMaximum = false;
+                        break;
+                    }
+                }
+            }
+            if (!isMaximum) {
+                continue;
+            }
+            // fit a parabola through the peak and its neighbours for a sub-pixel position
+            const float *above = m_response.ptr<float>(y - 1);
+            const float *below = m_response.ptr<float>(y + 1);
+            float dxx = row[x - 1] - 2 * value + row[x + 1];
+            float dyy = above[x] - 2 * value + below[x];
+            float offsetX = dxx < 0 ? 0.5f * (row[x - 1] - row[x + 1]) / dxx : 0;
+            float offsetY = dyy < 0 ? 0.5f * (above[x] - below[x]) / dyy : 0;
+            candidates.push_back({cv::Point2f(x + offsetX, y + offsetY), value});
+        }
+    }
+}
+
+void ChessboardDetector::clusterCandidates(float radius) {
+    std::sort(m_candidates.begin(), m_candidates.end(), [](const Candidate &a, const Candidate &b) {
+        return a.response > b.response;
+    });
+    if (m_candidates.size() > MAX_CANDIDATES) {
+        m_candidates.resize(MAX_CANDIDATES);
+    }
+    buildBuckets();
+    m_used.assign(m_candidates.size(), 0);
+    size_t kept = 0;
+    for (size_t i = 0; i < m_candidates.size(); i++) {
+        if (m_used[i]) {
+            continue;
+        }
+        m_used[i] = 1;
+        // everything still unused is weaker, merge it into this candidate
+        for (int j; (j = nearestCandidate(m_candidates[i].point, radius)) >= 0;) {
+            m_used[j] = 1;
+        }
+        // kept <= i and every index below i is used, so the buckets are not disturbed
+        m_candidates[kept++] = m_candidates[i];
+    }
+    m_candidates.resize(kept);
+}
+
+void ChessboardDetector::buildBuckets() {
+    m_bucketCols = m_response.cols / m_bucketSize + 1;
+    m_bucketRows = m_response.rows / m_bucketSize + 1;
+    m_bucketStart.assign(m_bucketCols * m_bucketRows + 1, 0);
+    auto bucketOf = [&](cv::Point2f point) {
+        int bx = std::min(std::max((int) (point.x / m_bucketSize), 0), m_bucketCols - 1);
+        int by = std::min(std::max((int) (point.y / m_bucketSize), 0), m_bucketRows - 1);
+        return by * m_bucketCols + bx;
+    };
+    for (const Candidate &candidate : m_candidates) {
+        m_bucketStart[bucketOf(candidate.point) + 1]++;
+    }
+    for (size_t b = 1; b < m_bucketStart.size(); b++) {
+        m_bucketStart[b] += m_bucketStart[b - 1];
+    }
+    m_bucketItems.resize(m_candidates.size());
+    m_queue.assign(m_bucketStart.begin(), m_bucketStart.end() - 1); // next free slot of every bucket
+    for (size_t i = 0; i < m_candidates.size(); i++) {
+        m_bucketItems[m_queue[bucketOf(m_candidates[i].point)]++] = (int) i;
+    }
+    m_used.assign(m_candidates.size(), 0);
+}
+
+int ChessboardDetector::nearestCandidate(cv::Point2f point, float radius, float minResponse) const {
+    int x0 = std::max((int) std::floor((point.x - radius) / m_bucketSize), 0);
+    int x1 = std::min((int) std::floor((point.x + radius) / m_bucketSize), m_bucketCols - 1);
+    int y0 = std::max((int) std::floor((point.y - radius) / m_bucketSize), 0);
+    int y1 = std::min((int) std::floor((point.y + radius) / m_bucketSize), m_bucketRows - 1);
+    int nearest = -1;
+    float best = radius * radius;
+    for (int by = y0; by <= y1; by++) {
+        for (int bx = x0; bx <= x1; bx++) {
+            int bucket = by * m_bucketCols + bx;
+            for (int k = m_bucketStart[bucket]; k < m_bucketStart[bucket + 1]; k++) {
+                int i = m_bucketItems[k];
+                if (m_used[i] || m_candidates[i].response < minResponse) {
+                    continue;
+                }
+                cv::Point2f d = m_candidates[i].point - point;
+                float distance = d.dot(d);
+                if (distance < best) {
+                    best = distance;
+                    nearest = i;
+                }
+            }
+        }
+    }
+    return nearest;
+}
+
+bool ChessboardDetector::fitGrid(int seed, cv::Size patternSize, std::vector<cv::Point2f> &corners) {
+    const int W = patternSize.width, H = patternSize.height;
+    cv::Point2f origin = m_candidates[seed].point;
+
+    // lattice vectors at the seed: the closest comparable candidate, then the closest one in a clearly different
+    // direction (the weak side lobes of the response around every X-corner are skipped)
+    m_used.assign(m_candidates.size(), 0);
+    m_used[seed] = 1;
+    float searchRadius = (float) std::max(m_response.cols, m_response.rows) / std::max(W, H);
+    float minResponse = BASIS_RESPONSE * m_candidates[seed].response;
+    int first = nearestCandidate(origin, searchRadius, minResponse);
+    if (first < 0) {
+        return false;
+    }
+    m_used[first] = 1;
+    cv::Point2f u = m_candidates[first].point - origin;
+    int second = -1;
+    for (int attempt = 0; attempt < 8 && second < 0; attempt++) {
+        int next = nearestCandidate(origin, searchRadius, minResponse);
+        if (next < 0) {
+            break;
+        }
+        m_used[next] = 1;
+        cv::Point2f d = m_candidates[next].point - origin;
+        float cosine = u.dot(d) / std::sqrt(u.dot(u) * d.dot(d));
+        if (std::abs(cosine) < 0.5f && d.dot(d) < 4 * u.dot(u)) {
+            second = next;
+        }
+    }
+    if (second < 0) {
+        return false;
+    }
+    cv::Point2f v = m_candidates[second].point - origin;
+
+    // grow the lattice breadth first; every cell predicts its neighbours with its own lattice vectors, which
+    // follow the perspective distortion of the board as the lattice spreads
+    const int half = std::max(W, H);
+    const int side = 2 * half + 1;
+    m_cells.assign(side * side, -1);
+    m_cellSteps.resize(2 * side * side);
+    m_used.assign(m_candidates.size(), 0);
+    int center = half * side + half;
+    m_cells[center] = seed;
+    m_used[seed] = 1;
+    m_cellSteps[2 * center] = u;
+    m_cellSteps[2 * center + 1] = v;
+    m_queue.clear();
+    m_queue.push_back(center);
+    int minI = half, maxI = half, minJ = half, maxJ = half;
+    static const int DI[4] = {1, -1, 0, 0};
+    static const int DJ[4] = {0, 0, 1, -1};
+    for (size_t q = 0; q < m_queue.size(); q++) {
+        int cell = m_queue[q];
+        int i = cell % side, j = cell / side;
+        cv::Point2f point = m_candidates[m_cells[cell]].point;
+        float minNeighbour = NEIGHBOUR_RESPONSE * m_candidates[m_cells[cell]].response;
+        for (int d = 0; d < 4; d++) {
+            int ni = i + DI[d], nj = j + DJ[d];
+            if (ni < 0 || nj < 0 || ni >= side || nj >= side) {
+                continue;
+            }
+            int neighbour = nj * side + ni;
+            if (m_cells[neighbour] >= 0) {
+                continue;
+            }
+            cv::Point2f step = DI[d] != 0 ? m_cellSteps[2 * cell] * (float) DI[d]
+                                          : m_cellSteps[2 * cell + 1] * (float) DJ[d];
+            int match = nearestCandidate(point + step, MATCH_TOLERANCE * std::sqrt(step.dot(step)), minNeighbour);
+            if (match < 0) {
+                continue;
+            }
+            m_used[match] = 1;
+            m_cells[neighbour] = match;
+            cv::Point2f measured = m_candidates[match].point - point;
+            m_cellSteps[2 * neighbour] = DI[d] != 0 ? measured * (float) DI[d] : m_cellSteps[2 * cell];
+            m_cellSteps[2 * neighbour + 1] = DJ[d] != 0 ? measured * (float) DJ[d] : m_cellSteps[2 * cell + 1];
+            m_queue.push_back(neighbour);
+            minI = std::min(minI, ni);
+            maxI = std::max(maxI, ni);
+            minJ = std::min(minJ, nj);
+            maxJ = std::max(maxJ, nj);
+        }
+    }
+
+    // the squares along the edge of the board meet the white margin in L-shaped corners, which respond weaker
+    // but still extend the lattice; among the complete W x H windows (in either orientation) take the strongest
+    int boardI = -1, boardJ = -1, boardOrientation = 0;
+    float bestScore = 0;
+    for (int orientation = 0; orientation < (W == H ? 1 : 2); orientation++) {
+        int extentI = orientation == 0 ? W : H;
+        int extentJ = orientation == 0 ? H : W;
+        for (int j0 = minJ; j0 + extentJ - 1 <= maxJ; j0++) {
+            for (int i0 = minI; i0 + extentI - 1 <= maxI; i0++) {
+                float score = 0;
+                for (int j = j0; j < j0 + extentJ && score >= 0; j++) {
+                    for (int i = i0; i < i0 + extentI; i++) {
+                        int candidate = m_cells[j * side + i];
+                        if (candidate < 0) {
+                            score = -1;
+                            break;
+                        }
+                        score += m_candidates[candidate].response;
+                    }
+                }
+                if (score > bestScore) {
+                    bestScore = score;
+                    boardI = i0;
+                    boardJ = j0;
+                    boardOrientation = orientation;
+                }
+            }
+        }
+    }
+    if (boardI < 0) {
+        return false;
+    }
+
+    // a = index along a row (W corners), b = row index (H rows); flips pick which board corner comes first
+    bool flipA = false, flipB = false;
+    auto pointAt = [&](int a, int b) {
+        if (flipA) {
+            a = W - 1 - a;
+        }
+        if (flipB) {
+            b = H - 1 - b;
+        }
+        int i = boardI + (boardOrientation == 0 ? a : b);
+        int j = boardJ + (boardOrientation == 0 ? b : a);
+        return m_candidates[m_cells[j * side + i]].point;
+    };
+    // a chessboard alternates dark and bright squares, other grids of X-junctions (tiles, shelves) do not
+    auto squareAt = [&](int a, int b) {
+        return sample(0.25f * (pointAt(a, b) + pointAt(a + 1, b) + pointAt(a, b + 1) + pointAt(a + 1, b + 1)));
+    };
+    float evenDark = squareAt(0, 0) < squareAt(1, 0) ? 1.f : -1.f;
+    for (int b = 0; b < H - 1; b++) {
+        for (int a = 0; a < W - 1; a++) {
+            float expected = (a + b) % 2 == 0 ? evenDark : -evenDark;
+            float value = squareAt(a, b);
+            if ((a + 1 < W - 1 && (value - squareAt(a + 1, b)) * expected >= 0) ||
+                (b + 1 < H - 1 && (value - squareAt(a, b + 1)) * expected >= 0)) {
+                return false;
+            }
+        }
+    }
+    // like cv::findChessboardCorners, the column direction is a clockwise turn from the row direction on screen;
+    // this fixes the handedness of the board frame seen by solvePnP
+    if (cross(pointAt(W - 1, 0) - pointAt(0, 0), pointAt(0, H - 1) - pointAt(0, 0)) < 0) {
+        flipA = true;
+    }
+    // two orderings are left, half a turn apart
+    bool turn;
+    if ((W + H) % 2 == 1) {
+        // the board is not symmetric under a half turn: start at the corner whose inner diagonal square is black
+        turn = squareAt(0, 0) > squareAt(1, 0);
+    } else {
+        // symmetric board: start at the upper one of the two candidates
+        float firstY = pointAt(0, 0).y;
+        turn = pointAt(W - 1, H - 1).y < firstY;
+    }
+    if (turn) {
+        flipA = !flipA;
+        flipB = !flipB;
+    }
+    corners.resize(W * H);
+    for (int b = 0; b < H; b++) {
+        for (int a = 0; a < W; a++) {
+            corners[b * W + a] = pointAt(a, b);
+        }
+    }
+    return true;
+}
+
+float ChessboardDetector::sample(cv::Point2f point) const {
+    int x = std::min(std::max(cvRound(point.x), 0), m_blurred.cols - 1);
+    int y = std::min(std::max(cvRound(point.y), 0), m_blurred.rows - 1);
+    return m_blurred.at<float>(y, x);
+}
@@ -0,0 +1,697 @@
+//
+// CS 5330 - Project 4
+// Nathaniel Haddad and Stephen Dorris
+//
+
+#include <algorithm>
+#include <cctype>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <map>
+#include <set>
+#include <tuple>
+#include <sys/types.h>
+
+// OpenCV Libraries
+#include <opencv2/calib3d.hpp>
+
+// Local Includes
+#include "ChunkedMesh.h"
+#include "ObjectModel.h"
+#include "Transforms.h"
+
+namespace {
+
+const char MAGIC[8] = {'O', 'B', 'J', 'C', 'H', 'N', 'K', '1'};
+
+const int MAX_CELLS_PER_SIDE = 16; // chunk ids must fit into the two bytes kept per vertex while building
+
+const double TRIANGLES_PER_CHUNK = 50000;
+
+const int COARSE_CELLS_PER_SIDE = 8; // vertex clustering grid of the coarse version, per chunk
+
+const int PENDING_FACES = 4096; // faces buffered per chunk before they are appended to its scratch file
+
+const size_t FACE_BLOCK = 65536; // faces read at once from a scratch file while a chunk is assembled
+
+const size_t MAX_CHUNK_VERTICES = (size_t) 1 << 24; // the chunk file stores local indices as floats, exact up to here
+
+/**
+ * A triangle as 1-based indices into every vertex of the obj file; 64 bit in the scratch files so models past 2^31
+ * vertices split correctly, only the indices local to a chunk are narrowed to 32 bit
+ */
+struct GlobalFace {
+    int64_t vertices[3];
+};
+
+/**
+ * Layout of the chunk file: this header, the table of chunks, then the coarse and fine data of every chunk, each as
+ * its vertices followed by its faces, all as Vec3f
+ */
+struct ChunkFileHeader {
+    char magic[8];
+    int64_t sourceSize; // size of the obj file the chunks were written from
+    int64_t sourceTime; // modification time of the obj file
+    int64_t chunkCount;
+};
+
+/**
+ * fillHeader
+ * @return (bool) false if the obj file cannot be inspected
+ */
+bool fillHeader(const std::string &path, ChunkFileHeader &header) {
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    std::error_code error;
+    uintmax_t size = std::filesystem::file_size(path, error);
+    if (error) {
+        return false;
+    }
+    std::filesystem::file_time_type time = std::filesystem::last_write_time(path, error);
+    if (error) {
+        return false;
+    }
+    header.sourceSize = (int64_t) size;
+    header.sourceTime = (int64_t) time.time_since_epoch().count();
+    return true;
+}
+
+/**
+ * readLine
+ * @param file (FILE *) an open obj file
+ * @param type (std::string &) receives the first word of the line ("v", "f", ...)
+ * @param line (std::vector<char> &) receives the rest of the line
+ * @return (bool) false at the end of the file
+ */
+bool readLine(FILE *file, std::string &type, std::vector<char> &line) {
+    type.clear();
+    line.clear();
+    int c = fgetc(file);
+    if (c == EOF) {
+        return false;
+    }
+    while (c == ' ' || c == '\t') {
+        c = fgetc(file);
+    }
+    for (; c != EOF && c != '\n' && !isspace(c); c = fgetc(file)) {
+        type.push_back((char) c);
+    }
+    for (; c != EOF && c != '\n'; c = fgetc(file)) {
+        line.push_back((char) c);
+    }
+    line.push_back('\0');
+    return true;
+}
+
+/**
+ * parseFace
+ * @param line (const char *) the rest of an "f" line
+ * @param vertexCount (int64_t) vertices read so far, for relative indices
+ * @param polygon (std::vector<int64_t> &) receives the 1-based vertex indices, texture and normal indices are skipped
+ */
+void parseFace(const char *line, int64_t vertexCount, std::vector<int64_t> &polygon) {
+    polygon.clear();
+    const char *cursor = line;
+    for (;;) {
+        char *end;
+        long long index = strtoll(cursor, &end, 10);
+        if (end == cursor) {
+            return;
+        }
+        polygon.push_back(index < 0 ? vertexCount + index + 1 : index);
+        for (cursor = end; *cursor != '\0' && !isspace(*cursor); cursor++) {
+        }
+    }
+}
+
+/**
+ * appendFaces
+ * @does appends the buffered faces of a chunk to its scratch file and empties the buffer
+ */
+bool appendFaces(const std::string &path, std::vector<GlobalFace> &faces) {
+    if (faces.empty()) {
+        return true;
+    }
+    FILE *file = fopen(path.c_str(), "ab");
+    if (file == nullptr) {
+        return false;
+    }
+    bool written = fwrite(faces.data(), sizeof(GlobalFace), faces.size(), file) == faces.size();
+    fclose(file);
+    faces.clear();
+    return written;
+}
+
+/**
+ * simplify
+ * @param fine (const ChunkedMesh::ChunkData &) the faces of a chunk over its own vertices
+ * @param cellsPerSide (int) clustering cells along the longest side of the chunk
+ * @return (ChunkedMesh::ChunkData) the chunk with every vertex snapped to the first vertex of its cell, collapsed and
+ *         repeated faces dropped and only the vertices still used kept
+ */
+ChunkedMesh::ChunkData simplify(const ChunkedMesh::ChunkData &fine, int cellsPerSide) {
+    ChunkedMesh::ChunkData coarse;
+    if (fine.vertices.empty()) {
+        return coarse;
+    }
+    cv::Vec3f low = fine.vertices[0], high = fine.vertices[0];
+    for (const cv::Vec3f &v : fine.vertices) {
+        for (int i = 0; i < 3; i++) {
+            low[i] = std::min(low[i], v[i]);
+            high[i] = std::max(high[i], v[i]);
+        }
+    }
+    float extent = std::max(std::max(high[0] - low[0], high[1] - low[1]), high[2] - low[2]);
+    float cellSize = extent > 0 ? extent / cellsPerSide : 1;
+    std::map<std::tuple<int, int, int>, unsigned int> cells;
+    std::vector<unsigned int> representative(fine.vertices.size());
+    for (size_t i = 0; i < fine.vertices.size(); i++) {
+        cv::Vec3f cell = (fine.vertices[i] - low) * (1.f / cellSize);
+        std::tuple<int, int, int> key((int) cell[0], (int) cell[1], (int) cell[2]);
+        std::pair<std::map<std::tuple<int, int, int>, unsigned int>::iterator, bool> inserted =
+                cells.emplace(key, (unsigned int) coarse.vertices.size() + 1);
+        if (inserted.second) {
+            coarse.vertices.push_back(fine.vertices[i]);
+        }
+        representative[i] = inserted.first->second;
+    }
+    std::set<std::tuple<unsigned int, unsigned int, unsigned int>> faces;
+    for (const cv::Vec3f &face : fine.indices) {
+        unsigned int a = representative[(unsigned int) face[0] - 1];
+        unsigned int b = representative[(unsigned int) face[1] - 1];
+        unsigned int c = representative[(unsigned int) face[2] - 1];
+        if (a == b || b == c || a == c) {
+            continue;
+        }
+        std::tuple<unsigned int, unsigned int, unsigned int> key =
+                std::min({std::make_tuple(a, b, c), std::make_tuple(b, c, a), std::make_tuple(c, a, b)});
+        if (faces.insert(key).second) {
+            coarse.indices.emplace_back((float) a, (float) b, (float) c);
+        }
+    }
+    return coarse;
+}
+
+}
+
+ChunkedMesh::~ChunkedMesh() {
+    close();
+}
+
+size_t ChunkedMesh::byteSize(int64_t vertexCount, int64_t indexCount) {
+    return (size_t) (vertexCount + indexCount) * sizeof(cv::Vec3f);
+}
+
+bool ChunkedMesh::build(const std::string &objPath, const std::string &chunkPath) {
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    ChunkFileHeader header;
+    if (!fillHeader(objPath, header)) {
+        std::cerr << "ERROR: cannot open " << objPath << std::endl;
+        return false;
+    }
+    std::string scratch = chunkPath + ".tmp";
+    std::error_code error;
+    std::filesystem::remove_all(scratch, error);
+    if (!std::filesystem::create_directories(scratch, error)) {
+        std::cerr << "ERROR: cannot create " << scratch << std::endl;
+        return false;
+    }
+    FILE *obj = fopen(objPath.c_str(), "r");
+    FILE *vertexFile = fopen((scratch + "/vertices.bin").c_str(), "wb+");
+    if (obj == nullptr || vertexFile == nullptr) {
+        std::cerr << "ERROR: cannot read " << objPath << " or write " << scratch << std::endl;
+        if (obj != nullptr) {
+            fclose(obj);
+        }
+        if (vertexFile != nullptr) {
+            fclose(vertexFile);
+        }
+        return false;
+    }
+
+    // first pass: spill the vertices, find the bounds and count the triangles
+    std::string type;
+    std::vector<char> line;
+    std::vector<int64_t> polygon;
+    int64_t vertexCount = 0, triangleCount = 0;
+    cv::Vec3f low(FLT_MAX, FLT_MAX, FLT_MAX), high(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+    while (readLine(obj, type, line)) {
+        if (type == "v") {
+            cv::Vec3f vertex;
+            if (sscanf(line.data(), "%f %f %f", &vertex[0], &vertex[1], &vertex[2]) != 3) {
+                continue;
+            }
+            fwrite(&vertex, sizeof(vertex), 1, vertexFile);
+            for (int i = 0; i < 3; i++) {
+                low[i] = std::min(low[i], vertex[i]);
+                high[i] = std::max(high[i], vertex[i]);
+            }
+            vertexCount++;
+        } else if (type == "f") {
+            parseFace(line.data(), vertexCount, polygon);
+            triangleCount += std::max((int64_t) polygon.size() - 2, (int64_t) 0);
+        }
+    }
+    int cellsPerSide = std::min(std::max((int) std::ceil(std::cbrt(triangleCount / TRIANGLES_PER_CHUNK)), 1),
+                                MAX_CELLS_PER_SIDE);
+    int chunkCount = cellsPerSide * cellsPerSide * cellsPerSide;
+
+    // the chunk of every vertex, the only thing kept per vertex
+    std::vector<uint16_t> vertexChunks((size_t) vertexCount);
+    cv::Vec3f cellSize;
+    for (int i = 0; i < 3; i++) {
+        cellSize[i] = high[i] > low[i] ? (high[i] - low[i]) / cellsPerSide : 1;
+    }
+    rewind(vertexFile);
+    std::vector<cv::Vec3f> block(65536);
+    for (int64_t first = 0; first < vertexCount; first += (int64_t) block.size()) {
+        size_t count = (size_t) std::min((int64_t) block.size(), vertexCount - first);
+        if (fread(block.data(), sizeof(cv::Vec3f), count, vertexFile) != count) {
+            break;
+        }
+        for (size_t i = 0; i < count; i++) {
+            int cell[3];
+            for (int axis = 0; axis < 3; axis++) {
+                cell[axis] = std::min((int) ((block[i][axis] - low[axis]) / cellSize[axis]), cellsPerSide - 1);
+            }
+            vertexChunks[first + i] = (uint16_t) ((cell[2] * cellsPerSide + cell[1]) * cellsPerSide + cell[0]);
+        }
+    }
+
+    // second pass: every triangle goes to the chunk of its first vertex
+    std::vector<std::vector<GlobalFace>> pending(chunkCount);
+    std::vector<int64_t> chunkTriangles(chunkCount, 0);
+    rewind(obj);
+    int64_t verticesSeen = 0;
+    bool valid = true;
+    while (valid && readLine(obj, type, line)) {
+        if (type == "v") {
+            verticesSeen++;
+            continue;
+        }
+        if (type != "f") {
+            continue;
+        }
+        parseFace(line.data(), verticesSeen, polygon);
+        for (size_t i = 2; i < polygon.size(); i++) {
+            int64_t a = polygon[0], b = polygon[i - 1], c = polygon[i];
+            if (std::min({a, b, c}) < 1 || std::max({a, b, c}) > vertexCount) {
+                std::cerr << "ERROR: face with a vertex index out of range in " << objPath << std::endl;
+                valid = false;
+                break;
+            }
+            int chunk = vertexChunks[a - 1];
+            pending[chunk].push_back({{a, b, c}});
+            chunkTriangles[chunk]++;
+            if ((int) pending[chunk].size() >= PENDING_FACES) {
+                valid &= appendFaces(scratch + "/faces_" + std::to_string(chunk) + ".bin", pending[chunk]);
+            }
+        }
+    }
+    fclose(obj);
+    for (int chunk = 0; valid && chunk < chunkCount; chunk++) {
+        valid &= appendFaces(scratch + "/faces_" + std::to_string(chunk) + ".bin", pending[chunk]);
+    }
+    std::vector<uint16_t>().swap(vertexChunks);
+
+    // third pass: every chunk is assembled on its own from its faces and the vertices they use
+    std::vector<ChunkEntry> entries;
+    for (int chunk = 0; chunk < chunkCount; chunk++) {
+        if (chunkTriangles[chunk] > 0) {
+            entries.emplace_back();
+        }
+    }
+    header.chunkCount = (int64_t) entries.size();
+    std::string partialPath = chunkPath + ".partial";
+    FILE *output = valid ? fopen(partialPath.c_str(), "wb") : nullptr;
+    if (valid && output == nullptr) {
+        std::cerr << "ERROR: cannot write " << partialPath << std::endl;
+    }
+    valid = output != nullptr && fwrite(&header, sizeof(header), 1, output) == 1 &&
+            fwrite(entries.data(), sizeof(ChunkEntry), entries.size(), output) == entries.size();
+    size_t entryIndex = 0;
+    std::vector<GlobalFace> faces(FACE_BLOCK);
+    std::vector<int64_t> used;
+    ChunkData fine;
+    for (int chunk = 0; valid && chunk < chunkCount; chunk++) {
+        if (chunkTriangles[chunk] == 0) {
+            continue;
+        }
+        std::string facePath = scratch + "/faces_" + std::to_string(chunk) + ".bin";
+        FILE *faceFile = fopen(facePath.c_str(), "rb");
+        valid = faceFile != nullptr;
+        // the faces are read in blocks and the vertices they use deduplicated whenever the list doubled, so neither
+        // the faces nor three indices per face are held in memory at once
+        used.clear();
+        size_t uniqueCount = 0;
+        for (int64_t left = chunkTriangles[chunk]; valid && left > 0;) {
+            size_t count = (size_t) std::min((int64_t) faces.size(), left);
+            valid = fread(faces.data(), sizeof(GlobalFace), count, faceFile) == count;
+            for (size_t i = 0; valid && i < count; i++) {
+                used.insert(used.end(), faces[i].vertices, faces[i].vertices + 3);
+            }
+            left -= (int64_t) count;
+            if (left == 0 || used.size() >= 2 * std::max(uniqueCount, FACE_BLOCK)) {
+                std::sort(used.begin(), used.end());
+                used.erase(std::unique(used.begin(), used.end()), used.end());
+                uniqueCount = used.size();
+            }
+        }
+        if (valid && used.size() > MAX_CHUNK_VERTICES) {
+            std::cerr << "ERROR: a chunk of " << objPath << " uses more than " << MAX_CHUNK_VERTICES << " vertices"
+                      << std::endl;
+            valid = false;
+        }
+        // the vertices are read in file order, seeking only over gaps
+        fine.vertices.resize(valid ? used.size() : 0);
+        int64_t position = -1;
+        for (size_t i = 0; valid && i < used.size(); i++) {
+            if (used[i] - 1 != position) {
+                valid = fseeko(vertexFile, (off_t) ((used[i] - 1) * (int64_t) sizeof(cv::Vec3f)), SEEK_SET) == 0;
+            }
+            valid = valid && fread(&fine.vertices[i], sizeof(cv::Vec3f), 1, vertexFile) == 1;
+            position = used[i];
+        }
+        // second read of the faces, now over the chunk's own vertices
+        fine.indices.resize(valid ? (size_t) chunkTriangles[chunk] : 0);
+        valid = valid && fseeko(faceFile, 0, SEEK_SET) == 0;
+        for (size_t first = 0; valid && first < fine.indices.size(); first += faces.size()) {
+            size_t count = std::min(faces.size(), fine.indices.size() - first);
+            valid = fread(faces.data(), sizeof(GlobalFace), count, faceFile) == count;
+            for (size_t i = 0; valid && i < count; i++) {
+                for (int k = 0; k < 3; k++) {
+                    uint32_t local = (uint32_t) (std::lower_bound(used.begin(), used.end(), faces[i].vertices[k]) -
+                                                 used.begin());
+                    fine.indices[first + i][k] = (float) (local + 1);
+                }
+            }
+        }
+        if (faceFile != nullptr) {
+            fclose(faceFile);
+        }
+        std::filesystem::remove(facePath, error);
+        if (!valid) {
+            break;
+        }
+        ChunkData coarse = simplify(fine, COARSE_CELLS_PER_SIDE);
+        ChunkEntry &entry = entries[entryIndex++];
+        entry.low = entry.high = fine.vertices[0];
+        for (const cv::Vec3f &v : fine.vertices) {
+            for (int i = 0; i < 3; i++) {
+                entry.low[i] = std::min(entry.low[i], v[i]);
+                entry.high[i] = std::max(entry.high[i], v[i]);
+            }
+        }
+        entry.coarseOffset = (int64_t) ftello(output);
+        entry.coarseVertexCount = (int64_t) coarse.vertices.size();
+        entry.coarseIndexCount = (int64_t) coarse.indices.size();
+        entry.fineOffset = entry.coarseOffset + (int64_t) byteSize(entry.coarseVertexCount, entry.coarseIndexCount);
+        entry.fineVertexCount = (int64_t) fine.vertices.size();
+        entry.fineIndexCount = (int64_t) fine.indices.size();
+        for (const ChunkData *data : {&coarse, &fine}) {
+            valid = valid && fwrite(data->vertices.data(), sizeof(cv::Vec3f), data->vertices.size(), output) ==
+                             data->vertices.size() &&
+                    fwrite(data->indices.data(), sizeof(cv::Vec3f), data->indices.size(), output) ==
+                    data->indices.size();
+        }
+    }
+    fclose(vertexFile);
+    if (output != nullptr) {
+        valid = valid && fseeko(output, (off_t) sizeof(header), SEEK_SET) == 0 &&
+                fwrite(entries.data(), sizeof(ChunkEntry), entries.size(), output) == entries.size();
+        valid = fclose(output) == 0 && valid;
+    }
+    std::filesystem::remove_all(scratch, error);
+    if (!valid) {
+        std::cerr << "ERROR: could not split " << objPath << " into chunks" << std::endl;
+        std::filesystem::remove(partialPath, error);
+        return false;
+    }
+    std::filesystem::rename(partialPath, chunkPath, error);
+    if (error) {
+        std::cerr << "ERROR: cannot write " << chunkPath << std::endl;
+        return false;
+    }
+    printf("Split %s into %zu chunks (%lld vertices, %lld triangles) in %.1f s\n", objPath.c_str(), entries.size(),
+           (long long) vertexCount, (long long) triangleCount,
+           std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+    return true;
+}
+
+bool ChunkedMesh::open(const std::string &objPath, int budgetMb) {
+    close();
+    m_path = objPath + ".chunks";
+    for (int attempt = 0; attempt < 2; attempt++) {
+        ChunkFileHeader stored, expected;
+        m_file = fopen(m_path.c_str(), "rb");
+        bool current = m_file != nullptr && fread(&stored, sizeof(stored), 1, m_file) == 1 &&
+                       memcmp(stored.magic, MAGIC, sizeof(MAGIC)) == 0 && stored.chunkCount >= 0;
+        // without the obj file the chunks are used as they are, they may be all that is kept of a huge model
+        if (current && fillHeader(objPath, expected)) {
+            current = stored.sourceSize == expected.sourceSize && stored.sourceTime == expected.sourceTime;
+        }
+        std::vector<ChunkEntry> entries(current ? stored.chunkCount : 0);
+        current = current && fread(entries.data(), sizeof(ChunkEntry), entries.size(), m_file) == entries.size();
+        if (current) {
+            m_chunks.assign(entries.size(), Chunk());
+            for (size_t i = 0; i < entries.size(); i++) {
+                m_chunks[i].entry = entries[i];
+            }
+            break;
+        }
+        if (m_file != nullptr) {
+            fclose(m_file);
+            m_file = nullptr;
+        }
+        if (attempt > 0 || !build(objPath, m_path)) {
+            return false;
+        }
+    }
+    if (m_chunks.empty()) {
+        std::cerr << "ERROR: " << objPath << " has no faces" << std::endl;
+        fclose(m_file);
+        m_file = nullptr;
+        return false;
+    }
+    size_t coarseBytes = 0, fineBytes = 0;
+    for (const Chunk &chunk : m_chunks) {
+        coarseBytes += byteSize(chunk.entry.coarseVertexCount, chunk.entry.coarseIndexCount);
+        fineBytes += byteSize(chunk.entry.fineVertexCount, chunk.entry.fineIndexCount);
+    }
+    m_budget = (size_t) std::max(budgetMb, 1) << 20;
+    m_fineBytes = 0;
+    m_stopping = false;
+    m_loading = true;
+    // placed on the chessboard like ObjectModel::loadModel: a quarter turn about x, five squares per unit
+    m_transform = cv::Matx33f(Transforms::rotateX3x3(-(M_PI / 2.0f))) * 5.f;
+    printf("Streaming %s: %zu chunks, %.1f MB coarse, %.1f MB fine, %d MB budget\n", objPath.c_str(),
+           m_chunks.size(), coarseBytes / 1048576.0, fineBytes / 1048576.0, std::max(budgetMb, 1));
+    m_loader.run([this]() {
+        loadCoarse();
+        loadFine();
+    });
+    return true;
+}
+
+bool ChunkedMesh::isOpen() const {
+    return m_file != nullptr;
+}
+
+std::shared_ptr<const ChunkedMesh::ChunkData> ChunkedMesh::readChunk(int64_t offset, int64_t vertexCount,
+                                                                     int64_t indexCount) {
+    std::shared_ptr<ChunkData> data = std::make_shared<ChunkData>();
+    data->vertices.resize((size_t) vertexCount);
+    data->indices.resize((size_t) indexCount);
+    if (fseeko(m_file, (off_t) offset, SEEK_SET) != 0 ||
+        fread(data->vertices.data(), sizeof(cv::Vec3f), data->vertices.size(), m_file) != data->vertices.size() ||
+        fread(data->indices.data(), sizeof(cv::Vec3f), data->indices.size(), m_file) != data->indices.size()) {
+        std::cerr << "ERROR: could not read a chunk of " << m_path << std::endl;
+        return nullptr;
+    }
+    return data;
+}
+
+void ChunkedMesh::loadCoarse() {
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    // every coarse chunk first, the whole model is shown as early as possible
+    for (size_t i = 0; i < m_chunks.size(); i++) {
+        ChunkEntry entry;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (m_stopping) {
+                return;
+            }
+            entry = m_chunks[i].entry;
+        }
+        std::shared_ptr<const ChunkData> data = readChunk(entry.coarseOffset, entry.coarseVertexCount,
+                                                          entry.coarseIndexCount);
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_chunks[i].coarse = data;
+    }
+    printf("Coarse model read in %.0f ms\n",
+           std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+}
+
+void ChunkedMesh::loadFine() {
+    // the fine chunk of the largest chunk on screen that is still coarse, making room if needed
+    for (;;) {
+        size_t next = m_chunks.size();
+        ChunkEntry entry;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (m_stopping) {
+                m_loading = false;
+                return;
+            }
+            next = m_chunks.size();
+            for (size_t i = 0; i < m_chunks.size(); i++) {
+                const Chunk &chunk = m_chunks[i];
+                if (!chunk.fine && !chunk.unreadable && chunk.screenSize >= m_minScreenSize &&
+                    byteSize(chunk.entry.fineVertexCount, chunk.entry.fineIndexCount) <= m_budget &&
+                    (next == m_chunks.size() || chunk.screenSize > m_chunks[next].screenSize)) {
+                    next = i;
+                }
+            }
+            size_t needed = next < m_chunks.size() ? byteSize(m_chunks[next].entry.fineVertexCount,
+                                                              m_chunks[next].entry.fineIndexCount) : 0;
+            // only chunks that are off-screen or too small to need their fine version are evicted
+            while (next < m_chunks.size() && m_fineBytes + needed > m_budget) {
+                size_t evict = m_chunks.size();
+                for (size_t i = 0; i < m_chunks.size(); i++) {
+                    const Chunk &chunk = m_chunks[i];
+                    if (chunk.fine && chunk.screenSize < m_minScreenSize &&
+                        (evict == m_chunks.size() || chunk.screenSize < m_chunks[evict].screenSize)) {
+                        evict = i;
+                    }
+                }
+                if (evict == m_chunks.size()) {
+                    next = m_chunks.size();
+                    break;
+                }
+                m_chunks[evict].fine.reset();
+                m_fineBytes -= byteSize(m_chunks[evict].entry.fineVertexCount,
+                                        m_chunks[evict].entry.fineIndexCount);
+            }
+            if (next == m_chunks.size()) {
+                // nothing to read or no room: the worker is released until the next frame moves the model
+                m_loading = false;
+                return;
+            }
+            entry = m_chunks[next].entry;
+        }
+        std::shared_ptr<const ChunkData> data = readChunk(entry.fineOffset, entry.fineVertexCount,
+                                                          entry.fineIndexCount);
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!data) {
+            m_chunks[next].unreadable = true;
+            continue;
+        }
+        m_chunks[next].fine = data;
+        m_fineBytes += byteSize(entry.fineVertexCount, entry.fineIndexCount);
+    }
+}
+
+void ChunkedMesh::applyTransform(const cv::Matx33f &transform) {
+    m_transform = transform * m_transform;
+}
+
+int ChunkedMesh::draw(LineRasterizer &rasterizer, const cv::Mat &rotationVector, const cv::Mat &translationVector,
+                      const cv::Mat &cameraMatrix, const cv::Mat &distortionCoefficients, cv::Size frameSize) {
+    if (!isOpen()) {
+        return 0;
+    }
+    cv::Matx33d rotation;
+    cv::Rodrigues(rotationVector, rotation);
+    cv::Matx33d toCamera = rotation * cv::Matx33d(m_transform);
+    cv::Vec3d translation(translationVector.at<double>(0), translationVector.at<double>(1),
+                          translationVector.at<double>(2));
+    cv::Matx33d K = cameraMatrix;
+    cv::Rect frame(cv::Point(0, 0), frameSize);
+    int fineCount = 0;
+    bool startLoader = false;
+    m_drawn.assign(m_chunks.size(), nullptr);
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (size_t i = 0; i < m_chunks.size(); i++) {
+            Chunk &chunk = m_chunks[i];
+            // the bounding box through a pinhole camera, enough to tell whether and how large the chunk is on screen
+            float minX = FLT_MAX, minY = FLT_MAX, maxX = -FLT_MAX, maxY = -FLT_MAX;
+            int behind = 0;
+            for (int corner = 0; corner < 8; corner++) {
+                cv::Vec3d point((corner & 1) ? chunk.entry.high[0] : chunk.entry.low[0],
+                                (corner & 2) ? chunk.entry.high[1] : chunk.entry.low[1],
+                                (corner & 4) ? chunk.entry.high[2] : chunk.entry.low[2]);
+                cv::Vec3d camera = toCamera * point + translation;
+                if (camera[2] <= 1e-6) {
+                    behind++;
+                    continue;
+                }
+                cv::Vec3d pixel = K * (camera * (1.0 / camera[2]));
+                minX = std::min(minX, (float) pixel[0]);
+                minY = std::min(minY, (float) pixel[1]);
+                maxX = std::max(maxX, (float) pixel[0]);
+                maxY = std::max(maxY, (float) pixel[1]);
+            }
+            if (behind == 8) {
+                chunk.screenSize = 0;
+            } else if (behind > 0) {
+                // crosses the camera plane, as large as the screen
+                chunk.screenSize = (float) std::max(frameSize.width, frameSize.height);
+            } else {
+                cv::Rect bounds(cv::Point((int) std::floor(minX), (int) std::floor(minY)),
+                                cv::Point((int) std::ceil(maxX) + 1, (int) std::ceil(maxY) + 1));
+                chunk.screenSize = (bounds & frame).empty() ? 0 : std::max(maxX - minX, maxY - minY);
+            }
+            if (chunk.screenSize <= 0) {
+                continue;
+            }
+            if (chunk.fine && chunk.screenSize >= m_minScreenSize) {
+                m_drawn[i] = chunk.fine;
+                fineCount++;
+            } else {
+                m_drawn[i] = chunk.coarse;
+            }
+        }
+        // the new screen sizes may call for other fine chunks, a loader task looks unless one is still at it
+        startLoader = !m_loading && !m_stopping;
+        m_loading = m_loading || startLoader;
+    }
+    if (startLoader) {
+        m_loader.run([this]() { loadFine(); });
+    }
+
+    for (const std::shared_ptr<const ChunkData> &data : m_drawn) {
+        if (!data) {
+            continue;
+        }
+        m_transformed.resize(data->vertices.size());
+        for (size_t v = 0; v < data->vertices.size(); v++) {
+            m_transformed[v] = m_transform * data->vertices[v];
+        }
+        cv::projectPoints(m_transformed, rotationVector, translationVector, cameraMatrix, distortionCoefficients,
+                          m_projected);
+        ObjectModel::draw(rasterizer, m_projected, data->indices);
+    }
+    // the chunks drawn are released here, an evicted chunk is freed once it is no longer drawn
+    m_drawn.clear();
+    return fineCount;
+}
+
+void ChunkedMesh::close() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+    }
+    m_loader.wait();
+    if (m_file != nullptr) {
+        fclose(m_file);
+        m_file = nullptr;
+    }
+    m_chunks.clear();
+    m_fineBytes = 0;
+}
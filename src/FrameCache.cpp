@@ -0,0 +1,104 @@
+//
+// CS 5330 - Project 4
+// Nathaniel Haddad and Stephen Dorris
+//
+
+#include <algorithm>
+
+// OpenCV Libraries
+#include <opencv2/imgproc.hpp>
+
+// Local Includes
+#include "FrameCache.h"
+
+void FrameCache::reset(const cv::Mat &frame) {
+    m_frame = frame;
+    m_gray = frame.channels() == 1 ? frame : cv::Mat();
+    m_levelCount = 0;
+    m_gradients = false;
+    m_scale = 0;
+    m_thumbnailFactor = 0;
+}
+
+void FrameCache::undistort(cv::Mat &frame, const UndistortMap &map) {
+    if (m_undistortBuffer.data == frame.data) {
+        // the caller captured into the buffer it got from the last swap, the remap cannot run in place
+        m_undistortBuffer.release();
+    }
+    map.apply(frame, m_undistortBuffer);
+    // swap instead of copy: the captured buffer becomes the destination of the next remap
+    std::swap(frame, m_undistortBuffer);
+    reset(frame);
+}
+
+const cv::Mat &FrameCache::frame() const {
+    return m_frame;
+}
+
+const cv::Mat &FrameCache::gray() {
+    if (m_gray.empty() && !m_frame.empty()) {
+        cv::cvtColor(m_frame, m_grayBuffer, m_frame.channels() == 4 ? cv::COLOR_BGRA2GRAY : cv::COLOR_BGR2GRAY);
+        m_gray = m_grayBuffer;
+    }
+    return m_gray;
+}
+
+const cv::Mat &FrameCache::level(int level) {
+    if (level <= 0) {
+        return gray();
+    }
+    level = std::min(level, MAX_LEVEL);
+    if (m_levelCount == 0) {
+        gray();
+        m_levelCount = 1;
+    }
+    for (; m_levelCount <= level; m_levelCount++) {
+        const cv::Mat &previous = m_levelCount == 1 ? m_gray : m_levels[m_levelCount - 2];
+        cv::pyrDown(previous, m_levels[m_levelCount - 1]);
+    }
+    return m_levels[level - 1];
+}
+
+const cv::Mat &FrameCache::gradientX() {
+    if (!m_gradients) {
+        cv::Sobel(gray(), m_gradientX, CV_32F, 1, 0, 3);
+        cv::Sobel(m_gray, m_gradientY, CV_32F, 0, 1, 3);
+        m_gradients = true;
+    }
+    return m_gradientX;
+}
+
+const cv::Mat &FrameCache::gradientY() {
+    gradientX();
+    return m_gradientY;
+}
+
+const cv::Mat &FrameCache::scaled(double scale) {
+    if (scale >= 1.0) {
+        return gray();
+    }
+    if (m_scale != scale) {
+        cv::resize(gray(), m_scaled, cv::Size(), scale, scale, cv::INTER_AREA);
+        m_scale = scale;
+    }
+    return m_scaled;
+}
+
+const cv::Mat &FrameCache::thumbnail(int factor) {
+    if (factor <= 1) {
+        return gray();
+    }
+    if (m_thumbnailFactor != factor) {
+        cv::Size size(std::max(1, m_frame.cols / factor), std::max(1, m_frame.rows / factor));
+        if (!m_gray.empty()) {
+            cv::resize(m_gray, m_thumbnail, size, 0, 0, cv::INTER_AREA);
+        } else {
+            // shrinking first makes the color conversion factor^2 times cheaper
+            cv::resize(m_frame, m_colorThumbnail, size, 0, 0, cv::INTER_AREA);
+            cv::cvtColor(m_colorThumbnail, m_thumbnail,
+                         m_frame.channels() == 4 ? cv::COLOR_BGRA2GRAY : cv::COLOR_BGR2GRAY);
+        }
+        m_thumbnailFactor = factor;
+    }
+    return m_thumbnail;
+}
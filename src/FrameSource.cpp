@@ -0,0 +1,57 @@
+//
+// CS 5330 - Project 4
+// Nathaniel Haddad and Stephen Dorris
+//
+
+#include <algorithm>
+#include <filesystem>
+#include <iostream>
+
+// OpenCV Libraries
+#include <opencv2/imgcodecs.hpp>
+
+// Local Includes
+#include "FrameSource.h"
+
+bool FrameSource::open(const std::string &path) {
+    if (std::filesystem::is_directory(path)) {
+        const std::vector<std::string> extensions{".png", ".jpg", ".jpeg", ".bmp", ".tif", ".tiff"};
+        for (const auto &entry : std::filesystem::directory_iterator(path)) {
+            std::string extension = entry.path().extension().string();
+            std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+            if (std::find(extensions.begin(), extensions.end(), extension) != extensions.end()) {
+                m_imagePaths.emplace_back(entry.path().string());
+            }
+        }
+        std::sort(m_imagePaths.begin(), m_imagePaths.end());
+        std::cout << "Found " << m_imagePaths.size() << " images in " << path << std::endl;
+        return !m_imagePaths.empty();
+    }
+    m_video.reset(new cv::VideoCapture(path));
+    if (!m_video->isOpened()) {
+        return false;
+    }
+    double fps = m_video->get(cv::CAP_PROP_FPS);
+    if (fps > 0) {
+        m_fps = fps;
+    }
+    return true;
+}
+
+bool FrameSource::read(cv::Mat &frame) {
+    if (m_video) {
+        return m_video->read(frame) && !frame.empty();
+    }
+    while (m_nextImage < m_imagePaths.size()) {
+        frame = cv::imread(m_imagePaths[m_nextImage++], cv::IMREAD_COLOR);
+        if (!frame.empty()) {
+            return true;
+        }
+        std::cerr << "ERROR: could not load image " << m_imagePaths[m_nextImage - 1] << std::endl;
+    }
+    return false;
+}
+
+double FrameSource::getFps() const {
+    return m_fps;
+}
@@ -0,0 +1,201 @@
+//
+// CS 5330 - Project 4
+// Nathaniel Haddad and Stephen Dorris
+//
+
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+
+// Local Includes
+#include "FrameStats.h"
+
+namespace {
+
+thread_local bool t_counting = false; // between beginFrame and endFrame on this thread
+
+thread_local uint64_t t_allocations = 0; // allocations of this thread while t_counting was set
+
+inline void countAllocation() {
+    if (t_counting) {
+        t_allocations++;
+    }
+}
+
+const char *STAGE_NAMES[FrameStats::STAGE_COUNT] = {"capture", "undistort", "detect", "pose", "project", "draw",
+                                                    "present"};
+
+void *countedAllocate(size_t size) {
+    countAllocation();
+    void *memory = malloc(size == 0 ? 1 : size);
+    if (memory == nullptr) {
+        throw std::bad_alloc();
+    }
+    return memory;
+}
+
+void *countedAllocate(size_t size, std::align_val_t alignment) {
+    countAllocation();
+    void *memory = aligned_alloc((size_t) alignment, ((size == 0 ? 1 : size) + (size_t) alignment - 1) /
+                                                     (size_t) alignment * (size_t) alignment);
+    if (memory == nullptr) {
+        throw std::bad_alloc();
+    }
+    return memory;
+}
+
+}
+
+// Replacements of the global allocation functions so allocations per frame can be counted. OpenCV image buffers
+// come from cv::fastMalloc and are not seen here.
+void *operator new(size_t size) {
+    return countedAllocate(size);
+}
+
+void *operator new[](size_t size) {
+    return countedAllocate(size);
+}
+
+void *operator new(size_t size, const std::nothrow_t &) noexcept {
+    countAllocation();
+    return malloc(size == 0 ? 1 : size);
+}
+
+void *operator new[](size_t size, const std::nothrow_t &) noexcept {
+    countAllocation();
+    return malloc(size == 0 ? 1 : size);
+}
+
+void *operator new(size_t size, std::align_val_t alignment) {
+    return countedAllocate(size, alignment);
+}
+
+void *operator new[](size_t size, std::align_val_t alignment) {
+    return countedAllocate(size, alignment);
+}
+
+void operator delete(void *memory) noexcept {
+    free(memory);
+}
+
+void operator delete[](void *memory) noexcept {
+    free(memory);
+}
+
+void operator delete(void *memory, size_t) noexcept {
+    free(memory);
+}
+
+void operator delete[](void *memory, size_t) noexcept {
+    free(memory);
+}
+
+void operator delete(void *memory, std::align_val_t) noexcept {
+    free(memory);
+}
+
+void operator delete[](void *memory, std::align_val_t) noexcept {
+    free(memory);
+}
+
+void operator delete(void *memory, size_t, std::align_val_t) noexcept {
+    free(memory);
+}
+
+void operator delete[](void *memory, size_t, std::align_val_t) noexcept {
+    free(memory);
+}
+
+FrameStats::FrameStats(int reportInterval) : m_reportInterval(reportInterval) {
+    m_intervalStart = Clock::now();
+}
+
+void FrameStats::setReportInterval(int reportInterval) {
+    m_reportInterval = reportInterval;
+}
+
+void FrameStats::beginFrame() {
+    t_counting = true;
+    m_allocationsAtFrameStart = allocationCount();
+    m_frameStart = Clock::now();
+    for (double &seconds : m_frameStageSeconds) {
+        seconds = 0;
+    }
+}
+
+bool FrameStats::endFrame() {
+    t_counting = false;
+    m_lastFrameSeconds = std::chrono::duration<double>(Clock::now() - m_frameStart).count();
+    for (int stage = 0; stage < STAGE_COUNT; stage++) {
+        m_lastStageSeconds[stage] = m_frameStageSeconds[stage];
+    }
+    uint64_t frameAllocations = allocationCount() - m_allocationsAtFrameStart;
+    m_allocations += frameAllocations;
+    if (frameAllocations > m_maxAllocations) {
+        m_maxAllocations = frameAllocations;
+    }
+    m_frames++;
+    if (m_reportInterval > 0 && m_frames >= (uint64_t) m_reportInterval) {
+        report();
+        return true;
+    }
+    return false;
+}
+
+void FrameStats::report() {
+    double seconds = std::chrono::duration<double>(Clock::now() - m_intervalStart).count();
+    // printf keeps the report itself from allocating
+    printf("##=== STATS: %llu frames, %.1f fps |", (unsigned long long) m_frames, m_frames / seconds);
+    for (int stage = 0; stage < STAGE_COUNT; stage++) {
+        printf(" %s %.2f ms", STAGE_NAMES[stage], 1000.0 * m_stageSeconds[stage] / m_frames);
+        m_stageSeconds[stage] = 0;
+    }
+    printf(" | allocations/frame avg %.1f max %llu", (double) m_allocations / m_frames,
+           (unsigned long long) m_maxAllocations);
+    if (m_arenaBytes > 0) {
+        printf(" | arena %.1f MB, grew %llu times", m_arenaBytes / (1024.0 * 1024.0),
+               (unsigned long long) m_arenaGrowths);
+    }
+    if (m_reusedDetections > 0) {
+        printf(" | detection reused in %.0f%% of frames", 100.0 * m_reusedDetections / m_frames);
+    }
+    if (m_quality[0] >= 0) {
+        printf(" | quality detect %d/%d render %d/%d", m_quality[0], m_quality[1], m_quality[2], m_quality[3]);
+    }
+    if (m_recordedFrames > 0) {
+        printf(" | recorder queue avg %.1f max %llu, %llu dropped", (double) m_recorderDepthSum / m_recordedFrames,
+               (unsigned long long) m_recorderMaxDepth, (unsigned long long) m_recorderDrops);
+    }
+    printf("\n");
+    m_frames = 0;
+    m_allocations = 0;
+    m_maxAllocations = 0;
+    m_reusedDetections = 0;
+    m_recordedFrames = 0;
+    m_recorderDepthSum = 0;
+    m_recorderMaxDepth = 0;
+    m_recorderDrops = 0;
+    m_intervalStart = Clock::now();
+}
+
+void FrameStats::countRecorder(size_t queueDepth, bool dropped) {
+    m_recordedFrames++;
+    m_recorderDepthSum += queueDepth;
+    if (queueDepth > m_recorderMaxDepth) {
+        m_recorderMaxDepth = queueDepth;
+    }
+    if (dropped) {
+        m_recorderDrops++;
+    }
+}
+
+void FrameStats::setQuality(int detectLevel, int detectMax, int renderLevel, int renderMax) {
+    m_quality[0] = detectLevel;
+    m_quality[1] = detectMax;
+    m_quality[2] = renderLevel;
+    m_quality[3] = renderMax;
+}
+
+uint64_t FrameStats::allocationCount() {
+    return t_allocations;
+}
@@ -0,0 +1,279 @@
+//
+// CS 5330 - Project 4
+// Nathaniel Haddad and Stephen Dorris
+//
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+
+// POSIX
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+// Local Includes
+#include "FrameStream.h"
+
+namespace {
+
+const size_t SLOT_ALIGNMENT = 64; // keeps every slot and its pixel data on its own cache lines
+
+size_t alignUp(size_t size) {
+    return (size + SLOT_ALIGNMENT - 1) / SLOT_ALIGNMENT * SLOT_ALIGNMENT;
+}
+
+uint32_t bytesPerPixel(PixelFormat pixelFormat) {
+    return pixelFormat == PixelFormat::GRAY8 ? 1 : (pixelFormat == PixelFormat::BGR8 ? 3 : 4);
+}
+
+/**
+ * tileRect
+ * @return (FrameRegion) the pixels tile covers in a frame of width x height cut into tiles of tileSize
+ */
+FrameRegion tileRect(uint32_t tile, uint32_t tileSize, uint32_t width, uint32_t height) {
+    uint32_t columns = (width + tileSize - 1) / tileSize;
+    FrameRegion region;
+    region.x = tile % columns * tileSize;
+    region.y = tile / columns * tileSize;
+    if (region.y >= height) {
+        return FrameRegion(); // not a tile of this frame, only seen in a torn read
+    }
+    region.width = std::min(tileSize, width - region.x);
+    region.height = std::min(tileSize, height - region.y);
+    return region;
+}
+
+}
+
+SharedFrameSink::SharedFrameSink(const std::string &name, uint32_t slotCount, uint32_t tileSize)
+        : m_name(name), m_slotCount(slotCount), m_tileSize(tileSize) {
+}
+
+SharedFrameSink::~SharedFrameSink() {
+    if (m_header != nullptr) {
+        munmap(m_header, m_mappedSize);
+        shm_unlink(m_name.c_str());
+    }
+}
+
+bool SharedFrameSink::create(size_t maxFrameBytes, size_t maxTiles) {
+    if (m_slotCount == 0) {
+        std::cerr << "ERROR: the frame ring " << m_name << " needs at least one slot" << std::endl;
+        return false;
+    }
+    size_t headerSize = alignUp(sizeof(FrameSlotHeader));
+    // a tile frame with every tile carries the whole frame and the tile indices
+    size_t slotSize = headerSize + alignUp(maxTiles * sizeof(uint32_t)) + alignUp(maxFrameBytes);
+    m_mappedSize = alignUp(sizeof(FrameRingHeader)) + slotSize * m_slotCount;
+    int fd = shm_open(m_name.c_str(), O_CREAT | O_RDWR, 0644);
+    if (fd < 0) {
+        std::cerr << "ERROR: shm_open " << m_name << ": " << strerror(errno) << std::endl;
+        return false;
+    }
+    if (ftruncate(fd, m_mappedSize) != 0) {
+        std::cerr << "ERROR: ftruncate " << m_name << ": " << strerror(errno) << std::endl;
+        close(fd);
+        return false;
+    }
+    void *memory = mmap(nullptr, m_mappedSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (memory == MAP_FAILED) {
+        std::cerr << "ERROR: mmap " << m_name << ": " << strerror(errno) << std::endl;
+        return false;
+    }
+    m_header = static_cast<FrameRingHeader *>(memory);
+    m_slots = static_cast<uint8_t *>(memory) + alignUp(sizeof(FrameRingHeader));
+    // readers check magic last, so a half initialised segment is never accepted
+    m_header->magic = 0;
+    m_header->version = FrameRingHeader::VERSION;
+    m_header->slotCount = m_slotCount;
+    m_header->headerSize = headerSize;
+    m_header->slotSize = slotSize;
+    m_header->writeIndex.store(0, std::memory_order_relaxed);
+    for (uint32_t i = 0; i < m_slotCount; i++) {
+        reinterpret_cast<FrameSlotHeader *>(m_slots + i * slotSize)->sequence.store(0, std::memory_order_relaxed);
+    }
+    std::atomic_thread_fence(std::memory_order_release);
+    m_header->magic = FrameRingHeader::MAGIC;
+    std::cout << "Publishing frames to shared memory " << m_name << " (" << m_slotCount << " slots of "
+              << slotSize << " bytes)" << std::endl;
+    return true;
+}
+
+bool SharedFrameSink::publish(const uint8_t *data, uint32_t width, uint32_t height, size_t stride,
+                              PixelFormat pixelFormat, uint64_t frameId, uint64_t timestampNs, bool base) {
+    uint32_t pixelBytes = bytesPerPixel(pixelFormat);
+    size_t rowBytes = (size_t) width * pixelBytes;
+    size_t frameBytes = rowBytes * height;
+    uint32_t columns = m_tileSize > 0 ? (width + m_tileSize - 1) / m_tileSize : 0;
+    uint32_t tileCount = m_tileSize > 0 ? columns * ((height + m_tileSize - 1) / m_tileSize) : 0;
+    if (m_header == nullptr && !create(frameBytes, tileCount)) {
+        return false;
+    }
+    if (frameBytes + alignUp(tileCount * sizeof(uint32_t)) > m_header->slotSize - m_header->headerSize) {
+        if (!m_warnedSize) {
+            std::cerr << "ERROR: frame of " << width << "x" << height << " does not fit in " << m_name << std::endl;
+            m_warnedSize = true;
+        }
+        return false;
+    }
+    // tiles only make sense on top of a base frame of the same size and format
+    base = base || m_tileSize == 0 || width != m_baseWidth || height != m_baseHeight ||
+           pixelFormat != m_basePixelFormat;
+    m_changedTiles.clear();
+    if (base) {
+        m_baseFrameId = frameId;
+        m_baseWidth = width;
+        m_baseHeight = height;
+        m_basePixelFormat = pixelFormat;
+        if (m_tileSize > 0) {
+            m_published.resize(frameBytes);
+            for (uint32_t y = 0; y < height; y++) {
+                std::memcpy(&m_published[y * rowBytes], data + y * stride, rowBytes);
+            }
+            m_changed.assign(tileCount, 0);
+        }
+    } else {
+        // tiles stay flagged until the next base frame, so a reader that skipped frames still composes the newest
+        // one from the base frame and the latest tile frame
+        for (uint32_t tile = 0; tile < tileCount; tile++) {
+            FrameRegion region = tileRect(tile, m_tileSize, width, height);
+            size_t offset = region.x * pixelBytes, bytes = region.width * pixelBytes;
+            bool changed = false;
+            for (uint32_t y = region.y; y < region.y + region.height && !changed; y++) {
+                changed = std::memcmp(&m_published[y * rowBytes + offset], data + y * stride + offset, bytes) != 0;
+            }
+            if (changed) {
+                for (uint32_t y = region.y; y < region.y + region.height; y++) {
+                    std::memcpy(&m_published[y * rowBytes + offset], data + y * stride + offset, bytes);
+                }
+                m_changed[tile] = 1;
+            }
+            if (m_changed[tile]) {
+                m_changedTiles.push_back(tile);
+            }
+        }
+    }
+
+    uint64_t index = m_header->writeIndex.load(std::memory_order_relaxed);
+    uint8_t *slot = m_slots + (index % m_header->slotCount) * m_header->slotSize;
+    FrameSlotHeader *slotHeader = reinterpret_cast<FrameSlotHeader *>(slot);
+    slotHeader->sequence.store(2 * index + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    slotHeader->width = width;
+    slotHeader->height = height;
+    slotHeader->stride = rowBytes;
+    slotHeader->tileSize = base ? 0 : m_tileSize;
+    slotHeader->tileCount = base ? 0 : (uint32_t) m_changedTiles.size();
+    slotHeader->pixelFormat = pixelFormat;
+    slotHeader->frameId = frameId;
+    slotHeader->baseFrameId = m_baseFrameId;
+    slotHeader->timestampNs = timestampNs;
+    uint8_t *pixels = slot + m_header->headerSize;
+    if (base) {
+        if (stride == rowBytes) {
+            std::memcpy(pixels, data, frameBytes);
+        } else {
+            for (uint32_t y = 0; y < height; y++) {
+                std::memcpy(pixels + y * rowBytes, data + y * stride, rowBytes);
+            }
+        }
+    } else {
+        std::memcpy(pixels, m_changedTiles.data(), m_changedTiles.size() * sizeof(uint32_t));
+        pixels += alignUp(m_changedTiles.size() * sizeof(uint32_t));
+        for (uint32_t tile : m_changedTiles) {
+            FrameRegion region = tileRect(tile, m_tileSize, width, height);
+            size_t bytes = region.width * pixelBytes;
+            for (uint32_t y = region.y; y < region.y + region.height; y++, pixels += bytes) {
+                std::memcpy(pixels, &m_published[y * rowBytes + region.x * pixelBytes], bytes);
+            }
+        }
+    }
+    slotHeader->sequence.store(2 * index + 2, std::memory_order_release);
+    m_header->writeIndex.store(index + 1, std::memory_order_release);
+    return true;
+}
+
+SharedFrameReader::~SharedFrameReader() {
+    if (m_header != nullptr) {
+        munmap(const_cast<FrameRingHeader *>(m_header), m_mappedSize);
+    }
+}
+
+bool SharedFrameReader::open(const std::string &name) {
+    int fd = shm_open(name.c_str(), O_RDONLY, 0);
+    if (fd < 0) {
+        std::cerr << "ERROR: shm_open " << name << ": " << strerror(errno) << std::endl;
+        return false;
+    }
+    void *memory = mmap(nullptr, sizeof(FrameRingHeader), PROT_READ, MAP_SHARED, fd, 0);
+    if (memory == MAP_FAILED) {
+        close(fd);
+        return false;
+    }
+    const FrameRingHeader *header = static_cast<const FrameRingHeader *>(memory);
+    bool compatible = header->magic == FrameRingHeader::MAGIC && header->version == FrameRingHeader::VERSION;
+    size_t mappedSize = alignUp(sizeof(FrameRingHeader)) + header->slotSize * header->slotCount;
+    munmap(memory, sizeof(FrameRingHeader));
+    if (!compatible) {
+        std::cerr << "ERROR: " << name << " is not a compatible frame stream" << std::endl;
+        close(fd);
+        return false;
+    }
+    memory = mmap(nullptr, mappedSize, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (memory == MAP_FAILED) {
+        return false;
+    }
+    m_mappedSize = mappedSize;
+    m_header = static_cast<const FrameRingHeader *>(memory);
+    m_slots = static_cast<const uint8_t *>(memory) + alignUp(sizeof(FrameRingHeader));
+    return true;
+}
+
+bool SharedFrameReader::acquireLatest(FrameView &view) {
+    uint64_t written = m_header->writeIndex.load(std::memory_order_acquire);
+    if (written == 0 || written <= m_readIndex) {
+        return false;
+    }
+    uint64_t index = written - 1;
+    const uint8_t *slot = m_slots + (index % m_header->slotCount) * m_header->slotSize;
+    const FrameSlotHeader *slotHeader = reinterpret_cast<const FrameSlotHeader *>(slot);
+    view.sequence = slotHeader->sequence.load(std::memory_order_acquire);
+    if (view.sequence != 2 * index + 2) {
+        return false; // already being overwritten, try again
+    }
+    view.width = slotHeader->width;
+    view.height = slotHeader->height;
+    view.stride = slotHeader->stride;
+    view.tileSize = slotHeader->tileSize;
+    view.tileCount = slotHeader->tileCount;
+    view.pixelFormat = slotHeader->pixelFormat;
+    view.frameId = slotHeader->frameId;
+    view.baseFrameId = slotHeader->baseFrameId;
+    view.timestampNs = slotHeader->timestampNs;
+    // a torn header may claim anything, the view never reaches past its slot
+    size_t indexBytes = view.tileSize > 0 ? alignUp((size_t) view.tileCount * sizeof(uint32_t)) : 0;
+    if (indexBytes > m_header->slotSize - m_header->headerSize) {
+        return false;
+    }
+    view.tiles = reinterpret_cast<const uint32_t *>(slot + m_header->headerSize);
+    view.data = slot + m_header->headerSize + indexBytes;
+    view.dataBytes = m_header->slotSize - m_header->headerSize - indexBytes;
+    view.index = index;
+    m_readIndex = written;
+    return true;
+}
+
+FrameRegion SharedFrameReader::tileRegion(const FrameView &view, uint32_t tile) {
+    return tileRect(tile, view.tileSize, view.width, view.height);
+}
+
+bool SharedFrameReader::release(const FrameView &view) const {
+    std::atomic_thread_fence(std::memory_order_acquire);
+    const uint8_t *slot = m_slots + (view.index % m_header->slotCount) * m_header->slotSize;
+    const FrameSlotHeader *slotHeader = reinterpret_cast<const FrameSlotHeader *>(slot);
+    return slotHeader->sequence.load(std::memory_order_relaxed) == view.sequence;
+}
@@ -0,0 +1,51 @@
+//
+// CS 5330 - Project 4
+// Nathaniel Haddad and Stephen Dorris
+//
+
+// Local Includes
+#include "FrameWorkspace.h"
+
+namespace {
+
+const size_t ARENA_ALIGNMENT = 64;
+
+unsigned char *alignPointer(unsigned char *pointer) {
+    return reinterpret_cast<unsigned char *>(
+            (reinterpret_cast<uintptr_t>(pointer) + ARENA_ALIGNMENT - 1) & ~(uintptr_t) (ARENA_ALIGNMENT - 1));
+}
+
+}
+
+void *ScratchArena::allocate(size_t bytes) {
+    bytes = (bytes + ARENA_ALIGNMENT - 1) & ~(ARENA_ALIGNMENT - 1);
+    if (m_used + bytes <= m_capacity) {
+        void *memory = alignPointer(m_block.get()) + m_used;
+        m_used += bytes;
+        return memory;
+    }
+    m_overflow.emplace_back(new unsigned char[bytes + ARENA_ALIGNMENT]);
+    m_overflowBytes += bytes;
+    return alignPointer(m_overflow.back().get());
+}
+
+cv::Mat ScratchArena::mat(int rows, int cols, int type) {
+    return cv::Mat(rows, cols, type, allocate((size_t) rows * cols * CV_ELEM_SIZE(type)));
+}
+
+void ScratchArena::reset() {
+    if (!m_overflow.empty()) {
+        m_capacity = m_used + m_overflowBytes;
+        m_block.reset(new unsigned char[m_capacity + ARENA_ALIGNMENT]);
+        m_overflow.clear();
+        m_overflowBytes = 0;
+        m_growths++;
+    }
+    m_used = 0;
+}
+
+void FrameWorkspace::reserve(size_t cornerCount, size_t vertexCount) {
+    corners.reserve(cornerCount);
+    reprojectedCorners.reserve(cornerCount);
+    projectedPoints.reserve(vertexCount);
+}
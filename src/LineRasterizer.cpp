@@ -0,0 +1,437 @@
+//
+// CS 5330 - Project 4
+// Nathaniel Haddad and Stephen Dorris
+//
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+// Local Includes
+#include "LineRasterizer.h"
+#include "TaskScheduler.h"
+
+namespace {
+
+const int BAND_ROWS = 32; // rows rasterized by one task
+
+const int SPAN_PIXELS = 16; // pixels written per block copy of a span
+
+const float MAX_COORDINATE = 1 << 20; // longer lines are cut to this range before rasterizing
+
+/**
+ * floorDiv
+ * @return (int64_t) numerator / denominator rounded towards minus infinity (denominator > 0)
+ */
+int64_t floorDiv(int64_t numerator, int64_t denominator) {
+    return numerator >= 0 ? numerator / denominator : -((-numerator + denominator - 1) / denominator);
+}
+
+/**
+ * Pixel k of an 8-connected line lies k steps along its major axis and m(k) steps along its minor axis, with
+ * m(k) = ceil((2 * minor * k - major) / (2 * major)); this is the sequence cv::LineIterator produces.
+ * firstStep returns the first k with m(k) >= m.
+ */
+int64_t firstStep(int64_t m, int64_t major, int64_t minor) {
+    if (m <= 0) {
+        return 0;
+    }
+    if (minor == 0) {
+        return INT64_MAX;
+    }
+    return floorDiv(2 * major * (m - 1) + major, 2 * minor) + 1;
+}
+
+/**
+ * stepRange
+ * @does restricts [first, last) to the steps whose coordinate start + sign * step lies in [low, high)
+ */
+void stepRange(int64_t start, int sign, int64_t low, int64_t high, int64_t &first, int64_t &last) {
+    if (sign > 0) {
+        first = std::max(first, low - start);
+        last = std::min(last, high - start);
+    } else {
+        first = std::max(first, start - high + 1);
+        last = std::min(last, start - low + 1);
+    }
+}
+
+/**
+ * drawThinLine
+ * @does sets the pixels cv::line (LINE_8, thickness 1) sets for a line between integer end points, limited to the
+ *       rows [top, bottom) and the columns of the frame
+ */
+void drawThinLine(cv::Mat &frame, int top, int bottom, cv::Point p0, cv::Point p1, const uchar *color) {
+    // cv::LineIterator walks from left to right
+    if (p1.x < p0.x) {
+        std::swap(p0, p1);
+    }
+    int64_t dx = p1.x - p0.x, dy = std::abs(p1.y - p0.y);
+    int signY = p1.y < p0.y ? -1 : 1;
+    bool yMajor = dy > dx;
+    int64_t major = yMajor ? dy : dx, minor = yMajor ? dx : dy;
+
+    int64_t first = 0, last = major + 1;
+    int64_t minorFirst = INT64_MIN / 4, minorLast = INT64_MAX / 4;
+    if (yMajor) {
+        stepRange(p0.y, signY, top, bottom, first, last);
+        stepRange(p0.x, 1, 0, frame.cols, minorFirst, minorLast);
+    } else {
+        stepRange(p0.x, 1, 0, frame.cols, first, last);
+        stepRange(p0.y, signY, top, bottom, minorFirst, minorLast);
+    }
+    first = std::max(first, firstStep(minorFirst, major, minor));
+    last = std::min(last, firstStep(minorLast, major, minor));
+    if (first >= last) {
+        return;
+    }
+
+    // error term of step k: 2 * minor * k - major - 2 * major * m(k), in (-2 * major, 0]
+    int64_t m = major > 0 ? -floorDiv(major - 2 * minor * first, 2 * major) : 0;
+    int64_t error = 2 * minor * first - major - 2 * major * m;
+    int64_t x = p0.x + (yMajor ? m : first), y = p0.y + signY * (yMajor ? first : m);
+    int64_t majorX = yMajor ? 0 : 1, majorY = yMajor ? signY : 0;
+    int64_t minorX = yMajor ? 1 : 0, minorY = yMajor ? 0 : signY;
+    for (int64_t k = first; k < last; k++) {
+        uchar *pixel = frame.ptr<uchar>((int) y) + 3 * x;
+        pixel[0] = color[0];
+        pixel[1] = color[1];
+        pixel[2] = color[2];
+        x += majorX;
+        y += majorY;
+        error += 2 * minor;
+        if (error > 0) {
+            x += minorX;
+            y += minorY;
+            error -= 2 * major;
+        }
+    }
+}
+
+/**
+ * capsuleSpan
+ * @return (bool) whether row y crosses the points within radius of the segment ab; [left, right] receives the
+ *         crossing (the shape is convex, so it is one interval)
+ */
+bool capsuleSpan(cv::Point2f a, cv::Point2f b, float radius, float y, float &left, float &right) {
+    left = INFINITY;
+    right = -INFINITY;
+    for (const cv::Point2f &end : {a, b}) {
+        float dy = y - end.y;
+        if (std::abs(dy) <= radius) {
+            float half = std::sqrt(radius * radius - dy * dy);
+            left = std::min(left, end.x - half);
+            right = std::max(right, end.x + half);
+        }
+    }
+    cv::Point2f direction = b - a;
+    float length = std::sqrt(direction.dot(direction));
+    if (length > 0) {
+        // along: 0 <= u.(p - a) <= length, across: |n.(p - a)| <= radius, both linear in x for a fixed row
+        cv::Point2f u = direction / length;
+        float low = -INFINITY, high = INFINITY;
+        bool empty = false;
+        const float coefficients[2] = {u.x, -u.y};
+        const float offsets[2] = {u.y * (y - a.y), u.x * (y - a.y)};
+        const float lows[2] = {0, -radius}, highs[2] = {length, radius};
+        for (int i = 0; i < 2 && !empty; i++) {
+            // lows[i] <= coefficients[i] * (x - a.x) + offsets[i] <= highs[i]
+            if (std::abs(coefficients[i]) < 1e-9f) {
+                empty = offsets[i] < lows[i] || offsets[i] > highs[i];
+                continue;
+            }
+            float x0 = a.x + (lows[i] - offsets[i]) / coefficients[i];
+            float x1 = a.x + (highs[i] - offsets[i]) / coefficients[i];
+            low = std::max(low, std::min(x0, x1));
+            high = std::min(high, std::max(x0, x1));
+        }
+        if (!empty && low <= high) {
+            left = std::min(left, low);
+            right = std::max(right, high);
+        }
+    }
+    return left <= right;
+}
+
+/**
+ * distanceToSegment
+ * @return (float) distance of p to the segment ab
+ */
+float distanceToSegment(cv::Point2f p, cv::Point2f a, cv::Point2f b) {
+    cv::Point2f direction = b - a;
+    float lengthSquared = direction.dot(direction);
+    float t = lengthSquared > 0 ? std::min(1.f, std::max(0.f, (p - a).dot(direction) / lengthSquared)) : 0.f;
+    cv::Point2f closest = a + direction * t;
+    return (float) std::sqrt((p - closest).dot(p - closest));
+}
+
+/**
+ * fillSpan
+ * @does writes pixels [x0, x1) of a row from a pattern of SPAN_PIXELS pixels
+ */
+void fillSpan(uchar *row, int x0, int x1, const uchar *pattern) {
+    uchar *pixel = row + 3 * x0;
+    int count = x1 - x0;
+    for (; count >= SPAN_PIXELS; count -= SPAN_PIXELS, pixel += 3 * SPAN_PIXELS) {
+        memcpy(pixel, pattern, 3 * SPAN_PIXELS);
+    }
+    memcpy(pixel, pattern, 3 * count);
+}
+
+/**
+ * drawWideLine
+ * @does fills the pixels within radius of the segment ab (a disc if a == b) in the rows [top, bottom), blending
+ *       the border when antialias is set
+ */
+void drawWideLine(cv::Mat &frame, int top, int bottom, cv::Point2f a, cv::Point2f b, float radius,
+                  const uchar *color, const uchar *pattern, bool antialias) {
+    float reach = antialias ? radius + 0.5f : radius;
+    int firstRow = std::max(top, (int) std::ceil(std::min(a.y, b.y) - reach));
+    int lastRow = std::min(bottom - 1, (int) std::floor(std::max(a.y, b.y) + reach));
+    for (int y = firstRow; y <= lastRow; y++) {
+        float left, right;
+        if (!capsuleSpan(a, b, reach, (float) y, left, right)) {
+            continue;
+        }
+        int x0 = std::max(0, (int) std::ceil(left)), x1 = std::min(frame.cols - 1, (int) std::floor(right));
+        if (x0 > x1) {
+            continue;
+        }
+        uchar *row = frame.ptr<uchar>(y);
+        if (!antialias) {
+            fillSpan(row, x0, x1 + 1, pattern);
+            continue;
+        }
+        for (int x = x0; x <= x1; x++) {
+            float coverage = std::min(1.f, radius + 0.5f - distanceToSegment(cv::Point2f(x, y), a, b));
+            if (coverage <= 0) {
+                continue;
+            }
+            uchar *pixel = row + 3 * x;
+            for (int c = 0; c < 3; c++) {
+                pixel[c] = (uchar) (pixel[c] + (color[c] - pixel[c]) * coverage + 0.5f);
+            }
+        }
+    }
+}
+
+/**
+ * clipToRange
+ * @return (bool) false if the segment misses [-MAX_COORDINATE, MAX_COORDINATE]^2; otherwise cuts it to that square
+ */
+bool clipToRange(cv::Point2f &a, cv::Point2f &b) {
+    float t0 = 0, t1 = 1;
+    cv::Point2f direction = b - a;
+    const float starts[2] = {a.x, a.y}, deltas[2] = {direction.x, direction.y};
+    for (int axis = 0; axis < 2; axis++) {
+        for (float bound : {-MAX_COORDINATE, MAX_COORDINATE}) {
+            // keep the side of the bound that contains the origin
+            float inside = bound < 0 ? starts[axis] - bound : bound - starts[axis];
+            float rate = bound < 0 ? -deltas[axis] : deltas[axis];
+            if (rate == 0) {
+                if (inside < 0) {
+                    return false;
+                }
+                continue;
+            }
+            float t = inside / rate;
+            if (rate > 0) {
+                t1 = std::min(t1, t);
+            } else {
+                t0 = std::max(t0, t);
+            }
+        }
+    }
+    if (t0 > t1) {
+        return false;
+    }
+    b = a + direction * t1;
+    a = a + direction * t0;
+    return true;
+}
+
+}
+
+void LineRasterizer::setAntialiasing(bool antialias) {
+    m_antialias = antialias;
+}
+
+void LineRasterizer::clear() {
+    m_items.clear();
+    m_points.clear();
+    m_edges.clear();
+    m_bounds = cv::Rect();
+}
+
+size_t LineRasterizer::size() const {
+    size_t count = 0;
+    for (const Item &item : m_items) {
+        count += std::max(item.edgeCount, (size_t) 1);
+    }
+    return count;
+}
+
+void LineRasterizer::addItem(Item &item, const cv::Scalar &color, int thickness) {
+    thickness = std::min(4, std::max(1, thickness));
+    for (int c = 0; c < 3; c++) {
+        item.color[c] = cv::saturate_cast<uchar>(color[c]);
+    }
+    if (item.edgeCount > 0) {
+        item.radius = 0.5f * thickness;
+        item.thin = thickness == 1 && !m_antialias;
+    }
+    if (item.edges == nullptr && item.edgeCount > 0 && !m_items.empty()) {
+        // consecutive single lines of the same style share an item
+        Item &last = m_items.back();
+        if (last.edges == nullptr && last.edgeCount > 0 && last.edgeStart + last.edgeCount == item.edgeStart &&
+            last.radius == item.radius && last.thin == item.thin && memcmp(last.color, item.color, 3) == 0) {
+            last.edgeCount += item.edgeCount;
+            last.top = std::min(last.top, item.top);
+            last.bottom = std::max(last.bottom, item.bottom);
+            last.left = std::min(last.left, item.left);
+            last.right = std::max(last.right, item.right);
+            return;
+        }
+    }
+    m_items.push_back(item);
+}
+
+void LineRasterizer::addLine(cv::Point2f a, cv::Point2f b, const cv::Scalar &color, int thickness) {
+    if (std::isnan(a.x) || std::isnan(a.y) || std::isnan(b.x) || std::isnan(b.y)) {
+        return;
+    }
+    m_points.push_back(a);
+    m_points.push_back(b);
+    m_edges.emplace_back((int) m_points.size() - 2, (int) m_points.size() - 1);
+    Item item{};
+    item.edgeStart = m_edges.size() - 1;
+    item.edgeCount = 1;
+    item.top = std::min(a.y, b.y);
+    item.bottom = std::max(a.y, b.y);
+    item.left = std::min(a.x, b.x);
+    item.right = std::max(a.x, b.x);
+    addItem(item, color, thickness);
+}
+
+void LineRasterizer::addEdges(const cv::Point2f *points, const std::vector<cv::Vec2i> &edges,
+                              const cv::Scalar &color, int thickness, cv::Rect bounds) {
+    if (edges.empty()) {
+        return;
+    }
+    Item item{};
+    item.points = points;
+    item.edges = edges.data();
+    item.edgeCount = edges.size();
+    if (bounds.empty()) {
+        item.top = item.left = INFINITY;
+        item.bottom = item.right = -INFINITY;
+        for (const cv::Vec2i &edge : edges) {
+            for (int i = 0; i < 2; i++) {
+                const cv::Point2f &point = points[edge[i]];
+                if (!std::isnan(point.x) && !std::isnan(point.y)) {
+                    item.top = std::min(item.top, point.y);
+                    item.bottom = std::max(item.bottom, point.y);
+                    item.left = std::min(item.left, point.x);
+                    item.right = std::max(item.right, point.x);
+                }
+            }
+        }
+        if (item.top > item.bottom) {
+            return;
+        }
+    } else {
+        item.top = (float) bounds.y;
+        item.bottom = (float) (bounds.y + bounds.height);
+        item.left = (float) bounds.x;
+        item.right = (float) (bounds.x + bounds.width);
+    }
+    addItem(item, color, thickness);
+}
+
+void LineRasterizer::addDisc(cv::Point2f center, float radius, const cv::Scalar &color) {
+    Item item{};
+    item.center = center;
+    item.radius = radius;
+    item.top = center.y - radius;
+    item.bottom = center.y + radius;
+    item.left = center.x - radius;
+    item.right = center.x + radius;
+    addItem(item, color, 1);
+}
+
+void LineRasterizer::render(cv::Mat &frame) {
+    CV_Assert(frame.type() == CV_8UC3);
+    int bandCount = (frame.rows + BAND_ROWS - 1) / BAND_ROWS;
+    m_bands.resize(bandCount);
+    m_bounds = cv::Rect();
+    for (std::vector<int> &band : m_bands) {
+        band.clear();
+    }
+    for (size_t i = 0; i < m_items.size(); i++) {
+        Item &item = m_items[i];
+        if (item.edgeCount > 0 && item.points == nullptr) {
+            item.points = m_points.data();
+            item.edges = m_edges.data() + item.edgeStart;
+        }
+        // clamped before the conversion, the rows of far away lines do not fit an int
+        float reach = item.radius + 1;
+        float top = std::max(-1.f, std::floor((item.top - reach) / BAND_ROWS));
+        float bottom = std::min((float) bandCount, std::floor((item.bottom + reach) / BAND_ROWS));
+        int first = std::max(0, (int) top), last = std::min(bandCount - 1, (int) bottom);
+        for (int band = first; band <= last; band++) {
+            m_bands[band].push_back((int) i);
+        }
+        if (first <= last) {
+            float left = std::max(-1.f, std::floor(item.left - reach));
+            float right = std::min((float) frame.cols, std::ceil(item.right + reach));
+            if (left < right) {
+                cv::Rect covered(cv::Point((int) left, (int) std::max(-1.f, std::floor(item.top - reach))),
+                                 cv::Point((int) right + 1,
+                                           (int) std::min((float) frame.rows, std::ceil(item.bottom + reach)) + 1));
+                m_bounds |= covered;
+            }
+        }
+    }
+    m_bounds &= cv::Rect(0, 0, frame.cols, frame.rows);
+    TaskScheduler::instance().parallelFor(cv::Range(0, bandCount), 1, [&](const cv::Range &range) {
+        for (int band = range.start; band < range.end; band++) {
+            drawBand(frame, band * BAND_ROWS, std::min(frame.rows, (band + 1) * BAND_ROWS), m_bands[band]);
+        }
+    });
+}
+
+cv::Rect LineRasterizer::getBounds() const {
+    return m_bounds;
+}
+
+void LineRasterizer::drawBand(cv::Mat &frame, int top, int bottom, const std::vector<int> &items) const {
+    uchar pattern[3 * SPAN_PIXELS];
+    for (int index : items) {
+        const Item &item = m_items[index];
+        for (int i = 0; i < SPAN_PIXELS; i++) {
+            memcpy(pattern + 3 * i, item.color, 3);
+        }
+        if (item.edgeCount == 0) {
+            drawWideLine(frame, top, bottom, item.center, item.center, item.radius, item.color, pattern,
+                         m_antialias);
+            continue;
+        }
+        float reach = item.radius + 1;
+        for (size_t e = 0; e < item.edgeCount; e++) {
+            cv::Point2f a = item.points[item.edges[e][0]], b = item.points[item.edges[e][1]];
+            if (std::isnan(a.x) || std::isnan(b.x) || std::max(a.y, b.y) < top - reach ||
+                std::min(a.y, b.y) > bottom + reach) {
+                continue;
+            }
+            if (!clipToRange(a, b)) {
+                continue;
+            }
+            if (item.thin) {
+                drawThinLine(frame, top, bottom, cv::Point(cvRound(a.x), cvRound(a.y)),
+                             cv::Point(cvRound(b.x), cvRound(b.y)), item.color);
+            } else {
+                drawWideLine(frame, top, bottom, a, b, item.radius, item.color, pattern, m_antialias);
+            }
+        }
+    }
+}
@@ -0,0 +1,229 @@
+//
+// CS 5330 - Project 4
+// Nathaniel Haddad and Stephen Dorris
+//
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+// OpenCV Libraries
+#include <opencv2/calib3d.hpp>
+
+// Local Includes
+#include "ModelInstances.h"
+#include "TaskScheduler.h"
+
+namespace {
+
+const float NEAR_PLANE = 1e-3f; // closest depth that is projected
+
+const float MAX_COORDINATE = 1e6f; // projected vertices further out are dropped with their edges
+
+const int CHUNK_INSTANCES = 16; // instances projected per task
+
+/**
+ * meshRadius
+ * @return (float) distance of the farthest vertex from the model origin
+ */
+float meshRadius(const std::vector<cv::Vec3f> &vertices) {
+    float radius = 0;
+    for (const cv::Vec3f &vertex : vertices) {
+        radius = std::max(radius, (float) cv::norm(vertex));
+    }
+    return radius;
+}
+
+}
+
+ModelInstances::ModelInstances(const std::vector<cv::Vec3f> &indices) {
+    // every face contributes three edges, most of them shared with a neighbour
+    for (const cv::Vec3f &face : indices) {
+        for (int i = 0; i < 3; i++) {
+            int a = (int) face[i] - 1, b = (int) face[(i + 1) % 3] - 1;
+            m_edges.emplace_back(std::min(a, b), std::max(a, b));
+        }
+    }
+    std::sort(m_edges.begin(), m_edges.end(), [](const cv::Vec2i &a, const cv::Vec2i &b) {
+        return a[0] < b[0] || (a[0] == b[0] && a[1] < b[1]);
+    });
+    m_edges.erase(std::unique(m_edges.begin(), m_edges.end()), m_edges.end());
+}
+
+void ModelInstances::clear() {
+    m_x.clear();
+    m_y.clear();
+    m_z.clear();
+    m_cos.clear();
+    m_sin.clear();
+    m_scale.clear();
+}
+
+void ModelInstances::addInstance(cv::Vec3f position, float angle, float scale) {
+    m_x.push_back(position[0]);
+    m_y.push_back(position[1]);
+    m_z.push_back(position[2]);
+    m_cos.push_back(scale * std::cos(angle));
+    m_sin.push_back(scale * std::sin(angle));
+    m_scale.push_back(scale);
+}
+
+size_t ModelInstances::size() const {
+    return m_x.size();
+}
+
+size_t ModelInstances::getEdgeCount() const {
+    return m_edges.size();
+}
+
+bool ModelInstances::layout(const std::string &name, const std::vector<cv::Vec3f> &vertices, int count, int rows,
+                            int cols, cv::RNG &rng) {
+    float width = cols - 1, height = rows - 1; // board extent in squares, x to the right and y up
+    float radius = std::max(meshRadius(vertices), 1e-6f);
+    clear();
+    if (name == "grid") {
+        int columns = std::max(1, (int) std::ceil(std::sqrt(count * width / height)));
+        int lines = (count + columns - 1) / columns;
+        float cellWidth = width / columns, cellHeight = height / std::max(lines, 1);
+        float scale = 0.5f * std::min(cellWidth, cellHeight) / radius;
+        for (int i = 0; i < count; i++) {
+            cv::Vec3f position(((i % columns) + 0.5f) * cellWidth, -((i / columns) + 0.5f) * cellHeight, 0);
+            addInstance(position, rng.uniform(0.f, (float) (2 * CV_PI)), scale);
+        }
+        return true;
+    }
+    if (name == "swarm") {
+        float scale = 0.5f * std::sqrt(width * height / std::max(count, 1)) / radius;
+        for (int i = 0; i < count; i++) {
+            // -z points away from the board, towards the camera
+            cv::Vec3f position(rng.uniform(0.f, width), -rng.uniform(0.f, height), -rng.uniform(0.f, 3.f));
+            addInstance(position, rng.uniform(0.f, (float) (2 * CV_PI)), scale);
+        }
+        return true;
+    }
+    return false;
+}
+
+int ModelInstances::project(const std::vector<cv::Vec3f> &vertices, const cv::Mat &rotationVector,
+                            const cv::Mat &translationVector, const cv::Mat &cameraMatrix,
+                            const cv::Mat &distortionCoefficients, cv::Size imageSize, Buffers &buffers) const {
+    cv::Matx33d rotation;
+    cv::Rodrigues(rotationVector, rotation);
+    cv::Matx33f R = rotation;
+    cv::Vec3f T((float) translationVector.at<double>(0), (float) translationVector.at<double>(1),
+                (float) translationVector.at<double>(2));
+    cv::Matx33d K;
+    cameraMatrix.convertTo(K, CV_64F);
+    float fx = K(0, 0), fy = K(1, 1), cx = K(0, 2), cy = K(1, 2);
+
+    // the usual 5 coefficient model is evaluated inline, longer models go through cv::projectPoints
+    float k[5] = {0, 0, 0, 0, 0};
+    bool distorted = false, generic = false;
+    cv::Mat D;
+    distortionCoefficients.convertTo(D, CV_64F);
+    for (int i = 0; i < (int) D.total(); i++) {
+        double coefficient = D.at<double>(i);
+        if (coefficient != 0) {
+            distorted = true;
+            if (i < 5) {
+                k[i] = (float) coefficient;
+            } else {
+                generic = true;
+            }
+        }
+    }
+
+    // frustum planes through the camera center and the image border, widened by 10% for the distortion
+    float radius = meshRadius(vertices);
+    float xMin = -0.1f * imageSize.width, xMax = 1.1f * imageSize.width;
+    float yMin = -0.1f * imageSize.height, yMax = 1.1f * imageSize.height;
+    cv::Vec3f planes[4] = {cv::Vec3f(fx, 0, cx - xMin), cv::Vec3f(-fx, 0, xMax - cx),
+                           cv::Vec3f(0, fy, cy - yMin), cv::Vec3f(0, -fy, yMax - cy)};
+    for (cv::Vec3f &plane : planes) {
+        plane /= (float) cv::norm(plane);
+    }
+    buffers.visible.clear();
+    for (size_t i = 0; i < m_x.size(); i++) {
+        cv::Vec3f center = R * cv::Vec3f(m_x[i], m_y[i], m_z[i]) + T;
+        float reach = radius * m_scale[i];
+        bool inside = center[2] + reach > NEAR_PLANE;
+        for (int p = 0; p < 4 && inside; p++) {
+            inside = planes[p].dot(center) >= -reach;
+        }
+        if (inside) {
+            buffers.visible.push_back((int) i);
+        }
+    }
+
+    size_t vertexCount = vertices.size();
+    int visibleCount = (int) buffers.visible.size();
+    buffers.points.resize(visibleCount * vertexCount);
+    buffers.bounds.resize(visibleCount);
+    int chunkCount = (visibleCount + CHUNK_INSTANCES - 1) / CHUNK_INSTANCES;
+    const float NaN = std::numeric_limits<float>::quiet_NaN();
+    TaskScheduler::instance().parallelFor(cv::Range(0, chunkCount), 1, [&](const cv::Range &range) {
+        std::vector<cv::Point3f> world; // only used by the generic distortion path
+        for (int slot = range.start * CHUNK_INSTANCES; slot < std::min(range.end * CHUNK_INSTANCES, visibleCount);
+             slot++) {
+            int i = buffers.visible[slot];
+            cv::Matx33f S(m_cos[i], -m_sin[i], 0, m_sin[i], m_cos[i], 0, 0, 0, m_scale[i]);
+            cv::Matx33f M = R * S;
+            cv::Vec3f position(m_x[i], m_y[i], m_z[i]);
+            cv::Vec3f t = R * position + T;
+            cv::Point2f *points = &buffers.points[slot * vertexCount];
+            if (generic) {
+                world.resize(vertexCount);
+                for (size_t v = 0; v < vertexCount; v++) {
+                    cv::Vec3f p = S * vertices[v] + position;
+                    world[v] = cv::Point3f(p[0], p[1], p[2]);
+                }
+                std::vector<cv::Point2f> projected;
+                cv::projectPoints(world, rotationVector, translationVector, cameraMatrix, distortionCoefficients,
+                                  projected);
+                std::copy(projected.begin(), projected.end(), points);
+            }
+            float minX = MAX_COORDINATE, minY = MAX_COORDINATE, maxX = -MAX_COORDINATE, maxY = -MAX_COORDINATE;
+            for (size_t v = 0; v < vertexCount; v++) {
+                cv::Vec3f camera = M * vertices[v] + t;
+                if (camera[2] <= NEAR_PLANE) {
+                    points[v] = cv::Point2f(NaN, NaN);
+                    continue;
+                }
+                if (!generic) {
+                    float x = camera[0] / camera[2], y = camera[1] / camera[2];
+                    if (distorted) {
+                        float r2 = x * x + y * y;
+                        float radial = 1 + r2 * (k[0] + r2 * (k[1] + r2 * k[4]));
+                        float xd = x * radial + 2 * k[2] * x * y + k[3] * (r2 + 2 * x * x);
+                        float yd = y * radial + k[2] * (r2 + 2 * y * y) + 2 * k[3] * x * y;
+                        x = xd;
+                        y = yd;
+                    }
+                    points[v] = cv::Point2f(fx * x + cx, fy * y + cy);
+                }
+                cv::Point2f &point = points[v];
+                if (std::abs(point.x) > MAX_COORDINATE || std::abs(point.y) > MAX_COORDINATE) {
+                    point = cv::Point2f(NaN, NaN);
+                    continue;
+                }
+                minX = std::min(minX, point.x);
+                maxX = std::max(maxX, point.x);
+                minY = std::min(minY, point.y);
+                maxY = std::max(maxY, point.y);
+            }
+            buffers.bounds[slot] = minX <= maxX ? cv::Rect(cv::Point(cvFloor(minX), cvFloor(minY)),
+                                                           cv::Point(cvFloor(maxX) + 2, cvFloor(maxY) + 2))
+                                                : cv::Rect();
+        }
+    });
+    return visibleCount;
+}
+
+void ModelInstances::draw(LineRasterizer &rasterizer, size_t vertexCount, const Buffers &buffers,
+                          const cv::Scalar &color) const {
+    for (size_t slot = 0; slot < buffers.visible.size(); slot++) {
+        if (!buffers.bounds[slot].empty()) {
+            rasterizer.addEdges(&buffers.points[slot * vertexCount], m_edges, color, 1, buffers.bounds[slot]);
+        }
+    }
+}
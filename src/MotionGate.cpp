@@ -0,0 +1,60 @@
+//
+// CS 5330 - Project 4
+// Nathaniel Haddad and Stephen Dorris
+//
+
+#include <algorithm>
+
+// OpenCV Libraries
+#include <opencv2/imgproc.hpp>
+
+// Local Includes
+#include "MotionGate.h"
+
+namespace {
+
+const int THUMBNAIL_SCALE = 8; // frame pixels per thumbnail pixel along each axis
+
+const double MAX_CHANGED_FRACTION = 0.002; // thumbnail pixels that may change (sensor noise, flicker) in a static scene
+
+}
+
+void MotionGate::configure(int threshold, int maxStaticFrames) {
+    m_threshold = threshold;
+    m_maxStaticFrames = std::max(maxStaticFrames, 0);
+    reset();
+}
+
+bool MotionGate::enabled() const {
+    return m_threshold > 0;
+}
+
+bool MotionGate::isStatic(FrameCache &images) {
+    if (!enabled()) {
+        return false;
+    }
+    m_gray = images.thumbnail(THUMBNAIL_SCALE);
+    if (m_reference.empty() || m_reference.size() != m_gray.size() || m_staticFrames >= m_maxStaticFrames) {
+        return false;
+    }
+    cv::absdiff(m_gray, m_reference, m_difference);
+    cv::threshold(m_difference, m_difference, m_threshold, 255, cv::THRESH_BINARY);
+    if (cv::countNonZero(m_difference) > MAX_CHANGED_FRACTION * m_difference.total()) {
+        return false;
+    }
+    m_staticFrames++;
+    return true;
+}
+
+void MotionGate::accept() {
+    if (!enabled()) {
+        return;
+    }
+    m_gray.copyTo(m_reference);
+    m_staticFrames = 0;
+}
+
+void MotionGate::reset() {
+    m_reference.release();
+    m_staticFrames = 0;
+}
@@ -0,0 +1,223 @@
+//
+// CS 5330 - Project 4
+// Nathaniel Haddad and Stephen Dorris
+//
+
+#include <algorithm>
+#include <cstdio>
+#include <iostream>
+#include <sstream>
+
+// OpenCV Libraries
+#include <opencv2/calib3d.hpp>
+#include <opencv2/imgproc.hpp>
+
+// Local Includes
+#include "MultiBoardTracker.h"
+#include "TaskScheduler.h"
+#include "Transforms.h"
+
+namespace {
+
+/**
+ * splitList
+ * @return (std::vector<std::string>) the comma separated items of list
+ */
+std::vector<std::string> splitList(const std::string &list) {
+    std::vector<std::string> items;
+    std::stringstream stream(list);
+    std::string item;
+    while (std::getline(stream, item, ',')) {
+        if (!item.empty()) {
+            items.push_back(item);
+        }
+    }
+    return items;
+}
+
+}
+
+bool MultiBoardTracker::configure(const std::string &boards, const std::string &models,
+                                  ChessboardDetector::Method method) {
+    m_boards.clear();
+    std::vector<std::string> sizes = splitList(boards), names = splitList(models);
+    if (names.empty()) {
+        names.emplace_back("axes");
+    }
+    for (size_t i = 0; i < sizes.size(); i++) {
+        Board board;
+        if (sscanf(sizes[i].c_str(), "%dx%d", &board.patternSize.width, &board.patternSize.height) != 2 ||
+            board.patternSize.width < 2 || board.patternSize.height < 2) {
+            std::cerr << "ERROR: expected <rows>x<cols> for a board, got " << sizes[i] << std::endl;
+            return false;
+        }
+        // same layout as Camera::buildBoardGeometry
+        for (int x = 0; x < board.patternSize.height; x++) {
+            for (int y = 0; y < board.patternSize.width; y++) {
+                board.world.emplace_back(x, -y, 0);
+            }
+        }
+        if (!board.model.loadModel(names[std::min(i, names.size() - 1)], board.patternSize.width,
+                                   board.patternSize.height)) {
+            return false;
+        }
+        board.detector.setMethod(method);
+        m_boards.push_back(board);
+    }
+    return !m_boards.empty();
+}
+
+size_t MultiBoardTracker::size() const {
+    return m_boards.size();
+}
+
+std::vector<MultiBoardTracker::Board> &MultiBoardTracker::getBoards() {
+    return m_boards;
+}
+
+void MultiBoardTracker::paintOver(cv::Mat &image, const Board &board) {
+    // the hull of the inner corners, grown by about one square on every side
+    std::vector<cv::Point2f> hull;
+    cv::convexHull(board.corners, hull);
+    cv::Point2f center(0, 0);
+    for (const cv::Point2f &point : hull) {
+        center += point;
+    }
+    center = center * (1.f / hull.size());
+    int inner = std::min(board.patternSize.width, board.patternSize.height);
+    float grow = (inner + 1.f) / (inner - 1.f);
+    std::vector<cv::Point> polygon;
+    for (const cv::Point2f &point : hull) {
+        cv::Point2f grown = center + (point - center) * grow;
+        polygon.emplace_back(cvRound(grown.x), cvRound(grown.y));
+    }
+    cv::fillConvexPoly(image, polygon, cv::Scalar::all(128));
+}
+
+bool MultiBoardTracker::overlaps(const Board &a, const Board &b) {
+    std::vector<cv::Point2f> hullA, hullB, common;
+    cv::convexHull(a.corners, hullA);
+    cv::convexHull(b.corners, hullB);
+    double shared = cv::intersectConvexConvex(hullA, hullB, common);
+    double smaller = std::min(cv::contourArea(hullA), cv::contourArea(hullB));
+    return smaller > 0 && shared > 0.5 * smaller;
+}
+
+void MultiBoardTracker::updateWindow(Board &board, cv::Size frameSize) {
+    if (board.corners.empty()) {
+        board.window = cv::Rect();
+        board.lostFrames++;
+        return;
+    }
+    // a quarter of the board size of motion between two frames, plus the border squares
+    cv::Rect bounds = cv::boundingRect(board.corners);
+    int margin = std::max(bounds.width, bounds.height) / 4 + 16;
+    board.window = cv::Rect(bounds.x - margin, bounds.y - margin, bounds.width + 2 * margin,
+                            bounds.height + 2 * margin) & cv::Rect(cv::Point(0, 0), frameSize);
+    board.lostFrames = 0;
+}
+
+int MultiBoardTracker::detect(FrameCache &images) {
+    // converted once before the parallel searches, every board then works on a view of it
+    const cv::Mat &frame = images.gray();
+    std::vector<int> tracked;
+    for (int i = 0; i < (int) m_boards.size(); i++) {
+        if (!m_boards[i].window.empty()) {
+            tracked.push_back(i);
+        }
+    }
+    // boards seen in the previous frame, each searched in its own window
+    TaskScheduler::instance().parallelFor(cv::Range(0, (int) tracked.size()), 1, [&](const cv::Range &range) {
+        for (int t = range.start; t < range.end; t++) {
+            Board &board = m_boards[tracked[t]];
+            cv::Rect window = board.window & cv::Rect(0, 0, frame.cols, frame.rows);
+            if (window.empty() || !board.detector.find(frame(window), board.gray, board.patternSize,
+                                                       board.corners)) {
+                board.corners.clear();
+                continue;
+            }
+            for (cv::Point2f &corner : board.corners) {
+                corner += cv::Point2f((float) window.x, (float) window.y);
+            }
+        }
+    });
+
+    // two windows can lock onto the same physical board, e.g. when two boards of the same size cross; the larger
+    // pattern (then the earlier board) keeps it and the other one is searched for again in the masked frame below
+    for (size_t t = 0; t < tracked.size(); t++) {
+        Board &board = m_boards[tracked[t]];
+        for (size_t u = 0; u < t && !board.corners.empty(); u++) {
+            const Board &kept = m_boards[tracked[u]];
+            if (kept.corners.empty() || !overlaps(board, kept)) {
+                continue;
+            }
+            if (board.corners.size() > kept.corners.size()) {
+                m_boards[tracked[u]].corners.clear();
+            } else {
+                board.corners.clear();
+            }
+        }
+    }
+
+    // every other board is looked for in the whole frame, with the boards found so far painted over
+    bool masked = false;
+    for (Board &board : m_boards) {
+        if (!board.corners.empty()) {
+            continue;
+        }
+        if (!masked) {
+            frame.copyTo(m_masked);
+            for (const Board &found : m_boards) {
+                if (!found.corners.empty()) {
+                    paintOver(m_masked, found);
+                }
+            }
+            masked = true;
+        }
+        if (board.detector.find(m_masked, board.gray, board.patternSize, board.corners)) {
+            paintOver(m_masked, board);
+        }
+    }
+
+    int found = 0;
+    for (Board &board : m_boards) {
+        updateWindow(board, frame.size());
+        found += board.corners.empty() ? 0 : 1;
+    }
+    return found;
+}
+
+void MultiBoardTracker::estimatePoses(const cv::Mat &cameraMatrix, const cv::Mat &distortionCoefficients) {
+    TaskScheduler::instance().parallelFor(cv::Range(0, (int) m_boards.size()), 1, [&](const cv::Range &range) {
+        for (int i = range.start; i < range.end; i++) {
+            Board &board = m_boards[i];
+            if (!board.corners.empty()) {
+                cv::solvePnP(board.world, board.corners, cameraMatrix, distortionCoefficients, board.rotationVector,
+                             board.translationVector);
+            }
+        }
+    });
+}
+
+void MultiBoardTracker::draw(LineRasterizer &rasterizer, const cv::Mat &cameraMatrix,
+                             const cv::Mat &distortionCoefficients) {
+    static const cv::Matx33f T_ROTZ = Transforms::rotateZ3x3(0.1);
+    for (Board &board : m_boards) {
+        // models keep spinning while their board is out of view, like the single board mode
+        if (board.model.getObjectType() == "custom") {
+            board.model.applyTransform(T_ROTZ);
+        }
+        if (board.corners.empty()) {
+            continue;
+        }
+        cv::projectPoints(board.model.getVertices(), board.rotationVector, board.translationVector, cameraMatrix,
+                          distortionCoefficients, board.projectedPoints);
+        if (board.model.getObjectType() == "corners") {
+            ObjectModel::drawCircles(rasterizer, board.projectedPoints);
+        } else if (board.model.getObjectType() == "axes") {
+            ObjectModel::drawAxes(rasterizer, board.projectedPoints);
+        } else {
+            ObjectModel::draw(rasterizer, board.projectedPoints, board.model.getIndices());
+        }
+    }
+}
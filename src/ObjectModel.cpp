@@ -3,12 +3,59 @@
 // Nathaniel Haddad and Stephen Dorris
 //
 
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
 #include <iostream>
+#include <map>
+#include <set>
+#include <tuple>
 
 // Local Includes
 #include "ObjectModel.h"
 #include "Transforms.h"
 
+namespace {
+
+const char MAGIC[8] = {'O', 'B', 'J', 'M', 'E', 'S', 'H', '1'};
+
+const float PLANAR_EPSILON = 1e-5f; // largest |z| of a vertex on the board plane, in board units
+
+/**
+ * Layout of the mesh cache: this header, then the vertices and the indices as Vec3f
+ */
+struct MeshFileHeader {
+    char magic[8];
+    int64_t sourceSize; // size of the obj file the cache was written from
+    int64_t sourceTime; // modification time of the obj file
+    int64_t vertexCount, indexCount;
+};
+
+/**
+ * fillHeader
+ * @return (bool) false if the obj file cannot be inspected
+ */
+bool fillHeader(const std::string &path, MeshFileHeader &header) {
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    std::error_code error;
+    uintmax_t size = std::filesystem::file_size(path, error);
+    if (error) {
+        return false;
+    }
+    std::filesystem::file_time_type time = std::filesystem::last_write_time(path, error);
+    if (error) {
+        return false;
+    }
+    header.sourceSize = (int64_t) size;
+    header.sourceTime = (int64_t) time.time_since_epoch().count();
+    return true;
+}
+
+}
+
 ObjectModel::ObjectModel(const std::string PATH) : m_PATH(PATH) {
     if (loadObj(PATH)) {
         std::cout << "Successfully loaded object from file" << std::endl;
@@ -19,35 +66,111 @@ ObjectModel::ObjectModel(const std::string PATH) : m_PATH(PATH) {
     std::cout << "Successfully created object model" << std::endl;
 }
 
-std::vector<cv::Vec3f> ObjectModel::getVertices() {
+const std::vector<cv::Vec3f> &ObjectModel::getVertices() const {
     return m_vertices;
 }
 
-std::vector<cv::Vec3f> ObjectModel::getIndices() {
+bool ObjectModel::isPlanar() const {
+    return m_planar;
+}
+
+void ObjectModel::updatePlanar() {
+    m_planar = !m_vertices.empty();
+    for (const cv::Vec3f &v : m_vertices) {
+        m_planar = m_planar && std::abs(v[2]) <= PLANAR_EPSILON;
+    }
+}
+
+const std::vector<cv::Vec3f> &ObjectModel::getIndices() const {
     return m_indices;
 }
 
-std::string ObjectModel::getObjectType() {
+const std::vector<cv::Vec3f> &ObjectModel::getIndices(int level) const {
+    if (level <= 0 || m_coarseIndices.empty()) {
+        return m_indices;
+    }
+    return m_coarseIndices[std::min(level, (int) m_coarseIndices.size()) - 1];
+}
+
+void ObjectModel::buildLevelsOfDetail(int levels) {
+    m_coarseIndices.clear();
+    if (m_vertices.empty()) {
+        return;
+    }
+    cv::Vec3f low = m_vertices[0], high = m_vertices[0];
+    for (const cv::Vec3f &v : m_vertices) {
+        for (int i = 0; i < 3; i++) {
+            low[i] = std::min(low[i], v[i]);
+            high[i] = std::max(high[i], v[i]);
+        }
+    }
+    float extent = std::max(std::max(high[0] - low[0], high[1] - low[1]), high[2] - low[2]);
+    for (int level = 1; level < levels; level++) {
+        int cellsPerSide = std::max(64 >> (level - 1), 1);
+        float cellSize = extent > 0 ? extent / cellsPerSide : 1;
+        // representative (1-based, like the obj indices) of every vertex: the first vertex that fell into its cell
+        std::map<std::tuple<int, int, int>, unsigned int> cells;
+        std::vector<unsigned int> representative(m_vertices.size());
+        for (size_t i = 0; i < m_vertices.size(); i++) {
+            cv::Vec3f cell = (m_vertices[i] - low) * (1.f / cellSize);
+            std::tuple<int, int, int> key((int) cell[0], (int) cell[1], (int) cell[2]);
+            representative[i] = cells.emplace(key, (unsigned int) i + 1).first->second;
+        }
+        std::set<std::tuple<unsigned int, unsigned int, unsigned int>> faces;
+        std::vector<cv::Vec3f> indices;
+        for (const cv::Vec3f &face : m_indices) {
+            unsigned int a = representative[(unsigned int) face[0] - 1];
+            unsigned int b = representative[(unsigned int) face[1] - 1];
+            unsigned int c = representative[(unsigned int) face[2] - 1];
+            if (a == b || b == c || a == c) {
+                continue;
+            }
+            // the same face can be left over from several original ones, in any rotation
+            std::tuple<unsigned int, unsigned int, unsigned int> key =
+                    std::min({std::make_tuple(a, b, c), std::make_tuple(b, c, a), std::make_tuple(c, a, b)});
+            if (faces.insert(key).second) {
+                indices.emplace_back((float) a, (float) b, (float) c);
+            }
+        }
+        std::cout << "Level of detail " << level << ": " << indices.size() << " of " << m_indices.size()
+                  << " faces" << std::endl;
+        m_coarseIndices.push_back(indices);
+    }
+}
+
+const std::string &ObjectModel::getObjectType() const {
     return m_objectType;
 }
 
+const std::string &ObjectModel::getPath() const {
+    return m_PATH;
+}
+
 bool ObjectModel::loadCorners(int rows, int cols) {
     // four corners of chessboard (order: top left, top right, bottom left, bottom right)
     m_vertices = std::vector <cv::Vec3f>{cv::Vec3f(0, 0, 0), cv::Vec3f(cols - 1, 0, 0),
                                        cv::Vec3f(0, -(rows - 1), 0),
                                        cv::Vec3f(cols - 1, -(rows - 1), 0)};
     m_objectType = "corners";
+    updatePlanar();
     return true;
 }
 
 bool ObjectModel::loadAxes() {
     m_vertices = std::vector <cv::Vec3f> {cv::Vec3f(0,0,0), cv::Vec3f(1,0,0), cv::Vec3f(0,1,0), cv::Vec3f(0,0,-1)};
     m_objectType = "axes";
+    updatePlanar();
     return true;
 }
 
 bool ObjectModel::loadObj(const std::string PATH) {
     m_PATH = PATH;
+    if (loadMeshCache(PATH)) {
+        m_objectType = "custom";
+        updatePlanar();
+        return true;
+    }
+    size_t firstVertex = m_vertices.size(), firstIndex = m_indices.size();
     std::vector <cv::Vec3f> vertices;
     std::vector<unsigned int> vertexIndices;
     FILE *file = fopen(PATH.c_str(), "r");
@@ -69,36 +192,88 @@ bool ObjectModel::loadObj(const std::string PATH) {
                                  &normalIndex[1], &vertexIndex[2], &normalIndex[2]);
             if (matches != 6) {
                 std::cerr << "Error: file with texture indices can't be read the parser" << std::endl;
+                fclose(file);
                 return false;
             }
             m_indices.push_back(cv::Vec3f(vertexIndex[0], vertexIndex[1], vertexIndex[2]));
         }
     }
+    fclose(file);
     m_objectType = "custom";
+    updatePlanar();
+    saveMeshCache(PATH, firstVertex, firstIndex);
+    return true;
+}
+
+bool ObjectModel::loadMeshCache(const std::string PATH) {
+    MeshFileHeader stored, expected;
+    std::ifstream file(PATH + ".mesh.bin", std::ios::binary);
+    if (!file.read((char *) &stored, sizeof(stored)) || !fillHeader(PATH, expected)) {
+        return false;
+    }
+    expected.vertexCount = stored.vertexCount;
+    expected.indexCount = stored.indexCount;
+    if (memcmp(&stored, &expected, sizeof(stored)) != 0 || stored.vertexCount < 0 || stored.indexCount < 0) {
+        return false;
+    }
+    std::vector<cv::Vec3f> vertices(stored.vertexCount), indices(stored.indexCount);
+    if (!file.read((char *) vertices.data(), vertices.size() * sizeof(cv::Vec3f)) ||
+        !file.read((char *) indices.data(), indices.size() * sizeof(cv::Vec3f))) {
+        return false;
+    }
+    m_vertices.insert(m_vertices.end(), vertices.begin(), vertices.end());
+    m_indices.insert(m_indices.end(), indices.begin(), indices.end());
     return true;
 }
 
-void ObjectModel::draw(cv::Mat &src, std::vector<cv::Point2f> points, std::vector<cv::Vec3f> indices) {
-    for (cv::Vec3f &indexVec : indices) {
+void ObjectModel::saveMeshCache(const std::string PATH, size_t firstVertex, size_t firstIndex) const {
+    MeshFileHeader header;
+    if (!fillHeader(PATH, header)) {
+        return;
+    }
+    header.vertexCount = (int64_t) (m_vertices.size() - firstVertex);
+    header.indexCount = (int64_t) (m_indices.size() - firstIndex);
+    std::string cachePath = PATH + ".mesh.bin";
+    std::string partialPath = cachePath + ".partial";
+    std::ofstream file(partialPath, std::ios::binary);
+    file.write((const char *) &header, sizeof(header));
+    file.write((const char *) (m_vertices.data() + firstVertex), header.vertexCount * sizeof(cv::Vec3f));
+    file.write((const char *) (m_indices.data() + firstIndex), header.indexCount * sizeof(cv::Vec3f));
+    file.close();
+    std::error_code error;
+    if (!file.good()) {
+        std::filesystem::remove(partialPath, error);
+        return;
+    }
+    // A reader either finds the previous cache or the complete new one, never a partly written file
+    std::filesystem::rename(partialPath, cachePath, error);
+    if (error) {
+        std::filesystem::remove(partialPath, error);
+    }
+}
+
+void ObjectModel::draw(LineRasterizer &rasterizer, const std::vector<cv::Point2f> &points,
+                       const std::vector<cv::Vec3f> &indices) {
+    for (const cv::Vec3f &indexVec : indices) {
         unsigned int v1 = indexVec[0] - 1;
         unsigned int v2 = indexVec[1] - 1;
         unsigned int v3 = indexVec[2] - 1;
-        cv::line(src, points[v1], points[v2], cv::Scalar(255,0,0), 1);
-        cv::line(src, points[v2], points[v3], cv::Scalar(255,0,0), 1);
-        cv::line(src, points[v3], points[v1], cv::Scalar(255,0,0), 1);
+        rasterizer.addLine(points[v1], points[v2], cv::Scalar(255,0,0), 1);
+        rasterizer.addLine(points[v2], points[v3], cv::Scalar(255,0,0), 1);
+        rasterizer.addLine(points[v3], points[v1], cv::Scalar(255,0,0), 1);
     }
 }
 
-void ObjectModel::drawAxes(cv::Mat &src, std::vector<cv::Point2f> points) {
+void ObjectModel::drawAxes(LineRasterizer &rasterizer, const std::vector<cv::Point2f> &points) {
     cv::Point2f origin = points[0];
-    cv::line(src, origin, points[1], cv::Scalar(255,0,0),4);
-    cv::line(src, origin, points[2], cv::Scalar(0,255,0),4);
-    cv::line(src, origin, points[3], cv::Scalar(0,0,255),4);
+    rasterizer.addLine(origin, points[1], cv::Scalar(255,0,0),4);
+    rasterizer.addLine(origin, points[2], cv::Scalar(0,255,0),4);
+    rasterizer.addLine(origin, points[3], cv::Scalar(0,0,255),4);
 }
 
-void ObjectModel::drawCircles(cv::Mat &src, std::vector<cv::Point2f> points) {
-    for (cv::Point2f &point : points) {
-        cv::circle(src, point, 10, cv::Scalar(0,0,255),cv::FILLED);
+void ObjectModel::drawCircles(LineRasterizer &rasterizer, const std::vector<cv::Point2f> &points) {
+    for (const cv::Point2f &point : points) {
+        rasterizer.addDisc(point, 10, cv::Scalar(0,0,255));
     }
 }
 
@@ -115,39 +290,58 @@ bool ObjectModel::setObjectModel(const int rows, const int cols) {
     while(!std::cin.fail() && character != '1' && character != '2' && character != '3');
 
     if (character == '1') {
-        loadCorners(rows, cols);
+        loadModel("corners", rows, cols);
     } else if (character == '2') {
-        loadAxes();
+        loadModel("axes", rows, cols);
     } else if (character == '3') {
         std::cout << "Please enter a path to an obj file" << std::endl;
         std::cin >> objPath;
-        if (loadObj(objPath)) {
-            std::cout << "Successfully loaded object from file" << std::endl;
-        } else {
-            std::cerr << "ERROR: could not load object from file" << std::endl;
-            return false;
-        }
-        std::cout << "Successfully created object model" << std::endl;
-        cv::Mat T_ROTX = Transforms::rotateX3x3(-(M_PI/2.0f));
-        cv::Mat T_TRAN(cv::Vec3f(0, 0, 0));
-        cv::Mat T = Transforms::createHomogeneousTransform(T_ROTX, T_TRAN, 5);
-        applyTransform(T, true);
+        return loadModel(objPath, rows, cols);
     }
     return true;
 }
 
+bool ObjectModel::loadModel(const std::string &model, const int rows, const int cols) {
+    if (model == "corners") {
+        return loadCorners(rows, cols);
+    } else if (model == "axes") {
+        return loadAxes();
+    }
+    if (loadObj(model)) {
+        std::cout << "Successfully loaded object from file" << std::endl;
+    } else {
+        std::cerr << "ERROR: could not load object from file" << std::endl;
+        return false;
+    }
+    std::cout << "Successfully created object model" << std::endl;
+    cv::Mat T_ROTX = Transforms::rotateX3x3(-(M_PI/2.0f));
+    cv::Mat T_TRAN(cv::Vec3f(0, 0, 0));
+    cv::Mat T = Transforms::createHomogeneousTransform(T_ROTX, T_TRAN, 5);
+    applyTransform(T, true);
+    return true;
+}
+
 void ObjectModel::applyTransform(cv::Mat T_MATRIX, bool homogeneous) {
     if (homogeneous) {
+        cv::Matx44f T = T_MATRIX;
         for (cv::Vec3f &v : m_vertices) {
-            cv::Mat vec(cv::Vec4f(v[0], v[1], v[2], 1));
-            cv::Mat vTransformed = T_MATRIX * vec;
-            v = cv::Vec3f(vTransformed.at<float>(0,0), vTransformed.at<float>(0,1), vTransformed.at<float>(0,2));
+            cv::Vec4f vTransformed = T * cv::Vec4f(v[0], v[1], v[2], 1);
+            v = cv::Vec3f(vTransformed[0], vTransformed[1], vTransformed[2]);
         }
+        updatePlanar();
     } else {
-        for (cv::Vec3f &v : m_vertices) {
-            cv::Mat vTransformed = T_MATRIX * cv::Mat(v);
-            v = cv::Vec3f(vTransformed);
-        }
+        cv::Matx33f T = T_MATRIX;
+        applyTransform(T);
+    }
+}
+
+void ObjectModel::applyTransform(const cv::Matx33f &T) {
+    for (cv::Vec3f &v : m_vertices) {
+        v = T * v;
+    }
+    // called every frame, a transform that keeps z = 0 (the spin about z) keeps the model planar without a check
+    if (m_planar && (T(2, 0) != 0 || T(2, 1) != 0)) {
+        updatePlanar();
     }
 }
 
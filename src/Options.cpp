@@ -0,0 +1,246 @@
+//
+// CS 5330 - Project 4
+// Nathaniel Haddad and Stephen Dorris
+//
+
+#include <climits>
+#include <cstdio>
+#include <iostream>
+#include <limits>
+#include <stdexcept>
+
+// Local Includes
+#include "Options.h"
+
+namespace {
+
+/**
+ * parseInt
+ * @param flag (const std::string &) the option, named in the error
+ * @param value (const std::string &) its value
+ * @param minimum (int) smallest value accepted
+ * @param maximum (int) largest value accepted
+ * @return (int) the value; exits with an error if it is not a whole number in range
+ */
+int parseInt(const std::string &flag, const std::string &value, int minimum, int maximum = INT_MAX) {
+    size_t used = 0;
+    long long number = 0;
+    try {
+        number = std::stoll(value, &used);
+    } catch (const std::exception &) {
+        used = 0;
+    }
+    if (used == 0 || used != value.size() || number < minimum || number > maximum) {
+        std::cerr << "ERROR: " << flag << " expects a whole number";
+        if (maximum != INT_MAX) {
+            std::cerr << " from " << minimum << " to " << maximum;
+        } else if (minimum != INT_MIN) {
+            std::cerr << " of at least " << minimum;
+        }
+        std::cerr << ", got " << value << std::endl;
+        exit(-1);
+    }
+    return (int) number;
+}
+
+/**
+ * parseDouble
+ * @param flag (const std::string &) the option, named in the error
+ * @param value (const std::string &) its value
+ * @param minimum (double) smallest value accepted
+ * @param maximum (double) largest value accepted
+ * @return (double) the value; exits with an error if it is not a number in range
+ */
+double parseDouble(const std::string &flag, const std::string &value, double minimum,
+                   double maximum = std::numeric_limits<double>::max()) {
+    size_t used = 0;
+    double number = 0;
+    try {
+        number = std::stod(value, &used);
+    } catch (const std::exception &) {
+        used = 0;
+    }
+    // written so that NaN fails the range check as well
+    if (used == 0 || used != value.size() || !(number >= minimum && number <= maximum)) {
+        std::cerr << "ERROR: " << flag << " expects a number";
+        if (maximum != std::numeric_limits<double>::max()) {
+            std::cerr << " from " << minimum << " to " << maximum;
+        } else if (minimum != std::numeric_limits<double>::lowest()) {
+            std::cerr << " of at least " << minimum;
+        }
+        std::cerr << ", got " << value << std::endl;
+        exit(-1);
+    }
+    return number;
+}
+
+}
+
+Options Options::parse(int argc, char *argv[]) {
+    Options options;
+    for (int i = 1; i < argc; i++) {
+        std::string flag = argv[i];
+        if (flag == "--help") {
+            usage();
+            exit(0);
+        } else if (flag == "--offline") {
+            options.mode = "offline";
+            continue;
+        } else if (flag == "--headless") {
+            options.headless = true;
+            continue;
+        } else if (flag == "--quiet") {
+            options.quiet = true;
+            continue;
+        } else if (flag == "--undistort") {
+            options.undistort = true;
+            continue;
+        } else if (flag == "--antialias") {
+            options.antialias = true;
+            continue;
+        } else if (flag == "--resume") {
+            options.resume = true;
+            continue;
+        } else if (flag == "--update-baseline") {
+            options.updateBaseline = true;
+            continue;
+        }
+        if (i + 1 >= argc) {
+            std::cerr << "ERROR: missing value for " << flag << std::endl;
+            usage();
+            exit(-1);
+        }
+        std::string value = argv[++i];
+        if (flag == "--input") {
+            options.inputPath = value;
+        } else if (flag == "--intrinsics") {
+            options.intrinsicsPath = value;
+        } else if (flag == "--model") {
+            options.model = value;
+        } else if (flag == "--instances") {
+            options.instances = parseInt(flag, value, 0);
+        } else if (flag == "--instance-layout") {
+            options.instanceLayout = value;
+        } else if (flag == "--output") {
+            options.outputPath = value;
+        } else if (flag == "--threads") {
+            options.threads = parseInt(flag, value, 0);
+        } else if (flag == "--pose-shm") {
+            options.poseShm = value;
+        } else if (flag == "--pose-slots") {
+            options.poseSlots = parseInt(flag, value, 1);
+        } else if (flag == "--camera-id") {
+            options.cameraId = parseInt(flag, value, 0);
+        } else if (flag == "--frame-shm") {
+            options.frameShm = value;
+        } else if (flag == "--frame-slots") {
+            options.frameSlots = parseInt(flag, value, 1);
+        } else if (flag == "--record") {
+            options.recordPath = value;
+        } else if (flag == "--record-policy") {
+            options.recordPolicy = value;
+        } else if (flag == "--record-buffers") {
+            options.recordBuffers = parseInt(flag, value, 1);
+        } else if (flag == "--session") {
+            options.sessionPath = value;
+        } else if (flag == "--session-codec") {
+            options.sessionCodec = value;
+        } else if (flag == "--session-chunk") {
+            options.sessionChunk = parseInt(flag, value, 1);
+        } else if (flag == "--replay") {
+            options.mode = "replay";
+            options.replayPath = value;
+        } else if (flag == "--replay-start") {
+            options.replayStart = parseInt(flag, value, 0);
+        } else if (flag == "--frame-keyframe") {
+            options.frameKeyframe = parseInt(flag, value, 0);
+        } else if (flag == "--state") {
+            options.statePath = value;
+        } else if (flag == "--stats") {
+            options.statsInterval = parseInt(flag, value, 0);
+        } else if (flag == "--detector") {
+            options.detector = value;
+        } else if (flag == "--boards") {
+            options.boards = value;
+        } else if (flag == "--board-models") {
+            options.boardModels = value;
+        } else if (flag == "--motion-gate") {
+            options.motionGate = parseInt(flag, value, 0, 255);
+        } else if (flag == "--motion-interval") {
+            options.motionInterval = parseInt(flag, value, 1);
+        } else if (flag == "--target-fps") {
+            options.targetFps = parseDouble(flag, value, 0);
+        } else if (flag == "--mesh-budget") {
+            options.meshBudget = parseInt(flag, value, 0);
+        } else if (flag == "--overlay") {
+            options.overlay = value;
+        } else if (flag == "--benchmark") {
+            options.mode = "benchmark";
+            options.benchmark = value;
+        } else if (flag == "--frames") {
+            options.frames = parseInt(flag, value, 1);
+        } else if (flag == "--baseline") {
+            options.baselinePath = value;
+        } else if (flag == "--report") {
+            options.reportPath = value;
+        } else if (flag == "--tolerance") {
+            options.tolerance = parseDouble(flag, value, std::numeric_limits<double>::lowest());
+        } else if (flag == "--generate") {
+            options.mode = "generate";
+            options.outputPath = value;
+        } else if (flag == "--resolution") {
+            if (sscanf(value.c_str(), "%dx%d", &options.width, &options.height) != 2 || options.width <= 0 ||
+                options.height <= 0) {
+                std::cerr << "ERROR: expected <width>x<height> for --resolution, got " << value << std::endl;
+                exit(-1);
+            }
+        } else if (flag == "--blur") {
+            options.blur = parseDouble(flag, value, 0);
+        } else if (flag == "--noise") {
+            options.noise = parseDouble(flag, value, 0);
+        } else if (flag == "--lighting") {
+            options.lighting = parseInt(flag, value, 0, 1) != 0;
+        } else if (flag == "--occlusion") {
+            options.occlusion = parseDouble(flag, value, 0, 1);
+        } else if (flag == "--seed") {
+            options.seed = parseInt(flag, value, INT_MIN);
+        } else {
+            std::cerr << "ERROR: unknown option " << flag << std::endl;
+            usage();
+            exit(-1);
+        }
+    }
+    return options;
+}
+
+void Options::usage() {
+    std::cout << "Usage: project_4 [--offline --input <video|directory> --intrinsics <yml> --model <corners|axes|obj>\n"
+                 "                  --output <video> [--threads <n>]]\n"
+                 "                 [--pose-shm <name> [--pose-slots <n>] [--camera-id <n>]]\n"
+                 "                 [--frame-shm <name> [--frame-slots <n>] [--frame-keyframe <n>]]\n"
+                 "                 [--headless] [--stats <frames>] [--quiet] [--detector <opencv|saddle>]\n"
+                 "                 [--undistort] [--instances <n> [--instance-layout <grid|swarm>]] [--antialias]\n"
+                 "                 [--motion-gate <gray levels> [--motion-interval <frames>]] [--target-fps <fps>]\n"
+                 "                 [--boards <rows>x<cols>,... [--board-models <model>,...]]\n"
+                 "                 [--record <video> [--record-policy <drop|block>] [--record-buffers <n>]]\n"
+                 "                 [--mesh-budget <MB>] [--overlay <image|video>]\n"
+                 "                 [--resume] [--state <yml>] [--intrinsics <yml>] [--model <corners|axes|obj>]\n"
+                 "                 [--session <directory> [--session-codec <raw|png|jpg>] [--session-chunk <n>]]\n"
+                 "       project_4 --replay <session directory> [--replay-start <frame>] [video mode flags]\n"
+                 "       project_4 --benchmark detector [--input <video|directory>] [--frames <n>]\n"
+                 "       project_4 --benchmark pipeline [--input <generated video|directory>] [--frames <n>]\n"
+                 "                 [synthetic scene flags]\n"
+                 "       project_4 --generate <video|directory> [--frames <n>] [synthetic scene flags]\n"
+                 "       project_4 --benchmark instancing [--model <obj>] [--instance-layout <grid|swarm>]\n"
+                 "                 [--frames <n>] [--resolution <w>x<h>]\n"
+                 "       project_4 --benchmark perf [--baseline <yml>] [--report <json>] [--tolerance <fraction>]\n"
+                 "                 [--update-baseline] [--frames <n>] [--detector <opencv|saddle>]\n"
+                 "                 [synthetic scene flags]\n"
+                 "       project_4 --benchmark refiner [--frames <n>] [synthetic scene flags]\n"
+                 "       project_4 --benchmark rasterizer [--frames <n>] [--resolution <w>x<h>] [--antialias]\n"
+                 "       project_4 --benchmark planar [--frames <n>] [synthetic scene flags]\n"
+                 "       project_4 --benchmark arena [--frames <n>] [synthetic scene flags]\n"
+                 "Synthetic scene flags: [--resolution <w>x<h>] [--blur <sigma>] [--noise <sigma>] [--lighting <0|1>]\n"
+                 "                       [--occlusion <probability>] [--seed <n>]\n"
+                 "Without --offline, --replay, --benchmark or --generate the interactive menu is started." << std::endl;
+}
@@ -0,0 +1,239 @@
+//
+// CS 5330 - Project 4
+// Nathaniel Haddad and Stephen Dorris
+//
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+// OpenCV Libraries
+#include <opencv2/imgcodecs.hpp>
+#include <opencv2/imgproc.hpp>
+
+// Local Includes
+#include "PlanarOverlay.h"
+#include "TaskScheduler.h"
+
+namespace {
+
+/**
+ * divide255
+ * @return (int) value / 255 rounded, for value in [0, 255 * 255]
+ */
+inline int divide255(int value) {
+    value += 128;
+    return (value + (value >> 8)) >> 8;
+}
+
+}
+
+void PlanarOverlay::buildTexture(const cv::Mat &image, Texture &texture) {
+    int levelCount = 1;
+    for (cv::Size size = image.size(); levelCount < MAX_LEVELS && (size.width > 1 || size.height > 1); levelCount++) {
+        size = cv::Size((size.width + 1) / 2, (size.height + 1) / 2);
+    }
+    texture.levels.resize(levelCount);
+    cv::Mat &base = texture.levels[0];
+    if (image.channels() == 4) {
+        image.copyTo(base);
+    } else {
+        cv::cvtColor(image, base, image.channels() == 1 ? cv::COLOR_GRAY2BGRA : cv::COLOR_BGR2BGRA);
+    }
+    // premultiplied, so filtering and sampling never mix the color of transparent texels into the edges
+    for (int y = 0; y < base.rows; y++) {
+        uchar *texel = base.ptr<uchar>(y);
+        for (int x = 0; x < base.cols; x++, texel += 4) {
+            if (texel[3] != 255) {
+                for (int c = 0; c < 3; c++) {
+                    texel[c] = (uchar) divide255(texel[c] * texel[3]);
+                }
+            }
+        }
+    }
+    for (int level = 1; level < levelCount; level++) {
+        const cv::Mat &previous = texture.levels[level - 1];
+        cv::resize(previous, texture.levels[level], cv::Size((previous.cols + 1) / 2, (previous.rows + 1) / 2), 0, 0,
+                   cv::INTER_AREA);
+    }
+}
+
+bool PlanarOverlay::open(const std::string &path, cv::Rect2f area) {
+    m_area = area;
+    m_clip.reset();
+    cv::Mat image = cv::imread(path, cv::IMREAD_UNCHANGED);
+    if (image.empty()) {
+        m_clip.reset(new cv::VideoCapture(path));
+        if (!m_clip->isOpened() || !m_clip->read(image) || image.empty()) {
+            std::cerr << "ERROR: could not read the overlay " << path << std::endl;
+            m_clip.reset();
+            return false;
+        }
+        // the first advance shows the first frame again
+        m_clip->set(cv::CAP_PROP_POS_FRAMES, 0);
+    }
+    if (image.depth() != CV_8U) {
+        std::cerr << "ERROR: the overlay " << path << " must have 8 bits per channel" << std::endl;
+        m_clip.reset();
+        return false;
+    }
+    m_texture = std::make_shared<Texture>();
+    buildTexture(image, *m_texture);
+    m_texture->serial = ++m_serial;
+    m_spare.reset();
+    return true;
+}
+
+void PlanarOverlay::advance() {
+    if (!m_clip) {
+        return;
+    }
+    if (!m_clip->read(m_clipFrame) || m_clipFrame.empty()) {
+        m_clip->set(cv::CAP_PROP_POS_FRAMES, 0);
+        if (!m_clip->read(m_clipFrame) || m_clipFrame.empty()) {
+            return; // the last frame read stays up
+        }
+    }
+    // the texture before the current one is refilled once no stream draws it anymore
+    std::shared_ptr<Texture> next = m_spare && m_spare.use_count() == 1 ? m_spare : std::make_shared<Texture>();
+    buildTexture(m_clipFrame, *next);
+    next->serial = ++m_serial;
+    m_spare = m_texture;
+    m_texture = next;
+}
+
+std::shared_ptr<const PlanarOverlay::Texture> PlanarOverlay::texture() const {
+    return m_texture;
+}
+
+void PlanarOverlay::warpRows(const Texture &texture, const cv::Matx33d &toTexture, cv::Mat &warped, cv::Rect rect,
+                             int top, int bottom) {
+    const double *m = toTexture.val;
+    // texels per pixel in the middle of the rows, from the Jacobian of the homography there
+    double cx = rect.x + rect.width / 2.0, cy = rect.y + (top + bottom) / 2.0;
+    double w = m[6] * cx + m[7] * cy + m[8];
+    double u = (m[0] * cx + m[1] * cy + m[2]) / w, v = (m[3] * cx + m[4] * cy + m[5]) / w;
+    double dudx = (m[0] - u * m[6]) / w, dudy = (m[1] - u * m[7]) / w;
+    double dvdx = (m[3] - v * m[6]) / w, dvdy = (m[4] - v * m[7]) / w;
+    double texels = std::sqrt(std::abs(dudx * dvdy - dudy * dvdx));
+    int level = texels > 1 ? std::min((int) std::lround(std::log2(texels)), (int) texture.levels.size() - 1) : 0;
+    const cv::Mat &source = texture.levels[level];
+    const cv::Mat &base = texture.levels[0];
+    double scaleX = (double) source.cols / base.cols, scaleY = (double) source.rows / base.rows;
+    double maxU = source.cols - 0.5, maxV = source.rows - 0.5;
+
+    for (int row = top; row < bottom; row++) {
+        int y = rect.y + row;
+        // homogeneous texel coordinates of the first pixel, stepped along the row
+        double X = m[0] * rect.x + m[1] * y + m[2];
+        double Y = m[3] * rect.x + m[4] * y + m[5];
+        double W = m[6] * rect.x + m[7] * y + m[8];
+        uchar *out = warped.ptr<uchar>(row);
+        for (int col = 0; col < rect.width; col++, out += 4, X += m[0], Y += m[3], W += m[6]) {
+            double inverse = 1.0 / W;
+            // texel centers of the level, 0.5 texel outside the content is still inside its edge texels
+            double su = (X * inverse + 0.5) * scaleX - 0.5, sv = (Y * inverse + 0.5) * scaleY - 0.5;
+            if (!(su >= -0.5 && su <= maxU && sv >= -0.5 && sv <= maxV)) {
+                out[0] = out[1] = out[2] = out[3] = 0;
+                continue;
+            }
+            // 8 fractional bits, the weights of the four texels sum to 65536
+            int fu = cvFloor(su * 256), fv = cvFloor(sv * 256);
+            int x0 = fu >> 8, y0 = fv >> 8, fx = fu & 255, fy = fv & 255;
+            int xa = std::max(x0, 0), xb = std::min(x0 + 1, source.cols - 1);
+            int ya = std::max(y0, 0), yb = std::min(y0 + 1, source.rows - 1);
+            const uchar *upper = source.ptr<uchar>(ya), *lower = source.ptr<uchar>(yb);
+            const uchar *p00 = upper + 4 * xa, *p01 = upper + 4 * xb, *p10 = lower + 4 * xa, *p11 = lower + 4 * xb;
+            for (int c = 0; c < 4; c++) {
+                int upperValue = p00[c] * (256 - fx) + p01[c] * fx;
+                int lowerValue = p10[c] * (256 - fx) + p11[c] * fx;
+                out[c] = (uchar) ((upperValue * (256 - fy) + lowerValue * fy + (1 << 15)) >> 16);
+            }
+        }
+    }
+}
+
+void PlanarOverlay::blendRows(cv::Mat &frame, const cv::Mat &warped, cv::Rect rect, int top, int bottom) {
+    for (int row = top; row < bottom; row++) {
+        const uchar *in = warped.ptr<uchar>(row);
+        uchar *out = frame.ptr<uchar>(rect.y + row) + 3 * rect.x;
+        for (int col = 0; col < rect.width; col++, in += 4, out += 3) {
+            int alpha = in[3];
+            if (alpha == 0) {
+                continue;
+            }
+            for (int c = 0; c < 3; c++) {
+                out[c] = (uchar) std::min(255, divide255(out[c] * (255 - alpha)) + in[c]);
+            }
+        }
+    }
+}
+
+cv::Rect PlanarOverlay::draw(cv::Mat &frame, const cv::Matx33d &homography, Buffers &buffers) const {
+    if (!buffers.texture || frame.type() != CV_8UC3) {
+        return cv::Rect();
+    }
+    const Texture &texture = *buffers.texture;
+    const cv::Mat &base = texture.levels[0];
+    // level 0 texel centers to the board plane: the content fitted into the area, centered, v pointing down the board
+    float scale = std::min(m_area.width / base.cols, m_area.height / base.rows);
+    float left = m_area.x + (m_area.width - scale * base.cols) / 2;
+    float upper = m_area.y + m_area.height - (m_area.height - scale * base.rows) / 2;
+    cv::Matx33d toBoard(scale, 0, left + 0.5 * scale,
+                        0, -scale, upper - 0.5 * scale,
+                        0, 0, 1);
+    cv::Matx33d toImage = homography * toBoard;
+
+    // the destination quad, all of its corners have to be in front of the camera
+    double minX = 1e9, minY = 1e9, maxX = -1e9, maxY = -1e9;
+    int positive = 0;
+    const double cornersU[4] = {-0.5, base.cols - 0.5, base.cols - 0.5, -0.5};
+    const double cornersV[4] = {-0.5, -0.5, base.rows - 0.5, base.rows - 0.5};
+    for (int k = 0; k < 4; k++) {
+        cv::Vec3d p = toImage * cv::Vec3d(cornersU[k], cornersV[k], 1);
+        positive += p[2] > 0 ? 1 : 0;
+        minX = std::min(minX, p[0] / p[2]);
+        maxX = std::max(maxX, p[0] / p[2]);
+        minY = std::min(minY, p[1] / p[2]);
+        maxY = std::max(maxY, p[1] / p[2]);
+    }
+    // cv::findHomography scales h33 to 1, so the board origin has w > 0 and a quad with w <= 0 lies behind the camera
+    if (positive != 4) {
+        return cv::Rect();
+    }
+    // clamped first, a quad seen at a grazing angle can reach far outside the frame
+    cv::Point low(cvFloor(std::max(minX, -1.0)), cvFloor(std::max(minY, -1.0)));
+    cv::Point high(cvCeil(std::min(maxX, (double) frame.cols)) + 1, cvCeil(std::min(maxY, (double) frame.rows)) + 1);
+    cv::Rect rect = cv::Rect(low, high) & cv::Rect(0, 0, frame.cols, frame.rows);
+    if (rect.empty()) {
+        return cv::Rect();
+    }
+
+    bool cached = buffers.serial == texture.serial && buffers.rect == rect;
+    for (int k = 0; cached && k < 9; k++) {
+        cached = buffers.homography.val[k] == homography.val[k];
+    }
+    int bandCount = (rect.height + BAND_ROWS - 1) / BAND_ROWS;
+    if (!cached) {
+        buffers.warped.create(rect.height, rect.width, CV_8UC4);
+        buffers.homography = homography;
+        buffers.serial = texture.serial;
+        buffers.rect = rect;
+        cv::Matx33d toTexture = toImage.inv();
+        TaskScheduler::instance().parallelFor(cv::Range(0, bandCount), 1, [&](const cv::Range &range) {
+            for (int band = range.start; band < range.end; band++) {
+                int top = band * BAND_ROWS, bottom = std::min(rect.height, top + BAND_ROWS);
+                warpRows(texture, toTexture, buffers.warped, rect, top, bottom);
+                blendRows(frame, buffers.warped, rect, top, bottom);
+            }
+        });
+    } else {
+        TaskScheduler::instance().parallelFor(cv::Range(0, bandCount), 1, [&](const cv::Range &range) {
+            for (int band = range.start; band < range.end; band++) {
+                int top = band * BAND_ROWS;
+                blendRows(frame, buffers.warped, rect, top, std::min(rect.height, top + BAND_ROWS));
+            }
+        });
+    }
+    return rect;
+}
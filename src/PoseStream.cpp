@@ -0,0 +1,155 @@
+//
+// CS 5330 - Project 4
+// Nathaniel Haddad and Stephen Dorris
+//
+
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+#include <iostream>
+
+// POSIX
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+// Local Includes
+#include "PoseStream.h"
+
+PosePublisher::~PosePublisher() {
+    if (m_header != nullptr) {
+        munmap(m_header, m_mappedSize);
+        shm_unlink(m_name.c_str());
+    }
+}
+
+bool PosePublisher::open(const std::string &name, uint32_t capacity) {
+    if (capacity == 0) {
+        std::cerr << "ERROR: the pose ring " << name << " needs at least one slot" << std::endl;
+        return false;
+    }
+    m_name = name;
+    m_mappedSize = sizeof(PoseRingHeader) + capacity * sizeof(PoseSlot);
+    int fd = shm_open(name.c_str(), O_CREAT | O_RDWR, 0644);
+    if (fd < 0) {
+        std::cerr << "ERROR: shm_open " << name << ": " << strerror(errno) << std::endl;
+        return false;
+    }
+    if (ftruncate(fd, m_mappedSize) != 0) {
+        std::cerr << "ERROR: ftruncate " << name << ": " << strerror(errno) << std::endl;
+        close(fd);
+        return false;
+    }
+    void *memory = mmap(nullptr, m_mappedSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (memory == MAP_FAILED) {
+        std::cerr << "ERROR: mmap " << name << ": " << strerror(errno) << std::endl;
+        return false;
+    }
+    m_header = static_cast<PoseRingHeader *>(memory);
+    m_slots = reinterpret_cast<PoseSlot *>(m_header + 1);
+    // readers check magic last, so a half initialised segment is never accepted
+    m_header->magic = 0;
+    m_header->version = PoseRecord::VERSION;
+    m_header->capacity = capacity;
+    m_header->recordSize = sizeof(PoseRecord);
+    m_header->writeIndex.store(0, std::memory_order_relaxed);
+    for (uint32_t i = 0; i < capacity; i++) {
+        m_slots[i].sequence.store(0, std::memory_order_relaxed);
+    }
+    std::atomic_thread_fence(std::memory_order_release);
+    m_header->magic = PoseRingHeader::MAGIC;
+    std::cout << "Publishing poses to shared memory " << name << " (" << capacity << " slots)" << std::endl;
+    return true;
+}
+
+void PosePublisher::publish(const PoseRecord &record) {
+    if (m_header == nullptr) {
+        return;
+    }
+    uint64_t index = m_header->writeIndex.load(std::memory_order_relaxed);
+    PoseSlot &slot = m_slots[index % m_header->capacity];
+    slot.sequence.store(2 * index + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    std::memcpy(&slot.record, &record, sizeof(PoseRecord));
+    slot.sequence.store(2 * index + 2, std::memory_order_release);
+    m_header->writeIndex.store(index + 1, std::memory_order_release);
+}
+
+uint64_t PosePublisher::nowNanoseconds() {
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t) now.tv_sec * 1000000000ull + now.tv_nsec;
+}
+
+PoseSubscriber::~PoseSubscriber() {
+    if (m_header != nullptr) {
+        munmap(const_cast<PoseRingHeader *>(m_header), m_mappedSize);
+    }
+}
+
+bool PoseSubscriber::open(const std::string &name, bool fromStart) {
+    int fd = shm_open(name.c_str(), O_RDONLY, 0);
+    if (fd < 0) {
+        std::cerr << "ERROR: shm_open " << name << ": " << strerror(errno) << std::endl;
+        return false;
+    }
+    void *memory = mmap(nullptr, sizeof(PoseRingHeader), PROT_READ, MAP_SHARED, fd, 0);
+    if (memory == MAP_FAILED) {
+        close(fd);
+        return false;
+    }
+    const PoseRingHeader *header = static_cast<const PoseRingHeader *>(memory);
+    bool compatible = header->magic == PoseRingHeader::MAGIC && header->version == PoseRecord::VERSION &&
+                      header->recordSize == sizeof(PoseRecord);
+    uint32_t capacity = header->capacity;
+    munmap(memory, sizeof(PoseRingHeader));
+    if (!compatible) {
+        std::cerr << "ERROR: " << name << " is not a compatible pose stream" << std::endl;
+        close(fd);
+        return false;
+    }
+    m_mappedSize = sizeof(PoseRingHeader) + capacity * sizeof(PoseSlot);
+    memory = mmap(nullptr, m_mappedSize, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (memory == MAP_FAILED) {
+        return false;
+    }
+    m_header = static_cast<const PoseRingHeader *>(memory);
+    m_slots = reinterpret_cast<const PoseSlot *>(m_header + 1);
+    uint64_t written = m_header->writeIndex.load(std::memory_order_acquire);
+    m_readIndex = written;
+    if (fromStart) {
+        m_readIndex = written > capacity ? written - capacity : 0;
+    }
+    return true;
+}
+
+bool PoseSubscriber::next(PoseRecord &record) {
+    for (;;) {
+        uint64_t written = m_header->writeIndex.load(std::memory_order_acquire);
+        if (m_readIndex >= written) {
+            return false;
+        }
+        if (written - m_readIndex > m_header->capacity) {
+            m_lost += written - m_header->capacity - m_readIndex;
+            m_readIndex = written - m_header->capacity;
+        }
+        const PoseSlot &slot = m_slots[m_readIndex % m_header->capacity];
+        uint64_t before = slot.sequence.load(std::memory_order_acquire);
+        std::memcpy(&record, &slot.record, sizeof(PoseRecord));
+        std::atomic_thread_fence(std::memory_order_acquire);
+        uint64_t after = slot.sequence.load(std::memory_order_relaxed);
+        if (before == after && before == 2 * m_readIndex + 2) {
+            m_readIndex++;
+            return true;
+        }
+        // the producer overwrote this slot while we were reading it, resynchronise and try again
+        m_lost++;
+        m_readIndex++;
+    }
+}
+
+uint64_t PoseSubscriber::getLost() const {
+    return m_lost;
+}
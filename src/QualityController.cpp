@@ -0,0 +1,167 @@
+//
+// CS 5330 - Project 4
+// Nathaniel Haddad and Stephen Dorris
+//
+
+#include <algorithm>
+#include <cstdio>
+
+// Local Includes
+#include "QualityController.h"
+
+namespace {
+
+// lowest quality first, the last level is what runs without the controller
+const QualityController::DetectSettings DETECT_LEVELS[] = {
+        {0.5, 3, 5, 10, 0.01},
+        {0.5, 2, 5, 10, 0.01},
+        {0.75, 1, 7, 15, 0.001},
+        {1.0, 1, 11, 30, 0.0001}
+};
+
+const QualityController::RenderSettings RENDER_LEVELS[] = {
+        {2, false},
+        {1, false},
+        {0, false},
+        {0, true}
+};
+
+const int DETECT_MAX = sizeof(DETECT_LEVELS) / sizeof(DETECT_LEVELS[0]) - 1;
+
+const double AVERAGE_WEIGHT = 0.1; // weight of the newest frame in the running averages
+
+const double OVER_BUDGET = 1.05, UNDER_BUDGET = 0.7; // thresholds as fractions of the budget
+
+const int LOWER_AFTER = 10; // frames over the budget before a level is lowered
+
+const int RAISE_AFTER = 90, MAX_RAISE_AFTER = 90 * 16; // frames well under the budget before a level is raised
+
+const int HOLD_FRAMES = 30; // frames the averages get to settle after a change
+
+}
+
+QualityController::QualityController() : m_raiseAfter(RAISE_AFTER) {
+    configure(0, false);
+}
+
+void QualityController::configure(double targetFps, bool antialias) {
+    m_budgetSeconds = targetFps > 0 ? 1.0 / targetFps : 0;
+    m_renderMax = antialias ? 3 : 2;
+    m_detectLevel = DETECT_MAX;
+    m_renderLevel = m_renderMax;
+    m_frames = 0;
+    m_framesSinceChange = 0;
+    m_overFrames = m_underFrames = 0;
+    m_raiseAfter = RAISE_AFTER;
+    m_framesSinceDetection = 0;
+}
+
+bool QualityController::enabled() const {
+    return m_budgetSeconds > 0;
+}
+
+const QualityController::DetectSettings &QualityController::detectSettings() const {
+    return DETECT_LEVELS[m_detectLevel];
+}
+
+const QualityController::RenderSettings &QualityController::renderSettings() const {
+    return RENDER_LEVELS[m_renderLevel];
+}
+
+bool QualityController::update(const FrameStats &stats) {
+    if (!enabled()) {
+        return false;
+    }
+    // waiting for the camera is not work, a camera slower than the target must not lower the quality
+    double frame = stats.lastFrameSeconds() - stats.lastStageSeconds(FrameStats::CAPTURE);
+    double detect = stats.lastStageSeconds(FrameStats::DETECT) + stats.lastStageSeconds(FrameStats::POSE);
+    double render = stats.lastStageSeconds(FrameStats::PROJECT) + stats.lastStageSeconds(FrameStats::DRAW);
+    if (m_frames++ == 0) {
+        m_frameSeconds = frame;
+        m_detectSeconds = detect;
+        m_renderSeconds = render;
+    } else {
+        m_frameSeconds += AVERAGE_WEIGHT * (frame - m_frameSeconds);
+        m_detectSeconds += AVERAGE_WEIGHT * (detect - m_detectSeconds);
+        m_renderSeconds += AVERAGE_WEIGHT * (render - m_renderSeconds);
+    }
+    if (++m_framesSinceChange < HOLD_FRAMES) {
+        return false;
+    }
+    if (m_frameSeconds > OVER_BUDGET * m_budgetSeconds) {
+        m_overFrames++;
+        m_underFrames = 0;
+    } else if (m_frameSeconds < UNDER_BUDGET * m_budgetSeconds) {
+        m_underFrames++;
+        m_overFrames = 0;
+    } else {
+        m_overFrames = m_underFrames = 0;
+    }
+    if (m_overFrames >= LOWER_AFTER) {
+        return change(true);
+    }
+    if (m_underFrames >= m_raiseAfter) {
+        return change(false);
+    }
+    return false;
+}
+
+bool QualityController::change(bool lower) {
+    int *ladder;
+    const char *name;
+    if (lower) {
+        if (m_detectLevel == 0 && m_renderLevel == 0) {
+            m_overFrames = 0;
+            return false;
+        }
+        // the more expensive side gives up quality first
+        bool detection = m_renderLevel == 0 || (m_detectLevel > 0 && m_detectSeconds >= m_renderSeconds);
+        ladder = detection ? &m_detectLevel : &m_renderLevel;
+        name = detection ? "detection" : "render";
+        if (m_lastRaise > 0 && m_frames - m_lastRaise < (uint64_t) (3 * HOLD_FRAMES)) {
+            // the last raise did not fit, wait longer before the next one
+            m_raiseAfter = std::min(2 * m_raiseAfter, MAX_RAISE_AFTER);
+        }
+    } else {
+        if (m_detectLevel == DETECT_MAX && m_renderLevel == m_renderMax) {
+            m_underFrames = 0;
+            return false;
+        }
+        // the cheaper side gets its quality back first
+        bool detection = m_renderLevel == m_renderMax ||
+                         (m_detectLevel < DETECT_MAX && m_detectSeconds < m_renderSeconds);
+        ladder = detection ? &m_detectLevel : &m_renderLevel;
+        name = detection ? "detection" : "render";
+        m_lastRaise = m_frames;
+    }
+    int previous = *ladder;
+    *ladder += lower ? -1 : 1;
+    printf("Quality: %s %d -> %d (processing %.1f ms, budget %.1f ms, detection %.1f ms, render %.1f ms)\n", name,
+           previous, *ladder, 1000.0 * m_frameSeconds, 1000.0 * m_budgetSeconds, 1000.0 * m_detectSeconds,
+           1000.0 * m_renderSeconds);
+    m_framesSinceChange = 0;
+    m_overFrames = m_underFrames = 0;
+    return true;
+}
+
+void QualityController::apply(ChessboardDetector &detector, LineRasterizer &rasterizer, FrameStats &stats) const {
+    if (!enabled()) {
+        return;
+    }
+    const DetectSettings &detect = detectSettings();
+    detector.setDetectionScale(detect.scale);
+    detector.setRefinement(detect.subPixWindow, detect.subPixIterations, detect.subPixEpsilon);
+    rasterizer.setAntialiasing(renderSettings().antialias);
+    stats.setQuality(m_detectLevel, DETECT_MAX, m_renderLevel, m_renderMax);
+}
+
+bool QualityController::skipDetection() {
+    if (!enabled()) {
+        return false;
+    }
+    if (++m_framesSinceDetection < detectSettings().interval) {
+        return true;
+    }
+    m_framesSinceDetection = 0;
+    return false;
+}
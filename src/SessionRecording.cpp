@@ -0,0 +1,354 @@
+//
+// CS 5330 - Project 4
+// Nathaniel Haddad and Stephen Dorris
+//
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+
+// OpenCV Libraries
+#include <opencv2/imgcodecs.hpp>
+
+// Local Includes
+#include "SessionRecording.h"
+#include "TaskScheduler.h"
+
+namespace {
+
+const char FRAME_MAGIC[4] = {'S', 'F', 'R', '2'};
+
+const char INDEX_MAGIC[8] = {'S', 'E', 'S', 'S', 'I', 'D', 'X', '2'};
+
+/**
+ * chunkPath
+ * @return (std::string) path of chunk file number chunk of a session
+ */
+std::string chunkPath(const std::string &directory, uint32_t chunk) {
+    char name[32];
+    snprintf(name, sizeof(name), "chunk_%05u.bin", chunk);
+    return (std::filesystem::path(directory) / name).string();
+}
+
+}
+
+SessionRecorder::~SessionRecorder() {
+    close();
+}
+
+bool SessionRecorder::open(const std::string &directory, const std::string &codec, int chunkFrames,
+                           int bufferCount, const cv::Mat &cameraMatrix, const cv::Mat &distortionCoefficients,
+                           const std::string &model) {
+    close();
+    if (codec != "raw" && codec != "png" && codec != "jpg") {
+        std::cerr << "ERROR: unknown session codec " << codec << std::endl;
+        return false;
+    }
+    std::error_code error;
+    std::filesystem::create_directories(directory, error);
+    std::string indexPath = (std::filesystem::path(directory) / "index.bin").string();
+    m_index.open(indexPath, std::ios::binary | std::ios::trunc);
+    if (error || !m_index) {
+        std::cerr << "ERROR: could not write a session to " << directory << std::endl;
+        return false;
+    }
+    m_index.write(INDEX_MAGIC, sizeof(INDEX_MAGIC));
+    cv::FileStorage file((std::filesystem::path(directory) / "session.yml").string(), cv::FileStorage::WRITE);
+    file << "codec" << codec;
+    file << "chunkFrames" << chunkFrames;
+    file << "cameraMatrix" << cameraMatrix;
+    file << "distortionCoefficients" << distortionCoefficients;
+    file << "model" << model;
+    file.release();
+    m_directory = directory;
+    m_codec = codec;
+    m_chunkFrames = std::max(chunkFrames, 1);
+    m_slots.assign(std::max(bufferCount, 1), Slot());
+    m_queue.assign(m_slots.size(), 0);
+    m_queueHead = m_queueSize = 0;
+    m_free.clear();
+    for (size_t i = 0; i < m_slots.size(); i++) {
+        m_free.push_back(i);
+    }
+    m_dropped = m_written = 0;
+    m_stopping = false;
+    m_writer = TaskScheduler::instance().async(TaskScheduler::BLOCKING, [this]() { write(); });
+    std::cout << "Recording the session to " << m_directory << " (" << m_codec << ", " << m_chunkFrames
+              << " frames per chunk)" << std::endl;
+    return true;
+}
+
+int SessionRecorder::acquire(const cv::Mat &frame, uint64_t frameId, uint64_t timestampNs) {
+    size_t index;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_free.empty()) {
+            m_dropped++;
+            return -1;
+        }
+        index = m_free.back();
+        m_free.pop_back();
+    }
+    // the slot belongs to the caller until it is committed
+    Slot &slot = m_slots[index];
+    frame.copyTo(slot.frame);
+    memset(&slot.header, 0, sizeof(slot.header));
+    memcpy(slot.header.magic, FRAME_MAGIC, sizeof(FRAME_MAGIC));
+    slot.header.frameId = frameId;
+    slot.header.timestampNs = timestampNs;
+    slot.header.width = frame.cols;
+    slot.header.height = frame.rows;
+    slot.header.type = frame.type();
+    return (int) index;
+}
+
+void SessionRecorder::commit(int slot, const std::vector<PoseRecord> &poses, const std::vector<cv::Point2f> &corners,
+                             const FrameStats &stats) {
+    if (slot < 0) {
+        return;
+    }
+    Slot &target = m_slots[slot];
+    SessionFrameHeader &header = target.header;
+    target.poses.assign(poses.begin(), poses.end());
+    header.boardCount = (uint32_t) poses.size();
+    target.corners.assign(corners.begin(), corners.end());
+    header.cornerCount = (uint32_t) corners.size();
+    header.frameMs = (float) (1000.0 * stats.lastFrameSeconds());
+    for (int stage = 0; stage < FrameStats::STAGE_COUNT; stage++) {
+        header.stageMs[stage] = (float) (1000.0 * stats.lastStageSeconds((FrameStats::Stage) stage));
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_queue[(m_queueHead + m_queueSize) % m_queue.size()] = slot;
+        m_queueSize++;
+    }
+    m_queued.notify_one();
+}
+
+void SessionRecorder::write() {
+    for (;;) {
+        size_t index;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_queued.wait(lock, [&]() { return m_queueSize > 0 || m_stopping; });
+            if (m_queueSize == 0) {
+                return;
+            }
+            index = m_queue[m_queueHead];
+            m_queueHead = (m_queueHead + 1) % m_queue.size();
+            m_queueSize--;
+        }
+        Slot &slot = m_slots[index];
+        if (m_codec == "raw") {
+            cv::Mat continuous = slot.frame.isContinuous() ? slot.frame : slot.frame.clone();
+            m_encoded.assign(continuous.data, continuous.data + continuous.total() * continuous.elemSize());
+        } else if (m_codec == "png") {
+            // the fastest compression level, the writer has to keep up with the camera
+            cv::imencode(".png", slot.frame, m_encoded, {cv::IMWRITE_PNG_COMPRESSION, 1});
+        } else {
+            cv::imencode(".jpg", slot.frame, m_encoded, {cv::IMWRITE_JPEG_QUALITY, 95});
+        }
+        slot.header.imageBytes = (uint32_t) m_encoded.size();
+        uint32_t chunk = (uint32_t) (m_written / m_chunkFrames);
+        if (m_written % m_chunkFrames == 0) {
+            m_chunk.close();
+            m_chunk.open(chunkPath(m_directory, chunk), std::ios::binary | std::ios::trunc);
+            // an index that ends with a complete chunk survives a crash of the application
+            m_index.flush();
+        }
+        SessionIndexEntry entry;
+        memset(&entry, 0, sizeof(entry));
+        entry.frameId = slot.header.frameId;
+        entry.timestampNs = slot.header.timestampNs;
+        entry.chunk = chunk;
+        entry.offset = (uint64_t) m_chunk.tellp();
+        entry.recordBytes = (uint32_t) (sizeof(SessionFrameHeader) + m_encoded.size() +
+                                        slot.poses.size() * sizeof(PoseRecord) +
+                                        slot.corners.size() * sizeof(cv::Point2f));
+        m_chunk.write((const char *) &slot.header, sizeof(slot.header));
+        m_chunk.write((const char *) m_encoded.data(), m_encoded.size());
+        m_chunk.write((const char *) slot.poses.data(), slot.poses.size() * sizeof(PoseRecord));
+        m_chunk.write((const char *) slot.corners.data(), slot.corners.size() * sizeof(cv::Point2f));
+        m_index.write((const char *) &entry, sizeof(entry));
+        m_written++;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_free.push_back(index);
+        }
+    }
+}
+
+uint64_t SessionRecorder::droppedCount() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_dropped;
+}
+
+void SessionRecorder::close() {
+    if (!m_writer.valid()) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+    }
+    m_queued.notify_all();
+    m_writer.get();
+    m_chunk.close();
+    m_index.close();
+    std::cout << "Recorded " << m_written << " frames to " << m_directory << " (" << m_dropped << " dropped)"
+              << std::endl;
+}
+
+bool SessionReader::open(const std::string &directory) {
+    cv::FileStorage file((std::filesystem::path(directory) / "session.yml").string(), cv::FileStorage::READ);
+    if (!file.isOpened()) {
+        return false;
+    }
+    file["codec"] >> m_codec;
+    file["cameraMatrix"] >> m_cameraMatrix;
+    file["distortionCoefficients"] >> m_distortionCoefficients;
+    file["model"] >> m_model;
+    file.release();
+    std::ifstream index((std::filesystem::path(directory) / "index.bin").string(), std::ios::binary);
+    char magic[sizeof(INDEX_MAGIC)];
+    if (!index.read(magic, sizeof(magic)) || memcmp(magic, INDEX_MAGIC, sizeof(magic)) != 0) {
+        return false;
+    }
+    m_index.clear();
+    SessionIndexEntry entry;
+    while (index.read((char *) &entry, sizeof(entry))) {
+        m_index.push_back(entry);
+    }
+    m_directory = directory;
+    m_openChunk = -1;
+    m_next = 0;
+    if (m_index.empty()) {
+        return false;
+    }
+    // the frame size comes from the first record
+    cv::Mat frame;
+    SessionFrame record;
+    if (!read(frame, record)) {
+        return false;
+    }
+    m_frameSize = frame.size();
+    m_next = 0;
+    return true;
+}
+
+size_t SessionReader::frameCount() const {
+    return m_index.size();
+}
+
+bool SessionReader::seek(size_t index) {
+    if (index >= m_index.size()) {
+        return false;
+    }
+    m_next = index;
+    return true;
+}
+
+bool SessionReader::read(cv::Mat &frame, SessionFrame &record) {
+    if (m_next >= m_index.size()) {
+        return false;
+    }
+    const SessionIndexEntry &entry = m_index[m_next];
+    if ((int) entry.chunk != m_openChunk) {
+        m_chunk.close();
+        m_chunk.clear();
+        m_chunk.open(chunkPath(m_directory, entry.chunk), std::ios::binary);
+        m_openChunk = (int) entry.chunk;
+    }
+    SessionFrameHeader header;
+    m_chunk.seekg((std::streamoff) entry.offset);
+    if (!m_chunk.read((char *) &header, sizeof(header)) ||
+        memcmp(header.magic, FRAME_MAGIC, sizeof(FRAME_MAGIC)) != 0) {
+        std::cerr << "ERROR: damaged record for frame " << entry.frameId << " in " << m_directory << std::endl;
+        return false;
+    }
+    m_encoded.resize(header.imageBytes);
+    record.poses.resize(header.boardCount);
+    record.corners.resize(header.cornerCount);
+    if (!m_chunk.read((char *) m_encoded.data(), m_encoded.size()) ||
+        !m_chunk.read((char *) record.poses.data(), record.poses.size() * sizeof(PoseRecord)) ||
+        !m_chunk.read((char *) record.corners.data(), record.corners.size() * sizeof(cv::Point2f))) {
+        std::cerr << "ERROR: truncated record for frame " << entry.frameId << " in " << m_directory << std::endl;
+        return false;
+    }
+    if (m_codec == "raw") {
+        frame.create(header.height, header.width, header.type);
+        if (m_encoded.size() != frame.total() * frame.elemSize()) {
+            return false;
+        }
+        memcpy(frame.data, m_encoded.data(), m_encoded.size());
+    } else {
+        frame = cv::imdecode(m_encoded, cv::IMREAD_UNCHANGED);
+        if (frame.empty()) {
+            return false;
+        }
+    }
+    record.frameId = header.frameId;
+    record.timestampNs = header.timestampNs;
+    record.frameMs = header.frameMs;
+    for (int stage = 0; stage < FrameStats::STAGE_COUNT; stage++) {
+        record.stageMs[stage] = header.stageMs[stage];
+    }
+    m_next++;
+    return true;
+}
+
+const cv::Mat &SessionReader::getCameraMatrix() const {
+    return m_cameraMatrix;
+}
+
+const cv::Mat &SessionReader::getDistortionCoefficients() const {
+    return m_distortionCoefficients;
+}
+
+const std::string &SessionReader::getModel() const {
+    return m_model;
+}
+
+cv::Size SessionReader::getFrameSize() const {
+    return m_frameSize;
+}
+
+double SessionReader::getFps() const {
+    if (m_index.size() < 2 || m_index.back().timestampNs <= m_index.front().timestampNs) {
+        return 30.0;
+    }
+    return (m_index.size() - 1) * 1e9 / (double) (m_index.back().timestampNs - m_index.front().timestampNs);
+}
+
+void ReplayReport::add(const SessionFrame &recorded, const std::vector<PoseRecord> &poses,
+                       const FrameStats &stats) {
+    frames++;
+    bool differs = poses.size() != recorded.poses.size();
+    for (size_t k = 0; k < poses.size() && k < recorded.poses.size(); k++) {
+        const PoseRecord &replayed = poses[k], &live = recorded.poses[k];
+        if ((replayed.cornerCount > 0) != (live.cornerCount > 0)) {
+            differs = true;
+        } else if (replayed.cornerCount > 0) {
+            cv::Vec3d difference(replayed.translation[0] - live.translation[0],
+                                 replayed.translation[1] - live.translation[1],
+                                 replayed.translation[2] - live.translation[2]);
+            maxTranslationDifference = std::max(maxTranslationDifference, cv::norm(difference));
+        }
+    }
+    foundDiffers += differs ? 1 : 0;
+    recordedMs += recorded.frameMs - recorded.stageMs[FrameStats::CAPTURE];
+    replayedMs += 1000.0 * (stats.lastFrameSeconds() - stats.lastStageSeconds(FrameStats::CAPTURE));
+}
+
+void ReplayReport::print(double seconds) const {
+    if (frames == 0) {
+        std::cout << "Replayed no frames" << std::endl;
+        return;
+    }
+    printf("Replayed %llu frames in %.2f s (%.1f fps) | processing per frame recorded %.2f ms, replayed %.2f ms | "
+           "detection differs in %llu frames, largest board position difference %.4f\n", (unsigned long long) frames,
+           seconds, frames / seconds, recordedMs / frames, replayedMs / frames, (unsigned long long) foundDiffers,
+           maxTranslationDifference);
+}
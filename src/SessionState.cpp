@@ -0,0 +1,45 @@
+//
+// CS 5330 - Project 4
+// Nathaniel Haddad and Stephen Dorris
+//
+
+#include <iostream>
+
+// Local Includes
+#include "SessionState.h"
+
+bool SessionState::load(const std::string &path) {
+    cv::FileStorage file(path, cv::FileStorage::READ);
+    if (!file.isOpened()) {
+        return false;
+    }
+    file["intrinsicsPath"] >> intrinsicsPath;
+    file["model"] >> model;
+    std::vector<int> region;
+    file["boardRegion"] >> region;
+    boardRegion = region.size() == 4 ? cv::Rect(region[0], region[1], region[2], region[3]) : cv::Rect();
+    file["rotationVector"] >> rotationVector;
+    file["translationVector"] >> translationVector;
+    file.release();
+    if (rotationVector.total() != 3 || translationVector.total() != 3) {
+        rotationVector.release();
+        translationVector.release();
+    }
+    return !intrinsicsPath.empty() && !model.empty();
+}
+
+bool SessionState::save(const std::string &path) const {
+    cv::FileStorage file(path, cv::FileStorage::WRITE);
+    if (!file.isOpened()) {
+        std::cerr << "ERROR: could not write the session state to " << path << std::endl;
+        return false;
+    }
+    file << "intrinsicsPath" << intrinsicsPath;
+    file << "model" << model;
+    file << "boardRegion" << std::vector<int>{boardRegion.x, boardRegion.y, boardRegion.width, boardRegion.height};
+    if (!rotationVector.empty() && !translationVector.empty()) {
+        file << "rotationVector" << rotationVector;
+        file << "translationVector" << translationVector;
+    }
+    return true;
+}
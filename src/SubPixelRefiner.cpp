@@ -0,0 +1,196 @@
+//
+// CS 5330 - Project 4
+// Nathaniel Haddad and Stephen Dorris
+//
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+// Local Includes
+#include "SubPixelRefiner.h"
+#include "TaskScheduler.h"
+
+namespace {
+
+const int LANES = 8; // independent accumulators per gradient sum, one SIMD register of floats
+
+const int MIN_WINDOW = 3; // smallest half window an adaptive window shrinks to
+
+const int MAX_PATCH = 2 * SubPixelRefiner::MAX_WINDOW + 3;
+
+/**
+ * samplePatch
+ * @does bilinearly samples a size x size patch centered on center, replicating the border (cv::getRectSubPix)
+ */
+void samplePatch(const cv::Mat &gray, cv::Point2f center, int size, float *patch) {
+    float x0 = center.x - (size - 1) * 0.5f, y0 = center.y - (size - 1) * 0.5f;
+    int ix = (int) std::floor(x0), iy = (int) std::floor(y0);
+    float fx = x0 - ix, fy = y0 - iy;
+    float w00 = (1 - fx) * (1 - fy), w01 = fx * (1 - fy), w10 = (1 - fx) * fy, w11 = fx * fy;
+    if (ix >= 0 && iy >= 0 && ix + size < gray.cols && iy + size < gray.rows) {
+        for (int r = 0; r < size; r++) {
+            const unsigned char *row0 = gray.ptr<unsigned char>(iy + r) + ix;
+            const unsigned char *row1 = gray.ptr<unsigned char>(iy + r + 1) + ix;
+            float *out = patch + r * size;
+            for (int k = 0; k < size; k++) {
+                out[k] = w00 * row0[k] + w01 * row0[k + 1] + w10 * row1[k] + w11 * row1[k + 1];
+            }
+        }
+        return;
+    }
+    for (int r = 0; r < size; r++) {
+        const unsigned char *row0 = gray.ptr<unsigned char>(std::min(std::max(iy + r, 0), gray.rows - 1));
+        const unsigned char *row1 = gray.ptr<unsigned char>(std::min(std::max(iy + r + 1, 0), gray.rows - 1));
+        float *out = patch + r * size;
+        for (int k = 0; k < size; k++) {
+            int xa = std::min(std::max(ix + k, 0), gray.cols - 1);
+            int xb = std::min(std::max(ix + k + 1, 0), gray.cols - 1);
+            out[k] = w00 * row0[xa] + w01 * row0[xb] + w10 * row1[xa] + w11 * row1[xb];
+        }
+    }
+}
+
+}
+
+SubPixelRefiner::SubPixelRefiner() {
+    configure(11, 30, 0.0001);
+}
+
+void SubPixelRefiner::configure(int window, int iterations, double epsilon) {
+    m_window = std::min(std::max(window, 1), MAX_WINDOW);
+    m_iterations = std::max(iterations, 1);
+    m_epsilon = epsilon;
+    if (!m_masks.empty()) {
+        return;
+    }
+    // the weights of cv::cornerSubPix: exp(-d^2 / w^2) along each axis
+    m_masks.resize(MAX_WINDOW + 1);
+    for (int w = 1; w <= MAX_WINDOW; w++) {
+        int size = 2 * w + 1;
+        std::vector<float> axis(size);
+        for (int i = 0; i < size; i++) {
+            axis[i] = (float) std::exp(-(double) (i - w) * (i - w) / ((double) w * w));
+        }
+        m_masks[w].resize(size * size);
+        for (int i = 0; i < size; i++) {
+            for (int j = 0; j < size; j++) {
+                m_masks[w][i * size + j] = axis[i] * axis[j];
+            }
+        }
+    }
+}
+
+int SubPixelRefiner::windowFor(const std::vector<cv::Point2f> &corners, cv::Size patternSize, int index) const {
+    if ((int) corners.size() != patternSize.area()) {
+        return m_window;
+    }
+    int row = index / patternSize.width, col = index % patternSize.width;
+    float side = FLT_MAX;
+    const cv::Point2f &corner = corners[index];
+    if (col > 0) {
+        side = std::min(side, (float) cv::norm(corner - corners[index - 1]));
+    }
+    if (col + 1 < patternSize.width) {
+        side = std::min(side, (float) cv::norm(corner - corners[index + 1]));
+    }
+    if (row > 0) {
+        side = std::min(side, (float) cv::norm(corner - corners[index - patternSize.width]));
+    }
+    if (row + 1 < patternSize.height) {
+        side = std::min(side, (float) cv::norm(corner - corners[index + patternSize.width]));
+    }
+    if (side == FLT_MAX) {
+        return m_window;
+    }
+    // the window has to stay inside the four squares around the corner
+    return std::min(std::max((int) (0.4f * side), std::min(MIN_WINDOW, m_window)), m_window);
+}
+
+void SubPixelRefiner::refineCorner(const cv::Mat &gray, cv::Point2f &corner, int window, float *patch) const {
+    const float *mask = m_masks[window].data();
+    int size = 2 * window + 1, patchSize = size + 2;
+    float offsets[2 * MAX_WINDOW + 1]; // x of every window column relative to the corner
+    for (int j = 0; j < size; j++) {
+        offsets[j] = (float) (j - window);
+    }
+    double epsilon2 = m_epsilon * m_epsilon;
+    cv::Point2f start = corner, current = corner;
+    for (int iteration = 0; iteration < m_iterations; iteration++) {
+        samplePatch(gray, current, patchSize, patch);
+        // lane l sums the columns j with j % LANES == l over all rows, the lanes are only added up at the end
+        float xx[LANES] = {}, xy[LANES] = {}, yy[LANES] = {}, xxOffset[LANES] = {}, xyOffset[LANES] = {};
+        float xyRow[LANES] = {}, yyRow[LANES] = {}; // weighted by the row offset
+        for (int i = 0; i < size; i++) {
+            const float *row = patch + (i + 1) * patchSize + 1, *up = row - patchSize, *down = row + patchSize;
+            const float *weights = mask + i * size;
+            float py = (float) (i - window);
+            int j = 0;
+            for (; j + LANES <= size; j += LANES) {
+                for (int l = 0; l < LANES; l++) {
+                    float gx = row[j + l + 1] - row[j + l - 1], gy = down[j + l] - up[j + l];
+                    float gxx = gx * gx * weights[j + l], gxy = gx * gy * weights[j + l];
+                    float gyy = gy * gy * weights[j + l];
+                    xx[l] += gxx;
+                    xy[l] += gxy;
+                    yy[l] += gyy;
+                    xxOffset[l] += gxx * offsets[j + l];
+                    xyOffset[l] += gxy * offsets[j + l];
+                    xyRow[l] += gxy * py;
+                    yyRow[l] += gyy * py;
+                }
+            }
+            for (; j < size; j++) {
+                float gx = row[j + 1] - row[j - 1], gy = down[j] - up[j];
+                float gxx = gx * gx * weights[j], gxy = gx * gy * weights[j], gyy = gy * gy * weights[j];
+                xx[0] += gxx;
+                xy[0] += gxy;
+                yy[0] += gyy;
+                xxOffset[0] += gxx * offsets[j];
+                xyOffset[0] += gxy * offsets[j];
+                xyRow[0] += gxy * py;
+                yyRow[0] += gyy * py;
+            }
+        }
+        double a = 0, b = 0, c = 0, bb1 = 0, bb2 = 0;
+        for (int l = 0; l < LANES; l++) {
+            a += xx[l];
+            b += xy[l];
+            c += yy[l];
+            bb1 += (double) xxOffset[l] + xyRow[l];
+            bb2 += (double) xyOffset[l] + yyRow[l];
+        }
+        double det = a * c - b * b;
+        if (std::fabs(det) <= DBL_EPSILON * DBL_EPSILON) {
+            break;
+        }
+        double scale = 1.0 / det;
+        cv::Point2f next((float) (current.x + c * scale * bb1 - b * scale * bb2),
+                         (float) (current.y - b * scale * bb1 + a * scale * bb2));
+        double moved = (next.x - current.x) * (next.x - current.x) + (next.y - current.y) * (next.y - current.y);
+        current = next;
+        if (current.x < 0 || current.x >= gray.cols || current.y < 0 || current.y >= gray.rows || moved <= epsilon2) {
+            break;
+        }
+    }
+    // a corner that ran away is left where it was, like cv::cornerSubPix does
+    if (std::fabs(current.x - start.x) > window || std::fabs(current.y - start.y) > window) {
+        current = start;
+    }
+    corner = current;
+}
+
+void SubPixelRefiner::refine(const cv::Mat &gray, std::vector<cv::Point2f> &corners, cv::Size patternSize) {
+    CV_Assert(gray.type() == CV_8UC1);
+    // windows are chosen from the unrefined corners, before any of them moves
+    m_windows.resize(corners.size());
+    for (int k = 0; k < (int) corners.size(); k++) {
+        m_windows[k] = windowFor(corners, patternSize, k);
+    }
+    TaskScheduler::instance().parallelFor(cv::Range(0, (int) corners.size()), 0, [&](const cv::Range &range) {
+        float patch[MAX_PATCH * MAX_PATCH];
+        for (int k = range.start; k < range.end; k++) {
+            refineCorner(gray, corners[k], m_windows[k], patch);
+        }
+    });
+}
@@ -0,0 +1,275 @@
+//
+// CS 5330 - Project 4
+// Nathaniel Haddad and Stephen Dorris
+//
+
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+
+// OpenCV Libraries
+#include <opencv2/calib3d.hpp>
+#include <opencv2/imgcodecs.hpp>
+#include <opencv2/imgproc.hpp>
+#include <opencv2/videoio.hpp>
+
+// Local Includes
+#include "SyntheticScene.h"
+
+namespace {
+
+const double MAX_TILT = 0.6; // radians around either board axis
+
+const int CORNER_MARGIN = 8; // pixels between a visible corner and the image border
+
+}
+
+SyntheticScene::SyntheticScene(const Settings &settings) : m_settings(settings), m_rng(settings.seed) {
+    const cv::Size &imageSize = m_settings.imageSize;
+    const cv::Size &patternSize = m_settings.patternSize;
+    if (m_settings.cameraMatrix.empty()) {
+        m_settings.cameraMatrix = (cv::Mat_<double>(3, 3) << imageSize.width, 0, (imageSize.width - 1) / 2.0,
+                0, imageSize.width, (imageSize.height - 1) / 2.0, 0, 0, 1);
+    }
+    if (m_settings.distortionCoefficients.empty()) {
+        m_settings.distortionCoefficients = (cv::Mat_<double>(5, 1) << -0.1, 0.02, 0, 0, 0);
+    }
+
+    // same layout as Camera: x over the columns of the board, y over its rows
+    for (int x = 0; x < patternSize.height; x++) {
+        for (int y = 0; y < patternSize.width; y++) {
+            m_boardWorld.emplace_back(cv::Vec3f(x, -y, 0));
+        }
+    }
+
+    // texture column u covers x in [-2, height + 1], row v covers -y in [-2, width + 1]; squares are about as
+    // large as they appear in the image so the texture is barely resampled
+    int squares = std::max(patternSize.width, patternSize.height) + 1;
+    int square = std::max(16, cvRound(0.75 * imageSize.height / squares));
+    m_board.create((patternSize.width + 3) * square, (patternSize.height + 3) * square, CV_8UC3);
+    m_board.setTo(cv::Scalar::all(255));
+    for (int j = 0; j <= patternSize.width; j++) {
+        for (int i = 0; i <= patternSize.height; i++) {
+            if ((i + j) % 2 == 0) {
+                cv::rectangle(m_board, cv::Rect((i + 1) * square, (j + 1) * square, square, square),
+                              cv::Scalar::all(0), cv::FILLED);
+            }
+        }
+    }
+
+    // every pixel as a ray in normalized camera coordinates, so each frame only needs a plane intersection
+    cv::Mat pixels(imageSize.area(), 1, CV_32FC2);
+    for (int y = 0; y < imageSize.height; y++) {
+        cv::Vec2f *pixel = pixels.ptr<cv::Vec2f>(y * imageSize.width);
+        for (int x = 0; x < imageSize.width; x++) {
+            pixel[x] = cv::Vec2f(x, y);
+        }
+    }
+    cv::undistortPoints(pixels, m_rays, m_settings.cameraMatrix, m_settings.distortionCoefficients);
+    m_rays = m_rays.reshape(2, imageSize.height);
+    m_mapX.create(imageSize, CV_32FC1);
+    m_mapY.create(imageSize, CV_32FC1);
+}
+
+SyntheticScene::Settings SyntheticScene::settingsFromOptions(const Options &options, cv::Size patternSize) {
+    Settings settings;
+    settings.imageSize = cv::Size(options.width, options.height);
+    settings.patternSize = patternSize;
+    settings.blurSigma = options.blur;
+    settings.noiseSigma = options.noise;
+    settings.lighting = options.lighting;
+    settings.occlusion = options.occlusion;
+    settings.seed = options.seed;
+    return settings;
+}
+
+const cv::Mat &SyntheticScene::getCameraMatrix() const {
+    return m_settings.cameraMatrix;
+}
+
+const cv::Mat &SyntheticScene::getDistortionCoefficients() const {
+    return m_settings.distortionCoefficients;
+}
+
+void SyntheticScene::randomPose(cv::Mat &rotationVector, cv::Mat &translationVector) {
+    const cv::Size &imageSize = m_settings.imageSize;
+    const cv::Size &patternSize = m_settings.patternSize;
+    const cv::Mat &K = m_settings.cameraMatrix;
+
+    // the board spans 35-75% of the image height, its +z axis points away from the camera like a board that
+    // faces it
+    double span = std::max(patternSize.width, patternSize.height) + 1;
+    double distance = K.at<double>(1, 1) * span / (m_rng.uniform(0.35, 0.75) * imageSize.height);
+    double roll = m_rng.uniform(-CV_PI, CV_PI);
+    double tiltX = m_rng.uniform(-MAX_TILT, MAX_TILT), tiltY = m_rng.uniform(-MAX_TILT, MAX_TILT);
+    cv::Matx33d rotateZ(std::cos(roll), -std::sin(roll), 0, std::sin(roll), std::cos(roll), 0, 0, 0, 1);
+    cv::Matx33d rotateX(1, 0, 0, 0, std::cos(tiltX), -std::sin(tiltX), 0, std::sin(tiltX), std::cos(tiltX));
+    cv::Matx33d rotateY(std::cos(tiltY), 0, std::sin(tiltY), 0, 1, 0, -std::sin(tiltY), 0, std::cos(tiltY));
+    cv::Matx33d R = rotateZ * rotateX * rotateY;
+
+    // board center within the middle 30% of the image
+    double u = K.at<double>(0, 2) + m_rng.uniform(-0.15, 0.15) * imageSize.width;
+    double v = K.at<double>(1, 2) + m_rng.uniform(-0.15, 0.15) * imageSize.height;
+    cv::Vec3d center((u - K.at<double>(0, 2)) / K.at<double>(0, 0) * distance,
+                     (v - K.at<double>(1, 2)) / K.at<double>(1, 1) * distance, distance);
+    cv::Vec3d boardCenter((patternSize.height - 1) / 2.0, -(patternSize.width - 1) / 2.0, 0);
+    cv::Vec3d t = center - R * boardCenter;
+
+    cv::Rodrigues(R, rotationVector);
+    translationVector = (cv::Mat_<double>(3, 1) << t[0], t[1], t[2]);
+}
+
+void SyntheticScene::renderBackground(cv::Mat &image) {
+    const cv::Size &imageSize = m_settings.imageSize;
+    image.create(imageSize, CV_8UC3);
+    image.setTo(cv::Scalar::all(m_rng.uniform(60, 200)));
+    for (int i = 0; i < 20; i++) {
+        cv::Point corner(m_rng.uniform(0, imageSize.width), m_rng.uniform(0, imageSize.height));
+        cv::Point size(m_rng.uniform(20, imageSize.width / 4), m_rng.uniform(20, imageSize.height / 4));
+        cv::Scalar color = cv::Scalar::all(m_rng.uniform(0, 255));
+        if (i % 2 == 0) {
+            cv::rectangle(image, corner, corner + size, color, cv::FILLED);
+        } else {
+            cv::line(image, corner, corner + size, color, m_rng.uniform(1, 8));
+        }
+    }
+}
+
+void SyntheticScene::render(const cv::Mat &rotationVector, const cv::Mat &translationVector,
+                            SyntheticFrame &frame) {
+    const cv::Size &imageSize = m_settings.imageSize;
+    frame.rotationVector = rotationVector.clone();
+    frame.translationVector = translationVector.clone();
+    cv::projectPoints(m_boardWorld, rotationVector, translationVector, m_settings.cameraMatrix,
+                      m_settings.distortionCoefficients, frame.corners);
+
+    // [r1 r2 t] maps the board plane to normalized camera coordinates, its inverse intersects the ray of every
+    // pixel with the plane
+    cv::Matx33d R;
+    cv::Rodrigues(rotationVector, R);
+    const double *t = translationVector.ptr<double>();
+    cv::Matx33d cameraToPlane = cv::Matx33d(R(0, 0), R(0, 1), t[0],
+                                            R(1, 0), R(1, 1), t[1],
+                                            R(2, 0), R(2, 1), t[2]).inv();
+    float square = (float) m_board.cols / (m_settings.patternSize.height + 3);
+    for (int y = 0; y < imageSize.height; y++) {
+        const cv::Vec2f *ray = m_rays.ptr<cv::Vec2f>(y);
+        float *mapX = m_mapX.ptr<float>(y);
+        float *mapY = m_mapY.ptr<float>(y);
+        for (int x = 0; x < imageSize.width; x++) {
+            cv::Vec3d plane = cameraToPlane * cv::Vec3d(ray[x][0], ray[x][1], 1);
+            if (plane[2] <= 0) {
+                // the plane lies behind the camera along this ray
+                mapX[x] = mapY[x] = -1;
+                continue;
+            }
+            mapX[x] = (float) ((plane[0] / plane[2] + 2) * square - 0.5);
+            mapY[x] = (float) ((-plane[1] / plane[2] + 2) * square - 0.5);
+        }
+    }
+    renderBackground(frame.image);
+    cv::remap(m_board, frame.image, m_mapX, m_mapY, cv::INTER_LINEAR, cv::BORDER_TRANSPARENT);
+
+    frame.visible = true;
+    for (const cv::Point2f &corner : frame.corners) {
+        if (corner.x < CORNER_MARGIN || corner.y < CORNER_MARGIN || corner.x >= imageSize.width - CORNER_MARGIN ||
+            corner.y >= imageSize.height - CORNER_MARGIN) {
+            frame.visible = false;
+            break;
+        }
+    }
+    if (m_settings.occlusion > 0 && m_rng.uniform(0.0, 1.0) < m_settings.occlusion) {
+        // an object in front of a random corner, one to two squares across
+        const cv::Point2f &corner = frame.corners[m_rng.uniform(0, (int) frame.corners.size())];
+        double squarePixels = cv::norm(frame.corners[1] - frame.corners[0]);
+        cv::Size axes(cvRound(squarePixels * m_rng.uniform(0.5, 1.0)),
+                      cvRound(squarePixels * m_rng.uniform(0.5, 1.0)));
+        cv::ellipse(frame.image, corner, axes, m_rng.uniform(0.0, 180.0), 0, 360,
+                    cv::Scalar::all(m_rng.uniform(0, 255)), cv::FILLED);
+        frame.visible = false;
+    }
+
+    if (m_settings.lighting) {
+        // exposure and a linear light gradient across the image
+        double gain = m_rng.uniform(0.6, 1.15);
+        double gradientX = m_rng.uniform(-0.3, 0.3) / imageSize.width;
+        double gradientY = m_rng.uniform(-0.3, 0.3) / imageSize.height;
+        for (int y = 0; y < imageSize.height; y++) {
+            uchar *pixel = frame.image.ptr<uchar>(y);
+            double rowGain = gain + gradientY * (y - imageSize.height / 2.0);
+            for (int x = 0; x < imageSize.width; x++) {
+                double pixelGain = rowGain + gradientX * (x - imageSize.width / 2.0);
+                for (int c = 0; c < 3; c++) {
+                    pixel[3 * x + c] = cv::saturate_cast<uchar>(pixel[3 * x + c] * pixelGain);
+                }
+            }
+        }
+    }
+    if (m_settings.blurSigma > 0) {
+        cv::GaussianBlur(frame.image, frame.image, cv::Size(), m_settings.blurSigma);
+    }
+    if (m_settings.noiseSigma > 0) {
+        cv::Mat noise(imageSize, CV_16SC3);
+        m_rng.fill(noise, cv::RNG::NORMAL, 0, m_settings.noiseSigma);
+        cv::add(frame.image, noise, frame.image, cv::noArray(), CV_8UC3);
+    }
+}
+
+void SyntheticScene::next(SyntheticFrame &frame) {
+    cv::Mat rotationVector, translationVector;
+    randomPose(rotationVector, translationVector);
+    render(rotationVector, translationVector, frame);
+}
+
+int SyntheticScene::generate(const Options &options, cv::Size patternSize) {
+    std::string outputPath = options.outputPath;
+    while (outputPath.size() > 1 && outputPath.back() == '/') {
+        outputPath.pop_back();
+    }
+    std::string extension = std::filesystem::path(outputPath).extension().string();
+    bool toVideo = extension == ".mp4" || extension == ".avi" || extension == ".mkv";
+
+    SyntheticScene scene(settingsFromOptions(options, patternSize));
+    cv::VideoWriter video;
+    if (toVideo) {
+        video.open(outputPath, cv::VideoWriter::fourcc('m', 'p', '4', 'v'), 30, scene.m_settings.imageSize);
+        if (!video.isOpened()) {
+            std::cerr << "ERROR: could not open " << outputPath << " for writing" << std::endl;
+            return -1;
+        }
+    } else {
+        std::filesystem::create_directories(outputPath);
+    }
+
+    cv::FileStorage intrinsics(outputPath + ".intrinsics.yml", cv::FileStorage::WRITE);
+    intrinsics << "cameraMatrix" << scene.getCameraMatrix();
+    intrinsics << "distortionCoefficients" << scene.getDistortionCoefficients();
+    intrinsics.release();
+
+    std::ofstream truthFile(outputPath + ".truth.csv");
+    truthFile << "frame,visible,rx,ry,rz,tx,ty,tz\n";
+    SyntheticFrame frame;
+    int visible = 0;
+    for (int i = 0; i < options.frames; i++) {
+        scene.next(frame);
+        if (toVideo) {
+            video.write(frame.image);
+        } else {
+            char name[32];
+            snprintf(name, sizeof(name), "/frame_%05d.png", i);
+            cv::imwrite(outputPath + name, frame.image);
+        }
+        truthFile << i << "," << frame.visible;
+        for (const cv::Mat &vector : {frame.rotationVector, frame.translationVector}) {
+            for (int j = 0; j < 3; j++) {
+                truthFile << "," << vector.at<double>(j);
+            }
+        }
+        truthFile << "\n";
+        visible += frame.visible;
+    }
+    std::cout << "Wrote " << options.frames << " frames (" << visible << " with the whole board visible) to "
+              << outputPath << ", " << outputPath << ".truth.csv and " << outputPath << ".intrinsics.yml"
+              << std::endl;
+    return 0;
+}
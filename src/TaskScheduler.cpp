@@ -0,0 +1,374 @@
+//
+// CS 5330 - Project 4
+// Nathaniel Haddad and Stephen Dorris
+//
+
+#include <algorithm>
+#include <cstdio>
+
+// Local Includes
+#include "TaskScheduler.h"
+
+namespace {
+
+thread_local TaskScheduler *t_scheduler = nullptr; // the pool the calling thread works for, null for other threads
+
+thread_local int t_worker = -1; // index of the calling thread among the workers of t_scheduler
+
+thread_local int t_depth = 0; // tasks running on the calling thread, a waiting task runs others inside it
+
+}
+
+int TaskScheduler::s_threadCount = 0;
+
+bool TaskScheduler::TaskQueue::push(const Task &task) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (tail - head == CAPACITY) {
+        return false;
+    }
+    tasks[tail++ % CAPACITY] = task;
+    return true;
+}
+
+bool TaskScheduler::TaskQueue::popBack(Task &task) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (tail == head) {
+        return false;
+    }
+    task = tasks[--tail % CAPACITY];
+    return true;
+}
+
+bool TaskScheduler::TaskQueue::popFront(Task &task) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (tail == head) {
+        return false;
+    }
+    task = tasks[head++ % CAPACITY];
+    return true;
+}
+
+bool TaskScheduler::TaskQueue::remove(const TaskGroup *group, const void *data, Task &task) {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (size_t i = head; i < tail; i++) {
+        const Task &queued = tasks[i % CAPACITY];
+        if (group != nullptr ? queued.group == group : queued.data == data) {
+            task = queued;
+            // the tasks behind it move up, the queue keeps its order
+            for (size_t j = i + 1; j < tail; j++) {
+                tasks[(j - 1) % CAPACITY] = tasks[j % CAPACITY];
+            }
+            tail--;
+            return true;
+        }
+    }
+    return false;
+}
+
+TaskScheduler::TaskGroup::TaskGroup(Priority priority) : m_priority(priority) {}
+
+TaskScheduler::TaskGroup::~TaskGroup() {
+    wait();
+}
+
+void TaskScheduler::TaskGroup::run(std::function<void()> task) {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_pending++;
+    }
+    TaskScheduler::instance().submit(m_priority, {[](void *data) {
+        std::unique_ptr<std::function<void()>> owned(static_cast<std::function<void()> *>(data));
+        (*owned)();
+    }, new std::function<void()>(std::move(task)), this});
+}
+
+void TaskScheduler::TaskGroup::finish() {
+    // counted under the mutex, the group may be destroyed as soon as the waiter sees 0
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (--m_pending == 0) {
+        m_done.notify_all();
+    }
+}
+
+void TaskScheduler::TaskGroup::wait() {
+    TaskScheduler &scheduler = TaskScheduler::instance();
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (m_pending > 0) {
+        lock.unlock();
+        Task task;
+        bool taken = scheduler.takeOwn(m_priority, this, nullptr, task);
+        if (taken) {
+            scheduler.execute(task, false);
+        }
+        lock.lock();
+        if (!taken) {
+            // the tasks left are running elsewhere, tasks a running one adds to the group are looked for every
+            // millisecond
+            m_done.wait_for(lock, std::chrono::milliseconds(1), [&]() { return m_pending == 0; });
+        }
+    }
+}
+
+TaskScheduler::TaskScheduler(int workerCount) {
+    // OpenCV functions run inside the tasks, their own thread pool would only oversubscribe the cores
+    cv::setNumThreads(1);
+    for (int i = 0; i < workerCount; i++) {
+        m_workers.emplace_back(new Worker());
+    }
+    // started once every deque exists, the workers steal from each other
+    for (int i = 0; i < workerCount; i++) {
+        m_workers[i]->thread = std::thread(&TaskScheduler::work, this, i);
+    }
+}
+
+TaskScheduler::~TaskScheduler() {
+    {
+        std::lock_guard<std::mutex> lock(m_laneMutex);
+        m_laneStopping = true;
+    }
+    m_laneWake.notify_all();
+    for (std::thread &thread : m_laneThreads) {
+        thread.join();
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_sleepMutex);
+        m_stopping = true;
+    }
+    m_wake.notify_all();
+    for (std::unique_ptr<Worker> &worker : m_workers) {
+        worker->thread.join();
+    }
+}
+
+void TaskScheduler::configure(int threads) {
+    s_threadCount = threads;
+}
+
+TaskScheduler &TaskScheduler::instance() {
+    static TaskScheduler scheduler(s_threadCount > 0 ? s_threadCount
+                                                     : std::max(1, (int) std::thread::hardware_concurrency()));
+    return scheduler;
+}
+
+int TaskScheduler::workerCount() const {
+    return (int) m_workers.size();
+}
+
+void TaskScheduler::work(int index) {
+    t_scheduler = this;
+    t_worker = index;
+    for (;;) {
+        Task task;
+        bool stolen = false;
+        if (take(LOW, task, stolen)) {
+            execute(task, stolen);
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(m_sleepMutex);
+        // queued is counted before a task is pushed, so either the submitter sees this worker sleeping or the
+        // worker sees the task
+        m_sleeping++;
+        m_wake.wait(lock, [&]() { return m_stopping || m_queued.load() > 0; });
+        m_sleeping--;
+        if (m_stopping && m_queued.load() == 0) {
+            return;
+        }
+    }
+}
+
+void TaskScheduler::lane() {
+    std::unique_lock<std::mutex> lock(m_laneMutex);
+    for (;;) {
+        m_laneIdle++;
+        m_laneWake.wait(lock, [&]() { return m_laneStopping || !m_laneTasks.empty(); });
+        m_laneIdle--;
+        if (m_laneTasks.empty()) {
+            return;
+        }
+        Task task = m_laneTasks.front();
+        m_laneTasks.pop_front();
+        lock.unlock();
+        task.function(task.data);
+        m_laneTaskCount++;
+        if (task.group != nullptr) {
+            task.group->finish();
+        }
+        lock.lock();
+    }
+}
+
+void TaskScheduler::submit(Priority priority, const Task &task) {
+    if (priority == BLOCKING) {
+        std::lock_guard<std::mutex> lock(m_laneMutex);
+        m_laneTasks.push_back(task);
+        // a blocking task never waits for another one to return, a lane thread is started when none is idle
+        if ((int) m_laneTasks.size() > m_laneIdle) {
+            m_laneThreads.emplace_back(&TaskScheduler::lane, this);
+        } else {
+            m_laneWake.notify_one();
+        }
+        return;
+    }
+    m_queued++;
+    TaskQueue &queue = t_scheduler == this ? m_workers[t_worker]->queues[priority] : m_submitted[priority];
+    if (!queue.push(task)) {
+        // a full queue means every worker is busy for a while, the task is not worth waiting for a slot
+        m_queued--;
+        task.function(task.data);
+        if (task.group != nullptr) {
+            task.group->finish();
+        }
+        return;
+    }
+    if (m_sleeping.load() > 0) {
+        std::lock_guard<std::mutex> lock(m_sleepMutex);
+        m_wake.notify_one();
+    }
+}
+
+bool TaskScheduler::take(Priority lowest, Task &task, bool &stolen) {
+    int self = t_scheduler == this ? t_worker : -1;
+    int workerCount = (int) m_workers.size();
+    int first = self >= 0 ? self + 1 : (int) (m_nextVictim++ % std::max(workerCount, 1));
+    for (int priority = HIGH; priority <= lowest; priority++) {
+        bool found = (self >= 0 && m_workers[self]->queues[priority].popBack(task)) ||
+                     m_submitted[priority].popFront(task);
+        for (int k = 0; !found && k < workerCount; k++) {
+            int victim = (first + k) % workerCount;
+            if (victim != self && m_workers[victim]->queues[priority].popFront(task)) {
+                found = stolen = true;
+            }
+        }
+        if (found) {
+            m_queued--;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool TaskScheduler::takeOwn(Priority priority, const TaskGroup *group, const void *data, Task &task) {
+    if (priority == BLOCKING) {
+        return false;
+    }
+    bool found = (t_scheduler == this && m_workers[t_worker]->queues[priority].remove(group, data, task)) ||
+                 m_submitted[priority].remove(group, data, task);
+    for (size_t k = 0; !found && k < m_workers.size(); k++) {
+        found = m_workers[k]->queues[priority].remove(group, data, task);
+    }
+    if (found) {
+        m_queued--;
+    }
+    return found;
+}
+
+void TaskScheduler::execute(const Task &task, bool stolen) {
+    if (t_scheduler != this) {
+        m_helpedTasks++;
+        task.function(task.data);
+    } else {
+        Worker &worker = *m_workers[t_worker];
+        // only the outermost task is timed, the tasks it runs while waiting are part of its time
+        bool outermost = t_depth++ == 0;
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        task.function(task.data);
+        t_depth--;
+        if (outermost) {
+            worker.busyNanos += (uint64_t) std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now() - start).count();
+        }
+        worker.tasks++;
+        if (stolen) {
+            worker.steals++;
+        }
+    }
+    if (task.group != nullptr) {
+        task.group->finish();
+    }
+}
+
+void TaskScheduler::runChunks(RangeJob &job) {
+    for (int chunk = job.next++; chunk < job.chunkCount; chunk = job.next++) {
+        int start = job.range.start + chunk * job.grain;
+        job.function(job.body, cv::Range(start, std::min(start + job.grain, job.range.end)));
+    }
+}
+
+void TaskScheduler::parallelFor(const cv::Range &range, int grain, RangeFunction function, const void *body,
+                                Priority priority) {
+    int length = range.end - range.start;
+    if (length <= 0) {
+        return;
+    }
+    int threadCount = (int) m_workers.size() + 1; // the calling thread takes chunks as well
+    if (grain <= 0) {
+        grain = std::max(1, length / (4 * threadCount));
+    }
+    int chunkCount = (length + grain - 1) / grain;
+    if (chunkCount == 1) {
+        function(body, range);
+        return;
+    }
+    if (priority == BLOCKING) {
+        // chunks are compute, they stay on the workers
+        priority = LOW;
+    }
+    RangeJob job;
+    job.function = function;
+    job.body = body;
+    job.range = range;
+    job.grain = grain;
+    job.chunkCount = chunkCount;
+    // one helper per thread that could take part, every helper claims chunks until none are left
+    int helperCount = std::min(chunkCount, threadCount) - 1;
+    job.helpers = helperCount;
+    for (int i = 0; i < helperCount; i++) {
+        submit(priority, {[](void *data) {
+            RangeJob &helped = *static_cast<RangeJob *>(data);
+            runChunks(helped);
+            helped.helpers--;
+        }, &job, nullptr});
+    }
+    runChunks(job);
+    // every chunk is claimed, helpers that did not start yet have nothing left to do and are taken back
+    Task helper;
+    while (takeOwn(priority, nullptr, &job, helper)) {
+        job.helpers--;
+    }
+    // the started helpers still point at the job, it lives until they finished their last chunk
+    while (job.helpers.load() > 0) {
+        std::this_thread::yield();
+    }
+}
+
+void TaskScheduler::report() {
+    std::lock_guard<std::mutex> lock(m_reportMutex);
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    double nanos = (double) std::chrono::duration_cast<std::chrono::nanoseconds>(now - m_reportStart).count();
+    m_reportStart = now;
+    // printf keeps the report itself from allocating
+    printf("##=== SCHEDULER: %d workers |", (int) m_workers.size());
+    for (size_t i = 0; i < m_workers.size(); i++) {
+        Worker &worker = *m_workers[i];
+        uint64_t busy = worker.busyNanos.load(), tasks = worker.tasks.load(), steals = worker.steals.load();
+        printf(" %zu: %.0f%% %llu tasks %llu stolen |", i,
+               nanos > 0 ? 100.0 * (busy - worker.reportedBusyNanos) / nanos : 0.0,
+               (unsigned long long) (tasks - worker.reportedTasks),
+               (unsigned long long) (steals - worker.reportedSteals));
+        worker.reportedBusyNanos = busy;
+        worker.reportedTasks = tasks;
+        worker.reportedSteals = steals;
+    }
+    uint64_t helped = m_helpedTasks.load(), laneTasks = m_laneTaskCount.load();
+    size_t laneThreads;
+    {
+        std::lock_guard<std::mutex> laneLock(m_laneMutex);
+        laneThreads = m_laneThreads.size();
+    }
+    printf(" %llu tasks run by waiting threads | %llu blocking tasks on %zu lane threads\n",
+           (unsigned long long) (helped - m_reportedHelpedTasks),
+           (unsigned long long) (laneTasks - m_reportedLaneTaskCount), laneThreads);
+    fflush(stdout);
+    m_reportedHelpedTasks = helped;
+    m_reportedLaneTaskCount = laneTasks;
+}
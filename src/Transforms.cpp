@@ -90,3 +90,18 @@ void Transforms::scaleH(const cv::Mat src, cv::Mat dst, const cv::Vec3f scaleXYZ
     S.at<double>(2, 2) = scaleXYZ[2];
     dst = src * S;
 }
+
+void Transforms::projectPlanar(const cv::Matx33d &homography, const std::vector<cv::Vec3f> &points,
+                               std::vector<cv::Point2f> &projected) {
+    projected.resize(points.size());
+    const cv::Matx33f h = homography;
+    const float *in = points.empty() ? nullptr : &points[0][0];
+    float *out = projected.empty() ? nullptr : &projected[0].x;
+    const int count = (int) points.size();
+    for (int i = 0; i < count; i++) {
+        float x = in[3 * i], y = in[3 * i + 1];
+        float inverse = 1.f / (h(2, 0) * x + h(2, 1) * y + h(2, 2));
+        out[2 * i] = (h(0, 0) * x + h(0, 1) * y + h(0, 2)) * inverse;
+        out[2 * i + 1] = (h(1, 0) * x + h(1, 1) * y + h(1, 2)) * inverse;
+    }
+}
@@ -0,0 +1,143 @@
+//
+// CS 5330 - Project 4
+// Nathaniel Haddad and Stephen Dorris
+//
+
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+// OpenCV Libraries
+#include <opencv2/calib3d.hpp>
+#include <opencv2/imgproc.hpp>
+
+// Local Includes
+#include "UndistortMap.h"
+
+namespace {
+
+const char MAGIC[8] = {'U', 'N', 'D', 'M', 'A', 'P', '0', '1'};
+
+const int MAX_COEFFICIENTS = 14; // longest distortion model OpenCV supports
+
+/**
+ * Layout of the map file: this header, then map1 and map2 row by row
+ */
+struct MapFileHeader {
+    char magic[8];
+    int32_t width, height;
+    int32_t coefficientCount;
+    double cameraMatrix[9];
+    double distortionCoefficients[MAX_COEFFICIENTS];
+};
+
+/**
+ * fillHeader
+ * @return (bool) false if the intrinsics cannot be described by the header
+ */
+bool fillHeader(const cv::Mat &cameraMatrix, const cv::Mat &distortionCoefficients, cv::Size imageSize,
+                MapFileHeader &header) {
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.width = imageSize.width;
+    header.height = imageSize.height;
+    header.coefficientCount = (int32_t) distortionCoefficients.total();
+    if (header.coefficientCount > MAX_COEFFICIENTS) {
+        return false;
+    }
+    cv::Mat K, D;
+    cameraMatrix.convertTo(K, CV_64F);
+    distortionCoefficients.convertTo(D, CV_64F);
+    for (int i = 0; i < 9; i++) {
+        header.cameraMatrix[i] = K.at<double>(i / 3, i % 3);
+    }
+    for (int i = 0; i < header.coefficientCount; i++) {
+        header.distortionCoefficients[i] = D.at<double>(i);
+    }
+    return true;
+}
+
+}
+
+void UndistortMap::prepare(const std::string &intrinsicsPath, const cv::Mat &cameraMatrix,
+                           const cv::Mat &distortionCoefficients, cv::Size imageSize) {
+    MapFileHeader current, requested;
+    if (!m_map1.empty() && fillHeader(m_cameraMatrix, m_distortionCoefficients, m_imageSize, current) &&
+        fillHeader(cameraMatrix, distortionCoefficients, imageSize, requested) &&
+        memcmp(&current, &requested, sizeof(current)) == 0) {
+        return;
+    }
+    m_cameraMatrix = cameraMatrix.clone();
+    m_distortionCoefficients = distortionCoefficients.clone();
+    m_imageSize = imageSize;
+    std::string path;
+    if (!intrinsicsPath.empty()) {
+        path = intrinsicsPath + ".undistort_" + std::to_string(imageSize.width) + "x" +
+               std::to_string(imageSize.height) + ".bin";
+        if (load(path)) {
+            std::cout << "Loaded undistortion maps from " << path << std::endl;
+            return;
+        }
+    }
+    // the undistorted frames keep the camera matrix, only the distortion is removed
+    cv::initUndistortRectifyMap(m_cameraMatrix, m_distortionCoefficients, cv::Mat(), m_cameraMatrix, imageSize,
+                                CV_16SC2, m_map1, m_map2);
+    if (!path.empty()) {
+        save(path);
+        std::cout << "Saved undistortion maps to " << path << std::endl;
+    }
+}
+
+bool UndistortMap::load(const std::string &path) {
+    std::ifstream file(path, std::ios::binary);
+    MapFileHeader stored, expected;
+    if (!file.read((char *) &stored, sizeof(stored)) ||
+        !fillHeader(m_cameraMatrix, m_distortionCoefficients, m_imageSize, expected) ||
+        memcmp(&stored, &expected, sizeof(stored)) != 0) {
+        return false;
+    }
+    m_map1.create(m_imageSize, CV_16SC2);
+    m_map2.create(m_imageSize, CV_16UC1);
+    for (cv::Mat *map : {&m_map1, &m_map2}) {
+        for (int y = 0; y < map->rows; y++) {
+            if (!file.read((char *) map->ptr(y), map->cols * map->elemSize())) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+void UndistortMap::save(const std::string &path) const {
+    MapFileHeader header;
+    if (!fillHeader(m_cameraMatrix, m_distortionCoefficients, m_imageSize, header)) {
+        return;
+    }
+    std::ofstream file(path, std::ios::binary);
+    file.write((const char *) &header, sizeof(header));
+    for (const cv::Mat *map : {&m_map1, &m_map2}) {
+        for (int y = 0; y < map->rows; y++) {
+            file.write((const char *) map->ptr(y), map->cols * map->elemSize());
+        }
+    }
+    if (!file) {
+        std::cerr << "ERROR: could not write " << path << std::endl;
+    }
+}
+
+void UndistortMap::apply(const cv::Mat &src, cv::Mat &dst) const {
+    cv::remap(src, dst, m_map1, m_map2, cv::INTER_LINEAR, cv::BORDER_CONSTANT);
+}
+
+cv::Size UndistortMap::getImageSize() const {
+    return m_imageSize;
+}
+
+const cv::Mat &UndistortMap::getCameraMatrix() const {
+    return m_cameraMatrix;
+}
+
+cv::Mat UndistortMap::getDistortionCoefficients() {
+    // OpenCV treats empty coefficients as no distortion
+    return cv::Mat();
+}
@@ -7,10 +7,23 @@
 #include <opencv2/highgui.hpp>
 
 // Local Includes
+#include "Benchmark.h"
 #include "Camera.h"
+#include "Options.h"
+#include "SyntheticScene.h"
+#include "TaskScheduler.h"
 
 int main(int argc, char *argv[]) {
-    std::unique_ptr<Camera> camera(new Camera(cv::Size(6,9), 5));
+    Options options = Options::parse(argc, argv);
+    TaskScheduler::configure(options.threads);
+    TaskScheduler::instance(); // started before any OpenCV call, which then runs on the calling thread
+    if (options.mode == "benchmark") {
+        return Benchmark::run(options, cv::Size(6,9));
+    }
+    if (options.mode == "generate") {
+        return SyntheticScene::generate(options, cv::Size(6,9));
+    }
+    std::unique_ptr<Camera> camera(new Camera(cv::Size(6,9), 5, options));
     camera->run();
     return (0);
 }
@@ -0,0 +1,95 @@
+//
+// CS 5330 - Project 4
+// Nathaniel Haddad and Stephen Dorris
+//
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Local Includes
+#include "FrameStream.h"
+
+/**
+ * Follows a frame stream published with --frame-shm and prints once per second how many frames were read,
+ * how many were torn (overwritten while being read), how many bytes a frame carried and the latency of the last
+ * one. Tile frames (--frame-keyframe) are composed onto a local copy of their base frame.
+ * Usage: frame_reader [name]
+ */
+int main(int argc, char *argv[]) {
+    std::string name = argc > 1 ? argv[1] : "/cvninjas_frames";
+    SharedFrameReader reader;
+    if (!reader.open(name)) {
+        return -1;
+    }
+    uint64_t frames = 0, torn = 0, skipped = 0, bytes = 0;
+    std::vector<uint8_t> composite; // the newest frame, rebuilt from base frames and tiles
+    uint64_t compositeBase = 0;
+    bool haveBase = false;
+    auto lastReport = std::chrono::steady_clock::now();
+    FrameView view;
+    for (;;) {
+        if (!reader.acquireLatest(view)) {
+            std::this_thread::sleep_for(std::chrono::microseconds(500));
+            continue;
+        }
+        // copy the frame or its tiles like a consumer would, straight from shared memory
+        uint32_t bytesPerPixel = view.pixelFormat == PixelFormat::GRAY8 ? 1 : 3;
+        if (view.pixelFormat == PixelFormat::BGRA8) {
+            bytesPerPixel = 4;
+        }
+        size_t compositeStride = (size_t) view.width * bytesPerPixel;
+        bool base = view.baseFrameId == view.frameId;
+        bool applies = base || (haveBase && compositeBase == view.baseFrameId &&
+                                composite.size() == compositeStride * view.height);
+        size_t carried = 0;
+        if (applies && base) {
+            carried = std::min(compositeStride * view.height, view.dataBytes);
+            composite.resize(compositeStride * view.height);
+            memcpy(composite.data(), view.data, carried);
+        } else if (applies) {
+            for (uint32_t t = 0; t < view.tileCount; t++) {
+                FrameRegion region = SharedFrameReader::tileRegion(view, view.tiles[t]);
+                size_t rowBytes = (size_t) region.width * bytesPerPixel;
+                if (carried + rowBytes * region.height > view.dataBytes) {
+                    break; // torn, release fails below
+                }
+                for (uint32_t y = 0; y < region.height; y++, carried += rowBytes) {
+                    memcpy(&composite[(region.y + y) * compositeStride + region.x * bytesPerPixel],
+                           view.data + carried, rowBytes);
+                }
+            }
+        }
+        if (!reader.release(view)) {
+            torn++;
+            haveBase = haveBase && !base;
+        } else if (!applies) {
+            skipped++; // the base frame of these tiles was missed, wait for the next one
+        } else {
+            frames++;
+            bytes += carried;
+            if (base) {
+                haveBase = true;
+                compositeBase = view.frameId;
+            }
+        }
+        auto now = std::chrono::steady_clock::now();
+        if (now - lastReport >= std::chrono::seconds(1)) {
+            timespec monotonic;
+            clock_gettime(CLOCK_MONOTONIC, &monotonic);
+            uint64_t nowNs = (uint64_t) monotonic.tv_sec * 1000000000ull + monotonic.tv_nsec;
+            printf("frame %llu %ux%u: %llu frames/s, %llu torn, %llu without base, %.0f KB/frame, latency %.2f ms\n",
+                   (unsigned long long) view.frameId, view.width, view.height, (unsigned long long) frames,
+                   (unsigned long long) torn, (unsigned long long) skipped, frames ? bytes / 1024.0 / frames : 0.0,
+                   (nowNs - view.timestampNs) / 1e6);
+            fflush(stdout);
+            frames = torn = skipped = bytes = 0;
+            lastReport = now;
+        }
+    }
+}
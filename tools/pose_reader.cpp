@@ -0,0 +1,47 @@
+//
+// CS 5330 - Project 4
+// Nathaniel Haddad and Stephen Dorris
+//
+
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <thread>
+
+// Local Includes
+#include "PoseStream.h"
+
+/**
+ * Prints the records of a pose stream published with --pose-shm, one line per frame.
+ * Usage: pose_reader [name] [--from-start]
+ */
+int main(int argc, char *argv[]) {
+    std::string name = "/cvninjas_poses";
+    bool fromStart = false;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--from-start") {
+            fromStart = true;
+        } else {
+            name = arg;
+        }
+    }
+    PoseSubscriber subscriber;
+    if (!subscriber.open(name, fromStart)) {
+        return -1;
+    }
+    printf("camera,frame,timestamp_ns,board,rx,ry,rz,tx,ty,tz,reprojection_error,corners,lost\n");
+    PoseRecord record;
+    for (;;) {
+        if (!subscriber.next(record)) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            continue;
+        }
+        printf("%u,%llu,%llu,%u,%f,%f,%f,%f,%f,%f,%f,%u,%llu\n", record.cameraId,
+               (unsigned long long) record.frameId, (unsigned long long) record.timestampNs, record.board,
+               record.rotation[0], record.rotation[1], record.rotation[2],
+               record.translation[0], record.translation[1], record.translation[2], record.reprojectionError,
+               record.cornerCount, (unsigned long long) subscriber.getLost());
+        fflush(stdout);
+    }
+}